@@ -0,0 +1,368 @@
+/**
+ * File: bench.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Host benchmark of tprotocol_parse and the DMA lookup path
+ *
+ * Replays streams of ROM3 address words through tprotocol_parse and
+ * tprotocol_parseFast, and through a copy of the path of
+ * term_dma_irq_handler_lookup with its command ring, and reports the time
+ * per word, the frames per second and the frames lost. The built-in streams
+ * hold valid frames, frames with checksum errors and frames with noise in
+ * between. A capture is a file of little-endian
+ * 16-bit address words, as stored by the ROMEMUL_ROM3_CAPTURE ring.
+ *
+ * Usage: tprotocol_bench [-n repeats] [-c words] [-f capture.bin]
+ *
+ * -c sets the words received between two runs of term_loop, which take all
+ * the commands of the ring. A larger value shows more drops.
+ *
+ * The times are host times: compare them between builds of the parser on the
+ * same machine, they are not RP2040 cycles.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "memfunc.h"
+#include "tprotocol.h"
+
+#define BENCH_ADDRESS_HIGH_BIT 0x8000    // ADDRESS_HIGH_BIT of term.h
+#define BENCH_ROM3_SIGNAL 0x00010000     // ROM3 bit of the lookup DMA address
+#define BENCH_LOOKUP_CHANNEL 4           // Any valid DMA channel
+#define BENCH_RING_SLOTS 8               // TERM_PROTOCOL_RING_SLOTS
+#define BENCH_RING_MASK (BENCH_RING_SLOTS - 1)
+#define BENCH_CONSUMER_WORDS 64          // Words between two term_loop runs
+#define BENCH_WORD_US 1                  // Bus time of a word for the parser
+#define BENCH_FRAMES 20000               // Frames of each built-in stream
+#define BENCH_WRITE_FRAME_PERIOD 64      // One 2KB write frame every N frames
+#define BENCH_WRITE_FRAME_BYTES 2048
+#define BENCH_DEFAULT_REPEATS 50
+#define BENCH_SEED 0x2545F491u
+
+// Needed by tprotocol.c and the pico-sdk stubs. __rom_in_ram_start__ is
+// linked at benchRom, as the firmware does with its 64KB ROM in RAM
+uint32_t benchRom[0x10000 / sizeof(uint32_t)];
+static timer_hw_t benchTimer;
+timer_hw_t *timer_hw = &benchTimer;
+static dma_hw_t benchDma;
+dma_hw_t *dma_hw = &benchDma;
+
+typedef struct {
+  uint16_t *words;        // ROM3 address words as seen on the bus
+  size_t count;           // Words in the stream
+  size_t capacity;        // Words allocated
+  uint32_t validFrames;   // Frames with a good checksum, 0 if unknown
+  uint32_t corruptFrames; // Frames with a bad checksum
+  const char *name;
+} BenchStream;
+
+typedef struct {
+  uint32_t commands;        // Commands parsed with a good checksum
+  uint32_t checksumErrors;  // Commands with a bad checksum
+  uint32_t dropped;         // Commands lost because the ring was full
+} BenchCounters;
+
+static BenchCounters counters;
+static uint32_t randomState = BENCH_SEED;
+
+// Command ring of term.c, drained by the consumer every consumerWords
+static TransmissionProtocol ring[BENCH_RING_SLOTS];
+static uint32_t ringHead = 0;
+static uint32_t ringTail = 0;
+static bool targetInRing = false;
+static uint32_t consumerWords = BENCH_CONSUMER_WORDS;
+
+// Host version of the DMA copy of memfunc.c
+void memfunc_dmaCopySwap16(void *dest, const void *source, size_t numBytes) {
+  const uint16_t *src = (const uint16_t *)source;
+  uint16_t *dst = (uint16_t *)dest;
+  for (size_t i = 0; i < numBytes / 2; i++) {
+    uint16_t word = src[i];
+    dst[i] = (uint16_t)((word << 8) | (word >> 8));
+  }
+}
+
+static uint32_t benchRandom(void) {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+static void streamPush(BenchStream *stream, uint16_t word) {
+  if (stream->count == stream->capacity) {
+    stream->capacity = (stream->capacity == 0) ? 4096 : stream->capacity * 2;
+    stream->words =
+        realloc(stream->words, stream->capacity * sizeof(uint16_t));
+    if (stream->words == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  // The parser gets the address with the high bit inverted
+  stream->words[stream->count++] = word ^ BENCH_ADDRESS_HIGH_BIT;
+}
+
+static void streamAddFrame(BenchStream *stream, uint16_t command,
+                           uint16_t payloadBytes, bool corrupt) {
+  uint16_t checksum = (uint16_t)(command + payloadBytes);
+  streamPush(stream, PROTOCOL_HEADER);
+  streamPush(stream, command);
+  streamPush(stream, payloadBytes);
+  for (uint16_t i = 0; i < payloadBytes; i += 2) {
+    uint16_t word = (uint16_t)benchRandom();
+    checksum += word;
+    streamPush(stream, word);
+  }
+  streamPush(stream, corrupt ? (uint16_t)(checksum + 1) : checksum);
+  if (corrupt) {
+    stream->corruptFrames++;
+  } else {
+    stream->validFrames++;
+  }
+}
+
+static void streamAddNoise(BenchStream *stream, uint32_t words) {
+  for (uint32_t i = 0; i < words; i++) {
+    streamPush(stream, (uint16_t)benchRandom());
+  }
+}
+
+// Command sizes of the shared functions: token plus 0 to 4 longwords, and
+// now and then a full write frame
+static uint16_t framePayload(uint32_t frame) {
+  if ((frame % BENCH_WRITE_FRAME_PERIOD) == BENCH_WRITE_FRAME_PERIOD - 1) {
+    return BENCH_WRITE_FRAME_BYTES;
+  }
+  return (uint16_t)(4 + (frame % 5) * 4);
+}
+
+static void streamBuild(BenchStream *stream, const char *name,
+                        uint32_t corruptPeriod, uint32_t maxNoise) {
+  memset(stream, 0, sizeof(*stream));
+  stream->name = name;
+  for (uint32_t frame = 0; frame < BENCH_FRAMES; frame++) {
+    bool corrupt =
+        (corruptPeriod > 0) && ((frame % corruptPeriod) == corruptPeriod - 1);
+    streamAddFrame(stream, (uint16_t)(frame & 0x3F), framePayload(frame),
+                   corrupt);
+    if (maxNoise > 0) {
+      streamAddNoise(stream, 1 + (benchRandom() % maxNoise));
+    }
+  }
+}
+
+static int streamLoad(BenchStream *stream, const char *path) {
+  memset(stream, 0, sizeof(*stream));
+  stream->name = path;
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    perror(path);
+    return -1;
+  }
+  uint8_t bytes[2];
+  while (fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes)) {
+    // Stored as captured, the high bit is inverted by the parser path
+    streamPush(stream, (uint16_t)((bytes[0] | (bytes[1] << 8)) ^
+                                  BENCH_ADDRESS_HIGH_BIT));
+  }
+  fclose(file);
+  return 0;
+}
+
+static void countCommand(const TransmissionProtocol *protocol) {
+  (void)protocol;
+  counters.commands++;
+}
+
+static void countChecksumError(const TransmissionProtocol *protocol) {
+  (void)protocol;
+  counters.checksumErrors++;
+}
+
+// Same as termAcquireProtocolSlot
+static inline void acquireSlot(void) {
+  if ((ringHead - ringTail) < BENCH_RING_SLOTS) {
+    tprotocol_setTarget(&ring[ringHead & BENCH_RING_MASK]);
+    targetInRing = true;
+  } else {
+    tprotocol_setTarget(NULL);
+    targetInRing = false;
+  }
+}
+
+// Same as handle_protocol_command for the deferred commands
+static void ringCommand(const TransmissionProtocol *protocol) {
+  (void)protocol;
+  if (targetInRing) {
+    __dmb();
+    ringHead++;
+    counters.commands++;
+  } else {
+    counters.dropped++;
+  }
+  acquireSlot();
+}
+
+// Same as termParseWord
+static inline void ringParseWord(uint16_t addrLsb) {
+  if (!targetInRing && (tprotocol_nextTPstep == HEADER_DETECTION)) {
+    acquireSlot();
+  }
+#if TPROTOCOL_FAST_PARSE == 1
+  tprotocol_parseFast(addrLsb, ringCommand, countChecksumError);
+#else
+  tprotocol_parse(addrLsb, ringCommand, countChecksumError);
+#endif
+}
+
+// Same as term_dma_irq_handler_lookup
+static inline void lookupIrq(void) {
+  dma_hw->ints1 = 1u << BENCH_LOOKUP_CHANNEL;
+  uint32_t addr = dma_hw->ch[BENCH_LOOKUP_CHANNEL].al3_read_addr_trig;
+  if (__builtin_expect(addr & BENCH_ROM3_SIGNAL, 0)) {
+    ringParseWord((uint16_t)(addr ^ BENCH_ADDRESS_HIGH_BIT));
+  }
+}
+
+static void resetParser(void) {
+  memset(&counters, 0, sizeof(counters));
+  ringHead = 0;
+  ringTail = 0;
+  targetInRing = false;
+  tprotocol_setTarget(NULL);
+  tprotocol_resetParserState();
+  benchTimer.timerawl = 0;
+}
+
+static double nowNs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static void runParse(const BenchStream *stream, uint32_t repeats) {
+  for (uint32_t r = 0; r < repeats; r++) {
+    for (size_t i = 0; i < stream->count; i++) {
+      benchTimer.timerawl += BENCH_WORD_US;
+      tprotocol_parse((uint16_t)(stream->words[i] ^ BENCH_ADDRESS_HIGH_BIT),
+                      countCommand, countChecksumError);
+    }
+  }
+}
+
+static void runFast(const BenchStream *stream, uint32_t repeats) {
+  for (uint32_t r = 0; r < repeats; r++) {
+    for (size_t i = 0; i < stream->count; i++) {
+      benchTimer.timerawl += BENCH_WORD_US;
+      tprotocol_parseFast(
+          (uint16_t)(stream->words[i] ^ BENCH_ADDRESS_HIGH_BIT), countCommand,
+          countChecksumError);
+    }
+  }
+}
+
+static void runIrq(const BenchStream *stream, uint32_t repeats) {
+  acquireSlot();
+  for (uint32_t r = 0; r < repeats; r++) {
+    for (size_t i = 0; i < stream->count; i++) {
+      benchTimer.timerawl += BENCH_WORD_US;
+      dma_hw->ch[BENCH_LOOKUP_CHANNEL].al3_read_addr_trig =
+          BENCH_ROM3_SIGNAL | stream->words[i];
+      lookupIrq();
+      if ((i % consumerWords) == 0) {
+        ringTail = ringHead;  // term_loop takes all the commands
+      }
+    }
+  }
+}
+
+static void report(const char *path, const BenchStream *stream,
+                   uint32_t repeats, double elapsedNs) {
+  double words = (double)stream->count * repeats;
+  double seconds = elapsedNs / 1e9;
+  printf("%-10s %-6s %8.2f ns/word %10.0f frames/s", stream->name, path,
+         elapsedNs / words, counters.commands / seconds);
+  if (stream->validFrames > 0) {
+    uint32_t expected = stream->validFrames * repeats;
+    uint32_t lost =
+        (counters.commands < expected) ? expected - counters.commands : 0;
+    printf("  ok %u/%u  csum %u  drop %u (%.3f%%)\n", counters.commands,
+           expected, counters.checksumErrors, counters.dropped,
+           100.0 * lost / expected);
+  } else {
+    printf("  ok %u  csum %u  drop %u\n", counters.commands,
+           counters.checksumErrors, counters.dropped);
+  }
+}
+
+static void benchStream(const BenchStream *stream, uint32_t repeats) {
+  resetParser();
+  double start = nowNs();
+  runParse(stream, repeats);
+  report("parse", stream, repeats, nowNs() - start);
+
+  resetParser();
+  start = nowNs();
+  runFast(stream, repeats);
+  report("fast", stream, repeats, nowNs() - start);
+
+  resetParser();
+  start = nowNs();
+  runIrq(stream, repeats);
+  report("irq", stream, repeats, nowNs() - start);
+}
+
+int main(int argc, char **argv) {
+  uint32_t repeats = BENCH_DEFAULT_REPEATS;
+  const char *capture = NULL;
+  for (int i = 1; i < argc; i++) {
+    if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+      repeats = (uint32_t)strtoul(argv[++i], NULL, 10);
+    } else if ((strcmp(argv[i], "-c") == 0) && (i + 1 < argc)) {
+      consumerWords = (uint32_t)strtoul(argv[++i], NULL, 10);
+    } else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc)) {
+      capture = argv[++i];
+    } else {
+      fprintf(stderr, "Usage: %s [-n repeats] [-c words] [-f capture.bin]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (repeats == 0) {
+    repeats = 1;
+  }
+  if (consumerWords == 0) {
+    consumerWords = 1;
+  }
+
+  BenchStream stream;
+  if (capture != NULL) {
+    if (streamLoad(&stream, capture) != 0) {
+      return EXIT_FAILURE;
+    }
+    benchStream(&stream, repeats);
+    free(stream.words);
+    return EXIT_SUCCESS;
+  }
+
+  streamBuild(&stream, "valid", 0, 0);
+  benchStream(&stream, repeats);
+  free(stream.words);
+
+  streamBuild(&stream, "checksum", 4, 0);
+  benchStream(&stream, repeats);
+  free(stream.words);
+
+  streamBuild(&stream, "noise", 0, 8);
+  benchStream(&stream, repeats);
+  free(stream.words);
+  return EXIT_SUCCESS;
+}
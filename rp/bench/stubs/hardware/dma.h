@@ -0,0 +1,28 @@
+/**
+ * File: dma.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Host stub of the pico-sdk for the parser benchmark
+ */
+
+#ifndef BENCH_HARDWARE_DMA_H
+#define BENCH_HARDWARE_DMA_H
+
+#include "pico/stdlib.h"
+
+#define NUM_DMA_CHANNELS 12
+
+// Only the registers read by the lookup interrupt handler
+typedef struct {
+  volatile uint32_t al3_read_addr_trig;
+} dma_channel_hw_t;
+
+typedef struct {
+  dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+  volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t *dma_hw;
+
+#endif  // BENCH_HARDWARE_DMA_H
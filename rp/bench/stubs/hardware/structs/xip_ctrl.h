@@ -0,0 +1,12 @@
+/**
+ * File: xip_ctrl.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Host stub of the pico-sdk for the parser benchmark
+ */
+
+#ifndef BENCH_HARDWARE_STRUCTS_XIP_CTRL_H
+#define BENCH_HARDWARE_STRUCTS_XIP_CTRL_H
+
+#endif  // BENCH_HARDWARE_STRUCTS_XIP_CTRL_H
@@ -0,0 +1,14 @@
+/**
+ * File: sync.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Host stub of the pico-sdk for the parser benchmark
+ */
+
+#ifndef BENCH_HARDWARE_SYNC_H
+#define BENCH_HARDWARE_SYNC_H
+
+static inline void __dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+#endif  // BENCH_HARDWARE_SYNC_H
@@ -0,0 +1,14 @@
+/**
+ * File: vreg.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Host stub of the pico-sdk for the parser benchmark
+ */
+
+#ifndef BENCH_HARDWARE_VREG_H
+#define BENCH_HARDWARE_VREG_H
+
+#define VREG_VOLTAGE_1_10 11
+
+#endif  // BENCH_HARDWARE_VREG_H
@@ -0,0 +1,28 @@
+/**
+ * File: stdlib.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Host stub of the pico-sdk for the parser benchmark
+ */
+
+#ifndef BENCH_PICO_STDLIB_H
+#define BENCH_PICO_STDLIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(func_name) func_name
+
+// The benchmark drives the time seen by the parser
+typedef struct {
+  volatile uint32_t timerawh;
+  volatile uint32_t timerawl;
+} timer_hw_t;
+
+extern timer_hw_t *timer_hw;
+
+#endif  // BENCH_PICO_STDLIB_H
@@ -4,6 +4,13 @@
 static SettingsConfigEntry defaultEntries[] = {
     {ACONFIG_PARAM_FOLDER, SETTINGS_TYPE_STRING, "/test"},
     {ACONFIG_PARAM_MODE, SETTINGS_TYPE_INT, "255"},  // 255: Menu mode
+    // 0: low-power, 1: default, 2: turbo. See perf.h
+    {ACONFIG_PARAM_PERF_PROFILE, SETTINGS_TYPE_INT, "1"},
+    // SD card SPI clock found by the calibration, and the card it is for
+    {ACONFIG_PARAM_SD_CAL_CARD, SETTINGS_TYPE_INT, "0"},
+    {ACONFIG_PARAM_SD_CAL_BAUD_KB, SETTINGS_TYPE_INT, "0"},
+    // Last WiFi access point and lease: "ssid hash,bssid,channel,ip"
+    {ACONFIG_PARAM_WIFI_CACHE, SETTINGS_TYPE_STRING, ""},
 };
 
 // Create a global context for our settings
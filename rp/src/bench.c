@@ -0,0 +1,293 @@
+/**
+ * File: bench.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: On-device micro-benchmarks
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "aconfig.h"
+#include "display.h"
+#include "ff.h"
+#include "gconfig.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "memfunc.h"
+#include "pico/stdlib.h"
+#include "pool.h"
+#include "settings.h"
+#include "term.h"
+#include "tprotocol.h"
+
+static uint32_t benchCommands = 0;
+static uint32_t benchErrors = 0;
+
+// Print the time of ops operations that moved bytes, 0 if not a copy
+static void benchReport(const char *name, uint32_t ops, uint64_t bytes,
+                        uint64_t us) {
+  if (us == 0) {
+    us = 1;
+  }
+  uint64_t mhz = clock_get_hz(clk_sys) / 1000000;
+  unsigned long cycles = (unsigned long)((us * mhz) / ((ops > 0) ? ops : 1));
+  if (bytes == 0) {
+    TPRINTF("%-16s %10lu cyc/op\n", name, cycles);
+    return;
+  }
+  // Hundredths of MB/s
+  unsigned long rate = (unsigned long)((bytes * 100) / us);
+  TPRINTF("%-16s %10lu cyc/op %5lu.%02lu MB/s\n", name, cycles, rate / 100,
+          rate % 100);
+}
+
+static void benchMemory(uint8_t *block) {
+  // Source in the flash: the start of this firmware
+  const uint16_t *flash = (const uint16_t *)XIP_BASE;
+  uint8_t *half = block + (BENCH_BLOCK_SIZE / 2);
+  uint64_t moved = (uint64_t)BENCH_BLOCK_SIZE * BENCH_MEM_REPEATS;
+
+  uint64_t start = time_us_64();
+  for (int i = 0; i < BENCH_MEM_REPEATS; i++) {
+    COPY_FLASH_TO_RAM_DMA(block, flash, BENCH_BLOCK_SIZE / 2);
+  }
+  benchReport("xip stream dma", BENCH_MEM_REPEATS, moved, time_us_64() - start);
+
+  start = time_us_64();
+  for (int i = 0; i < BENCH_MEM_REPEATS; i++) {
+    memcpy(block, flash, BENCH_BLOCK_SIZE);
+  }
+  benchReport("memcpy flash", BENCH_MEM_REPEATS, moved, time_us_64() - start);
+
+  start = time_us_64();
+  for (int i = 0; i < BENCH_MEM_REPEATS; i++) {
+    memcpy(block, half, BENCH_BLOCK_SIZE / 2);
+  }
+  benchReport("memcpy ram", BENCH_MEM_REPEATS, moved / 2,
+              time_us_64() - start);
+
+  start = time_us_64();
+  for (int i = 0; i < BENCH_MEM_REPEATS; i++) {
+    COPY_AND_SWAP_16BIT_DMA(block, half, BENCH_BLOCK_SIZE / 2);
+  }
+  benchReport("copy swap16 dma", BENCH_MEM_REPEATS, moved / 2,
+              time_us_64() - start);
+}
+
+static void benchDisplay(void) {
+  uint64_t start = time_us_64();
+  for (int i = 0; i < BENCH_DISPLAY_REPEATS; i++) {
+    display_refresh();
+  }
+  benchReport("refresh clean", BENCH_DISPLAY_REPEATS, 0, time_us_64() - start);
+
+  // The whole screen again, with the same content
+  start = time_us_64();
+  for (int i = 0; i < BENCH_DISPLAY_REPEATS; i++) {
+    display_markAllDirty();
+    display_refresh();
+  }
+  benchReport("refresh full", BENCH_DISPLAY_REPEATS, 0, time_us_64() - start);
+
+  // Every glyph of the terminal drawn again, and the refresh
+  start = time_us_64();
+  for (int i = 0; i < BENCH_DISPLAY_REPEATS; i++) {
+    term_redraw();
+  }
+  benchReport("term redraw", BENCH_DISPLAY_REPEATS, 0, time_us_64() - start);
+}
+
+static void benchSettings(void) {
+  SettingsContext *ctx = gconfig_getContext();
+  const volatile SettingsConfigEntry *entry = NULL;
+  uint64_t start = time_us_64();
+  for (int i = 0; i < BENCH_FIND_REPEATS; i++) {
+    entry = settings_find_entry(ctx, PARAM_HOSTNAME);
+  }
+  benchReport("settings find", BENCH_FIND_REPEATS, 0, time_us_64() - start);
+  (void)entry;
+}
+
+static void benchSave(void) {
+  SettingsContext *ctx = aconfig_getContext();
+  uint64_t start = time_us_64();
+  for (int i = 0; i < BENCH_SAVE_REPEATS; i++) {
+    settings_save(ctx, true);
+  }
+  benchReport("settings save", BENCH_SAVE_REPEATS, 0, time_us_64() - start);
+}
+
+static void benchCountCommand(const TransmissionProtocol *protocol) {
+  (void)protocol;
+  benchCommands++;
+}
+
+static void benchCountError(const TransmissionProtocol *protocol) {
+  (void)protocol;
+  benchErrors++;
+}
+
+static inline void benchParseWord(uint16_t word) {
+#if TPROTOCOL_FAST_PARSE == 1
+  tprotocol_parseFast(word, benchCountCommand, benchCountError);
+#else
+  tprotocol_parse(word, benchCountCommand, benchCountError);
+#endif
+}
+
+// Frames of a command with a random token and a longword, as the remote
+// computer sends them. The parser state of the bus is kept aside
+static void benchProtocol(void) {
+  TransmissionProtocol *target =
+      (TransmissionProtocol *)pool_alloc(sizeof(TransmissionProtocol));
+  if (target == NULL) {
+    term_printString("No memory for the parser benchmark.\n");
+    return;
+  }
+  uint16_t frame[5 + (BENCH_PROTOCOL_PAYLOAD / 2)];
+  uint16_t checksum = 0;
+  int words = 0;
+  frame[words++] = PROTOCOL_HEADER;
+  frame[words++] = 0x0042;
+  frame[words++] = BENCH_PROTOCOL_PAYLOAD;
+  checksum = (uint16_t)(0x0042 + BENCH_PROTOCOL_PAYLOAD);
+  for (int i = 0; i < (BENCH_PROTOCOL_PAYLOAD / 2); i++) {
+    frame[words] = (uint16_t)(0x1234 * (i + 1));
+    checksum += frame[words++];
+  }
+  frame[words++] = checksum;
+
+  benchCommands = 0;
+  benchErrors = 0;
+  uint32_t ints = save_and_disable_interrupts();
+  uint32_t lastHeader = tprotocol_last_header_found;
+  uint32_t newHeader = tprotocol_new_header_found;
+  TPParseStep step = tprotocol_nextTPstep;
+  TPStepHandler handler = tprotocol_step;
+  TransmissionProtocol *transmission = tprotocol_transmission;
+  tprotocol_nextTPstep = HEADER_DETECTION;
+  tprotocol_step = tprotocol_stepHeader;
+  tprotocol_setTarget(target);
+
+  uint64_t start = time_us_64();
+  for (int n = 0; n < BENCH_PROTOCOL_FRAMES; n++) {
+    for (int i = 0; i < words; i++) {
+      benchParseWord(frame[i]);
+    }
+  }
+  uint64_t elapsed = time_us_64() - start;
+
+  tprotocol_setTarget(transmission);
+  tprotocol_step = handler;
+  tprotocol_nextTPstep = step;
+  tprotocol_new_header_found = newHeader;
+  tprotocol_last_header_found = lastHeader;
+  restore_interrupts(ints);
+  pool_free(target);
+
+  benchReport("parse frame", BENCH_PROTOCOL_FRAMES, 0, elapsed);
+  benchReport("parse word", BENCH_PROTOCOL_FRAMES * (uint32_t)words, 0,
+              elapsed);
+  if (benchCommands != BENCH_PROTOCOL_FRAMES) {
+    TPRINTF("Parsed %lu of %d frames, %lu errors\n",
+            (unsigned long)benchCommands, BENCH_PROTOCOL_FRAMES,
+            (unsigned long)benchErrors);
+  }
+}
+
+static void benchSdcard(uint8_t *block) {
+  char path[FF_MAX_LFN];
+  const SettingsConfigEntry *folder =
+      settings_find_entry(aconfig_getContext(), ACONFIG_PARAM_FOLDER);
+  snprintf(path, sizeof(path), "%s/%s",
+           (folder != NULL) ? folder->value : "", BENCH_SD_FILENAME);
+  FIL file;
+  if (f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+    term_printString("No SD card to benchmark.\n");
+    return;
+  }
+  memset(block, 0xA5, BENCH_BLOCK_SIZE);
+  uint32_t ops = BENCH_SD_BYTES / BENCH_BLOCK_SIZE;
+  bool ok = true;
+  uint64_t start = time_us_64();
+  for (uint32_t i = 0; (i < ops) && ok; i++) {
+    UINT bytes = 0;
+    ok = (f_write(&file, block, BENCH_BLOCK_SIZE, &bytes) == FR_OK) &&
+         (bytes == BENCH_BLOCK_SIZE);
+  }
+  ok = (f_close(&file) == FR_OK) && ok;
+  uint64_t elapsed = time_us_64() - start;
+  if (ok) {
+    benchReport("fatfs write", ops, BENCH_SD_BYTES, elapsed);
+  } else {
+    term_printString("SD card write failed.\n");
+  }
+
+  if (ok && (f_open(&file, path, FA_READ) == FR_OK)) {
+    start = time_us_64();
+    for (uint32_t i = 0; (i < ops) && ok; i++) {
+      UINT bytes = 0;
+      ok = (f_read(&file, block, BENCH_BLOCK_SIZE, &bytes) == FR_OK) &&
+           (bytes == BENCH_BLOCK_SIZE);
+    }
+    elapsed = time_us_64() - start;
+    f_close(&file);
+    if (ok) {
+      benchReport("fatfs read", ops, BENCH_SD_BYTES, elapsed);
+    } else {
+      term_printString("SD card read failed.\n");
+    }
+  }
+  f_unlink(path);
+}
+
+static bool benchSelected(const char *arg, const char *group,
+                          bool byDefault) {
+  if ((arg == NULL) || (arg[0] == '\0')) {
+    return byDefault;
+  }
+  return strcmp(arg, group) == 0;
+}
+
+void bench_run(const char *arg) {
+  uint8_t *block = (uint8_t *)pool_alloc(BENCH_BLOCK_SIZE);
+  if (block == NULL) {
+    term_printString("No memory for the benchmarks.\n");
+    return;
+  }
+  TPRINTF("Clock: %lu MHz\n",
+          (unsigned long)(clock_get_hz(clk_sys) / 1000000));
+  bool any = false;
+  if (benchSelected(arg, "mem", true)) {
+    benchMemory(block);
+    any = true;
+  }
+  if (benchSelected(arg, "display", true)) {
+    benchDisplay();
+    any = true;
+  }
+  if (benchSelected(arg, "settings", true)) {
+    benchSettings();
+    any = true;
+  }
+  if (benchSelected(arg, "proto", true)) {
+    benchProtocol();
+    any = true;
+  }
+  if (benchSelected(arg, "sd", false)) {
+    benchSdcard(block);
+    any = true;
+  }
+  if (benchSelected(arg, "save", false)) {
+    benchSave();
+    any = true;
+  }
+  if (!any) {
+    term_printString("Groups: mem display settings proto sd save\n");
+  }
+  pool_free(block);
+}
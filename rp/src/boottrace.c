@@ -0,0 +1,57 @@
+/**
+ * File: boottrace.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Boot time checkpoints
+ */
+
+#include "boottrace.h"
+
+#include "pico/time.h"
+
+static BoottraceMark marks[BOOTTRACE_MAX_MARKS];
+static size_t markCount = 0;
+
+void boottrace_mark(const char *stage) {
+  if (markCount >= BOOTTRACE_MAX_MARKS) {
+    return;
+  }
+  marks[markCount].stage = stage;
+  marks[markCount].timeUs = time_us_64();
+  markCount++;
+}
+
+size_t boottrace_getCount(void) { return markCount; }
+
+const BoottraceMark *boottrace_get(size_t index) {
+  if (index >= markCount) {
+    return NULL;
+  }
+  return &marks[index];
+}
+
+int boottrace_getSlowest(void) {
+  int slowest = -1;
+  uint64_t slowestUs = 0;
+  uint64_t prevUs = 0;
+  for (size_t i = 0; i < markCount; i++) {
+    uint64_t durationUs = marks[i].timeUs - prevUs;
+    if ((slowest < 0) || (durationUs > slowestUs)) {
+      slowest = (int)i;
+      slowestUs = durationUs;
+    }
+    prevUs = marks[i].timeUs;
+  }
+  return slowest;
+}
+
+void boottrace_dump(void) {
+  uint64_t prevUs = 0;
+  for (size_t i = 0; i < markCount; i++) {
+    DPRINTF("Boot %-10s at %6lu ms (+%lu ms)\n", marks[i].stage,
+            (unsigned long)(marks[i].timeUs / 1000),
+            (unsigned long)((marks[i].timeUs - prevUs) / 1000));
+    prevUs = marks[i].timeUs;
+  }
+}
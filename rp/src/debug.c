@@ -0,0 +1,110 @@
+/**
+ * File: debug.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Deferred debug log
+ */
+
+#include "debug.h"
+
+#if defined(_DEBUG) && (_DEBUG != 0) && (DEBUG_DEFERRED != 0)
+
+#include <stdarg.h>
+
+#include "hardware/sync.h"
+
+typedef struct {
+  const char *file;
+  const char *func;
+  const char *fmt;
+  uint16_t line;
+  uint16_t count;
+  uint32_t args[DEBUG_LOG_ARGS];
+} DebugLogEntry;
+
+static DebugLogEntry logRing[DEBUG_LOG_ENTRIES];
+static volatile uint32_t logHead = 0;  // Next entry to write
+static volatile uint32_t logTail = 0;  // Next entry to print
+static volatile uint32_t logDropped = 0;
+static spin_lock_t *logLock = NULL;
+
+void debug_logInit(void) {
+  if (logLock == NULL) {
+    logLock = spin_lock_init((uint)spin_lock_claim_unused(true));
+  }
+}
+
+void __not_in_flash_func(debug_log)(const char *file, int line,
+                                    const char *func, const char *fmt,
+                                    int count, ...) {
+  if (logLock == NULL) {
+    logDropped++;
+    return;
+  }
+  uint32_t irq = spin_lock_blocking(logLock);
+  if ((logHead - logTail) >= DEBUG_LOG_ENTRIES) {
+    logDropped++;
+    spin_unlock(logLock, irq);
+    return;
+  }
+  DebugLogEntry *entry = &logRing[logHead & (DEBUG_LOG_ENTRIES - 1)];
+  entry->file = file;
+  entry->func = func;
+  entry->fmt = fmt;
+  entry->line = (uint16_t)line;
+  entry->count = (uint16_t)count;
+  va_list ap;
+  va_start(ap, count);
+  for (int i = 0; (i < count) && (i < DEBUG_LOG_ARGS); i++) {
+    entry->args[i] = va_arg(ap, uint32_t);
+  }
+  va_end(ap);
+  logHead++;
+  spin_unlock(logLock, irq);
+}
+
+// The entry is copied out, so the lock is not held while printing
+static bool logPop(DebugLogEntry *entry, uint32_t *dropped) {
+  uint32_t irq = spin_lock_blocking(logLock);
+  *dropped = logDropped;
+  logDropped = 0;
+  if (logHead == logTail) {
+    spin_unlock(logLock, irq);
+    return false;
+  }
+  *entry = logRing[logTail & (DEBUG_LOG_ENTRIES - 1)];
+  logTail++;
+  spin_unlock(logLock, irq);
+  return true;
+}
+
+void debug_logDrain(uint32_t max) {
+  if (logLock == NULL) {
+    return;
+  }
+  DebugLogEntry entry;
+  uint32_t dropped = 0;
+  for (uint32_t n = 0; n < max; n++) {
+    bool pending = logPop(&entry, &dropped);
+    if (dropped > 0) {
+      fprintf(stderr, "[%lu debug messages dropped]\n",
+              (unsigned long)dropped);
+    }
+    if (!pending) {
+      return;
+    }
+    if (entry.file != NULL) {
+      const char *file = strrchr(entry.file, '/') ? strrchr(entry.file, '/') + 1
+                                                  : entry.file;
+      fprintf(stderr, "%s:%d:%s(): ", file, entry.line, entry.func);
+    }
+    // Unused arguments are ignored by the format
+    const uint32_t *a = entry.args;
+    fprintf(stderr, entry.fmt, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+  }
+}
+
+void debug_logFlush(void) { debug_logDrain(UINT32_MAX); }
+
+#endif
@@ -8,9 +8,75 @@
 
 #include "display.h"
 
+#include "hardware/interp.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
 static uint32_t displayAddress = 0;
 static uint32_t displayCommandAddress = 0;
 static uint32_t displaysHighresTranstableAddress = 0;
+static uint32_t displayDirtyMapAddress = 0;
+static uint32_t displayHighresAddress = 0;
+
+// RAM copy of the highres translation table
+static uint16_t highresMaskTable[DISPLAY_MASK_TABLE_SIZE] = {0};
+
+_Static_assert(DISPLAY_HIGHRES_TRANSTABLE_OFFSET +
+                       DISPLAY_MASK_TABLE_SIZE * sizeof(uint16_t) <=
+                   DISPLAY_HIGHRES_OFFSET,
+               "The translation table overlaps the doubled highres buffer");
+_Static_assert(DISPLAY_HIGHRES_OFFSET + DISPLAY_HIGHRES_SIZE <=
+                   DISPLAY_BUFFER_OFFSET,
+               "The doubled highres buffer overlaps the framebuffer");
+
+#if DISPLAY_DOUBLE_BUFFER == 1
+#if DISPLAY_BYPASS_FRAMEBUFFER == 1
+#error "DISPLAY_DOUBLE_BUFFER needs DISPLAY_BYPASS_FRAMEBUFFER 0"
+#endif
+_Static_assert(DISPLAY_HIGHRES_OFFSET + DISPLAY_HIGHRES_SIZE <=
+                   DISPLAY_BUFFER_BANK1_OFFSET,
+               "The doubled highres buffer overlaps the second bank");
+_Static_assert(DISPLAY_BUFFER_BANK1_OFFSET + DISPLAY_FRONT_BANK_OFFSET <=
+                   DISPLAY_BUFFER_OFFSET,
+               "The second bank overlaps the first one");
+_Static_assert(DISPLAY_BUFFER_OFFSET + DISPLAY_FRONT_BANK_OFFSET +
+                       sizeof(uint16_t) <=
+                   DISPLAY_HIGHRES_BANK1_OFFSET,
+               "The first bank overlaps the second highres bank");
+_Static_assert(DISPLAY_HIGHRES_BANK1_OFFSET + DISPLAY_HIGHRES_SIZE <= 0xF000,
+               "The second highres bank overlaps the terminal memory");
+
+static const uint32_t bankOffsets[DISPLAY_BANKS] = {
+    DISPLAY_BUFFER_OFFSET, DISPLAY_BUFFER_BANK1_OFFSET};
+static const uint32_t bankHighresOffsets[DISPLAY_BANKS] = {
+    DISPLAY_HIGHRES_OFFSET, DISPLAY_HIGHRES_BANK1_OFFSET};
+
+// Bank read by the remote computer, when it became the front one, and the rows
+// of the last refresh, which the back bank does not have yet
+static uint16_t frontBank = 0;
+static absolute_time_t frontBankTime = {0};
+static uint32_t lastRefreshRows = 0;
+// A refresh came before DISPLAY_BANK_GUARD_US since the last flip. Its rows
+// are still dirty until display_retryRefresh publishes them
+static bool refreshDeferred = false;
+#endif
+
+// Rows changed since the last refresh, and their change counters
+static uint32_t dirtyRows = DISPLAY_DIRTY_ALL;
+static uint16_t dirtyRowCounters[DISPLAY_DIRTY_ROWS] = {0};
+// Rows published since the last display_takePublishedRows
+static uint32_t publishedRows = DISPLAY_DIRTY_ALL;
+#if DISPLAY_HIGHRES_EXPANDED == 1
+// The remote computer is in high resolution and copies the doubled rows
+static bool highresActive = false;
+#endif
+
+_Static_assert(DISPLAY_DIRTY_ROWS <= 32, "Dirty rows do not fit in a word");
+
+// Text rows scrolled with display_scrollRing, and the text row of the u8g2
+// buffer holding the logical top row
+static int ringRows = 0;
+static int ringBase = 0;
 
 // Static assert to ensure buffer size fits within uint32_t
 _Static_assert(DISPLAY_BUFFER_SIZE <= UINT32_MAX,
@@ -19,12 +85,19 @@ _Static_assert(DISPLAY_BUFFER_SIZE <= UINT32_MAX,
 // Allocate the framebuffer
 #if DISPLAY_BYPASS_FRAMEBUFFER == 0
 static unsigned char u8g2Buffer[DISPLAY_BUFFER_SIZE] = {0};
+// One block per run of dirty rows, and the end of the list
+static MemfuncDmaBlock refreshBlocks[(DISPLAY_DIRTY_ROWS + 1) / 2 + 1];
 #else
 static unsigned char *u8g2Buffer = NULL;
 #endif
 // Global u8g2 structure
 static u8g2_t u8g2 = {0};
 
+// Text rows rendered once by display_drawStrip, and the text they hold
+static unsigned char stripCache[DISPLAY_STRIP_COUNT][DISPLAY_DIRTY_ROW_BYTES];
+static char stripText[DISPLAY_STRIP_COUNT][DISPLAY_MAX_CHARACTERS];
+static bool stripValid[DISPLAY_STRIP_COUNT] = {false};
+
 // Dummy byte communication function
 static unsigned char u8x8DummyByte(void *u8x8, unsigned char msg,
                                    unsigned char argInt, void *argPtr) {
@@ -95,6 +168,12 @@ static void setDisplaysHighresTranstableAddress(uint32_t address) {
   displaysHighresTranstableAddress = address;
 }
 
+// Getter function for the doubled highres framebuffer address
+uint32_t display_getHighresAddress() { return displayHighresAddress; }
+
+// Getter function for the change map address
+uint32_t display_getDirtyMapAddress() { return displayDirtyMapAddress; }
+
 unsigned char u8x8DCustom(u8x8_t *u8x8, unsigned char msg, unsigned char argInt,
                           void *argPtr) {
   if (msg == U8X8_MSG_DISPLAY_SETUP_MEMORY) {
@@ -124,6 +203,25 @@ void display_setupU8g2() {
                            DISPLAY_COMMAND_ADDRESS_OFFSET);
   setDisplaysHighresTranstableAddress((unsigned int)&__rom_in_ram_start__ +
                                       DISPLAY_HIGHRES_TRANSTABLE_OFFSET);
+  displayHighresAddress =
+      (unsigned int)&__rom_in_ram_start__ + DISPLAY_HIGHRES_OFFSET;
+  displayDirtyMapAddress = (unsigned int)&__rom_in_ram_start__ +
+                           DISPLAY_BUFFER_OFFSET + DISPLAY_DIRTY_MAP_OFFSET;
+  memset(dirtyRowCounters, 0, sizeof(dirtyRowCounters));
+  for (int row = 0; row < DISPLAY_DIRTY_ROWS; row++) {
+    WRITE_WORD(displayDirtyMapAddress, row * sizeof(uint16_t), 0);
+  }
+#if DISPLAY_DOUBLE_BUFFER == 1
+  for (int row = 0; row < DISPLAY_DIRTY_ROWS; row++) {
+    WRITE_WORD((unsigned int)&__rom_in_ram_start__ +
+                   DISPLAY_BUFFER_BANK1_OFFSET + DISPLAY_DIRTY_MAP_OFFSET,
+               row * sizeof(uint16_t), 0);
+  }
+  frontBank = 0;
+  lastRefreshRows = DISPLAY_DIRTY_ALL;
+  WRITE_WORD(displayAddress, DISPLAY_FRONT_BANK_OFFSET, 0);
+#endif
+  display_markAllDirty();
   DPRINTF("Display buffer address: 0x%08x\n", (unsigned int)u8g2Buffer);
   DPRINTF("Display command address: 0x%08x\n", display_getCommandAddress());
   DPRINTF("Highres translation table address: 0x%08x\n",
@@ -151,24 +249,267 @@ void display_setupU8g2() {
   u8g2_InitDisplay(&u8g2);  // Initialize display (will use dummy callbacks)
 }
 
+#if DISPLAY_HIGHRES_EXPANDED == 1
+// Double the pixels of a row with the interpolator: lane0 gives the address
+// in the table of the first byte of the word and lane1 the one of the second
+static void renderHighresRows(uint32_t dirty, uint32_t highresAddress) {
+  interp_hw_save_t savedInterp;
+  interp_save(interp1, &savedInterp);
+
+  interp_config lane0 = interp_default_config();
+  interp_config_set_mask(&lane0, 1, 8);
+  interp_set_config(interp1, 0, &lane0);
+  interp_config lane1 = interp_default_config();
+  interp_config_set_cross_input(&lane1, true);
+  interp_config_set_shift(&lane1, 8);
+  interp_config_set_mask(&lane1, 1, 8);
+  interp_set_config(interp1, 1, &lane1);
+  interp1->base[0] = (uint32_t)highresMaskTable;
+  interp1->base[1] = (uint32_t)highresMaskTable;
+
+  for (int row = 0; row < DISPLAY_DIRTY_ROWS; row++) {
+    if ((dirty & (1u << row)) == 0) {
+      continue;
+    }
+    const uint16_t *src =
+        (const uint16_t *)(u8g2Buffer + row * DISPLAY_DIRTY_ROW_BYTES);
+    volatile uint32_t *dst =
+        (volatile uint32_t *)(highresAddress +
+                              row * DISPLAY_DIRTY_ROW_BYTES * 2);
+    for (int i = 0; i < (DISPLAY_DIRTY_ROW_BYTES / 2); i++) {
+      interp1->accum[0] = (uint32_t)src[i] << 1;
+      uint32_t first = *(uint16_t *)interp1->peek[0];
+      uint32_t second = *(uint16_t *)interp1->peek[1];
+      dst[i] = first | (second << 16);
+    }
+  }
+
+  interp_restore(interp1, &savedInterp);
+}
+#endif
+
+void display_markDirty(int y, int height) {
+  int last = y + height - 1;
+  if ((height <= 0) || (last < 0) || (y >= DISPLAY_HEIGHT)) {
+    return;
+  }
+  int firstRow = (y < 0) ? 0 : (y / DISPLAY_TILE_HEIGHT);
+  int lastRow = (last >= DISPLAY_HEIGHT) ? (DISPLAY_DIRTY_ROWS - 1)
+                                         : (last / DISPLAY_TILE_HEIGHT);
+  for (int row = firstRow; row <= lastRow; row++) {
+    dirtyRows |= 1u << row;
+  }
+}
+
+void display_markAllDirty(void) { dirtyRows = DISPLAY_DIRTY_ALL; }
+
+void display_setHighres(bool highres) {
+#if DISPLAY_HIGHRES_EXPANDED == 1
+  if (highres && !highresActive) {
+    // The doubled rows were not rendered in low resolution
+    display_markAllDirty();
+  }
+  highresActive = highres;
+#endif
+}
+
+static int greatestCommonDivisor(int a, int b) {
+  while (b != 0) {
+    int rest = a % b;
+    a = b;
+    b = rest;
+  }
+  return a;
+}
+
+void display_scrollRing(int rows) {
+  if ((rows <= 0) || (rows > DISPLAY_DIRTY_ROWS)) {
+    return;
+  }
+  if (rows != ringRows) {
+    display_unrollRing();
+    ringRows = rows;
+  }
+  // The top row becomes the bottom one
+  memset(u8g2Buffer + ringBase * DISPLAY_DIRTY_ROW_BYTES, 0,
+         DISPLAY_DIRTY_ROW_BYTES);
+  ringBase = (ringBase + 1) % ringRows;
+  display_markDirty(0, ringRows * DISPLAY_TILE_HEIGHT);
+}
+
+int display_getRingRow(int row) {
+  if ((row < 0) || (row >= ringRows)) {
+    return row;
+  }
+  return (row + ringBase) % ringRows;
+}
+
+void display_unrollRing(void) {
+  if (ringBase == 0) {
+    return;
+  }
+  // Rotate the rows left by ringBase, following each cycle of the permutation
+  // with a single spare row
+  unsigned char spare[DISPLAY_DIRTY_ROW_BYTES];
+  int cycles = greatestCommonDivisor(ringRows, ringBase);
+  for (int start = 0; start < cycles; start++) {
+    memcpy(spare, u8g2Buffer + start * DISPLAY_DIRTY_ROW_BYTES,
+           DISPLAY_DIRTY_ROW_BYTES);
+    int row = start;
+    for (;;) {
+      int next = (row + ringBase) % ringRows;
+      if (next == start) {
+        break;
+      }
+      memcpy(u8g2Buffer + row * DISPLAY_DIRTY_ROW_BYTES,
+             u8g2Buffer + next * DISPLAY_DIRTY_ROW_BYTES,
+             DISPLAY_DIRTY_ROW_BYTES);
+      row = next;
+    }
+    memcpy(u8g2Buffer + row * DISPLAY_DIRTY_ROW_BYTES, spare,
+           DISPLAY_DIRTY_ROW_BYTES);
+  }
+  ringBase = 0;
+}
+
 void display_refresh() {
+  display_unrollRing();
+  uint32_t dirty = dirtyRows;
+  if (dirty == 0) {
+    return;
+  }
+#if DISPLAY_DOUBLE_BUFFER == 1
+  // The remote computer can still be copying the back bank. Keep the rows
+  // dirty instead of waiting here
+  if (!time_reached(delayed_by_us(frontBankTime, DISPLAY_BANK_GUARD_US))) {
+    refreshDeferred = true;
+    return;
+  }
+  refreshDeferred = false;
+#endif
+  dirtyRows = 0;
+  publishedRows |= dirty;
+
+  // Rows to write, and where
+  uint32_t rows = dirty;
+  __unused uint32_t bufferAddress = displayAddress;
+  uint32_t mapAddress = displayDirtyMapAddress;
+  __unused uint32_t highresAddress = displayHighresAddress;
+#if DISPLAY_DOUBLE_BUFFER == 1
+  uint16_t backBank = frontBank ^ 1;
+  uint32_t sharedAddress = (unsigned int)&__rom_in_ram_start__;
+  bufferAddress = sharedAddress + bankOffsets[backBank];
+  mapAddress = bufferAddress + DISPLAY_DIRTY_MAP_OFFSET;
+  highresAddress = sharedAddress + bankHighresOffsets[backBank];
+  rows |= lastRefreshRows;
+  lastRefreshRows = dirty;
+#endif
+
+#if DISPLAY_BYPASS_FRAMEBUFFER == 0
+  // Copy each run of consecutive rows with a block of a DMA list, and double
+  // the highres rows meanwhile
+  int blockCount = 0;
+  int row = 0;
+  while (row < DISPLAY_DIRTY_ROWS) {
+    if ((rows & (1u << row)) == 0) {
+      row++;
+      continue;
+    }
+    int firstRow = row;
+    while ((row < DISPLAY_DIRTY_ROWS) && (rows & (1u << row))) {
+      row++;
+    }
+    uint32_t offset = firstRow * DISPLAY_DIRTY_ROW_BYTES;
+    refreshBlocks[blockCount].read = u8g2Buffer + offset;
+    refreshBlocks[blockCount].write = (void *)(bufferAddress + offset);
+    refreshBlocks[blockCount].count =
+        (uint32_t)(row - firstRow) * DISPLAY_DIRTY_ROW_BYTES;
+    blockCount++;
+  }
+  refreshBlocks[blockCount].count = 0;
+  int copyJob = memfunc_dmaCopyListAsync(refreshBlocks, true, NULL, NULL);
+#endif
+
+#if DISPLAY_HIGHRES_EXPANDED == 1
+  if (highresActive) {
+    renderHighresRows(rows, highresAddress);
+  }
+#endif
+
 #if DISPLAY_BYPASS_FRAMEBUFFER == 0
-  uint32_t *displayBuffer = (void *)display_getAddress();
-  COPY_AND_SWAP_16BIT_DMA(displayBuffer, (uint16_t *)u8g2Buffer,
-                          DISPLAY_BUFFER_SIZE);
+  memfunc_dmaWait(copyJob);
+#endif
+
+  // Publish the changes once the rows are complete. A bank holds the version
+  // of each row given by the counter in its own change map
+  for (int row = 0; row < DISPLAY_DIRTY_ROWS; row++) {
+    if (dirty & (1u << row)) {
+      dirtyRowCounters[row]++;
+    }
+    if (rows & (1u << row)) {
+      WRITE_WORD(mapAddress, row * sizeof(uint16_t), dirtyRowCounters[row]);
+    }
+  }
+
+#if DISPLAY_DOUBLE_BUFFER == 1
+  __dmb();
+  WRITE_WORD(displayAddress, DISPLAY_FRONT_BANK_OFFSET, backBank);
+  frontBank = backBank;
+  frontBankTime = get_absolute_time();
+#endif
+}
+
+void display_retryRefresh(void) {
+#if DISPLAY_DOUBLE_BUFFER == 1
+  if (refreshDeferred) {
+    display_refresh();
+  }
 #endif
 }
 
+uint32_t display_takePublishedRows(void) {
+  uint32_t rows = publishedRows;
+  publishedRows = 0;
+  return rows;
+}
+
+const unsigned char *display_getRowPixels(int row) {
+  return u8g2Buffer + display_getRingRow(row) * DISPLAY_DIRTY_ROW_BYTES;
+}
+
+void display_drawStrip(display_strip_t strip, int row, const char *text) {
+  if ((strip < 0) || (strip >= DISPLAY_STRIP_COUNT) || (row < 0) ||
+      (row >= DISPLAY_DIRTY_ROWS)) {
+    return;
+  }
+  // The row can be anywhere in the ring of the terminal
+  int bufferRow = display_getRingRow(row);
+  unsigned char *band = u8g2Buffer + bufferRow * DISPLAY_DIRTY_ROW_BYTES;
+  if (!stripValid[strip] ||
+      (strncmp(stripText[strip], text, sizeof(stripText[strip])) != 0)) {
+    // Render it once with the narrow font, centered on the baseline
+    memset(band, 0, DISPLAY_DIRTY_ROW_BYTES);
+    u8g2_SetFont(&u8g2, u8g2_font_squeezed_b7_tr);
+    u8g2_DrawStr(&u8g2,
+                 LEFT_PADDING_FOR_CENTER(text, 68) * DISPLAY_NARROW_CHAR_WIDTH,
+                 (bufferRow + 1) * DISPLAY_TILE_HEIGHT, text);
+    memcpy(stripCache[strip], band, DISPLAY_DIRTY_ROW_BYTES);
+    snprintf(stripText[strip], sizeof(stripText[strip]), "%s", text);
+    stripValid[strip] = true;
+  } else {
+    memcpy(band, stripCache[strip], DISPLAY_DIRTY_ROW_BYTES);
+  }
+  display_markDirty(bufferRow * DISPLAY_TILE_HEIGHT, DISPLAY_TILE_HEIGHT);
+}
+
 void display_drawProductInfo() {
-  // Product info
-  char productStr[DISPLAY_MAX_CHARACTERS] = {0};
-  u8g2_SetFont(&u8g2, u8g2_font_squeezed_b7_tr);
-  snprintf(productStr, sizeof(productStr), "%s %s - %s", DISPLAY_PRODUCT_MSG,
-           RELEASE_VERSION, DISPLAY_COPYRIGHT_MESSAGE);
-  u8g2_DrawStr(
-      &u8g2,
-      LEFT_PADDING_FOR_CENTER(productStr, 68) * DISPLAY_NARROW_CHAR_WIDTH,
-      DISPLAY_HEIGHT, productStr);
+  // Product info, composed and rendered only the first time
+  static char productStr[DISPLAY_MAX_CHARACTERS] = {0};
+  if (productStr[0] == '\0') {
+    snprintf(productStr, sizeof(productStr), "%s %s - %s", DISPLAY_PRODUCT_MSG,
+             RELEASE_VERSION, DISPLAY_COPYRIGHT_MESSAGE);
+  }
+  display_drawStrip(DISPLAY_STRIP_PRODUCT, DISPLAY_DIRTY_ROWS - 1, productStr);
 }
 
 void display_generateMaskTable(uint32_t memoryAddress) {
@@ -184,10 +525,10 @@ void display_generateMaskTable(uint32_t memoryAddress) {
 
     // Store the 16 bit result mask in the memory address
 #if DISPLAY_HIGHRES_INVERT == 1
-    WRITE_WORD(memoryAddress, i * 2, ~mask);
-#else
-    WRITE_WORD(memoryAddress, i * 2, mask);
+    mask = ~mask;
 #endif
+    highresMaskTable[i] = (uint16_t)mask;
+    WRITE_WORD(memoryAddress, i * 2, (uint16_t)mask);
   }
 }
 
@@ -200,6 +541,8 @@ void display_scrollup(uint16_t blankBytes) {
     return;
   }
 
+  display_unrollRing();
+  display_markAllDirty();
   if (blankBytes >= DISPLAY_BUFFER_SIZE) {
     memset(u8g2Buffer, 0, DISPLAY_BUFFER_SIZE);
     return;
@@ -8,11 +8,59 @@
 
 #include "display_term.h"
 
+#include <string.h>
+
 #include "display.h"
 
 static uint8_t maxCol = DISPLAY_TILES_WIDTH;
 static uint8_t maxRow = DISPLAY_TILES_HEIGHT;
 
+// Bytes of a line of pixels in the u8g2 buffer
+#define LINE_BYTES (DISPLAY_WIDTH / DISPLAY_TILE_WIDHT)
+
+// Terminal font decoded by u8g2 once. Byte N is the line N of the glyph
+static uint8_t glyphTable[DISPLAY_TERM_GLYPHS][DISPLAY_TERM_CHAR_HEIGHT];
+static bool glyphTableReady = false;
+
+_Static_assert(DISPLAY_TERM_CHAR_WIDTH == 8,
+               "The glyph blitter stores one byte per line");
+
+// Store 8 lines of a cell, clipped to the display
+static void storeCell(uint8_t col, int top, const uint8_t *lines) {
+  uint8_t *buffer = u8g2_GetBufferPtr(display_getU8g2Ref());
+  for (int line = 0; line < DISPLAY_TERM_CHAR_HEIGHT; line++) {
+    int y = top + line;
+    if ((y >= 0) && (y < DISPLAY_HEIGHT)) {
+      buffer[y * LINE_BYTES + col] = lines[line];
+    }
+  }
+  display_markDirty(top, DISPLAY_TERM_CHAR_HEIGHT);
+}
+
+// First line of the cells of a text row, the same display_termChar uses
+static int rowTop(uint8_t row) {
+  int textRow = display_getRingRow(DISPLAY_TERM_FIRST_ROW_OFFSET + row - 1);
+  return textRow * DISPLAY_TERM_CHAR_HEIGHT;
+}
+
+// Render every glyph with u8g2 in the top left cell and keep its bytes
+static void decodeGlyphs(void) {
+  u8g2_t *u8g2 = display_getU8g2Ref();
+  uint8_t *buffer = u8g2_GetBufferPtr(u8g2);
+  for (int i = 0; i < DISPLAY_TERM_GLYPHS; i++) {
+    for (int line = 0; line < DISPLAY_TERM_CHAR_HEIGHT; line++) {
+      buffer[line * LINE_BYTES] = 0;
+    }
+    // Same conversion of the char as display_termChar had with u8g2
+    u8g2_DrawGlyph(u8g2, 0, DISPLAY_TERM_CHAR_HEIGHT, (char)i);
+    for (int line = 0; line < DISPLAY_TERM_CHAR_HEIGHT; line++) {
+      glyphTable[i][line] = buffer[line * LINE_BYTES];
+      buffer[line * LINE_BYTES] = 0;
+    }
+  }
+  glyphTableReady = true;
+}
+
 // Static assert to ensure buffer size fits within uint32_t
 _Static_assert(DISPLAY_BUFFER_SIZE <= UINT32_MAX,
                "Buffer size exceeds allowed limits");
@@ -22,21 +70,82 @@ void display_termChar(const uint8_t col, const uint8_t row, const char chr) {
     return;
   }
 
-  u8g2_DrawGlyph(
-      display_getU8g2Ref(), col * DISPLAY_TERM_CHAR_WIDTH,
-      (DISPLAY_TERM_FIRST_ROW_OFFSET + row) * DISPLAY_TERM_CHAR_HEIGHT, chr);
+  // The glyphs sit on the baseline, without descent. The rows scrolled by
+  // display_scrollRing can be stored anywhere in the ring
+  int textRow = display_getRingRow(DISPLAY_TERM_FIRST_ROW_OFFSET + row - 1);
+  int baseline = (textRow + 1) * DISPLAY_TERM_CHAR_HEIGHT;
+  if (glyphTableReady) {
+    storeCell(col, baseline - DISPLAY_TERM_CHAR_HEIGHT,
+              glyphTable[(uint8_t)chr]);
+    return;
+  }
+  u8g2_DrawGlyph(display_getU8g2Ref(), col * DISPLAY_TERM_CHAR_WIDTH, baseline,
+                 chr);
+  display_markDirty(baseline - DISPLAY_TERM_CHAR_HEIGHT,
+                    DISPLAY_TERM_CHAR_HEIGHT);
+}
+
+void display_termCharReverse(const uint8_t col, const uint8_t row,
+                             const char chr) {
+  if (!glyphTableReady) {
+    display_termChar(col, row, chr);
+    return;
+  }
+  if ((col >= maxCol) || (row >= maxRow)) {
+    return;
+  }
+  uint8_t lines[DISPLAY_TERM_CHAR_HEIGHT];
+  for (int line = 0; line < DISPLAY_TERM_CHAR_HEIGHT; line++) {
+    lines[line] = (uint8_t)~glyphTable[(uint8_t)chr][line];
+  }
+  storeCell(col, rowTop(row), lines);
+}
+
+void display_termCopyRow(const uint8_t dstRow, const uint8_t srcRow) {
+  if ((dstRow >= maxRow) || (srcRow >= maxRow) || (dstRow == srcRow)) {
+    return;
+  }
+  uint8_t *buffer = u8g2_GetBufferPtr(display_getU8g2Ref());
+  int dst = rowTop(dstRow);
+  int src = rowTop(srcRow);
+  if ((dst < 0) || (src < 0) ||
+      (dst + DISPLAY_TERM_CHAR_HEIGHT > DISPLAY_HEIGHT) ||
+      (src + DISPLAY_TERM_CHAR_HEIGHT > DISPLAY_HEIGHT)) {
+    return;
+  }
+  // The lines of a text row are contiguous in the buffer
+  memcpy(buffer + dst * LINE_BYTES, buffer + src * LINE_BYTES,
+         DISPLAY_TERM_CHAR_HEIGHT * LINE_BYTES);
+  display_markDirty(dst, DISPLAY_TERM_CHAR_HEIGHT);
+}
+
+void display_termClearCells(const uint8_t row, const uint8_t col,
+                            const uint8_t count) {
+  if ((row >= maxRow) || (col >= maxCol) || (count == 0)) {
+    return;
+  }
+  uint8_t cells = ((col + count) > maxCol) ? (uint8_t)(maxCol - col) : count;
+  uint8_t *buffer = u8g2_GetBufferPtr(display_getU8g2Ref());
+  int top = rowTop(row);
+  for (int line = 0; line < DISPLAY_TERM_CHAR_HEIGHT; line++) {
+    int y = top + line;
+    if ((y >= 0) && (y < DISPLAY_HEIGHT)) {
+      memset(buffer + y * LINE_BYTES + col, 0, cells);
+    }
+  }
+  display_markDirty(top, DISPLAY_TERM_CHAR_HEIGHT);
 }
 
 void display_termCursor(const uint8_t col, const uint8_t row) {
+  static const uint8_t block[DISPLAY_TERM_CHAR_HEIGHT] = {
+      0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
   if ((col >= maxCol) || (row >= maxRow)) {
     return;
   }
 
   // Cursor row offset is intentionally distinct from glyph row offset.
-  u8g2_DrawBox(display_getU8g2Ref(), col * DISPLAY_TERM_CHAR_WIDTH,
-               (DISPLAY_TERM_CURSOR_ROW_OFFSET + row) * DISPLAY_TERM_CHAR_HEIGHT,
-               DISPLAY_TERM_CHAR_WIDTH,
-               DISPLAY_TERM_CHAR_HEIGHT);
+  int textRow = display_getRingRow(DISPLAY_TERM_CURSOR_ROW_OFFSET + row);
+  storeCell(col, textRow * DISPLAY_TERM_CHAR_HEIGHT, block);
 }
 
 void display_termStart(const uint8_t numCol, const uint8_t numRow) {
@@ -45,6 +154,7 @@ void display_termStart(const uint8_t numCol, const uint8_t numRow) {
 
   // // Clear the buffer first
   u8g2_ClearBuffer(display_getU8g2Ref());
+  display_markAllDirty();
 
   // Set the flag to NOT-RESET the computer
   SEND_COMMAND_TO_DISPLAY(DISPLAY_COMMAND_NOP);
@@ -64,7 +174,12 @@ void display_termRefresh() {
 }
 
 void display_termClear() {
-  // Clear the buffer
+  // Clear the buffer, with the rows back in order
+  display_unrollRing();
   u8g2_ClearBuffer(display_getU8g2Ref());
+  display_markAllDirty();
   u8g2_SetFont(display_getU8g2Ref(), u8g2_font_amstrad_cpc_extended_8f);
+  if (!glyphTableReady) {
+    decodeGlyphs();
+  }
 }
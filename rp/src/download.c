@@ -13,9 +13,295 @@ static FIL file;
 static download_status_t downloadStatus = DOWNLOAD_STATUS_IDLE;
 static HTTPC_REQUEST_T request = {0};
 static char filepath[DOWNLOAD_BUFFLINE_SIZE] = {0};
+// URL of the running benchmark, and its callback while it runs
+static char benchUrl[DOWNLOAD_BUFFLINE_SIZE] = {0};
+static download_bench_done_fn benchDone = NULL;
 static download_url_components_t components;
 static download_file_t fileUrl;
 
+#if DOWNLOAD_STAGING_SIZE > (TCP_WND - TCP_MSS)
+#error "DOWNLOAD_STAGING_SIZE must leave room for a segment in TCP_WND"
+#endif
+
+#if (DOWNLOAD_STAGING_SIZE % FF_MIN_SS) != 0
+#error "DOWNLOAD_STAGING_SIZE must be a multiple of the sector size"
+#endif
+
+#if DOWNLOAD_CORE1_WRITER == 1
+#include "hardware/sync.h"
+#include "pico/multicore.h"
+
+#if ROMEMUL_BUS_SERVICE_CORE1 == 1
+#error "DOWNLOAD_CORE1_WRITER needs core1 free, set ROMEMUL_BUS_SERVICE_CORE1 to 0"
+#endif
+#if ROMEMUL_TRACE == 1
+#error "DOWNLOAD_CORE1_WRITER needs core1 free, set ROMEMUL_TRACE to 0"
+#endif
+
+#define PIPELINE_SIZE (DOWNLOAD_PIPELINE_BUFFERS * DOWNLOAD_STAGING_SIZE)
+
+#if PIPELINE_SIZE < (TCP_WND + DOWNLOAD_STAGING_SIZE)
+#error "DOWNLOAD_PIPELINE_BUFFERS must hold TCP_WND and a buffer being filled"
+#endif
+
+// Ring of staging buffers. Core0 fills the one at pipeHead and hands it over
+// by moving pipeHead. Core1 writes the one at pipeTail and releases it by
+// moving pipeTail. Each index is written by a single core
+static uint8_t pipeBuffers[DOWNLOAD_PIPELINE_BUFFERS][DOWNLOAD_STAGING_SIZE]
+    __attribute__((aligned(4)));
+static volatile uint32_t pipeLengths[DOWNLOAD_PIPELINE_BUFFERS];
+static volatile uint32_t pipeHead = 0;
+static volatile uint32_t pipeTail = 0;
+static volatile uint32_t pipeWritten = 0;  // Bytes written by core1
+static volatile bool pipeError = false;
+static bool pipeRunning = false;
+// Bytes received and acknowledged to TCP, and the connection to ack
+static uint32_t pipeReceived = 0;
+static uint32_t pipeAcked = 0;
+static struct altcp_pcb *pipeConn = NULL;
+static async_when_pending_worker_t ackWorker;
+static bool ackWorkerAdded = false;
+#else
+// Received data not written to the file yet
+static uint8_t stagingBuffer[DOWNLOAD_STAGING_SIZE] __attribute__((aligned(4)));
+#endif
+static size_t stagingLength = 0;
+// Bytes received and not acknowledged to TCP yet
+static size_t unackedLength = 0;
+// Bytes already in the file when the download was resumed
+static FSIZE_t resumeOffset = 0;
+
+// MD5 of the data received, and the one it must match
+static mbedtls_md5_context md5Context;
+static uint8_t expectedMd5[DOWNLOAD_MD5_SIZE];
+static bool expectedMd5Set = false;
+static bool md5Verified = false;
+
+// Progress and timing of the current download
+static download_stats_t stats;
+static uint32_t windowStartUs = 0;
+static uint32_t windowBytes = 0;
+
+// Speed in KB/s of the bytes moved in the time given
+static uint32_t speedKbps(uint64_t bytes, uint32_t us) {
+  if (us == 0) {
+    return 0;
+  }
+  return (uint32_t)((bytes * 1000000ull) / ((uint64_t)us * 1024ull));
+}
+
+// Account the bytes of a received pbuf chain
+static void countReceived(uint32_t bytes) {
+  uint32_t now = time_us_32();
+  stats.receivedBytes += bytes;
+  windowBytes += bytes;
+  uint32_t windowUs = now - windowStartUs;
+  if (windowUs >= (DOWNLOAD_STATS_WINDOW_MS * 1000u)) {
+    stats.instantKbps = speedKbps(windowBytes, windowUs);
+    windowStartUs = now;
+    windowBytes = 0;
+  }
+}
+
+// Stop the clock of the download, once
+static void stopClock(void) {
+  if (stats.running) {
+    stats.elapsedUs = time_us_32() - stats.startUs;
+    stats.running = false;
+  }
+}
+
+// Allocate the clusters of the file before the data arrives. With f_expand
+// they are contiguous, so the blocks are written back to back and the FAT is
+// not updated while downloading
+static void preallocateFile(FSIZE_t size) {
+  FRESULT res;
+  if (size <= f_size(&file)) {
+    return;
+  }
+#if FF_USE_EXPAND
+  // Only an empty file can be expanded
+  if (f_size(&file) == 0) {
+    res = f_expand(&file, size, 1);
+    if (res == FR_OK) {
+      DPRINTF("File preallocated in a contiguous area\n");
+      return;
+    }
+    DPRINTF("No contiguous area for the file: %i\n", res);
+  }
+#endif
+  // Moving past the end allocates the clusters at once, maybe fragmented
+  FSIZE_t position = f_tell(&file);
+  res = f_lseek(&file, size);
+  if ((res != FR_OK) || (f_tell(&file) != size)) {
+    DPRINTF("Can't preallocate the file: %i\n", res);
+  }
+  f_lseek(&file, position);
+}
+
+#if DOWNLOAD_CORE1_WRITER == 1
+// Core1 loop: write the buffers handed over, in order. Runs from the flash,
+// so it must give way while core0 writes to it
+static void writerCore1Entry(void) {
+  multicore_lockout_victim_init();
+  while (true) {
+    if (pipeTail == pipeHead) {
+      __wfe();
+      continue;
+    }
+    uint32_t slot = pipeTail % DOWNLOAD_PIPELINE_BUFFERS;
+    uint32_t length = pipeLengths[slot];
+    if (!pipeError) {
+      UINT bytesWritten = 0;
+      uint32_t start = time_us_32();
+      FRESULT res = f_write(&file, pipeBuffers[slot], length, &bytesWritten);
+      stats.writeUs += time_us_32() - start;
+      stats.writeCount++;
+      if ((res != FR_OK) || (bytesWritten != length)) {
+        DPRINTF("Error writing to file: %i\n", res);
+        pipeError = true;
+      }
+    }
+    pipeWritten += length;
+    // The buffer is free only after the counters are updated
+    __dmb();
+    pipeTail++;
+    __sev();
+    async_context_set_work_pending(cyw43_arch_async_context(), &ackWorker);
+  }
+}
+
+// Acknowledge the data received while the free buffers can take a full
+// TCP_WND. Then the sender can never overrun the ring
+static void ackReleased(void) {
+  if (pipeConn == NULL) {
+    return;
+  }
+  uint32_t limit = pipeWritten + PIPELINE_SIZE - TCP_WND;
+  uint32_t ackable = (pipeReceived < limit) ? pipeReceived : limit;
+  while (pipeAcked < ackable) {
+    uint32_t chunk = ackable - pipeAcked;
+    if (chunk > UINT16_MAX) {
+      chunk = UINT16_MAX;
+    }
+    altcp_recved(pipeConn, (u16_t)chunk);
+    pipeAcked += chunk;
+  }
+}
+
+// Runs in the async context when core1 releases a buffer
+static void ackWorkerDoWork(async_context_t *context,
+                            async_when_pending_worker_t *worker) {
+  (void)context;
+  (void)worker;
+  ackReleased();
+}
+
+static void startWriter(void) {
+  if (!ackWorkerAdded) {
+    ackWorker.do_work = ackWorkerDoWork;
+    async_context_add_when_pending_worker(cyw43_arch_async_context(),
+                                          &ackWorker);
+    ackWorkerAdded = true;
+  }
+  pipeHead = 0;
+  pipeTail = 0;
+  pipeWritten = 0;
+  pipeError = false;
+  pipeReceived = 0;
+  pipeAcked = 0;
+  pipeConn = NULL;
+  multicore_reset_core1();
+  multicore_launch_core1(writerCore1Entry);
+  pipeRunning = true;
+}
+
+// Wait for the buffers handed over and stop core1. Returns false on error
+static bool stopWriter(void) {
+  if (!pipeRunning) {
+    return true;
+  }
+  while (pipeTail != pipeHead) {
+    __wfe();
+  }
+  multicore_reset_core1();
+  pipeRunning = false;
+  pipeConn = NULL;
+  return !pipeError;
+}
+
+// Buffer the receive callback copies to
+static inline uint8_t *stagingTarget(void) {
+  return pipeBuffers[pipeHead % DOWNLOAD_PIPELINE_BUFFERS];
+}
+
+// Hand the staged data over to core1. Returns false on error
+static bool flushStaging(void) {
+  if (stagingLength == 0) {
+    return !pipeError;
+  }
+  pipeLengths[pipeHead % DOWNLOAD_PIPELINE_BUFFERS] = (uint32_t)stagingLength;
+  __dmb();
+  pipeHead++;
+  __sev();
+  stagingLength = 0;
+  // The next buffer must be free. ackReleased makes the wait an exception
+  while (((pipeHead - pipeTail) >= DOWNLOAD_PIPELINE_BUFFERS) && !pipeError) {
+    __wfe();
+  }
+  return !pipeError;
+}
+#else
+static inline uint8_t *stagingTarget(void) { return stagingBuffer; }
+
+// Write the staged data to the file. Returns false on error
+static bool flushStaging(void) {
+  if (stagingLength == 0) {
+    return true;
+  }
+  UINT bytesWritten = 0;
+  uint32_t start = time_us_32();
+  FRESULT res = f_write(&file, stagingBuffer, stagingLength, &bytesWritten);
+  stats.writeUs += time_us_32() - start;
+  stats.writeCount++;
+  if ((res != FR_OK) || (bytesWritten != stagingLength)) {
+    DPRINTF("Error writing to file: %i\n", res);
+    return false;
+  }
+  stagingLength = 0;
+  return true;
+}
+#endif
+
+// Value of a hex digit, or -1 if it is not one
+static int hexValue(char c) {
+  if ((c >= '0') && (c <= '9')) return c - '0';
+  if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+  return -1;
+}
+
+// Hash again the data kept in the file from a previous attempt. The staging
+// buffer is free before the request starts
+static bool hashFilePrefix(FSIZE_t length) {
+  if (f_lseek(&file, 0) != FR_OK) {
+    return false;
+  }
+  while (length > 0) {
+    UINT chunk = (length > DOWNLOAD_STAGING_SIZE) ? DOWNLOAD_STAGING_SIZE
+                                                  : (UINT)length;
+    UINT bytesRead = 0;
+    FRESULT res = f_read(&file, stagingTarget(), chunk, &bytesRead);
+    if ((res != FR_OK) || (bytesRead != chunk)) {
+      DPRINTF("Error reading the file to hash: %i\n", res);
+      return false;
+    }
+    mbedtls_md5_update(&md5Context, stagingTarget(), chunk);
+    length -= chunk;
+  }
+  return true;
+}
+
 // Generates a temporary file path for downloads.
 static void getTmpFilenamePath(char filename[DOWNLOAD_BUFFLINE_SIZE]) {
   snprintf(
@@ -109,37 +395,46 @@ static err_t httpClientReceiveFileFn(__unused void *arg,
     return ERR_VAL;  // Invalid input or error occurred
   }
 
-  // Allocate buffer to hold pbuf content
-  char *buffc = malloc(ptr->tot_len);
-  if (buffc == NULL) {
-    DPRINTF("Error allocating memory\n");
-    downloadStatus = DOWNLOAD_STATUS_FAILED;
-    return ERR_MEM;  // Memory allocation failed
+  // Stage the payload of each pbuf of the chain. The file is written in
+  // full blocks, so the writes stay sector aligned
+  bool flushed = false;
+  for (struct pbuf *q = ptr; q != NULL; q = q->next) {
+    const uint8_t *payload = (const uint8_t *)q->payload;
+    size_t remaining = q->len;
+    mbedtls_md5_update(&md5Context, payload, remaining);
+    while (remaining > 0) {
+      size_t chunk = DOWNLOAD_STAGING_SIZE - stagingLength;
+      if (chunk > remaining) {
+        chunk = remaining;
+      }
+      memcpy(stagingTarget() + stagingLength, payload, chunk);
+      stagingLength += chunk;
+      payload += chunk;
+      remaining -= chunk;
+      if (stagingLength == DOWNLOAD_STAGING_SIZE) {
+        if (!flushStaging()) {
+          downloadStatus = DOWNLOAD_STATUS_FAILED;
+          return ERR_ABRT;  // Abort on failure
+        }
+        flushed = true;
+      }
+    }
   }
+  countReceived(ptr->tot_len);
+#if DOWNLOAD_CORE1_WRITER == 1
+  (void)flushed;
+  pipeConn = conn;
+  pipeReceived += ptr->tot_len;
+  ackReleased();
+#else
+  unackedLength += ptr->tot_len;
 
-  // Use pbuf_copy_partial to copy the pbuf content to the buffer
-  pbuf_copy_partial(ptr, buffc, ptr->tot_len, 0);
-
-  // Write the buffer to the file. File descriptor is 'file'
-  FRESULT res;
-  UINT bytesWritten;
-  res = f_write(&file, buffc, ptr->tot_len, &bytesWritten);
-
-  // Free the allocated memory
-  free(buffc);
-
-  // Check for file write errors
-  if (res != FR_OK || bytesWritten != ptr->tot_len) {
-    DPRINTF("Error writing to file: %i\n", res);
-    downloadStatus = DOWNLOAD_STATUS_FAILED;
-    return ERR_ABRT;  // Abort on failure
+  // Acknowledge the data once it is written, which opens the window again.
+  // The data left in the staging buffer waits for the next block
+  if (flushed) {
+    altcp_recved(conn, (u16_t)(unackedLength - stagingLength));
+    unackedLength = stagingLength;
   }
-
-  // Acknowledge that we received the data
-#if BOOSTER_DOWNLOAD_HTTPS == 1
-  altcp_recved(conn, ptr->tot_len);
-#else
-  tcp_recved(conn, ptr->tot_len);
 #endif
 
   // Free the pbuf
@@ -154,35 +449,54 @@ static err_t httpClientHeaderCheckSizeFn(__unused httpc_state_t *connection,
                                          __unused void *arg, struct pbuf *hdr,
                                          u16_t hdrLen,
                                          __unused u32_t contentLen) {
+  stats.responseUs = time_us_32() - stats.startUs;
   downloadStatus = DOWNLOAD_STATUS_FAILED;
-  const char *contentLengthLabel = "Content-Length:";
-  u16_t offset = 0;
-  char *headerData = malloc(hdrLen + 1);
-
-  if (headerData == NULL) {
-    return ERR_MEM;  // Memory allocation failed
+  if (resumeOffset > 0) {
+    u16_t status = http_client_get_status(hdr);
+    if (status == DOWNLOAD_HTTP_STATUS_PARTIAL) {
+      DPRINTF("Resuming the download at byte %lu\n",
+              (unsigned long)resumeOffset);
+    } else if (status == DOWNLOAD_HTTP_STATUS_OK) {
+      // The server ignored the range and sends the whole file
+      DPRINTF("Range not supported. Downloading the whole file\n");
+      f_lseek(&file, 0);
+      f_truncate(&file);
+      resumeOffset = 0;
+      mbedtls_md5_starts(&md5Context);
+    } else {
+      // Keep the data already downloaded for another attempt
+      DPRINTF("Can't resume the download. Status: %u\n", status);
+      return ERR_VAL;
+    }
   }
 
-  // Copy header data into a buffer for parsing
-  pbuf_copy_partial(hdr, headerData, hdrLen, 0);
-  headerData[hdrLen] = '\0';  // Null-terminate the string
-
-  // Find the Content-Length header
-  char *contentLengthStart = strstr(headerData, contentLengthLabel);
-  if (contentLengthStart != NULL) {
-    contentLengthStart +=
-        strlen(contentLengthLabel);  // Move past "Content-Length:"
-
-    // Skip leading spaces
-    while (*contentLengthStart == ' ') {
-      contentLengthStart++;
+  const char *contentLengthLabel = "Content-Length:";
+  u16_t labelLen = (u16_t)strlen(contentLengthLabel);
+
+  // Find the Content-Length header in the pbuf chain, without a copy of the
+  // headers
+  u16_t offset = pbuf_memfind(hdr, contentLengthLabel, labelLen, 0);
+  if ((offset != 0xFFFF) && (offset < hdrLen)) {
+    // Copy only the value, the spaces and digits after the label
+    char value[DOWNLOAD_CONTENT_LENGTH_SIZE] = {0};
+    offset += labelLen;
+    u16_t valueLen = (u16_t)(sizeof(value) - 1);
+    if (valueLen > (hdrLen - offset)) {
+      valueLen = hdrLen - offset;
     }
+    pbuf_copy_partial(hdr, value, valueLen, offset);
 
     // Convert the Content-Length value to an integer
-    size_t contentLength = strtoul(contentLengthStart, NULL, DEC_BASE);
+    size_t contentLength = strtoul(value, NULL, DEC_BASE);
+    DPRINTF("Content-Length: %u\n", (unsigned int)contentLength);
+    if (contentLength > 0) {
+      preallocateFile(resumeOffset + (FSIZE_t)contentLength);
+      stats.totalBytes = (uint32_t)contentLength;
+    }
   }
 
-  free(headerData);  // Free allocated memory
+  stagingLength = 0;
+  unackedLength = 0;
   downloadStatus = DOWNLOAD_STATUS_IN_PROGRESS;
   return ERR_OK;  // Header check passed
 }
@@ -194,6 +508,8 @@ static void httpClientResultCompleteFn(void *arg, httpc_result_t httpcResult,
   DPRINTF("Requet complete: result %d len %u server_response %u err %d\n",
           httpcResult, rxContentLen, srvRes, err);
   req->complete = true;
+  stopClock();
+  network_activityEnd();
   if (err == ERR_OK) {
     downloadStatus = DOWNLOAD_STATUS_COMPLETED;
   } else {
@@ -201,14 +517,16 @@ static void httpClientResultCompleteFn(void *arg, httpc_result_t httpcResult,
   }
 }
 
-download_err_t download_start() {
+// Open the temporary file and start the request. To resume, the data already
+// in the file is kept and only the rest is requested
+static download_err_t startDownload(const char *url, bool resume) {
   // Download the app binary from the URL in the app_info struct
   // The binary is saved to the SD card in the folder
   // The binary is downloaded using the HTTP client
   // The binary is saved to the SD card
 
   // Get the components of a url
-  if (parseUrl(filepath, &components, &fileUrl) != 0) {
+  if (parseUrl(url, &components, &fileUrl) != 0) {
     DPRINTF("Error parsing URL\n");
     return DOWNLOAD_CANNOTPARSEURL_ERROR;
   }
@@ -230,8 +548,11 @@ download_err_t download_start() {
 
   // Open file for writing or create if it doesn't exist
   DPRINTF("Opening file for writing\n");
-  res = f_open(&file, filename, FA_WRITE | FA_CREATE_ALWAYS);
-  if (res == FR_LOCKED) {
+  // Resuming reads the data kept to hash it
+  res = f_open(&file, filename,
+               resume ? (FA_READ | FA_WRITE | FA_OPEN_ALWAYS)
+                      : (FA_WRITE | FA_CREATE_ALWAYS));
+  if ((res == FR_LOCKED) && !resume) {
     DPRINTF("File is locked. Attempting to resolve...\n");
 
     // Try to remove the file and create it again
@@ -248,7 +569,31 @@ download_err_t download_start() {
     return DOWNLOAD_CANNOTOPENFILE_ERROR;
   }
 
+  // Append to the data of the previous attempt
+  resumeOffset = resume ? f_size(&file) : 0;
+  md5Verified = false;
+  mbedtls_md5_init(&md5Context);
+  mbedtls_md5_starts(&md5Context);
+  if ((resumeOffset > 0) && (!hashFilePrefix(resumeOffset) ||
+                             (f_lseek(&file, resumeOffset) != FR_OK))) {
+    DPRINTF("Error seeking the end of file %s\n", filename);
+    f_close(&file);
+    return DOWNLOAD_CANNOTOPENFILE_ERROR;
+  }
+
   downloadStatus = DOWNLOAD_STATUS_STARTED;
+  stagingLength = 0;
+  unackedLength = 0;
+  memset(&stats, 0, sizeof(stats));
+  stats.resumeOffset = (uint32_t)resumeOffset;
+  stats.startUs = time_us_32();
+  stats.running = true;
+  windowStartUs = stats.startUs;
+  http_client_reset_tls_heap_peak();
+  windowBytes = 0;
+#if DOWNLOAD_CORE1_WRITER == 1
+  startWriter();
+#endif
 
   request.url = components.uri;
   request.hostname = components.host;
@@ -256,16 +601,23 @@ download_err_t download_start() {
   request.headers_fn = httpClientHeaderCheckSizeFn;
   request.recv_fn = httpClientReceiveFileFn;
   request.result_fn = httpClientResultCompleteFn;
+  request.range_start = (uint32_t)resumeOffset;
   DPRINTF("Downloading: %s\n", request.url);
 #if APP_DOWNLOAD_HTTPS == 1
-  request.tls_config = altcp_tls_create_config_client(NULL, 0);  // https
+  request.tls_config = http_client_create_tls_config();  // https
   DPRINTF("Download with HTTPS\n");
 #else
   DPRINTF("Download with HTTP\n");
 #endif
+  // The radio leaves the power save mode until the request completes
+  network_activityBegin();
   int result = http_client_request_async(cyw43_arch_async_context(), &request);
   if (result != 0) {
     DPRINTF("Error initializing the download: %i\n", result);
+    network_activityEnd();
+#if DOWNLOAD_CORE1_WRITER == 1
+    stopWriter();
+#endif
     res = f_close(&file);
     if (res != FR_OK) {
       DPRINTF("Error closing file %s: %i\n", filename, res);
@@ -275,6 +627,10 @@ download_err_t download_start() {
   return DOWNLOAD_OK;
 }
 
+download_err_t download_start() { return startDownload(filepath, false); }
+
+download_err_t download_resume() { return startDownload(filepath, true); }
+
 download_poll_t download_poll() {
   if (!request.complete) {
     async_context_poll(cyw43_arch_async_context());
@@ -286,6 +642,24 @@ download_poll_t download_poll() {
 }
 
 download_err_t download_finish() {
+  // Write the tail of the data still in the staging buffer
+  if (!flushStaging()) {
+    downloadStatus = DOWNLOAD_STATUS_FAILED;
+  }
+  stagingLength = 0;
+#if DOWNLOAD_CORE1_WRITER == 1
+  // FatFs goes back to core0 once the last buffer is written
+  if (!stopWriter()) {
+    downloadStatus = DOWNLOAD_STATUS_FAILED;
+  }
+#endif
+  stopClock();
+
+  // Drop the preallocated clusters not written, if the transfer was short
+  if (f_size(&file) > f_tell(&file)) {
+    f_truncate(&file);
+  }
+
   // Close the file
   int res = f_close(&file);
   if (res != FR_OK) {
@@ -304,10 +678,53 @@ download_err_t download_finish() {
   }
   DPRINTF("File downloaded\n");
 
+  if (expectedMd5Set) {
+    uint8_t md5[DOWNLOAD_MD5_SIZE];
+    mbedtls_md5_finish(&md5Context, md5);
+    mbedtls_md5_free(&md5Context);
+    if (memcmp(md5, expectedMd5, sizeof(md5)) != 0) {
+      DPRINTF("MD5 mismatch. Deleting the file\n");
+      char filename[DOWNLOAD_BUFFLINE_SIZE] = {0};
+      getTmpFilenamePath(filename);
+      f_unlink(filename);
+      return DOWNLOAD_MD5MISMATCH_ERROR;
+    }
+    DPRINTF("MD5 verified\n");
+    md5Verified = true;
+  }
+
+  return DOWNLOAD_OK;
+}
+
+download_err_t download_setExpectedMd5(const char *md5Hex) {
+  expectedMd5Set = false;
+  if ((md5Hex == NULL) || (md5Hex[0] == '\0')) {
+    return DOWNLOAD_OK;
+  }
+  if (strlen(md5Hex) != DOWNLOAD_MD5_HEX_SIZE) {
+    DPRINTF("Invalid MD5 length: %s\n", md5Hex);
+    return DOWNLOAD_PARSEMD5_ERROR;
+  }
+  for (int i = 0; i < DOWNLOAD_MD5_SIZE; i++) {
+    int high = hexValue(md5Hex[i * 2]);
+    int low = hexValue(md5Hex[i * 2 + 1]);
+    if ((high < 0) || (low < 0)) {
+      DPRINTF("Invalid MD5 digit: %s\n", md5Hex);
+      return DOWNLOAD_PARSEMD5_ERROR;
+    }
+    expectedMd5[i] = (uint8_t)((high << 4) | low);
+  }
+  expectedMd5Set = true;
   return DOWNLOAD_OK;
 }
 
 download_err_t download_confirm() {
+  // The data was checked as it was received
+  if (expectedMd5Set && !md5Verified) {
+    DPRINTF("The download did not pass the MD5 check\n");
+    return DOWNLOAD_MD5MISMATCH_ERROR;
+  }
+
   // Get the filename of
   char fname[DOWNLOAD_BUFFLINE_SIZE] = {0};
   snprintf(
@@ -336,8 +753,55 @@ download_err_t download_confirm() {
   return DOWNLOAD_OK;
 }
 
+download_err_t download_benchmark(const char *url,
+                                   download_bench_done_fn done) {
+  if ((url == NULL) || (done == NULL) || (benchDone != NULL) ||
+      stats.running) {
+    return DOWNLOAD_CANNOTSTARTDOWNLOAD_ERROR;
+  }
+  strncpy(benchUrl, url, sizeof(benchUrl) - 1);
+  benchUrl[sizeof(benchUrl) - 1] = '\0';
+  download_err_t err = startDownload(benchUrl, false);
+  if (err == DOWNLOAD_OK) {
+    benchDone = done;
+  }
+  return err;
+}
+
+void download_pollBenchmark(void) {
+  // The network task polls the request
+  if ((benchDone == NULL) || !request.complete) {
+    return;
+  }
+  download_err_t err = download_finish();
+  download_stats_t out;
+  download_getStats(&out);
+
+  // Only the speed matters
+  char filename[DOWNLOAD_BUFFLINE_SIZE] = {0};
+  getTmpFilenamePath(filename);
+  f_unlink(filename);
+
+  download_bench_done_fn done = benchDone;
+  benchDone = NULL;
+  done(err, &out);
+}
+
 download_status_t download_getStatus() { return downloadStatus; }
 
+void download_getStats(download_stats_t *out) {
+  *out = stats;
+  if (out->running) {
+    out->elapsedUs = time_us_32() - out->startUs;
+  }
+  out->averageKbps = speedKbps(out->receivedBytes, out->elapsedUs);
+  out->networkUs =
+      (out->elapsedUs > out->writeUs) ? (out->elapsedUs - out->writeUs) : 0;
+  size_t tlsHeapPeak = 0;
+  http_client_get_tls_heap(NULL, &tlsHeapPeak);
+  out->tlsHeapPeak = (uint32_t)tlsHeapPeak;
+}
+
 void download_setStatus(download_status_t status) { downloadStatus = status; }
 
 const char *download_getFilepath() { return filepath; }
@@ -345,6 +809,8 @@ const char *download_getFilepath() { return filepath; }
 void download_setFilepath(const char *path) {
   strncpy(filepath, path, sizeof(filepath) - 1);
   filepath[sizeof(filepath) - 1] = '\0';
+  // The query goes out now, so download_start finds the address known
+  network_dnsPrefetch(filepath);
 }
 
 const download_url_components_t *download_getUrlComponents() {
@@ -14,23 +14,36 @@
 #include "target_firmware.h"  // Include the target firmware binary
 
 #include "aconfig.h"
+#include "bench.h"
+#include "boottrace.h"
 #include "constants.h"
 #include "debug.h"
 #include "display.h"
+#include "download.h"
 #include "ff.h"
 #include "gconfig.h"
 #include "memfunc.h"
+#include "memwatch.h"
+#include "metrics.h"
 #include "network.h"
 #include "pico/stdlib.h"
+#include "pool.h"
 #include "reset.h"
+#include "rombank.h"
 #include "romemul.h"
+#include "romtemp.h"
+#include "sched.h"
 #include "sdcard.h"
 #include "select.h"
+#include "stress.h"
 #include "term.h"
+#include "upload.h"
+#include "viewer.h"
 
 #define SLEEP_LOOP_MS 100
 
 enum {
+  APP_MODE_STRESS = 1,  // Bus stress test, see stress.h
   APP_MODE_SETUP = 255  // Setup
 };
 
@@ -40,14 +53,13 @@ static void cmdClear(const char *arg);
 static void cmdExit(const char *arg);
 static void cmdHelp(const char *arg);
 static void cmdBooster(const char *arg);
-static void cmdSettings(const char *arg);
-static void cmdPrint(const char *arg);
-static void cmdSave(const char *arg);
-static void cmdErase(const char *arg);
-static void cmdGet(const char *arg);
-static void cmdPutInt(const char *arg);
-static void cmdPutBool(const char *arg);
-static void cmdPutString(const char *arg);
+static void cmdStress(const char *arg);
+static void cmdBanks(const char *arg);
+static void cmdPerf(const char *arg);
+static void cmdPools(const char *arg);
+static void cmdRam(const char *arg);
+static void cmdTrace(const char *arg);
+static void cmdTasks(const char *arg);
 
 // Command table
 static const Command commands[] = {
@@ -56,15 +68,28 @@ static const Command commands[] = {
     {"e", cmdExit},
     {"x", cmdBooster},
     {"?", cmdHelp},
-    {"s", cmdSettings},
-    {"settings", cmdSettings},
-    {"print", cmdPrint},
-    {"save", cmdSave},
-    {"erase", cmdErase},
-    {"get", cmdGet},
-    {"put_int", cmdPutInt},
-    {"put_bool", cmdPutBool},
-    {"put_str", cmdPutString},
+    {"s", term_cmdSettings},
+    {"settings", term_cmdSettings},
+    {"print", term_cmdPrint},
+    {"save", term_cmdSave},
+    {"erase", term_cmdErase},
+    {"get", term_cmdGet},
+    {"put_int", term_cmdPutInt},
+    {"put_bool", term_cmdPutBool},
+    {"put_str", term_cmdPutString},
+    {"stats", term_cmdStats},
+    {"boot", term_cmdBoot},
+    {"download", term_cmdDownload},
+    {"scan", term_cmdScan},
+    {"net", term_cmdNet},
+    {"stress", cmdStress},
+    {"banks", cmdBanks},
+    {"perf", cmdPerf},
+    {"pools", cmdPools},
+    {"ram", cmdRam},
+    {"trace", cmdTrace},
+    {"tasks", cmdTasks},
+    {"bench", bench_run},
 };
 
 // Number of commands in the table
@@ -77,6 +102,27 @@ static absolute_time_t menuRefreshTime;
 
 #define MENU_REFRESH_TIME_MS 1000
 
+// Expected longest run of the main loop tasks, see the tasks command
+#define TASK_BUS_BUDGET_US 2000
+#define TASK_NETWORK_BUDGET_US 5000
+#define TASK_SHORT_BUDGET_US 500
+#define TASK_LOG_BUDGET_US 2000
+#define TASK_MENU_BUDGET_US 20000
+#define TASK_SDCARD_BUDGET_US 100000
+#define TASK_DISPLAY_BUDGET_US 5000
+
+// Periods of the main loop tasks that poll a timer or a queue. The bus and
+// network tasks run every pass: the loop wakes up for their work
+#define TASK_STRESS_PERIOD_MS 100  // Below STRESS_REFRESH_MS
+#define TASK_LOG_PERIOD_MS 20      // DEBUG_LOG_DRAIN_MAX messages each time
+#define TASK_MENU_PERIOD_MS 100    // Below MENU_REFRESH_TIME_MS
+#define TASK_SDCARD_PERIOD_MS 1000
+#define TASK_SCAN_PERIOD_MS 250
+#define TASK_DISPLAY_PERIOD_MS 10  // Below DISPLAY_BANK_GUARD_US
+
+// Connection attempts made in the background after a timeout
+#define WIFI_CONNECT_ATTEMPTS 3
+
 // Should we reset the device, or jump to the booster app?
 // By default, we reset the device.
 static bool resetDeviceAtBoot = true;
@@ -90,6 +136,7 @@ static void showTitle() {
 
 static void menu(void) {
   menuScreenActive = true;
+  term_beginBatch();
   showTitle();
   term_printString("\n\n");
   term_printString("[S]ettings     | Back to this [M]enu\n");
@@ -101,36 +148,49 @@ static void menu(void) {
   term_printString("\n");
   term_printString("Select an option: ");
   term_markMenuPromptCursor();
+  term_endBatch();
   menuRefreshTime = make_timeout_time_ms(MENU_REFRESH_TIME_MS);
 }
 
 // Command handlers
+static void leaveMenu(void) { menuScreenActive = false; }
+
 void cmdMenu(const char *arg) { menu(); }
 
 void cmdHelp(const char *arg) {
-  menuScreenActive = false;
   // term_printString("\x1B" "E" "Available commands:\n");
   term_printString("Available commands:\n");
   term_printString(" General:\n");
   term_printString("  clear   - Clear the terminal screen\n");
   term_printString("  exit    - Exit the terminal\n");
   term_printString("  help    - Show available commands\n");
+  term_printString("  stats   - Show bus stats [reset]\n");
+  term_printString("  boot    - Show the boot time stages\n");
+  term_printString("  download stats - Show the download speed\n");
+  term_printString("  download bench <url> - Measure a download\n");
+  term_printString("  scan - Show the WiFi networks found\n");
+  term_printString("  net - Show the network health\n");
+  term_printString("  stress - Run the bus stress test\n");
+  term_printString("  banks - Show the ROM4 page counters\n");
+  term_printString("  perf - Show the XIP cache and bus counters\n");
+  term_printString("  pools - Show the memory pool usage\n");
+  term_printString("  ram - Show the stack and RAM high water marks\n");
+  term_printString("  trace [full|sampled|stop|reset] - ROM hot spots\n");
+  term_printString("  tasks [reset] - Show the main loop task times\n");
+  term_printString("  bench [group] - Time the firmware primitives\n");
 }
 
 void cmdClear(const char *arg) {
-  menuScreenActive = false;
   term_clearScreen();
 }
 
 void cmdExit(const char *arg) {
-  menuScreenActive = false;
   term_printString("Exiting terminal...\n");
   // Send continue to desktop command
   SEND_COMMAND_TO_DISPLAY(DISPLAY_COMMAND_CONTINUE);
 }
 
 void cmdBooster(const char *arg) {
-  menuScreenActive = false;
   term_printString("Launching Booster app...\n");
   term_printString("The computer will boot shortly...\n\n");
   term_printString("If it doesn't boot, power it on and off.\n");
@@ -138,44 +198,222 @@ void cmdBooster(const char *arg) {
   keepActive = false;         // Exit the active loop
 }
 
-void cmdSettings(const char *arg) {
-  menuScreenActive = false;
-  term_cmdSettings(arg);
+void cmdStress(const char *arg) {
+  stress_start();
+}
+
+// Per mille of part in total, 0 if there is no total
+static unsigned long perMille(uint64_t part, uint64_t total) {
+  return (total > 0) ? (unsigned long)((part * 1000) / total) : 0;
+}
+
+static void showCounters(const char *title, const PerfCounters *counters,
+                         bool busAvailable) {
+  uint64_t ms = (counters->elapsedMs > 0) ? counters->elapsedMs : 1;
+  unsigned long hits = perMille(counters->xipHits, counters->xipAccesses);
+  TPRINTF("%s (%lu ms):\n", title, (unsigned long)counters->elapsedMs);
+  TPRINTF(" XIP: %lu K/s, hits %lu.%lu%%\n",
+          (unsigned long)(counters->xipAccesses / ms), hits / 10, hits % 10);
+  if (!busAvailable) {
+    return;
+  }
+  unsigned long xip = perMille(counters->bus[PERF_BUS_XIP_CONTESTED],
+                               counters->bus[PERF_BUS_XIP]);
+  TPRINTF(" XIP contested: %lu.%lu%%\n", xip / 10, xip % 10);
+  TPRINTF(" SRAM0 contested: %lu K/s\n",
+          (unsigned long)(counters->bus[PERF_BUS_SRAM0_CONTESTED] / ms));
+  TPRINTF(" PIO contested: %lu K/s\n",
+          (unsigned long)(counters->bus[PERF_BUS_FASTPERI_CONTESTED] / ms));
+  if (counters->saturated > 0) {
+    TPRINTF(" Saturated samples: %lu\n", (unsigned long)counters->saturated);
+  }
+}
+
+void cmdPerf(const char *arg) {
+  PerfCounters window;
+  PerfCounters total;
+  bool busAvailable = perf_getCounters(&window, &total);
+  TPRINTF("Profile: %s\n", perf_getProfile()->name);
+  showCounters("Last second", &window, busAvailable);
+  showCounters("Since boot", &total, busAvailable);
+  if (!busAvailable) {
+    term_printString("No bus fabric counters on this chip.\n");
+  }
 }
 
-void cmdPrint(const char *arg) {
-  menuScreenActive = false;
-  term_cmdPrint(arg);
+void cmdPools(const char *arg) {
+  PoolStats stats;
+  pool_getStats(&stats);
+  term_printString("Block  Blocks  In use  High  Misses\n");
+  for (int i = 0; i < POOL_CLASSES; i++) {
+    const PoolClassStats *cls = &stats.classes[i];
+    TPRINTF("%5lu %7lu %7lu %5lu %7lu\n", (unsigned long)cls->blockSize,
+            (unsigned long)cls->blocks, (unsigned long)cls->inUse,
+            (unsigned long)cls->highWater, (unsigned long)cls->misses);
+  }
+  TPRINTF("Heap fallbacks: %lu (%lu in use)\n",
+          (unsigned long)stats.heapFallbacks, (unsigned long)stats.heapInUse);
 }
 
-void cmdSave(const char *arg) {
-  menuScreenActive = false;
-  term_cmdSave(arg);
+static void showRegion(const char *name, const MemwatchRegion *region) {
+  TPRINTF("%-8s %7lu %7lu %7lu %7lu\n", name, (unsigned long)region->size,
+          (unsigned long)region->used, (unsigned long)region->highWater,
+          (unsigned long)(region->size - region->highWater));
 }
 
-void cmdErase(const char *arg) {
-  menuScreenActive = false;
-  term_cmdErase(arg);
+void cmdRam(const char *arg) {
+  MemwatchReport report;
+  memwatch_getReport(&report);
+  term_printString("Region      Size    Used    High    Free\n");
+  showRegion("Core0", &report.stack[0]);
+  showRegion("Core1", &report.stack[1]);
+  showRegion("Heap", &report.heap);
+  if (!report.painted) {
+    term_printString("Stacks not painted: high water marks unknown.\n");
+  }
+  TPRINTF("Static data: %lu bytes\n", (unsigned long)report.staticBytes);
+
+  PoolStats pools;
+  pool_getStats(&pools);
+  uint32_t poolHigh = 0;
+  uint32_t poolSize = 0;
+  for (int i = 0; i < POOL_CLASSES; i++) {
+    poolHigh += pools.classes[i].blockSize * pools.classes[i].highWater;
+    poolSize += pools.classes[i].blockSize * pools.classes[i].blocks;
+  }
+  TPRINTF("Pools: %lu of %lu bytes at most, %lu heap fallbacks\n",
+          (unsigned long)poolHigh, (unsigned long)poolSize,
+          (unsigned long)pools.heapFallbacks);
+
+  TermProtocolStats protocol;
+  term_getProtocolStats(&protocol);
+  TPRINTF("Protocol buffers: %lu of %d at most\n",
+          (unsigned long)protocol.highWater, TERM_PROTOCOL_RING_SLOTS);
+
+  network_telemetry_t net;
+  network_getTelemetry(&net);
+  if (net.lwipStats) {
+    TPRINTF("lwIP pbuf pool: %u in use, %u at most\n",
+            (unsigned)net.pbufPoolUsed, (unsigned)net.pbufPoolMax);
+  } else {
+    term_printString("lwIP pool counters off, see NETWORK_TELEMETRY.\n");
+  }
 }
 
-void cmdGet(const char *arg) {
-  menuScreenActive = false;
-  term_cmdGet(arg);
+void cmdBanks(const char *arg) {
+  static RombankPageStats stats[ROMBANK_MAX_PAGES];
+  uint32_t pages = rombank_getStats(stats);
+  if (pages == 0) {
+    term_printString("No bank switched image.\n");
+    return;
+  }
+  TPRINTF("Page in ROM4: %d\n", rombank_getPage());
+  term_printString("Page  Selects  Hits\n");
+  for (uint32_t i = 0; i < pages; i++) {
+    TPRINTF("%4lu %8lu %10lu\n", (unsigned long)i,
+            (unsigned long)stats[i].selects, (unsigned long)stats[i].hits);
+  }
 }
 
-void cmdPutInt(const char *arg) {
-  menuScreenActive = false;
-  term_cmdPutInt(arg);
+// Pages with the most accesses, sorted, as ST addresses
+#define TRACE_TOP_PAGES 16
+#define TRACE_ST_BASE 0xFA0000
+
+static void showTraceTop(void) {
+  const volatile uint32_t *histogram = romemul_getTraceHistogram();
+  uint16_t top[TRACE_TOP_PAGES];
+  uint32_t counts[TRACE_TOP_PAGES];
+  uint32_t found = 0;
+  for (uint32_t page = 0; page < ROMEMUL_TRACE_PAGES; page++) {
+    uint32_t count = histogram[page];
+    if ((count == 0) ||
+        ((found == TRACE_TOP_PAGES) && (count <= counts[found - 1]))) {
+      continue;
+    }
+    uint32_t i = (found < TRACE_TOP_PAGES) ? found++ : found - 1;
+    while ((i > 0) && (counts[i - 1] < count)) {
+      top[i] = top[i - 1];
+      counts[i] = counts[i - 1];
+      i--;
+    }
+    top[i] = (uint16_t)page;
+    counts[i] = count;
+  }
+  if (found == 0) {
+    term_printString("No accesses traced.\n");
+    return;
+  }
+  term_printString("Address      Accesses\n");
+  for (uint32_t i = 0; i < found; i++) {
+    TPRINTF("$%06lX %12lu\n",
+            (unsigned long)(TRACE_ST_BASE +
+                            ((uint32_t)top[i] << ROMEMUL_TRACE_PAGE_BITS)),
+            (unsigned long)counts[i]);
+  }
 }
 
-void cmdPutBool(const char *arg) {
-  menuScreenActive = false;
-  term_cmdPutBool(arg);
+void cmdTrace(const char *arg) {
+  if (romemul_getTraceHistogram() == NULL) {
+    term_printString("ROM trace off, see ROMEMUL_TRACE.\n");
+    return;
+  }
+  if ((arg != NULL) && (strcmp(arg, "full") == 0)) {
+    if (romemul_startTrace(ROMEMUL_TRACE_FULL) != 0) {
+      term_printString("ROM trace not available.\n");
+      return;
+    }
+    term_printString("Tracing every ROM access.\n");
+    return;
+  }
+  if ((arg != NULL) && (strcmp(arg, "sampled") == 0)) {
+    if (romemul_startTrace(ROMEMUL_TRACE_SAMPLED) != 0) {
+      term_printString("ROM trace not available.\n");
+      return;
+    }
+    TPRINTF("Tracing up to %d ROM accesses every %d us.\n",
+            ROMEMUL_TRACE_SAMPLE_ENTRIES, ROMEMUL_TRACE_SAMPLE_US);
+    return;
+  }
+  if ((arg != NULL) && (strcmp(arg, "stop") == 0)) {
+    romemul_stopTrace();
+    term_printString("ROM trace stopped.\n");
+    return;
+  }
+  if ((arg != NULL) && (strcmp(arg, "reset") == 0)) {
+    romemul_resetTrace();
+    term_printString("ROM trace reset.\n");
+    return;
+  }
+
+  RomemulTraceStats stats;
+  romemul_getTraceStats(&stats);
+  static const char *const modes[] = {"stopped", "full", "sampled"};
+  TPRINTF("Trace %s: %lu traced, %lu skipped, %lu passes\n",
+          modes[stats.mode], (unsigned long)stats.folded,
+          (unsigned long)stats.skipped, (unsigned long)stats.passes);
+  // The ring can overrun in the full mode, compare with the PIO counter
+  TPRINTF("ROM4 accesses seen by the bus: %lu\n",
+          (unsigned long)romemul_getRom4AccessCount());
+  showTraceTop();
 }
 
-void cmdPutString(const char *arg) {
-  menuScreenActive = false;
-  term_cmdPutString(arg);
+void cmdTasks(const char *arg) {
+  if ((arg != NULL) && (strcmp(arg, "reset") == 0)) {
+    sched_resetStats();
+    term_printString("Task statistics reset.\n");
+    return;
+  }
+  term_printString("Task     Runs    Avg us  Max us  Over  Late us\n");
+  for (int i = 0; i < sched_getTaskCount(); i++) {
+    SchedTaskStats stats;
+    sched_getTaskStats(i, &stats);
+    uint32_t avgUs =
+        (stats.runs > 0) ? (uint32_t)(stats.totalUs / stats.runs) : 0;
+    TPRINTF("%-8s %7lu %7lu %7lu %5lu %8lu\n", stats.name,
+            (unsigned long)stats.runs, (unsigned long)avgUs,
+            (unsigned long)stats.maxUs, (unsigned long)stats.overruns,
+            (unsigned long)stats.maxLateUs);
+  }
 }
 
 // This section contains the functions that are called from the main loop
@@ -184,6 +422,230 @@ static bool getKeepActive() { return keepActive; }
 
 static bool getResetDevice() { return resetDeviceAtBoot; }
 
+#if PICO_CYW43_ARCH_POLL
+// The worker does nothing: setting it pending is enough to make
+// cyw43_arch_wait_for_work_until return when a command arrives
+static void commandWorkerDoWork(async_context_t *context,
+                                async_when_pending_worker_t *worker) {
+  (void)context;
+  (void)worker;
+}
+
+static async_when_pending_worker_t commandWorker = {
+    .do_work = commandWorkerDoWork};
+static bool commandWorkerAdded = false;
+
+static void __not_in_flash_func(commandNotify)(void) {
+  async_context_set_work_pending(cyw43_arch_async_context(), &commandWorker);
+}
+#endif
+
+// Wait until a remote command is queued or the timeout expires
+static void waitForWork(uint32_t timeoutMs) {
+  absolute_time_t until = make_timeout_time_ms(timeoutMs);
+#if PICO_CYW43_ARCH_POLL
+  if (commandWorkerAdded) {
+    if (!term_hasPendingCommands()) {
+      cyw43_arch_wait_for_work_until(until);
+    }
+    return;
+  }
+#endif
+  // term_dma_irq_handler_lookup sends a SEV for every queued command
+  while (!term_hasPendingCommands() && !best_effort_wfe_or_timeout(until)) {
+  }
+}
+
+// Tasks of the main loop, see startTasks
+
+static bool busTask(void *context) {
+  (void)context;
+  term_loop();
+  return true;
+}
+
+#if PICO_CYW43_ARCH_POLL
+static bool networkTask(void *context) {
+  (void)context;
+  network_safePoll();
+  return true;
+}
+
+static bool downloadTask(void *context) {
+  (void)context;
+  download_pollBenchmark();
+  return true;
+}
+
+// Refresh the WiFi scan results while the radio is free
+static bool scanTask(void *context) {
+  (void)context;
+  download_stats_t downloadStats;
+  download_getStats(&downloadStats);
+  if (!downloadStats.running) {
+    network_scanBackground();
+  }
+  return true;
+}
+#endif
+
+#if METRICS_EXPORT == 1
+static bool metricsTask(void *context) {
+  (void)context;
+  metrics_poll();
+  return true;
+}
+#endif
+
+#if VIEWER_SERVER == 1
+static bool viewerTask(void *context) {
+  (void)context;
+  viewer_poll();
+  return true;
+}
+#endif
+
+static bool stressTask(void *context) {
+  (void)context;
+  stress_refresh();
+  return true;
+}
+
+#if DISPLAY_DOUBLE_BUFFER == 1
+// Publish the rows of a refresh that came too soon after a bank flip
+static bool displayTask(void *context) {
+  (void)context;
+  display_retryRefresh();
+  return true;
+}
+#endif
+
+static bool logTask(void *context) {
+  (void)context;
+  debug_logDrain(DEBUG_LOG_DRAIN_MAX);
+  return true;
+}
+
+// Count the SD card free space once, a few FAT sectors in each idle slice, so
+// the menu never waits for a FAT scan
+static bool sdcardTask(void *context) {
+  (void)context;
+  // Run again in the next pass until the count is done
+  return !sdcard_refreshFreeSpace();
+}
+
+static bool menuTask(void *context) {
+  (void)context;
+  if (!menuScreenActive ||
+      (absolute_time_diff_us(get_absolute_time(), menuRefreshTime) > 0)) {
+    return true;
+  }
+  char *input = term_getInputBuffer();
+  if ((input != NULL) && (input[0] != '\0')) {
+    return true;
+  }
+  term_refreshMenuLiveInfo();
+  menuRefreshTime = make_timeout_time_ms(MENU_REFRESH_TIME_MS);
+  return true;
+}
+
+// The remote commands run first, and again after any task if more arrived
+static void startTasks(void) {
+  sched_setBusPending(term_hasPendingCommands);
+  sched_addTask("bus", busTask, NULL, SCHED_EVERY_PASS, TASK_BUS_BUDGET_US,
+                SCHED_PRIORITY_BUS, NULL);
+#if PICO_CYW43_ARCH_POLL
+  sched_addTask("network", networkTask, NULL, SCHED_EVERY_PASS,
+                TASK_NETWORK_BUDGET_US, SCHED_PRIORITY_NORMAL, NULL);
+#endif
+  sched_addTask("stress", stressTask, NULL, TASK_STRESS_PERIOD_MS,
+                TASK_SHORT_BUDGET_US, SCHED_PRIORITY_NORMAL, NULL);
+  sched_addTask("log", logTask, NULL, TASK_LOG_PERIOD_MS, TASK_LOG_BUDGET_US,
+                SCHED_PRIORITY_NORMAL, NULL);
+#if DISPLAY_DOUBLE_BUFFER == 1
+  sched_addTask("display", displayTask, NULL, TASK_DISPLAY_PERIOD_MS,
+                TASK_DISPLAY_BUDGET_US, SCHED_PRIORITY_NORMAL, NULL);
+#endif
+  sched_addTask("menu", menuTask, NULL, TASK_MENU_PERIOD_MS,
+                TASK_MENU_BUDGET_US, SCHED_PRIORITY_NORMAL, NULL);
+  sched_addTask("sdcard", sdcardTask, NULL, TASK_SDCARD_PERIOD_MS,
+                TASK_SDCARD_BUDGET_US, SCHED_PRIORITY_IDLE, NULL);
+  sched_addTask("download", downloadTask, NULL,
+                DOWNLOAD_POLLING_INTERVAL_MS, TASK_SDCARD_BUDGET_US,
+                SCHED_PRIORITY_NORMAL, NULL);
+#if PICO_CYW43_ARCH_POLL
+  sched_addTask("scan", scanTask, NULL, TASK_SCAN_PERIOD_MS,
+                TASK_NETWORK_BUDGET_US, SCHED_PRIORITY_IDLE, NULL);
+#endif
+#if METRICS_EXPORT == 1
+  sched_addTask("metrics", metricsTask, NULL, METRICS_POLL_MS,
+                TASK_SHORT_BUDGET_US, SCHED_PRIORITY_IDLE, NULL);
+#endif
+#if VIEWER_SERVER == 1
+  sched_addTask("viewer", viewerTask, NULL, VIEWER_FRAME_MS,
+                TASK_SHORT_BUDGET_US, SCHED_PRIORITY_IDLE, NULL);
+#endif
+}
+
+// End of the background WiFi connection
+static void wifiConnectEvent(wifi_sta_conn_process_status_t status,
+                             int attempt) {
+  if (status == NETWORK_WIFI_STA_CONN_ERR_TIMEOUT) {
+    DPRINTF("Timeout connecting to the WiFi network after %d attempts\n",
+            attempt);
+  } else if (status != NETWORK_WIFI_STA_CONN_OK) {
+    DPRINTF("Error connecting to the WiFi network: %i\n", status);
+  } else {
+    DPRINTF("WiFi connected at attempt %d\n", attempt);
+    boottrace_mark("wifi");
+#if UPLOAD_SERVER == 1
+    upload_init();
+#endif
+#if VIEWER_SERVER == 1
+    viewer_init();
+#endif
+#if METRICS_EXPORT == 1
+    metrics_init();
+#endif
+  }
+}
+
+// Start the WiFi connection in station mode, if configured. The menu is
+// already shown, so the connection goes on in the background while the main
+// loop polls the network
+static void startWifi(void) {
+  int wifiModeSetting = 0;
+  if (settings_get_int(gconfig_getContext(),
+                       settings_get_handle(gconfig_getContext(),
+                                           PARAM_WIFI_MODE),
+                       &wifiModeSetting) != 0) {
+    DPRINTF("No WiFi mode found in the settings. No initializing.\n");
+    return;
+  }
+  if ((wifi_mode_t)wifiModeSetting == WIFI_MODE_AP) {
+    DPRINTF("WiFi mode is AP. No initializing.\n");
+    return;
+  }
+  DPRINTF("WiFi mode is STA\n");
+  int err = network_wifiInit(WIFI_MODE_STA);
+  if (err != 0) {
+    DPRINTF("Error initializing the network: %i. No initializing.\n", err);
+    return;
+  }
+#if PICO_CYW43_ARCH_POLL
+  // Wake up the network polling wait when a remote command arrives
+  async_context_add_when_pending_worker(cyw43_arch_async_context(),
+                                        &commandWorker);
+  commandWorkerAdded = true;
+  term_setCommandNotify(commandNotify);
+#endif
+  network_setConnectCallback(wifiConnectEvent);
+  err = network_wifiStaConnectAsync(WIFI_CONNECT_ATTEMPTS);
+  if (err != NETWORK_WIFI_STA_CONN_PENDING) {
+    DPRINTF("Error connecting to the WiFi network: %i\n", err);
+  }
+}
+
 static void preinit() {
   // Initialize the terminal
   term_init();
@@ -194,7 +656,7 @@ static void preinit() {
   // Show the title
   showTitle();
   term_printString("\n\n");
-  term_printString("Configuring network... please wait...\n");
+  term_printString("Starting... please wait...\n");
 
   display_refresh();
 }
@@ -215,8 +677,9 @@ void failure(const char *message) {
 }
 
 static void init(void) {
-  // Set the command table
+  // Set the command table. Any command but the menu leaves the menu screen
   term_setCommands(commands, numCommands);
+  term_setCommandHook(leaveMenu);
 
   // Clear the screen
   term_clearScreen();
@@ -275,14 +738,14 @@ void emul_start() {
 
   // 1. Check if the host device must be initialized to perform the emulation
   //    of the device, or start in setup/configuration mode
-  SettingsConfigEntry *appMode =
-      settings_find_entry(aconfig_getContext(), ACONFIG_PARAM_MODE);
   int appModeValue = APP_MODE_SETUP;  // Setup menu
-  if (appMode == NULL) {
+  if (settings_get_int(aconfig_getContext(),
+                       settings_get_handle(aconfig_getContext(),
+                                           ACONFIG_PARAM_MODE),
+                       &appModeValue) != 0) {
     DPRINTF(
         "APP_MODE_SETUP not found in the configuration. Using default value\n");
   } else {
-    appModeValue = atoi(appMode->value);
     DPRINTF("Start emulation in mode: %i\n", appModeValue);
   }
 
@@ -300,10 +763,17 @@ void emul_start() {
   // As a rule of thumb, the remote device (the computer) driver code must
   // be copied to the RAM of the host device where the emulation will take
   // place.
-  // The code is stored as an array in the target_firmware.h file
+  // The code is stored as an array in the target_firmware.h file, LZ4
+  // compressed if built with firmware.py --compress
   //
   // Copy the terminal firmware to RAM
+#ifdef TARGET_FIRMWARE_LZ4
+  COPY_FIRMWARE_LZ4_TO_RAM(target_firmware_lz4, target_firmware_lz4_length,
+                           target_firmware_size);
+#else
   COPY_FIRMWARE_TO_RAM((uint16_t *)target_firmware, target_firmware_length);
+#endif
+  boottrace_mark("firmware");
 
   // Initialize the terminal emulator PIO programs
   // The communication between the remote (target) computer and the RP2040 is
@@ -312,7 +782,21 @@ void emul_start() {
   // using the command protocol.
   // Hence, if you want to implement your own app or microfirmware, you should
   // implement your own command handler using this protocol.
+#if ROMEMUL_ROM3_CAPTURE == 1
+  // No IRQ per bus access: the PIO captures the ROM3 accesses and a timer
+  // parses them in batches
+  init_romemul(NULL, NULL, false);
+  if ((romemul_initRom3Capture() != 0) || (term_startRom3Capture() != 0)) {
+    DPRINTF("ROM3 capture unavailable. Using the DMA IRQ.\n");
+    dma_setResponseCB(term_dma_irq_handler_lookup);
+  }
+#elif ROMEMUL_BUS_SERVICE_CORE1 == 1
+  // Keep the bus service away from the network, SD and flash work of core0
+  romemul_initOnCore1(term_dma_irq_handler_lookup, false);
+#else
   init_romemul(NULL, term_dma_irq_handler_lookup, false);
+#endif
+  boottrace_mark("romemul");
 
   // After this point, the remote computer can execute the code
 
@@ -326,6 +810,7 @@ void emul_start() {
 
   // Initialize the display
   display_setupU8g2();
+  boottrace_mark("display");
 
   // 5. Init the sd card
   // Most of the apps or microfirmwares will need to read and write files
@@ -338,9 +823,9 @@ void emul_start() {
   // If there is no folder in the micro SD card, the app will create it.
 
   FATFS fsys;
-  SettingsConfigEntry *folder =
+  const SettingsConfigEntry *folder =
       settings_find_entry(aconfig_getContext(), ACONFIG_PARAM_FOLDER);
-  char *folderName = "/test";  // MODIFY THIS TO YOUR FOLDER NAME
+  const char *folderName = "/test";  // MODIFY THIS TO YOUR FOLDER NAME
   if (folder == NULL) {
     DPRINTF("FOLDER not found in the configuration. Using default value\n");
   } else {
@@ -353,74 +838,47 @@ void emul_start() {
   } else {
     DPRINTF("SD card found & initialized\n");
   }
+  boottrace_mark("sdcard");
 
   // Initialize the display again (in case the terminal emulator changed it)
   display_setupU8g2();
 
   // Pre-init the stuff
   // In this example it only prints the please wait message, but can be used as
-  // a place to put other code that needs to be run before the network is
-  // initialized
+  // a place to put other code that needs to be run before the menu is shown
   preinit();
 
-  // 6. Init the network, if needed
-  // It's always a good idea to wait for the network to be ready
-  // Get the WiFi mode from the settings
+  // 6. Configure the SELECT button so menu status can show it immediately.
+  select_configure();
+
+  // 7. Now complete the terminal emulator initialization
+  // The terminal emulator is used to interact with the user to configure the
+  // device. The menu is shown before the network is up
+  init();
+  boottrace_mark("menu");
+
+  // The image in the ROM_TEMP flash, paged in ROM4 on request of the remote
+  // computer
+  rombank_init(romtemp_getImage(), ROMTEMP_SIZE_BYTES / ROMBANK_PAGE_SIZE);
+  boottrace_dump();
+  term_publishBoot();
+
+  // The stress mode skips the menu and loads the bus from the first frame
+  if (appModeValue == APP_MODE_STRESS) {
+    menuScreenActive = false;
+    stress_start();
+  }
+
+  // 8. Init the network, if needed
+  // The connection is completed in the background by the main loop, and the
+  // live lines of the menu show the link when it comes up.
   // If you are developing code that does not use the network, you can
   // comment this section
   // It's important to note that the network parameters are taken from the
   // global configuration of the Booster app. The network parameters are
   // ready only for the microfirmware apps.
-  SettingsConfigEntry *wifiMode =
-      settings_find_entry(gconfig_getContext(), PARAM_WIFI_MODE);
-  wifi_mode_t wifiModeValue = WIFI_MODE_STA;
-  if (wifiMode == NULL) {
-    DPRINTF("No WiFi mode found in the settings. No initializing.\n");
-  } else {
-    wifiModeValue = (wifi_mode_t)atoi(wifiMode->value);
-    if (wifiModeValue != WIFI_MODE_AP) {
-      DPRINTF("WiFi mode is STA\n");
-      wifiModeValue = WIFI_MODE_STA;
-      int err = network_wifiInit(wifiModeValue);
-      if (err != 0) {
-        DPRINTF("Error initializing the network: %i. No initializing.\n", err);
-      } else {
-        // Set the term_loop as a callback during the polling period
-        network_setPollingCallback(term_loop);
-        // Connect to the WiFi network
-        int maxAttempts = 3;  // or any other number defined elsewhere
-        int attempt = 0;
-        err = NETWORK_WIFI_STA_CONN_ERR_TIMEOUT;
-
-        while ((attempt < maxAttempts) &&
-               (err == NETWORK_WIFI_STA_CONN_ERR_TIMEOUT)) {
-          err = network_wifiStaConnect();
-          attempt++;
-
-          if ((err > 0) && (err < NETWORK_WIFI_STA_CONN_ERR_TIMEOUT)) {
-            DPRINTF("Error connecting to the WiFi network: %i\n", err);
-          }
-        }
-
-        if (err == NETWORK_WIFI_STA_CONN_ERR_TIMEOUT) {
-          DPRINTF("Timeout connecting to the WiFi network after %d attempts\n",
-                  maxAttempts);
-          // Optionally, return an error code here.
-        }
-        network_setPollingCallback(NULL);
-      }
-    } else {
-      DPRINTF("WiFi mode is AP. No initializing.\n");
-    }
-  }
-
-  // 7. Configure the SELECT button so menu status can show it immediately.
-  select_configure();
-
-  // 8. Now complete the terminal emulator initialization
-  // The terminal emulator is used to interact with the user to configure the
-  // device.
-  init();
+  startWifi();
+  boottrace_mark("wifi init");
 
   // Blink on
 #ifdef BLINK_H
@@ -433,25 +891,11 @@ void emul_start() {
   // The main loop runs until the user decides to exit.
   // For testing purposes, this app only shows commands to manage the settings
   DPRINTF("Start the app loop here\n");
+  startTasks();
   while (getKeepActive()) {
-#if PICO_CYW43_ARCH_POLL
-    network_safePoll();
-    cyw43_arch_wait_for_work_until(make_timeout_time_ms(SLEEP_LOOP_MS));
-#else
-    sleep_ms(SLEEP_LOOP_MS);
-#endif
-    // Check remote commands
-    term_loop();
-
-    if (menuScreenActive) {
-      char *input = term_getInputBuffer();
-      bool hasPendingInput = (input != NULL) && (input[0] != '\0');
-      if (!hasPendingInput &&
-          (absolute_time_diff_us(get_absolute_time(), menuRefreshTime) <= 0)) {
-        term_refreshMenuLiveInfo();
-        menuRefreshTime = make_timeout_time_ms(MENU_REFRESH_TIME_MS);
-      }
-    }
+    // Sleep until a remote command arrives or a task is due
+    waitForWork(sched_getWaitMs(SLEEP_LOOP_MS));
+    sched_run();
   }
 
   // 10. Send RESET computer command
@@ -474,6 +918,7 @@ void emul_start() {
 
     // Jump to the booster app
     DPRINTF("Jumping to the booster app...\n");
+    debug_logFlush();
     reset_jump_to_booster();
   }
 }
@@ -6,6 +6,8 @@ static SettingsConfigEntry defaultEntries[] = {
      "http://atarist.sidecartridge.com/apps.json"},
     {PARAM_BOOT_FEATURE, SETTINGS_TYPE_STRING, "CONFIGURATOR"},
     {PARAM_HOSTNAME, SETTINGS_TYPE_STRING, "sidecart"},
+    {PARAM_METRICS_COLLECTOR, SETTINGS_TYPE_STRING, ""},
+    {PARAM_METRICS_INTERVAL, SETTINGS_TYPE_INT, "60"},
     {PARAM_SAFE_CONFIG_REBOOT, SETTINGS_TYPE_BOOL, "true"},
     {PARAM_SD_BAUD_RATE_KB, SETTINGS_TYPE_INT, "12500"},
     {PARAM_WIFI_AUTH, SETTINGS_TYPE_INT, "0"},
@@ -74,7 +76,7 @@ int gconfig_init(const char *currentAppName) {
     // If we are here, it means that the settings were initialized correctly
     // We now must read the flash address of the configuration settings of the
     // current application
-    SettingsConfigEntry *entry =
+    const SettingsConfigEntry *entry =
         settings_find_entry(&gSettingsCtx, PARAM_BOOT_FEATURE);
     if ((entry == NULL) || (entry->value == NULL) ||
         (strcmp(currentAppName, entry->value) != 0)) {
@@ -0,0 +1,47 @@
+/**
+ * File: handoff.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Warm hand-off block between apps
+ */
+
+#include "handoff.h"
+
+#include <string.h>
+
+static HandoffLink handoffLink __attribute__((section(".handoff_ram")));
+
+// FNV-1a of the block up to the check. The RAM is random after a power on
+static uint32_t handoffCheck(const HandoffLink *link) {
+  const uint8_t *bytes = (const uint8_t *)link;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < offsetof(HandoffLink, check); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+void handoff_saveLink(const HandoffLink *link) {
+  HandoffLink block = *link;
+  block.magic = HANDOFF_MAGIC;
+  block.version = HANDOFF_VERSION;
+  block.size = (uint16_t)sizeof(HandoffLink);
+  block.check = handoffCheck(&block);
+  handoffLink = block;
+}
+
+bool handoff_takeLink(HandoffLink *link) {
+  HandoffLink block = handoffLink;
+  handoff_clear();
+  if ((block.magic != HANDOFF_MAGIC) || (block.version != HANDOFF_VERSION) ||
+      (block.size != sizeof(HandoffLink)) ||
+      (block.check != handoffCheck(&block))) {
+    return false;
+  }
+  DPRINTF("Hand-off block of the previous app found\n");
+  *link = block;
+  return true;
+}
+
+void handoff_clear(void) { memset(&handoffLink, 0, sizeof(handoffLink)); }
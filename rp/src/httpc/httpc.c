@@ -6,6 +6,12 @@
 
 #include "httpc.h"
 
+#include <malloc.h>
+
+// Heap of the TLS connections
+static size_t tlsHeapInUse = 0;
+static size_t tlsHeapPeak = 0;
+
 // Print headers to stdout
 err_t http_client_header_print_fn(__unused httpc_state_t *connection,
                                   __unused void *arg, struct pbuf *hdr,
@@ -32,6 +38,114 @@ err_t http_client_receive_print_fn(__unused void *arg,
   return ERR_OK;
 }
 
+u16_t http_client_get_status(struct pbuf *hdr) {
+  // "HTTP/1.1 206 Partial Content": the code follows the first space
+  u16_t offset = pbuf_memfind(hdr, " ", 1, 0);
+  if (offset == 0xFFFF) {
+    return 0;
+  }
+  u16_t status = 0;
+  for (int i = 1; i <= 3; i++) {
+    int c = pbuf_try_get_at(hdr, offset + i);
+    if ((c < '0') || (c > '9')) {
+      return 0;
+    }
+    status = (u16_t)(status * 10 + (c - '0'));
+  }
+  return status;
+}
+
+#if APP_DOWNLOAD_HTTPS == 1 && LWIP_ALTCP
+// Session of the last TLS connection and the server it belongs to. One entry
+// is enough: the catalog and the files come from the same server
+static mbedtls_ssl_session tlsSession;
+static bool tlsSessionValid = false;
+static char tlsSessionHost[HTTPC_TLS_SESSION_HOST_SIZE];
+static uint16_t tlsSessionPort = 0;
+
+static uint16_t tls_port(const HTTPC_REQUEST_T *req) {
+  return req->port ? req->port : 443;
+}
+
+static bool tls_session_matches(const HTTPC_REQUEST_T *req) {
+  return tlsSessionValid && (tlsSessionPort == tls_port(req)) &&
+         (strcmp(tlsSessionHost, req->hostname) == 0);
+}
+
+// Keep the session once the handshake is done, when the first data arrives
+static void tls_session_save(HTTPC_REQUEST_T *req, struct altcp_pcb *conn) {
+  if ((req->tls_config == NULL) || req->tls_session_saved ||
+      (strlen(req->hostname) >= sizeof(tlsSessionHost))) {
+    return;
+  }
+  req->tls_session_saved = true;
+  http_client_clear_tls_session();
+  mbedtls_ssl_session_init(&tlsSession);
+  if (mbedtls_ssl_get_session(altcp_tls_context(conn), &tlsSession) != 0) {
+    mbedtls_ssl_session_free(&tlsSession);
+    return;
+  }
+  snprintf(tlsSessionHost, sizeof(tlsSessionHost), "%s", req->hostname);
+  tlsSessionPort = tls_port(req);
+  tlsSessionValid = true;
+}
+#endif
+
+#if APP_DOWNLOAD_HTTPS == 1
+static void *tls_calloc(size_t count, size_t size) {
+  void *ptr = calloc(count, size);
+  if (ptr != NULL) {
+    tlsHeapInUse += malloc_usable_size(ptr);
+    if (tlsHeapInUse > tlsHeapPeak) {
+      tlsHeapPeak = tlsHeapInUse;
+    }
+  }
+  return ptr;
+}
+
+static void tls_free(void *ptr) {
+  if (ptr != NULL) {
+    tlsHeapInUse -= malloc_usable_size(ptr);
+    free(ptr);
+  }
+}
+#endif
+
+#if APP_DOWNLOAD_HTTPS == 1 && LWIP_ALTCP
+struct altcp_tls_config *http_client_create_tls_config(void) {
+  // Count the allocations from the first configuration on, so no block is
+  // freed without being counted
+  static bool tls_heap_hooked = false;
+  if (!tls_heap_hooked) {
+    mbedtls_platform_set_calloc_free(tls_calloc, tls_free);
+    tls_heap_hooked = true;
+  }
+  // The profile is in mbedtls_config.h: altcp_tls_mbedtls gives no access
+  // to the mbedTLS configuration it wraps
+  return altcp_tls_create_config_client(NULL, 0);
+}
+#endif
+
+void http_client_get_tls_heap(size_t *in_use, size_t *peak) {
+  if (in_use) {
+    *in_use = tlsHeapInUse;
+  }
+  if (peak) {
+    *peak = tlsHeapPeak;
+  }
+}
+
+void http_client_reset_tls_heap_peak(void) { tlsHeapPeak = tlsHeapInUse; }
+
+void http_client_clear_tls_session(void) {
+#if APP_DOWNLOAD_HTTPS == 1 && LWIP_ALTCP
+  if (tlsSessionValid) {
+    mbedtls_ssl_session_free(&tlsSession);
+    tlsSessionValid = false;
+  }
+#endif
+}
+
 static err_t internal_header_fn(httpc_state_t *connection, void *arg,
                                 struct pbuf *hdr, u16_t hdr_len,
                                 u32_t content_len) {
@@ -48,6 +162,9 @@ static err_t internal_recv_fn(void *arg, struct altcp_pcb *conn, struct pbuf *p,
                               err_t err) {
   assert(arg);
   HTTPC_REQUEST_T *req = (HTTPC_REQUEST_T *)arg;
+#if APP_DOWNLOAD_HTTPS == 1 && LWIP_ALTCP
+  tls_session_save(req, conn);
+#endif
   if (req->recv_fn) {
     return req->recv_fn(req->callback_arg, conn, p, err);
   }
@@ -62,6 +179,12 @@ static void internal_result_fn(void *arg, httpc_result_t httpc_result,
              rx_content_len, srv_res, err);
   req->complete = true;
   req->result = httpc_result;
+#if APP_DOWNLOAD_HTTPS == 1 && LWIP_ALTCP
+  // A server that failed may have lost the session too
+  if ((httpc_result != HTTPC_RESULT_OK) && tls_session_matches(req)) {
+    http_client_clear_tls_session();
+  }
+#endif
   if (req->result_fn) {
     req->result_fn(req->callback_arg, httpc_result, rx_content_len, srv_res,
                    err);
@@ -79,6 +202,12 @@ static struct altcp_pcb *altcp_tls_alloc_sni(void *arg, u8_t ip_type) {
     return NULL;
   }
   mbedtls_ssl_set_hostname(altcp_tls_context(pcb), req->hostname);
+  // Offer the session of the last connection to the same server. If the
+  // server does not know it any more, the handshake is a full one
+  if (tls_session_matches(req) &&
+      (mbedtls_ssl_set_session(altcp_tls_context(pcb), &tlsSession) == 0)) {
+    HTTP_DEBUG("Resuming the TLS session with %s\n", req->hostname);
+  }
   return pcb;
 }
 #endif
@@ -105,6 +234,9 @@ int http_client_request_async(async_context_t *context, HTTPC_REQUEST_T *req) {
 #endif
 
   req->complete = false;
+#if APP_DOWNLOAD_HTTPS == 1 && LWIP_ALTCP
+  req->tls_session_saved = false;
+#endif
   req->settings.headers_done_fn = req->headers_fn ? internal_header_fn : NULL;
   req->settings.result_fn = internal_result_fn;
   async_context_acquire_lock_blocking(context);
@@ -112,9 +244,27 @@ int http_client_request_async(async_context_t *context, HTTPC_REQUEST_T *req) {
   DPRINTF("HTTP Async connection to port: %d\n",
           req->port ? req->port : default_port);
   DPRINTF("HTTP Async connection to url: %s\n", req->url);
+  // lwIP builds the request line and the headers itself. A range goes in
+  // its own header line after the url, and the rest of the request line is
+  // left in a dummy header. lwIP copies the request before returning
+  const char *url = req->url;
+  char rangeUrl[HTTPC_RANGE_URL_SIZE];
+  if (req->range_start != 0) {
+    int len = snprintf(rangeUrl, sizeof(rangeUrl),
+                       "%s HTTP/1.1\r\nRange: bytes=%lu-\r\nX-Range:", url,
+                       (unsigned long)req->range_start);
+    if ((len < 0) || ((size_t)len >= sizeof(rangeUrl))) {
+      async_context_release_lock(context);
+      HTTP_ERROR("url too long for a range request\n");
+      return ERR_ARG;
+    }
+    url = rangeUrl;
+    DPRINTF("HTTP Async range from byte: %lu\n",
+            (unsigned long)req->range_start);
+  }
   err_t ret =
       httpc_get_file_dns(req->hostname, req->port ? req->port : default_port,
-                         req->url, &req->settings, internal_recv_fn, req, NULL);
+                         url, &req->settings, internal_recv_fn, req, NULL);
   async_context_release_lock(context);
   if (ret != ERR_OK) {
     HTTP_ERROR("http request failed: %d", ret);
@@ -16,7 +16,8 @@
 #include "lwip/altcp.h"
 #include "lwip/altcp_tls.h"
 // Mbed TLS
-#include "mbedtls/ssl.h"  // Server Name Indication TLS extension
+#include "mbedtls/platform.h"  // Heap of the TLS connections
+#include "mbedtls/ssl.h"       // Server Name Indication TLS extension
 #ifdef MBEDTLS_DEBUG_C
 #include "mbedtls/debug.h"  // Mbed TLS debugging
 #endif                      // MBEDTLS_DEBUG_C
@@ -54,6 +55,12 @@
 
 #define PICOHTTPS_MBEDTLS_DEBUG_LEVEL 4
 
+// Room for the url plus the Range header added to the request line
+#define HTTPC_RANGE_URL_SIZE 320
+
+// Longest host name whose TLS session is kept for the next connection
+#define HTTPC_TLS_SESSION_HOST_SIZE 64
+
 #define PICOHTTPS_CA_ROOT_CERT                     \
   {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, \
    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f}
@@ -93,6 +100,11 @@ typedef struct HTTPC_REQUEST {
    * The port to use. A default port is chosen if this is set to zero
    */
   uint16_t port;
+  /*!
+   * First byte to request with a Range header, zero for the whole file. The
+   * server answers 206 if it honours the range, 200 if it sends all
+   */
+  uint32_t range_start;
 #if LWIP_ALTCP && LWIP_ALTCP_TLS
   /*!
    * TLS configuration, can be null or set to a correctly configured tls
@@ -104,6 +116,10 @@ typedef struct HTTPC_REQUEST {
    * TLS allocator, used internall for setting TLS server name indication
    */
   altcp_allocator_t tls_allocator;
+  /*!
+   * Set once the session of the connection is kept for the next request
+   */
+  bool tls_session_saved;
 #endif
   /*!
    * LwIP HTTP client settings
@@ -153,6 +169,56 @@ int http_client_request_async(struct async_context *context,
 int http_client_request_sync(struct async_context *context,
                              HTTPC_REQUEST_T *req);
 
+/*! \brief Forget the TLS session kept for the next request
+ *  \ingroup pico_http_client
+ *
+ * The session of the last TLS connection is resumed by the next request to
+ * the same host and port, which skips the key exchange of the handshake.
+ * lwIP closes the connection after each response, so the session is what is
+ * reused between requests
+ */
+void http_client_clear_tls_session(void);
+
+#if APP_DOWNLOAD_HTTPS == 1 && LWIP_ALTCP
+/*! \brief Create the TLS configuration of the requests
+ *  \ingroup pico_http_client
+ *
+ * Same as altcp_tls_create_config_client(NULL, 0), with the options of
+ * APP_DOWNLOAD_TLS_PROFILE and the heap counted by
+ * http_client_get_tls_heap. Free it with altcp_tls_free_config
+ *
+ * @return The configuration, or null if there is no memory
+ */
+struct altcp_tls_config *http_client_create_tls_config(void);
+#endif
+
+/*! \brief Get the heap used by the TLS connections
+ *  \ingroup pico_http_client
+ *
+ * Counts the mbedTLS allocations: the record buffers, the handshake and the
+ * certificates. Zero with HTTP downloads
+ *
+ * @param in_use Bytes allocated now, can be null
+ * @param peak Most bytes allocated at once since the last reset, can be null
+ */
+void http_client_get_tls_heap(size_t *in_use, size_t *peak);
+
+/*! \brief Restart the peak of http_client_get_tls_heap at the bytes in use
+ *  \ingroup pico_http_client
+ */
+void http_client_reset_tls_heap_peak(void);
+
+/*! \brief Get the status code of a response
+ *  \ingroup pico_http_client
+ *
+ * Parses the status line at the start of the headers passed to the header
+ * callback
+ *
+ * @param hdr header pbuf(s)
+ * @return the status code, e.g. 200 or 206, or 0 if it can't be parsed
+ */
+u16_t http_client_get_status(struct pbuf *hdr);
+
 /*! \brief A http header callback that can be passed to \em http_client_init or
  * \em http_client_init_secure
  *  \ingroup pico_http_client
@@ -62,11 +62,40 @@ static sd_spi_if_t spi_ifs[] = {{
     .ss_gpio_drive_strength = GPIO_DRIVE_STRENGTH_2MA,
 }};
 
+#if SDCARD_SDIO == 1
+// Hardware Configuration of the SDIO interface. pio0 belongs to the ROM
+// emulator, and DMA_IRQ_1 too, so the DMA interrupt is shared on DMA_IRQ_0
+static sd_sdio_if_t sdio_ifs[] = {{
+    .CMD_gpio = SDCARD_SDIO_CMD_GPIO,
+    .D0_gpio = SDCARD_SDIO_D0_GPIO,
+    .SDIO_PIO = pio1,
+    .DMA_IRQ_num = DMA_IRQ_0,
+    .use_exclusive_DMA_IRQ_handler = false,
+    .baud_rate = SDCARD_SDIO_BAUD_RATE,
+    .set_drive_strength = true,
+    .CLK_gpio_drive_strength = GPIO_DRIVE_STRENGTH_2MA,
+    .CMD_gpio_drive_strength = GPIO_DRIVE_STRENGTH_2MA,
+    .D0_gpio_drive_strength = GPIO_DRIVE_STRENGTH_2MA,
+    .D1_gpio_drive_strength = GPIO_DRIVE_STRENGTH_2MA,
+    .D2_gpio_drive_strength = GPIO_DRIVE_STRENGTH_2MA,
+    .D3_gpio_drive_strength = GPIO_DRIVE_STRENGTH_2MA,
+}};
+#endif
+
+// Constructor of the SPI driver of the SD library, run by sd_init_driver
+void sd_spi_ctor(sd_card_t *sd_card_p);
+bool my_spi_init(spi_t *spi_p);
+
 // Hardware Configuration of the SD Card "objects"
 static sd_card_t sd_cards[] = {  // One for each SD card
     {
+#if SDCARD_SDIO == 1
+        .type = SD_IF_SDIO,
+        .sdio_if_p = &sdio_ifs[0],  // Pointer to the SDIO driving this card
+#else
         .type = SD_IF_SPI,
         .spi_if_p = &spi_ifs[0],  // Pointer to the SPI driving this card
+#endif
         .use_card_detect = false,
         .card_detect_gpio = -1,   // Card detect
         .card_detected_true = -1  // What the GPIO read returns when a card is
@@ -82,6 +111,18 @@ sd_card_t *sd_get_by_num(size_t num) {
     return NULL;
   }
 }
+// The SPI pins are the CLK, CMD and D0 of the SDIO wiring, so the same card
+// can be driven again in SPI mode
+bool sd_fallback_to_spi() {
+  sd_card_t *sd_card_p = &sd_cards[0];
+  if (sd_card_p->type == SD_IF_SPI) {
+    return false;
+  }
+  sd_card_p->type = SD_IF_SPI;
+  sd_card_p->spi_if_p = &spi_ifs[0];
+  sd_spi_ctor(sd_card_p);
+  return my_spi_init(spi_ifs[0].spi);
+}
 size_t spi_get_num() { return count_of(spis); }
 spi_t *spi_get_by_num(size_t num) {
   if (num <= sd_get_num()) {
@@ -15,6 +15,10 @@
 
 #define ACONFIG_PARAM_FOLDER "FOLDER"
 #define ACONFIG_PARAM_MODE "MODE"
+#define ACONFIG_PARAM_PERF_PROFILE "PERF_PROFILE"
+#define ACONFIG_PARAM_SD_CAL_CARD "SD_CAL_CARD"
+#define ACONFIG_PARAM_SD_CAL_BAUD_KB "SD_CAL_BAUD_KB"
+#define ACONFIG_PARAM_WIFI_CACHE "WIFI_CACHE"
 
 #define ACONFIG_SUCCESS 0
 #define ACONFIG_INIT_ERROR -1
@@ -0,0 +1,44 @@
+/**
+ * File: bench.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the on-device micro-benchmarks
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "debug.h"
+
+// Block moved by the memory benchmarks and by each FatFs call
+#define BENCH_BLOCK_SIZE 4096
+// Bytes of the FatFs sequential write and read
+#define BENCH_SD_BYTES (1024 * 1024)
+#define BENCH_SD_FILENAME "bench.tmp"
+
+#define BENCH_MEM_REPEATS 64
+#define BENCH_DISPLAY_REPEATS 16
+#define BENCH_FIND_REPEATS 1000
+#define BENCH_SAVE_REPEATS 3
+// Frames of the parser benchmark. The interrupts are off meanwhile
+#define BENCH_PROTOCOL_FRAMES 2000
+#define BENCH_PROTOCOL_PAYLOAD 8  // Random token and a longword
+
+/**
+ * @brief Run the micro-benchmarks and print the time of each one.
+ *
+ * Prints the cycles per operation and, for the copies, the MB/s. The
+ * groups are mem, display, settings, proto, sd and save. Without a group,
+ * all but sd and save run: those two write the SD card and the flash.
+ * The parser benchmark keeps the interrupts off for a few milliseconds and
+ * restores the parser state of the bus after it.
+ *
+ * @param arg Group to run, or NULL for the default ones.
+ */
+void bench_run(const char *arg);
+
+#endif  // BENCH_H
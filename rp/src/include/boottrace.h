@@ -0,0 +1,77 @@
+/**
+ * File: boottrace.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the boot time checkpoints
+ */
+
+#ifndef BOOTTRACE_H
+#define BOOTTRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "debug.h"
+
+// Maximum number of checkpoints. The ones after the last are dropped
+#ifndef BOOTTRACE_MAX_MARKS
+#define BOOTTRACE_MAX_MARKS 24
+#endif
+
+// Write the boot summary in the shared variables, see term_publishBoot
+#ifndef BOOTTRACE_SHARED_SUMMARY
+#define BOOTTRACE_SHARED_SUMMARY 0
+#endif
+
+// A checkpoint: the stage that ends and the time since the reset
+typedef struct {
+  const char *stage;
+  uint64_t timeUs;
+} BoottraceMark;
+
+/**
+ * @brief Record the end of a boot stage.
+ *
+ * Stores time_us_64 and the name of the stage in a static array. Call only
+ * from core0.
+ *
+ * @param stage Name of the stage. Must be a string literal, only the pointer
+ * is stored.
+ */
+void boottrace_mark(const char *stage);
+
+/**
+ * @brief Get the number of checkpoints recorded.
+ *
+ * @return The number of checkpoints, at most BOOTTRACE_MAX_MARKS.
+ */
+size_t boottrace_getCount(void);
+
+/**
+ * @brief Get a checkpoint.
+ *
+ * @param index Index of the checkpoint, in the order they were recorded.
+ * @return Pointer to the checkpoint, or NULL if the index is out of range.
+ */
+const BoottraceMark *boottrace_get(size_t index);
+
+/**
+ * @brief Get the index of the stage that took the longest.
+ *
+ * The first stage runs from the reset to the first checkpoint.
+ *
+ * @return The index of the checkpoint that ends the stage, or -1 if none.
+ */
+int boottrace_getSlowest(void);
+
+/**
+ * @brief Print the checkpoints with DPRINTF.
+ *
+ * Shows the time of each checkpoint and the duration of its stage, in
+ * milliseconds. Does nothing in release builds.
+ */
+void boottrace_dump(void);
+
+#endif  // BOOTTRACE_H
@@ -16,14 +16,43 @@
 #include "constants.h"
 #include "pico/stdlib.h"
 
+// Set to 1 to record the debug messages in a RAM ring instead of printing
+// them. The UART output is deferred to debug_logDrain, so debug builds keep
+// close to the timing of release builds
+#ifndef DEBUG_DEFERRED
+#define DEBUG_DEFERRED 0
+#endif
+
+#define DEBUG_LOG_ARGS 8        // Arguments of a deferred message
+#define DEBUG_LOG_ENTRIES 128   // Messages in the ring. Power of 2
+#define DEBUG_LOG_DRAIN_MAX 8   // Messages printed by each main loop drain
+
+// NOLINTBEGIN(readability-identifier-naming)
+#define DEBUG_NARGS(...) \
+  DEBUG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DEBUG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+// NOLINTEND(readability-identifier-naming)
+
 /**
  * @brief A macro to print debug
  *
+ * In the deferred mode the format and up to DEBUG_LOG_ARGS arguments are
+ * stored as 32 bit values and formatted later. Only integers, characters
+ * and strings that outlive the drain (literals, constant tables) can be
+ * printed: a buffer passed to %s is read when the message is printed.
+ *
  * @param fmt The format string for the debug message, similar to printf.
  * @param ... Variadic arguments corresponding to the format specifiers in the
  * fmt parameter.
  */
-#if defined(_DEBUG) && (_DEBUG != 0)
+#if defined(_DEBUG) && (_DEBUG != 0) && (DEBUG_DEFERRED != 0)
+#define DPRINTF(fmt, ...)                                  \
+  debug_log(__FILE__, __LINE__, __func__, fmt,             \
+            DEBUG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+#define DPRINTFRAW(fmt, ...) \
+  debug_log(NULL, 0, NULL, fmt, DEBUG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+
+#elif defined(_DEBUG) && (_DEBUG != 0)
 #define DPRINTF(fmt, ...)                                               \
   do {                                                                  \
     const char *file =                                                  \
@@ -43,4 +72,49 @@
 
 typedef void (*IRQInterceptionCallback)();
 
+#if defined(_DEBUG) && (_DEBUG != 0) && (DEBUG_DEFERRED != 0)
+/**
+ * @brief Initialize the deferred debug log.
+ *
+ * Claims the spin lock of the ring. Messages recorded before are dropped.
+ * Call once from main after stdio_init_all.
+ */
+void debug_logInit(void);
+
+/**
+ * @brief Record a debug message in the ring.
+ *
+ * Safe from any core and from interrupts, including the bus IRQ: it only
+ * copies the arguments under a spin lock. A message is dropped and counted
+ * if the ring is full. Use DPRINTF instead.
+ *
+ * @param file Source file, or NULL for a message without the prefix.
+ * @param line Line in the source file.
+ * @param func Function name.
+ * @param fmt Format string. Must be a literal.
+ * @param count Number of arguments, up to DEBUG_LOG_ARGS.
+ * @param ... Arguments, each of 32 bits or less.
+ */
+void debug_log(const char *file, int line, const char *func, const char *fmt,
+               int count, ...);
+
+/**
+ * @brief Print the oldest messages of the ring.
+ *
+ * Call from idle time of the main loop, never from an interrupt.
+ *
+ * @param max Maximum number of messages to print.
+ */
+void debug_logDrain(uint32_t max);
+
+/**
+ * @brief Print all the messages of the ring. Call before a reset.
+ */
+void debug_logFlush(void);
+#else
+static inline void debug_logInit(void) {}
+static inline void debug_logDrain(uint32_t max) { (void)max; }
+static inline void debug_logFlush(void) {}
+#endif
+
 #endif  // DEBUG_H
@@ -48,6 +48,18 @@
 // 0x1000) // increment 4K bytes to create the translation table
 #define DISPLAY_HIGHRES_INVERT \
   0  // If 1, the highres display will be inverted, otherwise it will be normal
+
+// If 1, display_refresh also renders the dirty rows with the pixels doubled,
+// 640x200, at DISPLAY_HIGHRES_OFFSET, once display_setHighres reports the
+// remote computer in high resolution. It then copies each line twice instead of
+// translating each byte with the translation table.
+#define DISPLAY_HIGHRES_EXPANDED 1
+
+// If 1, display_refresh writes the dirty rows in the back bank of two
+// framebuffer banks and then flips the front bank word read by the remote
+// computer, so it never copies a half written frame. Needs the framebuffer in
+// RAM, DISPLAY_BYPASS_FRAMEBUFFER 0.
+#define DISPLAY_DOUBLE_BUFFER 0
 #define DISPLAY_BYPASS_MESSAGE "Press any SHIFT key to boot from GEMDOS."
 #define DISPLAY_TARGET_COMPUTER_NAME "Atari ST"
 #endif
@@ -66,9 +78,48 @@
 // Commands offset. BUFFER_OFFSET + ADDRESS_OFFSET
 #define DISPLAY_COMMAND_ADDRESS_OFFSET 8000
 
+// Dirty rows. A row is a band of DISPLAY_TILE_HEIGHT scanlines, the height of
+// a terminal character
+#define DISPLAY_DIRTY_ROWS (DISPLAY_HEIGHT / DISPLAY_TILE_HEIGHT)
+#define DISPLAY_DIRTY_ROW_BYTES \
+  ((DISPLAY_WIDTH / DISPLAY_TILE_WIDHT) * DISPLAY_TILE_HEIGHT)
+#define DISPLAY_DIRTY_ALL ((uint32_t)((1ull << DISPLAY_DIRTY_ROWS) - 1))
+
+// Change map offset: BUFFER_OFFSET + DIRTY_MAP_OFFSET. One word per row, right
+// after the command longword. The word of a row is incremented every time the
+// row changes, so the remote computer only copies the rows whose word differs
+// from the value seen in its last copy
+#define DISPLAY_DIRTY_MAP_OFFSET (DISPLAY_COMMAND_ADDRESS_OFFSET + 4)
+#define DISPLAY_DIRTY_MAP_SIZE (DISPLAY_DIRTY_ROWS * sizeof(uint16_t))
+
+// Front bank word offset: BUFFER_OFFSET + FRONT_BANK_OFFSET, after the change
+// map. 0 for the bank at DISPLAY_BUFFER_OFFSET, 1 for the one at
+// DISPLAY_BUFFER_BANK1_OFFSET
+#define DISPLAY_FRONT_BANK_OFFSET \
+  (DISPLAY_DIRTY_MAP_OFFSET + DISPLAY_DIRTY_MAP_SIZE)
+
+// Second framebuffer bank, with its own command gap and change map at the same
+// offsets as the first one
+#define DISPLAY_BUFFER_BANK1_OFFSET 0x6000
+#define DISPLAY_BANKS 2
+
+// Time the remote computer can still be copying a bank after it stops being
+// the front one. Two VBLs of a full copy in low resolution
+#define DISPLAY_BANK_GUARD_US 40000
+
 // Highres translate table offset: BUFFER_OFFSET + TRANSTABLE_OFFSET
 #define DISPLAY_HIGHRES_TRANSTABLE_OFFSET 0x1000
 
+// Doubled highres framebuffer offset, between the translation table and the
+// framebuffer
+#define DISPLAY_HIGHRES_OFFSET 0x2000
+#define DISPLAY_HIGHRES_SIZE (DISPLAY_BUFFER_SIZE * 2)
+
+// Second bank of the doubled highres framebuffer, in the free range between
+// the end of the first framebuffer bank, with its change map and front bank
+// word, and the shared memory at 0xF000
+#define DISPLAY_HIGHRES_BANK1_OFFSET 0xA000
+
 // Commands sent to the active loop in the display terminal application
 #define DISPLAY_COMMAND_NOP 0x0       // Do nothing, clean the command buffer
 #define DISPLAY_COMMAND_RESET 0x1     // Reset the computer
@@ -76,6 +127,7 @@
 #define DISPLAY_COMMAND_TERMINAL \
   0x3                              //  Terminal. Not used from RP to Computer.
 #define DISPLAY_COMMAND_START 0x4  // Continue boot process and emulation
+#define DISPLAY_COMMAND_STRESS 0x5  // Run the bus stress test, see stress.h
 
 /**
  * @brief Sends a command to the display.
@@ -114,18 +166,106 @@ void display_setupU8g2();
 /**
  * @brief Refreshes the display.
  *
- * Copies the contents of the u8g2 buffer into the display's memory-mapped
- * buffer using a DMA transfer with 16-bit swapping, ensuring the on-screen
- * content is updated.
+ * Copies the dirty rows of the u8g2 buffer into the display's memory-mapped
+ * buffer using a DMA transfer with 16-bit swapping, and then increments their
+ * words in the change map. Does nothing if no row is dirty.
+ *
+ * With DISPLAY_DOUBLE_BUFFER the rows go to the back bank, together with the
+ * rows of the previous refresh that the bank missed, and then the front bank
+ * word is flipped. Before DISPLAY_BANK_GUARD_US since the last flip it does
+ * not wait: the rows stay dirty and display_retryRefresh publishes them.
  */
 void display_refresh();
 
+/**
+ * @brief Runs the refresh that display_refresh deferred, if any.
+ *
+ * Call it periodically from the main loop. Does nothing if
+ * DISPLAY_DOUBLE_BUFFER is 0.
+ */
+void display_retryRefresh(void);
+
+/**
+ * @brief Marks the rows touched by a range of scanlines as dirty.
+ *
+ * Anything drawing in the u8g2 buffer must mark the area it changes, or the
+ * next display_refresh will not publish it.
+ *
+ * @param y First scanline. Can be negative.
+ * @param height Number of scanlines.
+ */
+void display_markDirty(int y, int height);
+
+/**
+ * @brief Marks the whole display as dirty.
+ */
+void display_markAllDirty(void);
+
+/**
+ * @brief Sets the resolution reported by the remote computer.
+ *
+ * display_refresh only renders the rows with the pixels doubled while the
+ * remote computer is in high resolution. Switching to high resolution marks
+ * the whole display as dirty. Does nothing if DISPLAY_HIGHRES_EXPANDED is 0.
+ *
+ * @param highres True if the remote computer is in high resolution.
+ */
+void display_setHighres(bool highres);
+
+/**
+ * @brief Takes the rows published since the last call.
+ *
+ * The rows that display_refresh copied to the remote computer, for a second
+ * consumer of the framebuffer such as the network viewer.
+ *
+ * @return Bit mask of the rows, bit 0 for the top row.
+ */
+uint32_t display_takePublishedRows(void);
+
+/**
+ * @brief Retrieves the pixels of a row of the framebuffer.
+ *
+ * DISPLAY_DIRTY_ROW_BYTES bytes: DISPLAY_TILE_HEIGHT scanlines of
+ * DISPLAY_WIDTH / 8 bytes, with the leftmost pixel of each byte in bit 0.
+ *
+ * @param row Row on the screen, 0 to DISPLAY_DIRTY_ROWS - 1.
+ * @return The pixels, in the row of the buffer holding it.
+ */
+const unsigned char *display_getRowPixels(int row);
+
+/**
+ * @brief Retrieves the change map address.
+ *
+ * @return The address of the DISPLAY_DIRTY_ROWS words of the change map.
+ */
+uint32_t display_getDirtyMapAddress();
+
+// Text rows cached by display_drawStrip
+typedef enum {
+  DISPLAY_STRIP_PRODUCT = 0,  // Product and version banner
+  DISPLAY_STRIP_COUNT
+} display_strip_t;
+
+/**
+ * @brief Draws a centered line of text with the narrow font in a text row.
+ *
+ * The first time, or when the text changes, the row is cleared, the text is
+ * rendered with u8g2 and the row is kept in a cache. Otherwise the row is
+ * restored from the cache with a single copy, with no font decoding. The
+ * strip owns the whole row.
+ *
+ * @param strip The cache to use.
+ * @param row Text row of DISPLAY_TILE_HEIGHT scanlines, 0 at the top.
+ * @param text Text to show, at most DISPLAY_MAX_CHARACTERS - 1 chars.
+ */
+void display_drawStrip(display_strip_t strip, int row, const char *text);
+
 /**
  * @brief Draws product information on the display.
  *
- * Sets the appropriate font, composes a string with the product message,
- * release version, and copyright information, centers it using calculated left
- * padding, and renders the text.
+ * Composes a string with the product message, release version, and copyright
+ * information and draws it centered in the bottom row with
+ * display_drawStrip, so it is rendered only the first time.
  */
 void display_drawProductInfo();
 
@@ -161,6 +301,34 @@ u8g2_t* display_getU8g2Ref();
  */
 void display_scrollup(uint16_t blankBytes);
 
+/**
+ * @brief Scrolls up the top text rows by one through a ring index.
+ *
+ * Instead of moving the rows, the logical top row is blanked and becomes the
+ * bottom one. Use display_getRingRow to find where a logical row is stored.
+ * The rows are put back in order by display_refresh, so a burst of scrolls
+ * costs a single copy. Rows below the ring are not affected.
+ *
+ * @param rows Number of text rows of the ring, from the top of the display.
+ */
+void display_scrollRing(int rows);
+
+/**
+ * @brief Gets the text row of the u8g2 buffer holding a logical row.
+ *
+ * @param row Logical text row.
+ * @return The text row to draw in. Rows outside the ring are not changed.
+ */
+int display_getRingRow(int row);
+
+/**
+ * @brief Puts the text rows of the ring back in order in the u8g2 buffer.
+ *
+ * Called by display_refresh. Call it before drawing in the u8g2 buffer
+ * without display_getRingRow.
+ */
+void display_unrollRing(void);
+
 /**
  * @brief Retrieves the display buffer address.
  *
@@ -191,4 +359,13 @@ uint32_t display_getCommandAddress();
  */
 uint32_t display_getHighresTranstableAddress();
 
+/**
+ * @brief Retrieves the doubled high-resolution framebuffer address.
+ *
+ * Only updated if DISPLAY_HIGHRES_EXPANDED is 1.
+ *
+ * @return The address of the 640x200 framebuffer with the pixels doubled.
+ */
+uint32_t display_getHighresAddress();
+
 #endif  // DISPLAY_H
@@ -23,14 +23,18 @@
 #define DISPLAY_TERM_CHAR_HEIGHT 8
 #endif
 
+// Glyphs of the pre-decoded terminal font, one byte per line
+#define DISPLAY_TERM_GLYPHS 256
+
 /**
  * @brief Draws a character glyph on the display buffer at the specified grid
  * position.
  *
  * This function calculates the pixel coordinates based on the provided column
  * and row indices, taking into account the character width, height, and a
- * predefined offset for the first row. It then uses the u8g2 graphics library
- * to render the specified character glyph on the display.
+ * predefined offset for the first row. Once display_termClear has decoded the
+ * terminal font, the 8 bytes of the glyph are stored straight into the u8g2
+ * buffer, replacing the whole cell. Before that, u8g2 renders the glyph.
  *
  * @param col The column index where the character should be drawn. The actual
  * x-coordinate is computed as col multiplied by the character width.
@@ -41,6 +45,38 @@
  */
 void display_termChar(uint8_t col, uint8_t row, char chr);
 
+/**
+ * @brief Draws a character glyph in reverse video, white on black.
+ *
+ * Same as display_termChar, with the bits of the glyph inverted. Before
+ * the font is decoded the glyph is drawn as usual.
+ *
+ * @param col The column index where the character should be drawn.
+ * @param row The row index where the character should be drawn.
+ * @param chr The character (glyph) to be displayed.
+ */
+void display_termCharReverse(uint8_t col, uint8_t row, char chr);
+
+/**
+ * @brief Copies the pixels of a text row over another one.
+ *
+ * A single copy of the lines of the row in the u8g2 buffer, for the insert
+ * and delete line sequences of the terminal.
+ *
+ * @param dstRow The row index to overwrite.
+ * @param srcRow The row index to copy.
+ */
+void display_termCopyRow(uint8_t dstRow, uint8_t srcRow);
+
+/**
+ * @brief Clears consecutive cells of a text row.
+ *
+ * @param row The row index of the cells.
+ * @param col The column index of the first cell.
+ * @param count The number of cells, clipped to the end of the row.
+ */
+void display_termClearCells(uint8_t row, uint8_t col, uint8_t count);
+
 /**
  * @brief Draws a solid block at the cursor position.
  *
@@ -82,7 +118,9 @@ void display_termRefresh();
  * @brief Clears the terminal display buffer and sets the font.
  *
  * This function clears the current display buffer and sets the font to
- * 'u8g2_font_amstrad_cpc_extended_8f' for the terminal display.
+ * 'u8g2_font_amstrad_cpc_extended_8f' for the terminal display. The first
+ * time, it also decodes the glyphs of the font into a RAM table for
+ * display_termChar.
  */
 void display_termClear();
 #endif  // DISPLAY_TERM_H
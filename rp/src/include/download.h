@@ -18,6 +18,7 @@
 #include "debug.h"
 #include "ff.h"
 #include "httpc/httpc.h"
+#include "mbedtls/md5.h"
 #include "memfunc.h"
 #include "network.h"
 
@@ -27,6 +28,43 @@
 #define DOWNLOAD_PROTOCOL_SIZE 16
 #define DOWNLOAD_POLLING_INTERVAL_MS 100
 
+// The received data is written to the file in blocks of this size, multiple
+// of the sector size. The data is acknowledged to TCP only once written, so
+// it must be smaller than the receive window
+#ifndef DOWNLOAD_STAGING_SIZE
+#if NETWORK_LWIP_PROFILE == 1
+#define DOWNLOAD_STAGING_SIZE 8192
+#else
+#define DOWNLOAD_STAGING_SIZE 4096
+#endif
+#endif
+
+// Set to 1 to write the file from core1. The receive callback copies the
+// data into a ring of staging buffers and core1 writes the full ones with
+// FatFs, so the network and the SD card work at the same time. TCP gets the
+// acknowledgement as the buffers are released. Core0 must not use FatFs
+// while a download runs
+#ifndef DOWNLOAD_CORE1_WRITER
+#define DOWNLOAD_CORE1_WRITER 0
+#endif
+
+// Staging buffers of the ring. The data in flight is acknowledged only if
+// the free buffers can still take a full TCP_WND
+#ifndef DOWNLOAD_PIPELINE_BUFFERS
+#define DOWNLOAD_PIPELINE_BUFFERS 3
+#endif
+
+// Status codes of the answer to a request with or without a range
+#define DOWNLOAD_HTTP_STATUS_OK 200
+#define DOWNLOAD_HTTP_STATUS_PARTIAL 206
+
+// Room for the spaces and digits of the Content-Length header value
+#define DOWNLOAD_CONTENT_LENGTH_SIZE 24
+
+// Bytes of an MD5 digest and characters of its hex form
+#define DOWNLOAD_MD5_SIZE 16
+#define DOWNLOAD_MD5_HEX_SIZE (DOWNLOAD_MD5_SIZE * 2)
+
 typedef enum {
   DOWNLOAD_STATUS_IDLE,
   DOWNLOAD_STATUS_REQUESTED,
@@ -60,6 +98,30 @@ typedef enum {
   DOWNLOAD_CANNOTDELETECONFIGSECTOR_ERROR
 } download_err_t;
 
+// Period of the instantaneous speed of the download stats
+#define DOWNLOAD_STATS_WINDOW_MS 1000
+
+// Progress and timing of the last download. Times in microseconds
+typedef struct {
+  uint32_t receivedBytes;  // Body bytes received in this request
+  uint32_t totalBytes;     // Content-Length of this request, 0 if unknown
+  uint32_t resumeOffset;   // Bytes already in the file when resumed
+  uint32_t instantKbps;    // Over the last DOWNLOAD_STATS_WINDOW_MS
+  uint32_t averageKbps;    // Since the request started
+  uint32_t startUs;        // time_us_32 when the request started
+  uint32_t elapsedUs;      // Until now, or until the end of the request
+  uint32_t writeUs;        // Spent in f_write, by core1 with the pipeline
+  uint32_t writeCount;     // Number of f_write calls
+  uint32_t networkUs;      // Rest of the time, waiting for the network
+  uint32_t responseUs;     // Until the headers: TCP and TLS handshakes
+  uint32_t tlsHeapPeak;    // Most bytes allocated by mbedTLS, 0 with HTTP
+  bool running;            // The request has not ended yet
+} download_stats_t;
+
+// End of a download_benchmark, with its result and stats
+typedef void (*download_bench_done_fn)(download_err_t err,
+                                       const download_stats_t *stats);
+
 typedef struct {
   char protocol[DOWNLOAD_PROTOCOL_SIZE];
   char host[DOWNLOAD_HOSTNAME_SIZE];
@@ -82,6 +144,20 @@ typedef struct {
  */
 download_err_t download_start(void);
 
+/**
+ * @brief Continues a download that failed, from the bytes already written.
+ *
+ * Opens the temporary file left by the previous attempt, after
+ * download_finish, and requests only the rest of the file with a Range
+ * header. If the server sends the whole file instead, the file is written
+ * again from the start. With no previous data it works as download_start.
+ * Poll and finish it as any other download.
+ *
+ * @return A download_err_t code indicating a successful start or a specific
+ * error.
+ */
+download_err_t download_resume(void);
+
 /**
  * @brief Polls the download process by invoking the asynchronous context
  * routines. Processes incoming data packets and HTTP events. Periodically waits
@@ -93,11 +169,28 @@ download_err_t download_start(void);
  */
 download_poll_t download_poll(void);
 
+/**
+ * @brief Sets the MD5 the next downloads must match.
+ *
+ * The MD5 is computed over the data as it is received, so the check needs no
+ * second read of the file. Only the part kept from a previous attempt is read
+ * again when a download is resumed. The value stays until it is changed.
+ *
+ * @param md5Hex The 32 hex digits of the MD5, as in the md5sum of the build.
+ * NULL or empty to download without a check.
+ * @return DOWNLOAD_OK, or DOWNLOAD_PARSEMD5_ERROR if the value is not valid.
+ * Then no check is done.
+ */
+download_err_t download_setExpectedMd5(const char *md5Hex);
+
 /**
  * @brief Finalizes the download process by closing the temporary file and
  * releasing resources. Performs error handling during file closure and cleans
  * up HTTPS configurations if used.
  *
+ * If an MD5 was set and the data does not match it, the temporary file is
+ * deleted and DOWNLOAD_MD5MISMATCH_ERROR is returned.
+ *
  * @return A download_err_t code indicating success or the specific error
  * encountered.
  */
@@ -111,7 +204,8 @@ download_err_t download_finish(void);
  * operation.
  *
  * @return A download_err_t code indicating a successful rename or an error code
- * if renaming fails.
+ * if renaming fails. DOWNLOAD_MD5MISMATCH_ERROR if an MD5 was set and the last
+ * download did not pass the check.
  */
 download_err_t download_confirm(void);
 
@@ -122,6 +216,43 @@ download_err_t download_confirm(void);
  */
 download_status_t download_getStatus(void);
 
+/**
+ * @brief Start a download of a URL to measure the speed.
+ *
+ * The file goes to the temporary file and is deleted at the end. The URL is
+ * kept apart from download_setFilepath, and the main loop keeps running:
+ * download_pollBenchmark ends the download and calls done. The stats give
+ * the KB/s and the time split between the network and the SD card, to tune
+ * NETWORK_LWIP_PROFILE and DOWNLOAD_STAGING_SIZE, and the time to the
+ * response and the TLS heap peak, to compare the APP_DOWNLOAD_TLS_PROFILE
+ * values. A second run to the same server resumes the TLS session of the
+ * first one.
+ *
+ * @param url The URL to download.
+ * @param done Called with the result and the stats when the download ends.
+ * @return DOWNLOAD_OK if the download started,
+ * DOWNLOAD_CANNOTSTARTDOWNLOAD_ERROR if another one runs, or the error of the
+ * start.
+ */
+download_err_t download_benchmark(const char *url, download_bench_done_fn done);
+
+/**
+ * @brief End the benchmark download once the request completes. Call it
+ * periodically from the main loop, it does not wait for the network.
+ */
+void download_pollBenchmark(void);
+
+/**
+ * @brief Get the progress and timing of the current or the last download.
+ *
+ * The speeds and the network time are computed at the call. The time not
+ * spent in f_write is counted as waiting for the network, which includes
+ * the lwIP and CYW43 processing.
+ *
+ * @param out Destination of the stats.
+ */
+void download_getStats(download_stats_t *out);
+
 /**
  * @brief Updates the status of the download process.
  *
@@ -143,7 +274,8 @@ const char *download_getFilepath(void);
  * @brief Sets the file path for the download process.
  *
  * Copies the supplied path into internal storage ensuring proper
- * null-termination.
+ * null-termination. The host of the URL is resolved in the background, see
+ * network_dnsPrefetch.
  *
  * @param path A null-terminated string containing the new file path.
  */
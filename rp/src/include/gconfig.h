@@ -17,6 +17,8 @@
 #define PARAM_APPS_CATALOG_URL "APPS_CATALOG_URL"
 #define PARAM_BOOT_FEATURE "BOOT_FEATURE"
 #define PARAM_HOSTNAME "HOSTNAME"
+#define PARAM_METRICS_COLLECTOR "METRICS_COLLECTOR"
+#define PARAM_METRICS_INTERVAL "METRICS_INTERVAL"
 #define PARAM_SAFE_CONFIG_REBOOT "SAFE_CONFIG_REBOOT"
 #define PARAM_SD_BAUD_RATE_KB "SD_BAUD_RATE_KB"
 #define PARAM_WIFI_AUTH "WIFI_AUTH"
@@ -0,0 +1,60 @@
+/**
+ * File: handoff.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the warm hand-off block between apps
+ */
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "debug.h"
+
+// The block lives in the HANDOFF_RAM region of the linker script, the last
+// 256 bytes before ROM_IN_RAM. The section is NOLOAD, so it survives the jump
+// to the Booster and the watchdog reboot. The Booster and every microfirmware
+// must reserve the same address and agree on the layout and version
+#define HANDOFF_MAGIC 0x48414E44u  // "HAND"
+#define HANDOFF_VERSION 1
+
+// Link state of the last WiFi connection
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;  // sizeof(HandoffLink) of the writer
+  uint32_t ssidHash;  // FNV-1a of the SSID
+  uint8_t bssid[6];
+  uint16_t channel;
+  uint32_t ip;  // Leased or static address, network byte order
+  uint32_t check;  // FNV-1a of the fields above
+} HandoffLink;
+
+/**
+ * @brief Fill in the header and the check, and store the link state.
+ *
+ * @param link Link state. Only the fields after the header are read.
+ */
+void handoff_saveLink(const HandoffLink *link);
+
+/**
+ * @brief Take the link state left by the previous app, once.
+ *
+ * The block is invalidated, so a failed connection with it does not make
+ * the next app try it again.
+ *
+ * @param link Destination of the copy.
+ * @return true if there was a valid block of this version.
+ */
+bool handoff_takeLink(HandoffLink *link);
+
+/**
+ * @brief Invalidate the block, for example when the link goes down.
+ */
+void handoff_clear(void);
+
+#endif  // HANDOFF_H
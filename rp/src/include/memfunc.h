@@ -11,9 +11,13 @@
 #ifndef MEMFUNC_H
 #define MEMFUNC_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "constants.h"
 #include "debug.h"
 #include "hardware/dma.h"
+#include "hardware/sync.h"
 #include "hardware/structs/xip_ctrl.h"
 
 #define COPY_FIRMWARE_TO_RAM(emulROM, emulROM_length)  \
@@ -34,7 +38,12 @@
     DPRINTF("Emulation firmware copied to RAM.\n");          \
   } while (0)
 
-#define COPY_FIRMWARE_TO_RAM_DMA(emulROM, emulROM_length)                     \
+#define COPY_FIRMWARE_TO_RAM_DMA(emulROM, emulROM_length) \
+  COPY_FLASH_TO_RAM_DMA((void *)&__rom_in_ram_start__, emulROM, emulROM_length)
+
+// Copy 16-bit words from the flash with the XIP stream, bypassing the cache.
+// Falls back to the CPU if no DMA channel is free
+#define COPY_FLASH_TO_RAM_DMA(dest, emulROM, emulROM_length)                  \
   do {                                                                        \
     while (!(xip_ctrl_hw->stat & XIP_STAT_FIFO_EMPTY))                        \
       (void)xip_ctrl_hw->stream_fifo;                                         \
@@ -42,7 +51,7 @@
     if (dma_chan < 0) {                                                       \
       DPRINTF("No DMA channel available for firmware copy. Using memcpy.\n"); \
       size_t __copy_words = (size_t)(emulROM_length);                         \
-      uint16_t *__dst = (uint16_t *)&__rom_in_ram_start__;                    \
+      uint16_t *__dst = (uint16_t *)(dest);                                   \
       const uint16_t *__src = (const uint16_t *)(emulROM);                    \
       for (size_t __i = 0; __i < __copy_words; ++__i) {                       \
         __dst[__i] = __src[__i];                                              \
@@ -56,8 +65,7 @@
     channel_config_set_read_increment(&cfg, false);                           \
     channel_config_set_write_increment(&cfg, true);                           \
     channel_config_set_dreq(&cfg, DREQ_XIP_STREAM);                           \
-    dma_channel_configure(dma_chan, &cfg,                                     \
-                          (void *)&__rom_in_ram_start__, /* Write addr */     \
+    dma_channel_configure(dma_chan, &cfg, (void *)(dest), /* Write addr */    \
                           (const void *)XIP_AUX_BASE,    /* Read addr */      \
                           (emulROM_length) / 2,          /* Transfer count */ \
                           true /* Start immediately! */                       \
@@ -66,27 +74,26 @@
     dma_channel_unclaim((uint)dma_chan);                                      \
   } while (0)
 
-#define CHANGE_ENDIANESS_BLOCK16(dest_ptr_word, size_in_bytes) \
-  do {                                                         \
-    uint16_t *word_ptr = (uint16_t *)(dest_ptr_word);          \
-    for (uint16_t j = 0; j < (size_in_bytes) / 2; ++j) {       \
-      word_ptr[j] = (word_ptr[j] << 8) | (word_ptr[j] >> 8);   \
-    }                                                          \
-  } while (0)
+// The byte swaps are done by the DMA, see memfunc_dmaCopySwap16. Swapping
+// in place is safe: each word is read before it is written. Use it on a ROM
+// image after COPY_FIRMWARE_TO_RAM, the XIP stream moves 32-bit words
+#define CHANGE_ENDIANESS_BLOCK16(dest_ptr_word, size_in_bytes)      \
+  memfunc_dmaCopySwap16((void *)(dest_ptr_word),                    \
+                        (const void *)(dest_ptr_word), (size_in_bytes))
 
-#define COPY_AND_CHANGE_ENDIANESS_BLOCK16(src_ptr_word, dest_ptr_word,    \
-                                          size_in_bytes)                  \
-  do {                                                                    \
-    uint16_t *src_word_ptr = (uint16_t *)(src_ptr_word);                  \
-    uint16_t *dest_word_ptr = (uint16_t *)(dest_ptr_word);                \
-    for (uint16_t j = 0; j < (size_in_bytes) / 2; ++j) {                  \
-      dest_word_ptr[j] = (src_word_ptr[j] << 8) | (src_word_ptr[j] >> 8); \
-    }                                                                     \
-  } while (0)
+#define COPY_AND_CHANGE_ENDIANESS_BLOCK16(src_ptr_word, dest_ptr_word, \
+                                          size_in_bytes)               \
+  memfunc_dmaCopySwap16((void *)(dest_ptr_word),                       \
+                        (const void *)(src_ptr_word), (size_in_bytes))
 
 #define SWAP_WORD(data) \
   ((((uint16_t)data << 8) & 0xFF00) | (((uint16_t)data >> 8) & 0xFF))
 
+// Swap the bytes of the two words of a longword. Compiles to a single REV16
+#define SWAP_WORDS32(data)                         \
+  ((((uint32_t)(data) << 8) & 0xFF00FF00u) |       \
+   (((uint32_t)(data) >> 8) & 0x00FF00FFu))
+
 #define SWAP_LONGWORD(data) \
   ((((uint32_t)data << 16) & 0xFFFF0000) | (((uint32_t)data >> 16) & 0xFFFF))
 
@@ -124,28 +131,135 @@ static inline uint32_t memfunc_readAndSwapLongword(
 #define READ_AND_SWAP_LONGWORD(address, offset) \
   memfunc_readAndSwapLongword((const volatile uint32_t *)((address) + (offset)))
 
-#define COPY_AND_SWAP_16BIT_DMA(dest, source, num_bytes)           \
-  do {                                                             \
-    size_t _rounded_bytes = ((num_bytes) + 1) & ~1;                \
-    size_t _num_words = _rounded_bytes / 2;                        \
-    int _dma_channel = dma_claim_unused_channel(true);             \
-    dma_channel_config _dma_cfg =                                  \
-        dma_channel_get_default_config(_dma_channel);              \
-    channel_config_set_transfer_data_size(&_dma_cfg, DMA_SIZE_16); \
-    channel_config_set_read_increment(&_dma_cfg, true);            \
-    channel_config_set_write_increment(&_dma_cfg, true);           \
-    channel_config_set_bswap(&_dma_cfg, true);                     \
-    dma_channel_configure(                                         \
-        _dma_channel, /* Channel */                                \
-        &_dma_cfg,    /* Channel config */                         \
-        (dest),       /* Destination address */                    \
-        (source),     /* Source address */                         \
-        (_num_words), /* Number of 16-bit words to transfer */     \
-        false         /* Don't start yet */                        \
-    );                                                             \
-    dma_channel_start(_dma_channel);                               \
-    dma_channel_wait_for_finish_blocking(_dma_channel);            \
-    dma_channel_unclaim(_dma_channel);                             \
+#define COPY_AND_SWAP_16BIT_DMA(dest, source, num_bytes)        \
+  memfunc_dmaCopySwap16((void *)(dest), (const void *)(source), \
+                        ((num_bytes) + 1) & ~1)
+
+// Channel pairs claimed once for the asynchronous copies: one channel moves
+// the data and the other loads the blocks of a list into it
+#ifndef MEMFUNC_DMA_SLOTS
+#define MEMFUNC_DMA_SLOTS 2
+#endif
+
+// Returned instead of a job when the copy was done by the CPU
+#define MEMFUNC_DMA_NO_JOB (-1)
+
+// Called in the DMA_IRQ_0 interrupt when a copy ends
+typedef void (*MemfuncDmaCallback)(void *context);
+
+// Block of a scatter/gather list, in the order of the DMA alias 1 registers.
+// A block with count 0 ends the list
+typedef struct {
+  uint32_t ctrl;     // Filled by memfunc_dmaCopyListAsync
+  const void *read;  // Source
+  void *write;       // Destination
+  uint32_t count;    // Bytes, turned into transfers when the list starts
+} MemfuncDmaBlock;
+
+// Smaller blocks are swapped by the CPU, faster than setting up the DMA
+#ifndef MEMFUNC_DMA_MIN_BYTES
+#define MEMFUNC_DMA_MIN_BYTES 64
+#endif
+
+/**
+ * @brief Claim the channels of the DMA copy pool and install its handler.
+ *
+ * Call it once from core0 at boot, before any interrupt uses the copies. It
+ * claims channels and adds a shared DMA_IRQ_0 handler, which are not safe
+ * from the interrupts. Until then the copies are done by the CPU.
+ */
+void memfunc_dmaInit(void);
+
+/**
+ * @brief Copy a block swapping the bytes of each 16-bit word, and wait.
+ *
+ * Uses the byte swap of a DMA channel of the pool. The end is polled on the
+ * channel, not notified by the interrupt, so once memfunc_dmaInit has run it
+ * can be called from any context. Falls back to the CPU for small blocks or
+ * if no channel is free.
+ * dest can be the same as source.
+ *
+ * @param dest Destination address, 16-bit aligned.
+ * @param source Source address, 16-bit aligned.
+ * @param numBytes Bytes to copy, a multiple of 2.
+ */
+void memfunc_dmaCopySwap16(void *dest, const void *source, size_t numBytes);
+
+/**
+ * @brief Start a copy with the DMA and return without waiting for it.
+ *
+ * If no channel of the pool is free, or memfunc_dmaInit has not run, the copy
+ * is done by the CPU before returning, and the callback is called too.
+ *
+ * @param dest Destination address.
+ * @param source Source address.
+ * @param numBytes Bytes to copy. A multiple of 2 if swap16, or of 4 if not.
+ * @param swap16 Swap the bytes of each 16-bit word while copying.
+ * @param callback Function called when the copy ends, or NULL.
+ * @param context Parameter passed to the callback.
+ * @return The job, or MEMFUNC_DMA_NO_JOB if the copy is already done.
+ */
+int memfunc_dmaCopyAsync(void *dest, const void *source, size_t numBytes,
+                         bool swap16, MemfuncDmaCallback callback,
+                         void *context);
+
+/**
+ * @brief Start a scatter/gather list of copies with a single job.
+ *
+ * The blocks are loaded by a second DMA channel, so the CPU is only involved
+ * at the end of the list. The list is modified and must stay untouched until
+ * the job ends. The same rules of memfunc_dmaCopyAsync apply to each block.
+ *
+ * @param blocks The blocks, ended by a block with count 0.
+ * @param swap16 Swap the bytes of each 16-bit word while copying.
+ * @param callback Function called when the last block ends, or NULL.
+ * @param context Parameter passed to the callback.
+ * @return The job, or MEMFUNC_DMA_NO_JOB if the copies are already done.
+ */
+int memfunc_dmaCopyListAsync(MemfuncDmaBlock *blocks, bool swap16,
+                             MemfuncDmaCallback callback, void *context);
+
+/**
+ * @brief Check if a job is still running.
+ *
+ * @param job The job returned by the copy functions.
+ * @return true until the copy ends.
+ */
+bool memfunc_dmaIsBusy(int job);
+
+/**
+ * @brief Wait for the end of a job. DMA_IRQ_0 must not be masked.
+ *
+ * @param job The job returned by the copy functions.
+ */
+void memfunc_dmaWait(int job);
+
+/**
+ * @brief Decompress an LZ4 block, as made by target/atarist/firmware.py.
+ *
+ * Runs from RAM, reading the compressed block through the XIP cache. The
+ * literals and the matches far enough apart are copied by words. Used to
+ * expand the target firmware straight into __rom_in_ram_start__.
+ *
+ * @param dest Destination, at least destSize bytes.
+ * @param source LZ4 block, without the frame header.
+ * @param sourceSize Bytes of the block.
+ * @param destSize Room in the destination.
+ * @return Bytes written, or -1 if the block is corrupted or does not fit.
+ */
+int memfunc_lz4Decompress(void *dest, const void *source, size_t sourceSize,
+                          size_t destSize);
+
+#define COPY_FIRMWARE_LZ4_TO_RAM(emulROM, emulROM_length, emulROM_size)    \
+  do {                                                                     \
+    if (memfunc_lz4Decompress((void *)&__rom_in_ram_start__, (emulROM),    \
+                              (emulROM_length),                            \
+                              ROM_SIZE_BYTES * ROM_BANKS) !=               \
+        (int)(emulROM_size)) {                                             \
+      DPRINTF("Emulation firmware corrupted in the flash.\n");             \
+    } else {                                                               \
+      DPRINTF("Emulation firmware decompressed to RAM.\n");                \
+    }                                                                      \
   } while (0)
 
 /**
@@ -202,6 +316,88 @@ static inline uint32_t memfunc_readAndSwapLongword(
             p_shared_variable_result);                                        \
   } while (0)
 
+// Block of shared variables published with a sequence counter (seqlock). The
+// counter is the first longword and is odd while the block is written. The
+// remote computer reads the counter, the variables and the counter again, and
+// retries if the counter was odd or changed. Each variable is a single 32-bit
+// store in the remote byte order
+#define MEMFUNC_SHARED_BLOCK_SEQ 0   // Offset of the sequence counter
+#define MEMFUNC_SHARED_BLOCK_VARS 4  // Offset of the first variable
+
+/**
+ * @brief Start writing a block of shared variables.
+ *
+ * Makes the sequence counter odd. Calls must not nest: the first
+ * memfunc_sharedBlockEnd would publish the block while the outer writer is
+ * still changing it.
+ *
+ * @param block Address of the block in the shared memory.
+ */
+static inline void memfunc_sharedBlockBegin(uintptr_t block) {
+  uint32_t seq = READ_AND_SWAP_LONGWORD(block, MEMFUNC_SHARED_BLOCK_SEQ);
+  WRITE_AND_SWAP_LONGWORD(block, MEMFUNC_SHARED_BLOCK_SEQ, seq | 1u);
+  // The counter must be odd before any variable changes
+  __dmb();
+}
+
+/**
+ * @brief Set a variable of a block of shared variables.
+ *
+ * Call between memfunc_sharedBlockBegin and memfunc_sharedBlockEnd.
+ *
+ * @param block Address of the block in the shared memory.
+ * @param index Index of the variable.
+ * @param value The value to set.
+ */
+static inline void memfunc_sharedBlockSet(uintptr_t block, uint32_t index,
+                                          uint32_t value) {
+  WRITE_AND_SWAP_LONGWORD(block, MEMFUNC_SHARED_BLOCK_VARS + (index * 4),
+                          value);
+}
+
+/**
+ * @brief Get a variable of a block of shared variables.
+ *
+ * @param block Address of the block in the shared memory.
+ * @param index Index of the variable.
+ * @return The value of the variable.
+ */
+static inline uint32_t memfunc_sharedBlockGet(uintptr_t block, uint32_t index) {
+  return READ_AND_SWAP_LONGWORD(block, MEMFUNC_SHARED_BLOCK_VARS + (index * 4));
+}
+
+/**
+ * @brief Publish the variables written in a block of shared variables.
+ *
+ * Makes the sequence counter even again, with a new value.
+ *
+ * @param block Address of the block in the shared memory.
+ */
+static inline void memfunc_sharedBlockEnd(uintptr_t block) {
+  // All the variables must be written before the counter changes
+  __dmb();
+  uint32_t seq = READ_AND_SWAP_LONGWORD(block, MEMFUNC_SHARED_BLOCK_SEQ);
+  WRITE_AND_SWAP_LONGWORD(block, MEMFUNC_SHARED_BLOCK_SEQ, (seq | 1u) + 1);
+}
+
+/**
+ * @brief Write consecutive variables of a block of shared variables.
+ *
+ * @param block Address of the block in the shared memory.
+ * @param first Index of the first variable.
+ * @param values The values to set.
+ * @param count Number of values.
+ */
+static inline void memfunc_sharedBlockWrite(uintptr_t block, uint32_t first,
+                                            const uint32_t *values,
+                                            size_t count) {
+  memfunc_sharedBlockBegin(block);
+  for (size_t i = 0; i < count; i++) {
+    memfunc_sharedBlockSet(block, first + i, values[i]);
+  }
+  memfunc_sharedBlockEnd(block);
+}
+
 /**
  * @brief Macro to set a private shared variable.
  *
@@ -0,0 +1,57 @@
+/**
+ * File: memwatch.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the stack and RAM usage watermarks
+ */
+
+#ifndef MEMWATCH_H
+#define MEMWATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Word written over the free stack at boot. A word that still holds it was
+// never used
+#define MEMWATCH_PAINT 0x5354414Bu  // "STAK"
+
+// Words below the stack pointer of core0 left unpainted, for the painting
+// routine itself
+#define MEMWATCH_PAINT_MARGIN 16
+
+// Usage of a region. highWater is the most bytes ever used
+typedef struct {
+  uint32_t size;
+  uint32_t used;
+  uint32_t highWater;
+} MemwatchRegion;
+
+typedef struct {
+  MemwatchRegion stack[2];  // Core0 in SCRATCH_Y, core1 in SCRATCH_X
+  MemwatchRegion heap;      // Up to the ROM image. used: allocated now
+  uint32_t staticBytes;     // .data and .bss
+  bool painted;             // memwatch_paintStacks was called
+} MemwatchReport;
+
+/**
+ * @brief Fill the free stack of both cores with MEMWATCH_PAINT.
+ *
+ * The stacks can grow down to the end of the code placed in the scratch
+ * banks, so the whole space is painted and measured. Call from core0 at the
+ * start of main, before core1 is launched.
+ */
+void memwatch_paintStacks(void);
+
+/**
+ * @brief Measure the stacks and the heap.
+ *
+ * The stack high water marks are found scanning up to the first word that
+ * is not the paint, so a frame that skipped words is not seen. The heap
+ * high water mark is the heap grown with sbrk, never given back by newlib.
+ *
+ * @param report Destination of the measures.
+ */
+void memwatch_getReport(MemwatchReport *report);
+
+#endif  // MEMWATCH_H
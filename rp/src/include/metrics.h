@@ -0,0 +1,78 @@
+/**
+ * File: metrics.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the UDP exporter of the device metrics
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "debug.h"
+#include "gconfig.h"
+
+// Build the metrics exporter. It only sends when PARAM_METRICS_COLLECTOR is
+// set in the global settings
+#ifndef METRICS_EXPORT
+#define METRICS_EXPORT 0
+#endif
+
+// Port of the collector when PARAM_METRICS_COLLECTOR has none. The one of
+// the Telegraf socket listener
+#define METRICS_DEFAULT_PORT 8094
+
+// Shortest interval between two datagrams, in seconds
+#define METRICS_MIN_INTERVAL_S 5
+
+// Check of the interval by the main loop
+#define METRICS_POLL_MS 1000
+
+// Measurement name of the line protocol
+#define METRICS_MEASUREMENT "sidecart"
+
+// Room for the datagram, one line
+#define METRICS_LINE_SIZE 512
+
+/**
+ * @brief Start the exporter with the collector of the global settings.
+ *
+ * PARAM_METRICS_COLLECTOR is "host" or "host:port", a name or an address,
+ * and PARAM_METRICS_INTERVAL the seconds between two datagrams. If the
+ * collector is empty or the interval is 0 nothing is started, and
+ * metrics_poll returns at once. Call it when the WiFi connects.
+ *
+ * @return 0 on success, disabled or already started, -1 if lwIP has no
+ * memory.
+ */
+int metrics_init(void);
+
+/**
+ * @brief Send the metrics if the interval has passed.
+ *
+ * Does nothing until metrics_init started the exporter. A collector given by
+ * name is resolved in the background, and the datagrams wait for it. Call
+ * it every METRICS_POLL_MS.
+ */
+void metrics_poll(void);
+
+/**
+ * @brief Write the metrics as a line of the InfluxDB line protocol.
+ *
+ * The fields are the uptime, the boot time, the protocol commands and their
+ * rate since the last line, the drops and checksum errors, the bus IRQ
+ * latency, the heap and stack high water marks, the SD card write speed of
+ * the last download and the WiFi RSSI. A field is left out if this build
+ * does not measure it.
+ *
+ * @param buffer Destination of the text, with no line end.
+ * @param size Size of the buffer.
+ * @return Length of the text, or -1 if it does not fit.
+ */
+int metrics_formatLine(char *buffer, size_t size);
+
+#endif  // METRICS_H
@@ -9,9 +9,12 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
+#include "aconfig.h"
 #include "constants.h"
 #include "debug.h"
 #include "gconfig.h"
+#include "handoff.h"
+#include "pool.h"
 #include "settings.h"
 
 #ifdef BLINK_H
@@ -19,9 +22,11 @@
 #endif
 
 #ifdef CYW43_WL_GPIO_LED_PIN
+#include "lwip/dhcp.h"
 #include "lwip/dns.h"
 #include "lwip/ip4_addr.h"
 #include "lwip/netif.h"
+#include "lwip/stats.h"
 #include "pico/cyw43_arch.h"
 #include "pico/unique_id.h"
 #endif
@@ -45,15 +50,44 @@
 
 #define NETWORK_POLLING_INTERVAL 100  // 100 ms
 #define NETWORK_CONNECT_TIMEOUT 30    // 30 seconds
+#define NETWORK_CONNECT_CHECK_MS 1000  // Period of the background connect
+// Timeout of the connection to the access point of the last boot. Then the
+// next attempt scans all the channels
+#define NETWORK_FAST_CONNECT_TIMEOUT 5  // 5 seconds
+
+// Hosts resolved as soon as the link is up, and the longest name kept
+#define NETWORK_DNS_PREFETCH_HOSTS 4
+#define NETWORK_DNS_HOST_SIZE 64
+
+// Period of the RSSI samples of the telemetry, and the samples kept
+#define NETWORK_TELEMETRY_SAMPLE_MS 5000
+#define NETWORK_TELEMETRY_RSSI_SAMPLES 12
 
 #define NETWORK_POWER_MGMT_DISABLED 0xa11140
 #define NETWORK_POWER_MGMT_MAX_OPTIONS 5
 
+// Power management by activity in STA mode: aggressive while idle, to draw
+// less current and wake the chip less often, and performance during the
+// transfers. It ignores the WIFI_POWER setting in STA mode, even if the
+// setting disables the power management. 0 keeps the mode of WIFI_POWER all
+// the time
+#ifndef NETWORK_POWER_POLICY
+#define NETWORK_POWER_POLICY 0
+#endif
+#define NETWORK_POWER_IDLE_PM CYW43_AGGRESSIVE_PM
+#define NETWORK_POWER_BUSY_PM CYW43_PERFORMANCE_PM
+
 #define NETWORK_MAX_STRING_LENGTH 32
 
 #define NETWORK_MAC_SIZE 6
 
 #define MAX_NETWORKS 100
+// Period of the background scan, and the scans a network can miss before it
+// is removed from the results
+#define NETWORK_SCAN_INTERVAL_MS 30000
+#define NETWORK_SCAN_MAX_AGE 2
+// Scan type of cyw43_wifi_scan_options_t. Passive only listens for beacons
+#define NETWORK_SCAN_TYPE_PASSIVE 1
 #define MAX_SSID_LENGTH \
   36  // SSID can have up to 32 characters + null terminator + padding
 #define MAX_BSSID_LENGTH 20
@@ -69,7 +103,8 @@
 
 // Connection errors as an enumeration
 typedef enum {
-  NETWORK_WIFI_STA_CONN_OK = 0,  // WiFi connected successfully
+  NETWORK_WIFI_STA_CONN_PENDING = 1,  // Connection started, not done yet
+  NETWORK_WIFI_STA_CONN_OK = 0,       // WiFi connected successfully
   NETWORK_WIFI_STA_CONN_ERR_NOT_INITIALIZED = -1,  // WiFi not initialized
   NETWORK_WIFI_STA_CONN_ERR_INVALID_MODE = -2,     // Invalid WiFi mode
   NETWORK_WIFI_STA_CONN_ERR_MAC_FAILED = -3,       // Failed to get MAC address
@@ -119,9 +154,35 @@ typedef struct {
   uint16_t count;  // The number of networks found/stored
 } wifi_scan_data_t;
 
+// Health of the network. The lwIP counters are 0 without NETWORK_TELEMETRY
+typedef struct {
+  int16_t rssi;              // Last sample in dBm, INT16_MIN if none
+  int16_t rssiMin;           // Of the samples kept
+  int16_t rssiMax;           // Of the samples kept
+  int16_t rssiAvg;           // Of the samples kept
+  int16_t rssiTrend;         // Last sample minus the oldest one kept, dB
+  uint16_t rssiSamples;      // Samples kept
+  uint32_t linkDownCount;    // WiFi link losses since the boot
+  uint32_t connectAttempts;  // Connection attempts since the boot
+  uint32_t tcpOutSegs;       // TCP segments sent
+  uint32_t tcpRetransSegs;   // TCP segments sent again
+  uint32_t tcpInErrors;      // TCP segments received with errors
+  uint16_t pbufPoolUsed;     // Pbufs of the pool in use now
+  uint16_t pbufPoolMax;      // Most pbufs of the pool in use at once
+  uint32_t pbufPoolErrors;   // Pbufs not given because the pool was empty
+  uint32_t mempErrors;       // Failures of all the pools, pbuf pool included
+  uint32_t memErrors;        // Failures of the lwIP heap
+  bool lwipStats;            // The lwIP counters are kept in this build
+} network_telemetry_t;
+
 // Function to handle callback when trying to connect
 typedef void (*NetworkPollingCallback)(void);
 
+// Function called when a background connection ends, with the result and the
+// attempt it ended at
+typedef void (*NetworkConnectCallback)(wifi_sta_conn_process_status_t status,
+                                       int attempt);
+
 #ifdef CYW43_WL_GPIO_LED_PIN
 /**
  * @brief Registers a callback for periodic network polling.
@@ -179,6 +240,27 @@ void network_safePoll();
  */
 int network_scan(absolute_time_t* wifi_scan_time, int wifi_scan_interval);
 
+/**
+ * @brief Refresh the scan results in the background.
+ *
+ * Call from the idle slices of the main loop. Starts a passive scan every
+ * NETWORK_SCAN_INTERVAL_MS, never while a connection is being made, and
+ * closes it when the radio is done. The results are merged in the table of
+ * network_getFoundNetworks as they arrive, so the table can be read at any
+ * time and keeps the previous results until they are refreshed.
+ *
+ * @return 0 on success, -1 if the network is not initialized.
+ */
+int network_scanBackground(void);
+
+/**
+ * @brief Time since the last scan was completed.
+ *
+ * @return Age of the scan results in milliseconds, or UINT32_MAX if no scan
+ * has completed yet.
+ */
+uint32_t network_scanAgeMs(void);
+
 /**
  * @brief Indicates whether a WiFi network scan is currently active.
  *
@@ -191,7 +273,8 @@ int network_scanIsActive();
 /**
  * @brief Retrieves information about found WiFi networks.
  *
- * Provides the data structure containing the list of scanned networks.
+ * Provides the data structure containing the list of scanned networks,
+ * sorted by RSSI, strongest first.
  *
  * @return Pointer to a wifi_scan_data_t structure with network details.
  */
@@ -206,6 +289,54 @@ wifi_scan_data_t* network_getFoundNetworks();
  */
 wifi_sta_conn_process_status_t network_wifiStaConnect();
 
+/**
+ * @brief Starts connecting to the WiFi network in station mode.
+ *
+ * Configures the interface and requests the connection without waiting for
+ * it. Call network_wifiStaConnectPoll from the main loop until it is done.
+ * The first connection after the boot goes straight to the BSSID and channel
+ * of the last one, and with DHCP asks for the same address (INIT-REBOOT).
+ * They are taken from the hand-off block of the previous app if it left one
+ * for the same SSID, or from ACONFIG_PARAM_WIFI_CACHE.
+ *
+ * @return NETWORK_WIFI_STA_CONN_PENDING if the connection is in progress, an
+ * error code otherwise.
+ */
+wifi_sta_conn_process_status_t network_wifiStaConnectStart();
+
+/**
+ * @brief Connects to the WiFi network in station mode in the background.
+ *
+ * An async_context worker checks the connection every
+ * NETWORK_CONNECT_CHECK_MS and starts it again after a timeout, up to the
+ * given attempts. The link up event of the interface ends it right away. The
+ * result goes to the callback of network_setConnectCallback. The network
+ * must be polled meanwhile with network_safePoll.
+ *
+ * @param attempts Connections to try before giving up.
+ * @return NETWORK_WIFI_STA_CONN_PENDING if the connection is in progress, an
+ * error code otherwise. Then the callback is not called.
+ */
+wifi_sta_conn_process_status_t network_wifiStaConnectAsync(int attempts);
+
+/**
+ * @brief Sets the function called when a background connection ends.
+ *
+ * @param callback The function, or NULL for none.
+ */
+void network_setConnectCallback(NetworkConnectCallback callback);
+
+/**
+ * @brief Checks the connection started by network_wifiStaConnectStart.
+ *
+ * Never blocks. The network must be polled meanwhile with network_safePoll.
+ *
+ * @return NETWORK_WIFI_STA_CONN_PENDING while connecting,
+ * NETWORK_WIFI_STA_CONN_OK when the link is up with an IP address, or
+ * NETWORK_WIFI_STA_CONN_ERR_TIMEOUT after NETWORK_CONNECT_TIMEOUT seconds.
+ */
+wifi_sta_conn_process_status_t network_wifiStaConnectPoll();
+
 /**
  * @brief Obtains the current WiFi connection status.
  *
@@ -347,6 +478,67 @@ bool network_parsePassword(const char* password, char* outPassword);
 const char* network_WifiStaConnStatusString(
     wifi_sta_conn_process_status_t status);
 
+/**
+ * @brief Tell the network that a transfer starts.
+ *
+ * With NETWORK_POWER_POLICY, the radio switches to NETWORK_POWER_BUSY_PM
+ * until every network_activityBegin has its network_activityEnd. The mode
+ * changes in the next poll, so it can be called from the lwIP callbacks.
+ */
+void network_activityBegin(void);
+
+/**
+ * @brief Tell the network that a transfer has ended.
+ *
+ * Back to NETWORK_POWER_IDLE_PM when no transfer is left.
+ */
+void network_activityEnd(void);
+
+/**
+ * @brief Take a snapshot of the network health.
+ *
+ * The RSSI is sampled every NETWORK_TELEMETRY_SAMPLE_MS while the link is
+ * up. With the RSSI trend next to the TCP retransmissions and the pool
+ * failures, a slow download can be told apart as a radio or a memory issue.
+ *
+ * @param out Destination of the snapshot.
+ */
+void network_getTelemetry(network_telemetry_t* out);
+
+/**
+ * @brief Write the network health snapshot as a JSON object.
+ *
+ * @param buffer Destination of the text.
+ * @param size Size of the buffer.
+ * @return Length of the text, or -1 if it does not fit.
+ */
+int network_formatTelemetryJson(char* buffer, size_t size);
+
+/**
+ * @brief Resolve a host before it is needed.
+ *
+ * The host of the URL, or the host itself, is added to the prefetch list and
+ * resolved now if the link is up, else as soon as it comes up. The answer is
+ * kept in the lwIP DNS table for the TTL given by the server, so the next
+ * dns_gethostbyname of the host, as made by the HTTP client, returns at once
+ * without a round trip. The catalog host of the global settings is always in
+ * the list.
+ *
+ * @param urlOrHost URL like "https://host[:port]/path", or a bare host name.
+ * @return 0 on success, -1 if the host is empty or too long.
+ */
+int network_dnsPrefetch(const char* urlOrHost);
+
+/**
+ * @brief Look up a host in the DNS table without waiting.
+ *
+ * @param host Host name.
+ * @param addr Address of the host, set only if it is known.
+ * @return true if the address is known and still valid. If not, a query is
+ * started and the address is known when it is answered.
+ */
+bool network_dnsLookup(const char* host, ip_addr_t* addr);
+
 #endif
 
 #endif  // NETWORK_H
@@ -0,0 +1,104 @@
+/**
+ * File: perf.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the clock and voltage performance profiles
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "debug.h"
+#include "hardware/vreg.h"
+
+// Profile identifiers. The value is stored in ACONFIG_PARAM_PERF_PROFILE
+typedef enum {
+  PERF_PROFILE_LOW_POWER = 0,
+  PERF_PROFILE_DEFAULT = 1,
+  PERF_PROFILE_TURBO = 2,
+  PERF_PROFILE_COUNT
+} perf_profile_id_t;
+
+// Time to let the regulator settle after a voltage change
+#define PERF_VREG_SETTLE_US 1000
+
+// Maximum deviation of the measured system clock, in KHz
+#define PERF_SELFTEST_CLOCK_TOLERANCE_KHZ 1000
+
+// Words moved by DMA and bytes of flash checked in the boot self-test
+#define PERF_SELFTEST_RAM_WORDS 1024
+#define PERF_SELFTEST_FLASH_BYTES 4096
+#define PERF_SELFTEST_ROUNDS 8
+
+// Period of the XIP and bus fabric counters sampling. The bus counters
+// saturate at 24 bits, so they are read and cleared well before that
+#define PERF_COUNTER_SAMPLE_MS 100
+#define PERF_COUNTER_WINDOW 10  // Samples of a window: 1 second
+
+// Bus fabric counters. RP2040 only, the RP2350 has other events
+#define PERF_BUS_COUNTERS 4
+#define PERF_BUS_XIP 0                 // XIP accesses
+#define PERF_BUS_XIP_CONTESTED 1       // XIP accesses that had to wait
+#define PERF_BUS_SRAM0_CONTESTED 2     // SRAM0 accesses that had to wait
+#define PERF_BUS_FASTPERI_CONTESTED 3  // PIO accesses that had to wait
+
+// XIP cache and bus fabric counts
+typedef struct {
+  uint64_t xipAccesses;  // Reads through the XIP, cached or not
+  uint64_t xipHits;      // Reads served by the XIP cache
+  uint64_t bus[PERF_BUS_COUNTERS];
+  uint32_t saturated;    // Samples with a bus counter at its maximum
+  uint32_t elapsedMs;    // Time covered by the counts
+} PerfCounters;
+
+// A clock and voltage setting and the bus timing that goes with it
+typedef struct {
+  const char *name;
+  uint32_t clockKhz;          // System clock
+  enum vreg_voltage voltage;  // Core voltage
+  float sampleDiv;            // Clock divider of the ROM emulator PIO
+  uint8_t readWaitCycles;     // READ_ADDRESS_SAFE_WAIT_CYCLES, 0 to 3
+  int sdBaudRateKb;           // Maximum SD card SPI clock
+} PerfProfile;
+
+/**
+ * @brief Apply the performance profile selected in the app settings.
+ *
+ * Reads ACONFIG_PARAM_PERF_PROFILE, sets the voltage and the system clock and
+ * runs a self-test: the measured clock, DMA transfers in RAM and the flash
+ * contents read through the XIP are checked. If anything fails the default
+ * profile is restored. Call once after aconfig_init and before init_romemul.
+ *
+ * @return The identifier of the profile in use.
+ */
+perf_profile_id_t perf_init(void);
+
+/**
+ * @brief Get the profile in use.
+ *
+ * Before perf_init it returns the default profile, which matches the clock
+ * set in main.
+ *
+ * @return Pointer to the active profile. Never NULL.
+ */
+const PerfProfile *perf_getProfile(void);
+
+/**
+ * @brief Get the XIP cache and bus fabric counters.
+ *
+ * perf_init starts a repeating timer that reads and clears the hardware
+ * counters every PERF_COUNTER_SAMPLE_MS. The window holds the counts of the
+ * last PERF_COUNTER_WINDOW samples and the total ones since perf_init.
+ *
+ * @param window Counts of the last complete window.
+ * @param total Counts since perf_init.
+ * @return true if the bus fabric counters are available on this chip.
+ */
+bool perf_getCounters(PerfCounters *window, PerfCounters *total);
+
+#endif  // PERF_H
@@ -0,0 +1,91 @@
+/**
+ * File: pool.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the fixed block memory pools
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Block classes, smallest first. Up to 32 blocks each (one bitmap word):
+// strings, settings entries, lwIP pbufs and print buffers, flash pages
+#define POOL_CLASSES 4
+#define POOL_CLASS0_SIZE 64
+#define POOL_CLASS0_BLOCKS 32
+#define POOL_CLASS1_SIZE 256
+#define POOL_CLASS1_BLOCKS 16
+#define POOL_CLASS2_SIZE 2048
+// lwIP keeps up to a TCP_WND of received segments in 2KB blocks, one per
+// TCP_MSS, see lwipopts.h. The other two are for the print buffers
+#if NETWORK_LWIP_PROFILE == 1
+#define POOL_CLASS2_BLOCKS 10
+#else
+#define POOL_CLASS2_BLOCKS 6
+#endif
+#define POOL_CLASS3_SIZE 4096
+#define POOL_CLASS3_BLOCKS 1
+
+// Counters of a block class
+typedef struct {
+  uint32_t blockSize;
+  uint32_t blocks;
+  uint32_t inUse;
+  uint32_t highWater;  // Most blocks in use at once
+  uint32_t misses;     // Requests of this size served by a larger class
+} PoolClassStats;
+
+typedef struct {
+  PoolClassStats classes[POOL_CLASSES];
+  uint32_t heapFallbacks;  // Requests served by malloc, all classes busy
+  uint32_t heapInUse;      // Of them, not freed yet
+} PoolStats;
+
+/**
+ * @brief Allocate a block of the smallest class that fits.
+ *
+ * Tries the larger classes if the class is full, and malloc as the last
+ * resort, counted in heapFallbacks, so a steady state with no fallbacks makes
+ * no heap allocation. Safe from any context but the interrupts of the other
+ * core. Blocks are aligned to 4 bytes.
+ *
+ * @param size Bytes needed.
+ * @return The block, or NULL if there is no memory at all.
+ */
+void *pool_alloc(size_t size);
+
+/**
+ * @brief Allocate a zeroed block for count elements of size bytes.
+ *
+ * @return The block, or NULL on overflow or if there is no memory.
+ */
+void *pool_calloc(size_t count, size_t size);
+
+/**
+ * @brief Return a block to its pool, or to the heap if it came from malloc.
+ *
+ * @param ptr Block of pool_alloc, pool_calloc or pool_strdup. NULL is ignored.
+ */
+void pool_free(void *ptr);
+
+/**
+ * @brief Copy a string into a pool block.
+ *
+ * @param str String to copy.
+ * @return The copy, to release with pool_free, or NULL.
+ */
+char *pool_strdup(const char *str);
+
+/**
+ * @brief Copy the pool counters.
+ *
+ * @param stats Destination of the copy.
+ */
+void pool_getStats(PoolStats *stats);
+
+#endif  // POOL_H
@@ -27,6 +27,9 @@
  * Do not use to reboot the device, because it does not jump to the start of the
  * Flash
  *
+ * The RAM is not cleared, so the Booster finds the WiFi link state of the
+ * hand-off block, see handoff.h.
+ *
  * @note This function should not return. If it does, an error message is
  * printed.
  */
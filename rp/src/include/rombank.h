@@ -0,0 +1,82 @@
+/**
+ * File: rombank.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the bank switched ROM4 images
+ */
+
+#ifndef ROMBANK_H
+#define ROMBANK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "debug.h"
+#include "display.h"
+
+// Command of the remote computer to map a page in ROM4. Sent through ROM3
+// as any other command, so it shares the handler table of the terminal
+#define APP_ROMBANK_SELECT 0x18  // Page number
+
+// Each page maps the start of ROM4, below the first display buffer. The
+// display buffers and the shared memory at TERM_RANDOM_TOKEN_OFFSET stay in
+// place, since the terminal keeps writing them while a page is mapped
+#define ROMBANK_PAGE_SIZE DISPLAY_HIGHRES_TRANSTABLE_OFFSET
+
+// Largest image: 32 pages of 4KB, the 128KB of the ROM_TEMP flash region
+#define ROMBANK_MAX_PAGES 32
+
+// Counters of a page since rombank_init
+typedef struct {
+  uint32_t selects;  // Times mapped in ROM4
+  uint32_t hits;     // ROM4 accesses while mapped
+} RombankPageStats;
+
+/**
+ * @brief Set the image to map in ROM4 one page at a time.
+ *
+ * Registers the APP_ROMBANK_SELECT handler and clears the counters. No page
+ * is mapped until the remote computer selects one, so the terminal firmware
+ * stays in ROM4 until then. The image is a sequence of ROMBANK_PAGE_SIZE pages in the bus byte
+ * order, like the images in the ROM_TEMP region, in the flash or in the RAM.
+ * ROM3 is not changed. Call after init_romemul and term_init.
+ *
+ * @param image First page, aligned to 4 bytes.
+ * @param pages Number of pages, up to ROMBANK_MAX_PAGES.
+ * @return 0 on success, -1 on error.
+ */
+int rombank_init(const void *image, uint32_t pages);
+
+/**
+ * @brief Map a page of the image in ROM4.
+ *
+ * Copies the page over the first ROMBANK_PAGE_SIZE bytes of the ROM4 half of
+ * __rom_in_ram_start__. The rest of ROM4 is not changed. The remote
+ * computer must not read ROM4 until the command is acknowledged, so it runs
+ * the switch from its RAM.
+ *
+ * @param page Page number, below the pages of rombank_init.
+ * @return 0 on success, -1 if there is no image or the page is out of it.
+ */
+int rombank_select(uint32_t page);
+
+/**
+ * @brief Get the page mapped in ROM4.
+ *
+ * @return The page number, or -1 if rombank_init was not called.
+ */
+int rombank_getPage(void);
+
+/**
+ * @brief Get the counters of the pages.
+ *
+ * The hits of the page mapped are updated up to the call.
+ *
+ * @param stats Array of ROMBANK_MAX_PAGES entries to fill.
+ * @return Number of pages of the image, 0 if rombank_init was not called.
+ */
+uint32_t rombank_getStats(RombankPageStats *stats);
+
+#endif  // ROMBANK_H
@@ -21,13 +21,106 @@
 #include "hardware/structs/bus_ctrl.h"
 #include "hardware/vreg.h"
 #include "memfunc.h"
+#include "perf.h"
+#include "pico/multicore.h"
 #include "pico/stdlib.h"
 
 #define ROMEMUL_BUS_BITS 17
 
+// The ROM base is pushed as the bits above ROMEMUL_BUS_BITS, so it must be
+// aligned to 128KB: both banks of ROM_BANKS
+#define ROMEMUL_ROM_BASE_ALIGN (1u << ROMEMUL_BUS_BITS)
+
+// Maximum time waiting for the bus to be idle to switch the ROM base
+#define ROMEMUL_ROM_BASE_SWITCH_TIMEOUT_US 1000
+
+// PIO IRQ flag set by the ROM3 and ROM4 monitors on every access
+#define ROMEMUL_ACCESS_IRQ 2
+
+// Set to 1 to run the ROM emulator DMA IRQ handler (and hence the command
+// parser) on core1. Core1 then only executes from SRAM and its stack lives in
+// the scratch banks, so flash writes, network or SD work on core0 can not add
+// latency to the bus. Core1 is not available for anything else in this mode.
+#ifndef ROMEMUL_BUS_SERVICE_CORE1
+#define ROMEMUL_BUS_SERVICE_CORE1 0
+#endif
+
 // extern int read_addr_rom_dma_channel;
 // extern int lookup_data_rom_dma_channel;
 
+// Set to 1 to capture the ROM3 accesses with a PIO state machine and a DMA
+// channel into a circular buffer instead of raising a DMA IRQ per bus access.
+// The consumer parses the captured words in batches.
+#ifndef ROMEMUL_ROM3_CAPTURE
+#define ROMEMUL_ROM3_CAPTURE 0
+#endif
+
+// Set to 1 to build the bus instrumentation. The DMA IRQ handler is wrapped
+// to measure its start latency and duration, and the FIFO stalls of the
+// romemul_read state machine are counted. Adds a few cycles to every access.
+#ifndef ROMEMUL_BUS_STATS
+#define ROMEMUL_BUS_STATS 0
+#endif
+
+#define ROMEMUL_BUS_STATS_BINS 16  // log2 histogram bins
+
+// Instrumentation of the DMA IRQ handler. The latency is the time in
+// microseconds from the end of the lookup DMA to the handler entry. The
+// duration is measured in system clock cycles with the SysTick.
+typedef struct {
+  uint32_t samples;
+  uint32_t latencyMinUs;
+  uint32_t latencyMaxUs;
+  uint64_t latencySumUs;
+  uint32_t durationMinCycles;
+  uint32_t durationMaxCycles;
+  uint64_t durationSumCycles;
+  uint32_t latencyHistogram[ROMEMUL_BUS_STATS_BINS];   // Bin N: < 2^N us
+  uint32_t durationHistogram[ROMEMUL_BUS_STATS_BINS];  // Bin N: < 2^N cycles
+  uint32_t txStalls;  // romemul_read waited for the data to put in the bus
+  uint32_t rxStalls;  // romemul_read waited to push the address
+} RomemulBusStats;
+
+// Set to 1 to build the ROM bus tracer. A DMA channel chained after the
+// lookup copies every address served into a ring, and romemul_startTrace
+// runs on core1 a loop from RAM that folds the ring into a histogram of 256
+// byte pages. Needs core1, so not with ROMEMUL_BUS_SERVICE_CORE1.
+#ifndef ROMEMUL_TRACE
+#define ROMEMUL_TRACE 0
+#endif
+
+#if (ROMEMUL_TRACE == 1) && (ROMEMUL_BUS_SERVICE_CORE1 == 1)
+#error "ROMEMUL_TRACE needs core1 free, set ROMEMUL_BUS_SERVICE_CORE1 to 0"
+#endif
+
+#define ROMEMUL_TRACE_RING_BITS 12  // 4KB circular buffer, 1024 addresses
+#define ROMEMUL_TRACE_ENTRIES ((1u << ROMEMUL_TRACE_RING_BITS) / 4)
+#define ROMEMUL_TRACE_MASK (ROMEMUL_TRACE_ENTRIES - 1)
+#define ROMEMUL_TRACE_PAGE_BITS 8
+// Pages of ROM4 and ROM3, both banks of the 128KB window
+#define ROMEMUL_TRACE_PAGES (ROMEMUL_ROM_BASE_ALIGN >> ROMEMUL_TRACE_PAGE_BITS)
+// Sampled mode: every period, only up to the last entries are folded
+#define ROMEMUL_TRACE_SAMPLE_US 1000
+#define ROMEMUL_TRACE_SAMPLE_ENTRIES 64
+
+typedef enum {
+  ROMEMUL_TRACE_OFF = 0,
+  ROMEMUL_TRACE_FULL,     // Fold every address. Core1 spins on the ring
+  ROMEMUL_TRACE_SAMPLED,  // Fold a slice of the ring each sample period
+} romemul_trace_mode_t;
+
+typedef struct {
+  romemul_trace_mode_t mode;
+  uint32_t folded;   // Addresses added to the histogram
+  uint32_t skipped;  // Addresses left out by the sampled mode
+  uint32_t passes;   // Loops of the aggregator over the ring
+} RomemulTraceStats;
+
+#define ROMEMUL_ROM3_CAPTURE_RING_BITS 11  // 2KB circular buffer
+#define ROMEMUL_ROM3_CAPTURE_WORDS \
+  ((1u << ROMEMUL_ROM3_CAPTURE_RING_BITS) / sizeof(uint16_t))
+#define ROMEMUL_ROM3_CAPTURE_MASK (ROMEMUL_ROM3_CAPTURE_WORDS - 1)
+
 // Function Prototypes
 int init_romemul(IRQInterceptionCallback requestCallback,
                  IRQInterceptionCallback responseCallback, bool copyFlashToRAM);
@@ -35,6 +128,159 @@ int init_romemul(IRQInterceptionCallback requestCallback,
 void dma_irqHandlerLookup(void);
 void dma_irqHandlerAddress(void);
 void dma_setResponseCB(IRQInterceptionCallback responseCallback);
-int romemul_getLookupDataRomDmaChannel(void);
+int __not_in_flash_func(romemul_getLookupDataRomDmaChannel)(void);
+
+/**
+ * @brief Switch the memory the ROM emulator reads the ROM image from.
+ *
+ * Waits until the read state machine is idle between two bus cycles and
+ * replaces the base in its X register, so the remote computer never reads a
+ * mix of two images. The lower 64KB of the base are ROM4 and the upper 64KB
+ * are ROM3. The terminal shared memory stays at __rom_in_ram_start__. A
+ * base in the flash, as the ROM_TEMP region, is read through the XIP cache:
+ * a miss can be too slow for the bus, so use it only for short periods.
+ * Call after init_romemul.
+ *
+ * @param base Start of the image, aligned to ROMEMUL_ROM_BASE_ALIGN.
+ * @return 0 on success, -1 if not aligned, not initialized or the bus was
+ * never idle for ROMEMUL_ROM_BASE_SWITCH_TIMEOUT_US.
+ */
+int romemul_setRomBase(const void *base);
+
+/**
+ * @brief Get the base of the ROM image in use.
+ *
+ * @return The base set by init_romemul or romemul_setRomBase.
+ */
+const void *romemul_getRomBase(void);
+
+/**
+ * @brief Number of ROM4 accesses of the remote computer.
+ *
+ * The monitor_rom4 state machine counts the accesses in its X register, so
+ * the count costs nothing to the bus service. The value wraps at 2^32; use
+ * the difference of two reads. Call after init_romemul.
+ *
+ * @return The free running count of ROM4 accesses, 0 if not initialized.
+ */
+uint32_t romemul_getRom4AccessCount(void);
+
+/**
+ * @brief Replace the ROM image in RAM without a window of half copied data.
+ *
+ * The image, prepared in the flash (for example in the ROM_TEMP region), is
+ * served directly while it is copied to __rom_in_ram_start__, and then the
+ * base is switched back to the RAM. The copy takes ROM_SIZE_BYTES * ROM_BANKS
+ * bytes and overwrites the terminal shared memory.
+ *
+ * @param image Image in the flash, aligned to ROMEMUL_ROM_BASE_ALIGN.
+ * @return 0 on success, -1 on error.
+ */
+int romemul_loadImage(const void *image);
+
+/**
+ * @brief Copy the bus instrumentation counters.
+ *
+ * The counters are updated by the DMA IRQ handler, maybe on the other core,
+ * so the copy is not atomic. Only available if ROMEMUL_BUS_STATS is 1.
+ *
+ * @param stats Destination of the copy.
+ * @return 0 on success, -1 if the instrumentation is not in this build.
+ */
+int romemul_getBusStats(RomemulBusStats *stats);
+
+/**
+ * @brief Reset the bus instrumentation counters.
+ */
+void romemul_resetBusStats(void);
+
+/**
+ * @brief Start capturing the ROM3 accesses into a circular buffer.
+ *
+ * Loads the capture_rom3 PIO program next to the ROM emulator and chains its
+ * FIFO to a DMA channel writing into a ROMEMUL_ROM3_CAPTURE_WORDS ring. Call
+ * after init_romemul. Each captured word is the low 16 bits of the address,
+ * the same value the DMA IRQ handler obtains from the lookup channel. The
+ * words carry no time: the reader stamps them when it finds them, see
+ * term_pollRom3Capture.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int romemul_initRom3Capture(void);
+
+/**
+ * @brief Total number of words captured since romemul_initRom3Capture.
+ *
+ * The value wraps at 2^32. The word N is stored at
+ * romemul_getRom3CaptureBuffer()[N & ROMEMUL_ROM3_CAPTURE_MASK].
+ *
+ * @return The free running count of captured words.
+ */
+uint32_t __not_in_flash_func(romemul_getRom3CaptureCount)(void);
+
+/**
+ * @brief Get the circular buffer with the captured ROM3 addresses.
+ *
+ * @return Pointer to the ROMEMUL_ROM3_CAPTURE_WORDS ring.
+ */
+const volatile uint16_t *romemul_getRom3CaptureBuffer(void);
+
+/**
+ * @brief Start folding the traced ROM addresses into the page histogram.
+ *
+ * Launches the aggregator on core1. It only runs from RAM, so it does not
+ * need to be locked out while the flash is written. Call after init_romemul.
+ * Starting again switches the mode and keeps the histogram.
+ *
+ * @param mode ROMEMUL_TRACE_FULL or ROMEMUL_TRACE_SAMPLED.
+ * @return 0 on success, -1 if the tracer is not in this build or not ready.
+ */
+int romemul_startTrace(romemul_trace_mode_t mode);
+
+/**
+ * @brief Stop the aggregator and reset core1. The histogram is kept.
+ */
+void romemul_stopTrace(void);
+
+/**
+ * @brief Clear the page histogram and the trace counters.
+ */
+void romemul_resetTrace(void);
+
+/**
+ * @brief Get the page histogram of the tracer.
+ *
+ * Entry N counts the accesses to the 256 bytes at $FA0000 + N * 256, ROM4
+ * then ROM3. Updated by core1 while the trace runs.
+ *
+ * @return Pointer to the ROMEMUL_TRACE_PAGES counters, or NULL if the tracer
+ * is not in this build.
+ */
+const volatile uint32_t *romemul_getTraceHistogram(void);
+
+/**
+ * @brief Copy the counters of the tracer.
+ *
+ * @param stats Destination of the copy.
+ */
+void romemul_getTraceStats(RomemulTraceStats *stats);
+
+/**
+ * @brief Initialize the ROM emulator with the DMA IRQ serviced by core1.
+ *
+ * Same as init_romemul with only a response callback, but the PIO, DMA and
+ * DMA_IRQ_1 setup is done from core1, which then sleeps waiting for
+ * interrupts. Core0 is blocked during the setup, so core1 only runs from flash
+ * while nobody can write to it. The callback and everything it calls must
+ * live in RAM (__not_in_flash_func) because core0 may be erasing or programming
+ * the flash at any time. Results must be handed over to core0 through a
+ * lock-free queue. Blocks until core1 has finished the initialization.
+ *
+ * @param responseCallback The DMA IRQ handler for the lookup data channel.
+ * @param copyFlashToRAM Copy the ROM images from flash before starting.
+ * @return The state machine of the ROM emulator, or -1 on error.
+ */
+int romemul_initOnCore1(IRQInterceptionCallback responseCallback,
+                        bool copyFlashToRAM);
 
 #endif  // ROMEMUL_H
@@ -0,0 +1,58 @@
+/**
+ * File: romtemp.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the ROM image kept in the ROM_TEMP flash
+ */
+
+#ifndef ROMTEMP_H
+#define ROMTEMP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "debug.h"
+#include "hardware/flash.h"
+
+// Size of the ROM_TEMP region of memmap_rp.ld
+#define ROMTEMP_SIZE_BYTES (ROM_SIZE_BYTES * ROM_BANKS)
+
+// Time to lock out the other core before a sector write
+#define ROMTEMP_FLASH_SAFE_TIMEOUT_MS 100
+
+// Sectors checked and written by the last romtemp_update
+typedef struct {
+  uint32_t sectorsChecked;
+  uint32_t sectorsErased;
+  uint32_t sectorsProgrammed;
+  uint32_t timeUs;
+} RomtempUpdateStats;
+
+/**
+ * @brief Get the image kept in the ROM_TEMP flash region.
+ *
+ * @return Start of the region, read through the XIP.
+ */
+const void *romtemp_getImage(void);
+
+/**
+ * @brief Write an image to ROM_TEMP, only the sectors that changed.
+ *
+ * Each FLASH_SECTOR_SIZE sector is compared with the flash and left alone if
+ * it is the same. A changed sector is programmed without the erase when the
+ * new data only clears bits. The writes run with flash_safe_execute, one
+ * sector at a time, and are read back. Not allowed while the ROM emulator
+ * serves its image from ROM_TEMP.
+ *
+ * @param image The image, in RAM.
+ * @param size Bytes of the image, a multiple of FLASH_SECTOR_SIZE up to
+ * ROMTEMP_SIZE_BYTES.
+ * @param stats Output sectors written and time, or NULL.
+ * @return 0 on success, -1 on error.
+ */
+int romtemp_update(const void *image, size_t size, RomtempUpdateStats *stats);
+
+#endif  // ROMTEMP_H
@@ -0,0 +1,130 @@
+/**
+ * File: sched.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the cooperative scheduler of the main loop
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "debug.h"
+#include "pico/stdlib.h"
+
+#ifndef SCHED_MAX_TASKS
+#define SCHED_MAX_TASKS 12
+#endif
+
+// Period of a task that runs every time the main loop wakes up
+#define SCHED_EVERY_PASS 0
+
+typedef enum {
+  SCHED_PRIORITY_BUS = 0,  // Remote commands. Run again between other tasks
+  SCHED_PRIORITY_NORMAL,
+  SCHED_PRIORITY_IDLE,  // Only when no remote command is waiting
+} sched_priority_t;
+
+/**
+ * @brief Body of a task.
+ *
+ * @param context Parameter given to sched_addTask.
+ * @return false to run again in the next pass without waiting for the period,
+ * for example when the task could not do its work yet.
+ */
+typedef bool (*SchedTaskFn)(void *context);
+
+// Returns true when the task must run before its period ends
+typedef bool (*SchedReadyFn)(void);
+
+// Runtime accounting of a task
+typedef struct {
+  const char *name;
+  sched_priority_t priority;
+  uint32_t periodMs;
+  uint32_t budgetUs;
+  uint32_t runs;
+  uint32_t overruns;   // Runs longer than the budget
+  uint32_t lastUs;     // Duration of the last run
+  uint32_t maxUs;      // Longest run
+  uint64_t totalUs;    // Time spent in the task
+  uint32_t maxLateUs;  // Longest delay after the deadline of a periodic task
+} SchedTaskStats;
+
+/**
+ * @brief Register a task. Tasks of the same priority run in deadline order,
+ * then in the order they were added.
+ *
+ * The scheduler is cooperative: a task that runs longer than its budget is
+ * not stopped, only counted in overruns. Long tasks can end early when
+ * sched_shouldYield returns true.
+ *
+ * @param name Name shown in the statistics, a string literal.
+ * @param fn Body of the task.
+ * @param context Parameter passed to the body.
+ * @param periodMs Milliseconds between runs, or SCHED_EVERY_PASS.
+ * @param budgetUs Expected longest run, in microseconds.
+ * @param priority Priority of the task.
+ * @param ready Event trigger that runs the task at once, or NULL.
+ * @return The task number, or -1 if the table is full.
+ */
+int sched_addTask(const char *name, SchedTaskFn fn, void *context,
+                  uint32_t periodMs, uint32_t budgetUs,
+                  sched_priority_t priority, SchedReadyFn ready);
+
+/**
+ * @brief Set the check of pending bus work.
+ *
+ * While it returns true, the idle tasks are skipped and the bus tasks run
+ * again after each task of other priority.
+ *
+ * @param pending The check, or NULL.
+ */
+void sched_setBusPending(SchedReadyFn pending);
+
+/**
+ * @brief Run the due tasks once. Call from the main loop on core0.
+ */
+void sched_run(void);
+
+/**
+ * @brief Milliseconds the main loop can sleep before the next deadline.
+ *
+ * @param maxMs Longest sleep.
+ * @return Time to the earliest periodic deadline, at most maxMs. 0 if a task
+ * asked to run again.
+ */
+uint32_t sched_getWaitMs(uint32_t maxMs);
+
+/**
+ * @brief Ask the running task to return because of its budget or bus work.
+ *
+ * @return true if the budget of the task is spent, or if bus work is
+ * pending and the task is not a bus task.
+ */
+bool sched_shouldYield(void);
+
+/**
+ * @brief Number of registered tasks.
+ */
+int sched_getTaskCount(void);
+
+/**
+ * @brief Copy the accounting of a task.
+ *
+ * @param task Task number, from 0 to sched_getTaskCount() - 1.
+ * @param stats Destination of the copy.
+ * @return 0 on success, -1 if there is no such task.
+ */
+int sched_getTaskStats(int task, SchedTaskStats *stats);
+
+/**
+ * @brief Clear the runtime accounting of all the tasks.
+ */
+void sched_resetStats(void);
+
+#endif  // SCHED_H
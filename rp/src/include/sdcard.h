@@ -9,6 +9,7 @@
 #ifndef SDCARD_H
 #define SDCARD_H
 
+#include "aconfig.h"
 #include "constants.h"
 #include "debug.h"
 #include "gconfig.h"
@@ -21,11 +22,91 @@ typedef enum {
   SDCARD_CREATE_FOLDER_ERROR = -3
 } sdcard_status_t;
 
+typedef enum {
+  SDCARD_ROM_OK = 0,
+  SDCARD_ROM_NOT_MOUNTED = -1,
+  SDCARD_ROM_OPEN_ERROR = -2,
+  SDCARD_ROM_SIZE_ERROR = -3,
+  SDCARD_ROM_READ_ERROR = -4
+} sdcard_rom_status_t;
+
+typedef enum {
+  SDCARD_IMAGE_OK = 0,
+  SDCARD_IMAGE_NOT_MOUNTED = -1,
+  SDCARD_IMAGE_OPEN_ERROR = -2,
+  SDCARD_IMAGE_RANGE_ERROR = -3,
+  SDCARD_IMAGE_IO_ERROR = -4
+} sdcard_image_status_t;
+
 #define SDCARD_KILOBAUD 1000
 
 #define NUM_BYTES_PER_SECTOR 512
 #define SDCARD_MEGABYTE 1048576
 
+// Drive the card in 4-bit SDIO mode from pio1, for the boards wired for it.
+// D1 to D3 follow D0, and the clock is two GPIOs below D0, as the SPI pins
+// of the board: CLK and SCK 2, CMD and MOSI 3, D0 and MISO 4, D1 to D3 5 to 7.
+// If the card does not answer in SDIO mode it falls back to SPI
+#ifndef SDCARD_SDIO
+#define SDCARD_SDIO 0
+#endif
+#define SDCARD_SDIO_CMD_GPIO 3
+#define SDCARD_SDIO_D0_GPIO 4
+// SDIO clock. The SD default speed is up to 25 MHz
+#define SDCARD_SDIO_BAUD_RATE (RP2040_CLOCK_FREQ_KHZ * SDCARD_KILOBAUD / 10)
+
+// Calibrate the SPI clock of each new card after the mount
+#ifndef SDCARD_SPI_CALIBRATION
+#define SDCARD_SPI_CALIBRATION 0
+#endif
+
+// Scratch file of the calibration, in the app folder
+#define SDCARD_CALIBRATION_FILE "sdcal.tmp"
+// Sectors moved in each multi-block transfer of the calibration, and
+// transfers checked at each clock
+#define SDCARD_CALIBRATION_SECTORS 4
+#define SDCARD_CALIBRATION_ROUNDS 8
+// Ceiling when the performance profile does not set one. SD SPI mode limit
+#define SDCARD_CALIBRATION_MAX_KB 25000
+
+// Bytes of each read of the ROM image loader. A multiple of the sector size
+#define SDCARD_ROM_CHUNK_BYTES 16384
+
+// Size of the sector read cache under FatFs, in KB. 0 to disable it. The
+// RP2350 has RAM to spare for it
+#ifndef SDCARD_CACHE_KB
+#if PICO_RP2350
+#define SDCARD_CACHE_KB 64
+#else
+#define SDCARD_CACHE_KB 0
+#endif
+#endif
+
+// Sectors of a cache line, read with one multi-block command. A miss right
+// after the previous line also reads the next lines ahead
+#define SDCARD_CACHE_LINE_SECTORS 4
+#define SDCARD_CACHE_READAHEAD_LINES 1
+#define SDCARD_CACHE_LINES       \
+  ((SDCARD_CACHE_KB * 1024) / \
+   (SDCARD_CACHE_LINE_SECTORS * NUM_BYTES_PER_SECTOR))
+
+// FAT sectors counted by each sdcard_refreshFreeSpace call
+#define SDCARD_FREE_SCAN_SECTORS 16
+
+// Words of the cluster link map of an open image. It holds the image in up to
+// (SDCARD_IMAGE_LINK_WORDS - 2) / 2 fragments; a more fragmented one seeks
+// through the FAT chain
+#ifndef SDCARD_IMAGE_LINK_WORDS
+#define SDCARD_IMAGE_LINK_WORDS 64
+#endif
+
+// Disk image open for random access, see sdcard_openImage
+typedef struct {
+  FIL file;
+  DWORD linkMap[SDCARD_IMAGE_LINK_WORDS];  // Cluster runs of the file
+  bool fastSeek;  // The seeks use linkMap instead of the FAT
+} SdcardImage;
+
 /**
  * @brief Mount filesystem using FatFS library.
  *
@@ -62,6 +143,120 @@ bool sdcard_dirExist(const char *dir);
  */
 sdcard_status_t sdcard_initFilesystem(FATFS *fsPtr, const char *folderName);
 
+/**
+ * @brief Find the highest SPI clock the mounted card works with.
+ *
+ * Steps up through the clocks the SPI divider can make, from the current one
+ * to the limit of the performance profile. At each one the sectors of a
+ * scratch file in the folder are written and read back with multi-block DMA
+ * transfers and compared; a CRC error or a wrong byte ends the search. The
+ * result is stored in the app settings with a key of the card CID, so the
+ * next boots with the same card just apply it. Called by
+ * sdcard_initFilesystem when SDCARD_SPI_CALIBRATION is 1.
+ *
+ * @param folderName Folder of the scratch file. It must exist.
+ * @return The SPI clock in use after the calibration, in kilobits per second.
+ */
+int sdcard_calibrateSpiSpeed(const char *folderName);
+
+/**
+ * @brief Load a ROM image from the SD card into __rom_in_ram_start__.
+ *
+ * The image is read in SDCARD_ROM_CHUNK_BYTES pieces of whole sectors, so
+ * FatFs reads them with multi-block DMA transfers straight into the ROM
+ * memory. The byte swap of each piece runs by DMA while the next one is
+ * read. An image of ROM_SIZE_BYTES fills ROM4 only; one of ROM_SIZE_BYTES *
+ * ROM_BANKS fills ROM4 and ROM3, including the terminal shared memory. The
+ * remote computer must not read the cartridge during the load.
+ *
+ * @param folderName Folder of the image, usually ACONFIG_PARAM_FOLDER.
+ * @param fileName Name of the image in the folder.
+ * @param swapBytes Swap the bytes of each 16-bit word, for raw images.
+ * @param loadUs Output time of the load in microseconds, or NULL.
+ * @return sdcard_rom_status_t Status code indicating the load result.
+ */
+sdcard_rom_status_t sdcard_loadRomImage(const char *folderName,
+                                        const char *fileName, bool swapBytes,
+                                        uint32_t *loadUs);
+
+/**
+ * @brief Open a disk image for random access.
+ *
+ * Builds the cluster link map of the file (FatFs fast seek), so every seek
+ * is found in the map instead of following the FAT chain from the start of
+ * the file. If the image has more fragments than SDCARD_IMAGE_LINK_WORDS can
+ * hold, or FF_USE_FASTSEEK is 0, it still opens and seeks the slow way. An
+ * image with the map can not grow: writes past its size fail.
+ *
+ * @param image Image to open. Keep it until sdcard_closeImage.
+ * @param folderName Folder of the image, usually ACONFIG_PARAM_FOLDER.
+ * @param fileName Name of the image in the folder.
+ * @param writable Open it for reading and writing instead of reading only.
+ * @return sdcard_image_status_t Status code indicating the open result.
+ */
+sdcard_image_status_t sdcard_openImage(SdcardImage *image,
+                                       const char *folderName,
+                                       const char *fileName, bool writable);
+
+/**
+ * @brief Read bytes of an open image at an offset.
+ *
+ * Reads of whole sectors aligned to the sector size go to the card in one
+ * multi-block transfer, or through the sector read cache when shorter than a
+ * cache line.
+ *
+ * @param image Image of sdcard_openImage.
+ * @param offset Offset in the image, in bytes.
+ * @param buffer Destination of the bytes.
+ * @param length Bytes to read. All of them must be inside the image.
+ * @return sdcard_image_status_t Status code indicating the read result.
+ */
+sdcard_image_status_t sdcard_readImage(SdcardImage *image, FSIZE_t offset,
+                                       void *buffer, UINT length);
+
+/**
+ * @brief Write bytes of an open image at an offset.
+ *
+ * @param image Image of sdcard_openImage, open as writable.
+ * @param offset Offset in the image, in bytes.
+ * @param buffer Source of the bytes.
+ * @param length Bytes to write. All of them must be inside the image.
+ * @return sdcard_image_status_t Status code indicating the write result.
+ */
+sdcard_image_status_t sdcard_writeImage(SdcardImage *image, FSIZE_t offset,
+                                        const void *buffer, UINT length);
+
+/**
+ * @brief Get the size of an open image.
+ *
+ * @param image Image of sdcard_openImage.
+ * @return Size of the image in bytes.
+ */
+FSIZE_t sdcard_getImageSize(const SdcardImage *image);
+
+/**
+ * @brief Close an open image, writing its pending data.
+ *
+ * @param image Image of sdcard_openImage.
+ */
+void sdcard_closeImage(SdcardImage *image);
+
+/**
+ * @brief Drop all the sectors of the read cache.
+ *
+ * The cache sits under FatFs and follows its writes. Call it after writing
+ * the card without FatFs or after changing the card.
+ */
+void sdcard_cacheInvalidate(void);
+
+/**
+ * @brief Get the counters of the read cache.
+ *
+ * @param hits Output sectors served from the cache.
+ * @param misses Output sectors read from the card.
+ */
+void sdcard_getCacheStats(uint32_t *hits, uint32_t *misses);
+
 /**
  * @brief Adjust the SPI communication speed.
  *
@@ -110,6 +305,40 @@ bool sdcard_isMounted(void);
  */
 bool sdcard_getMountedInfo(uint32_t *totalSizeMb, uint32_t *freeSpaceMb);
 
+/**
+ * @brief Retrieves total and free SD card space without accessing the card.
+ *
+ * Uses the free clusters count that FatFs keeps up to date in every write once
+ * it is known, so it never scans the FAT. It is not known until the first
+ * sdcard_getMountedInfo or sdcard_refreshFreeSpace after the mount, unless
+ * the FSInfo sector of the volume has it.
+ *
+ * @param totalSizeMb Output total size in MB.
+ * @param freeSpaceMb Output free space in MB.
+ * @return true on success, false if not mounted or not known yet.
+ */
+bool sdcard_getCachedInfo(uint32_t *totalSizeMb, uint32_t *freeSpaceMb);
+
+/**
+ * @brief Counts the free clusters of the mounted volume if not known yet.
+ *
+ * A FAT16 or FAT32 table is read SDCARD_FREE_SCAN_SECTORS sectors per call, so
+ * a large card never blocks the caller for long. The small FAT12 tables and
+ * the exFAT bitmap are counted by FatFs in one call. The count starts again
+ * if FatFs allocates a cluster meanwhile. It does nothing once the count is
+ * known or after an error.
+ *
+ * @return true while the count is not finished, to call it again soon.
+ */
+bool sdcard_refreshFreeSpace(void);
+
+/**
+ * @brief Tells if the free clusters count of the mounted volume failed.
+ *
+ * @return true after a read error of the count, until the next mount.
+ */
+bool sdcard_hasFreeSpaceError(void);
+
 // Hardware Configuration of SPI "objects"
 
 // NOLINTBEGIN(readability-identifier-naming)
@@ -117,6 +346,8 @@ size_t sd_get_num();
 sd_card_t *sd_get_by_num(size_t num);
 size_t spi_get_num();
 spi_t *spi_get_by_num(size_t num);
+// Drive the card with SPI after the SDIO mode failed. False if it already is
+bool sd_fallback_to_spi(void);
 // NOLINTEND(readability-identifier-naming)
 
 #endif  // SDCARD_H
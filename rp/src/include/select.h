@@ -11,11 +11,12 @@
 
 #include "constants.h"
 #include "debug.h"
-#include "pico/multicore.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
 #include "pico/stdlib.h"
+#include "pico/time.h"
 
-#define SELECT_LOOP_DELAY 10  // 10 ms
-
+// Time the pin must keep its level after the last edge to be accepted
 #define SELECT_DEBOUNCE_DELAY 20  // 20 ms
 
 #define SELECT_LONG_RESET 10000  // 10 seconds
@@ -23,19 +24,29 @@
 // Define a callback typdef for the reset function
 typedef void (*reset_callback_t)(void);
 
+// Presses reported when the button is released
+typedef enum {
+  SELECT_EVENT_NONE = 0,
+  SELECT_EVENT_SHORT,  // Released before SELECT_LONG_RESET
+  SELECT_EVENT_LONG,   // Held for SELECT_LONG_RESET or more
+} select_event_t;
+
 /**
  * @brief Initializes the SELECT detection.
  *
  * Configures the hardware and software parameters needed for detecting
- * the SELECT button press. Always call first.
+ * the SELECT button press. Each edge of the pin starts a debounce alarm in
+ * the default alarm pool, and the level left when it fires is the state of
+ * the button. Nothing polls the pin. Always call first.
  */
 void select_configure();
 
 /**
  * @brief Waits for button release.
  *
- * Blocks execution until the SELECT button is released. Ensures the user’s
- * push is fully handled.
+ * If the SELECT button is pressed, sleeps with __wfe until it is released
+ * and calls the short or long press callback. Returns at once if it is not
+ * pressed.
  */
 void select_waitPush();
 
@@ -44,16 +55,28 @@ void select_waitPush();
  *
  * Checks whether the SELECT button has been pressed.
  *
- * Verifies the button state and returns true if a push is detected.
+ * Reads the pin without debounce and returns true if a push is detected.
  */
 bool select_detectPush();
 
 /**
- * @brief Waits for push in secondary core.
+ * @brief Get the last press of the button.
+ *
+ * A press is reported once, when the button is released. Safe to call from
+ * the main loop of any core.
+ *
+ * @return The press not read yet, or SELECT_EVENT_NONE.
+ */
+select_event_t select_getEvent(void);
+
+/**
+ * @brief Waits for push in the background.
  *
- * Launches an asynchronous wait for a SELECT button push on the secondary core.
- * Accepts two callbacks: one for short press reset and one for long press
- * reset.
+ * Calls a callback on every press from the debounce alarm, so no core is
+ * parked waiting. The name is kept from when this launched core1. The
+ * callbacks run in the timer IRQ and must not block: resetting the device is
+ * fine. Accepts two callbacks: one for short press reset and one for long
+ * press reset.
  *
  * @param reset Callback to be invoked on a short button press.
  * @param resetLong Callback to be invoked on a long button press.
@@ -63,9 +86,7 @@ void select_coreWaitPush(reset_callback_t reset, reset_callback_t resetLong);
 /**
  * @brief Disables secondary core wait.
  *
- * Disables waiting for the SELECT button push on the secondary core.
- *
- * Useful to cancel or adjust the handling in multicore scenarios.
+ * Stops calling the callbacks from the debounce alarm.
  */
 void select_coreWaitPushDisable();
 
@@ -73,8 +94,10 @@ void select_coreWaitPushDisable();
  * @brief Monitors for reset trigger.
  *
  * Monitors for a SELECT button push intended to trigger a device reset.
+ * Calls the reset callback once per press, as soon as the press is stable.
  *
- * Frequently called to check for reset conditions during operation.
+ * Frequently called to check for reset conditions during operation. It
+ * never blocks.
  */
 void select_checkPushReset();
 
@@ -0,0 +1,87 @@
+/**
+ * File: stress.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the bus stress test
+ */
+
+#ifndef STRESS_H
+#define STRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "debug.h"
+
+// Commands sent by stress_commands in main.s. Same values there
+#define APP_STRESS_SYNC 0x10   // Sequence, complement, timeouts, max ticks
+#define APP_STRESS_WRITE 0x11  // Sequence, complement, 0 and the pattern
+#define APP_STRESS_STOP 0x12   // A key was pressed in the remote computer
+
+// Bytes of the pattern of an APP_STRESS_WRITE command: the words
+// sequence + index. Must match STRESS_WRITE_SIZE of main.s
+#define STRESS_WRITE_SIZE 256
+
+// Payload of the commands: random token, d3, d4, d5 and d6 or the pattern
+#define STRESS_SYNC_PAYLOAD_SIZE 20
+#define STRESS_WRITE_PAYLOAD_SIZE (16 + STRESS_WRITE_SIZE)
+
+// A sequence number further than this from the expected one is counted as
+// an order error, not as commands lost
+#define STRESS_MAX_SEQUENCE_GAP 1024
+
+// Refresh period of the results on the screen
+#define STRESS_REFRESH_MS 500
+
+// Results of the test since stress_start
+typedef struct {
+  uint32_t syncCommands;    // APP_STRESS_SYNC commands received
+  uint32_t writeCommands;   // APP_STRESS_WRITE commands received
+  uint32_t missing;         // Sequence numbers never received
+  uint32_t repeated;        // Retries of a command already received
+  uint32_t orderErrors;     // Sequence numbers out of order
+  uint32_t patternErrors;   // Good checksum but wrong content or size
+  uint32_t checksumErrors;  // Commands with a bad checksum
+  uint32_t drops;           // Commands lost because the ring was full
+  uint32_t highWater;       // Most ring slots in use at once
+  uint32_t timeouts;        // Sync commands timed out in the remote computer
+  uint32_t maxTicks;        // Slowest round trip in 200 Hz ticks
+  uint32_t elapsedMs;       // Time since stress_start
+} StressStats;
+
+/**
+ * @brief Start the bus stress test.
+ *
+ * Registers the APP_STRESS_* protocol handlers, clears the results and sends
+ * DISPLAY_COMMAND_STRESS, so the remote computer sends sync and write
+ * commands as fast as it can. The handlers check the sequence numbers and
+ * the patterns; the checksum errors and the ring drops come from
+ * term_getProtocolStats. A key pressed in the remote computer stops the
+ * test. Call after term_init.
+ */
+void stress_start(void);
+
+/**
+ * @brief Check if the stress test is running.
+ *
+ * @return true from stress_start until a key stops the test.
+ */
+bool stress_isActive(void);
+
+/**
+ * @brief Show the results on the terminal if they are due.
+ *
+ * Call from the main loop. Draws the results every STRESS_REFRESH_MS while
+ * the test runs.
+ */
+void stress_refresh(void);
+
+/**
+ * @brief Get the results of the test.
+ *
+ * @param stats Filled with the results since the last stress_start.
+ */
+void stress_getStats(StressStats *stats);
+
+#endif  // STRESS_H
@@ -1,48 +1,125 @@
-const uint16_t target_firmware[] = {
-    0xABCD, 0xEF42, 0x0000, 0x0000, 0x08FA, 0x001E, 0x0000, 0x0000, 0x9912, 0x5C59, 0x0000, 0x0552, 0x5445, 0x524D, 0x0000, 0x3F3C,
-    0x0002, 0x4E4E, 0x548F, 0x2440, 0x45EA, 0xF000, 0x264A, 0x2C3C, 0x0000, 0x052A, 0x43F9, 0x00FA, 0x0046, 0xE44E, 0x5346, 0x24D9,
-    0x51CE, 0xFFFC, 0x4ED3, 0x2C40, 0x0038, 0x0008, 0x0484, 0x3F3C, 0x0004, 0x4E4E, 0x548F, 0xB07C, 0x0002, 0x6700, 0x0114, 0x3F3C,
-    0x0025, 0x4E4E, 0x548F, 0x204E, 0x227C, 0x00FA, 0x8000, 0x203C, 0x0000, 0x0F9F, 0x3219, 0xE159, 0x3401, 0x4842, 0x3401, 0x20C2,
-    0x20C2, 0x51C8, 0xFFF0, 0x2C39, 0x00FA, 0x9F40, 0xBCBC, 0x0000, 0x0003, 0x6664, 0x3F3C, 0x000B, 0x4E41, 0x548F, 0x4A80, 0x6700,
-    0x0054, 0x3F3C, 0x0008, 0x4E41, 0x548F, 0xB03C, 0x001B, 0x6700, 0x0026, 0x2600, 0x3E3C, 0x0003, 0x48E7, 0x7F00, 0x7204, 0x303C,
-    0x0001, 0x6100, 0x02BA, 0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0x0020, 0x3E3C, 0x0003, 0x48E7, 0x7F00, 0x7200,
-    0x303C, 0x0000, 0x6100, 0x0298, 0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0x0076, 0xBCBC, 0x0000, 0x0001, 0x6700,
-    0x01B2, 0xBCBC, 0x0000, 0x0002, 0x6700, 0x01C6, 0x3F3C, 0x000B, 0x4E41, 0x548F, 0x4A80, 0x6700, 0x0054, 0x3F3C, 0x0008, 0x4E41,
-    0x548F, 0xB03C, 0x001B, 0x6700, 0x0026, 0x2600, 0x3E3C, 0x0003, 0x48E7, 0x7F00, 0x7204, 0x303C, 0x0001, 0x6100, 0x0242, 0x4CDF,
-    0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0x0020, 0x3E3C, 0x0003, 0x48E7, 0x7F00, 0x7200, 0x303C, 0x0000, 0x6100, 0x0220,
-    0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0xFEF0, 0x3F3C, 0x0025, 0x4E4E, 0x548F, 0x224E, 0x244E, 0x45EA, 0x0050,
-    0x207C, 0x00FA, 0x8000, 0x267C, 0x00FA, 0x1000, 0x203C, 0x0000, 0x00C7, 0x223C, 0x0000, 0x0013, 0x3418, 0xE15A, 0x3602, 0xC67C,
-    0xFF00, 0xEE4B, 0x3833, 0x3000, 0x4844, 0xC47C, 0x00FF, 0xD442, 0x3833, 0x2000, 0x22C4, 0x24C4, 0x51C9, 0xFFDE, 0x43E9, 0x0050,
-    0x45EA, 0x0050, 0x51C8, 0xFFCC, 0x2C39, 0x00FA, 0x9F40, 0xBCBC, 0x0000, 0x0003, 0x6664, 0x3F3C, 0x000B, 0x4E41, 0x548F, 0x4A80,
-    0x6700, 0x0054, 0x3F3C, 0x0008, 0x4E41, 0x548F, 0xB03C, 0x001B, 0x6700, 0x0026, 0x2600, 0x3E3C, 0x0003, 0x48E7, 0x7F00, 0x7204,
-    0x303C, 0x0001, 0x6100, 0x0178, 0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0x0020, 0x3E3C, 0x0003, 0x48E7, 0x7F00,
-    0x7200, 0x303C, 0x0000, 0x6100, 0x0156, 0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0x0076, 0xBCBC, 0x0000, 0x0001,
-    0x6700, 0x0070, 0xBCBC, 0x0000, 0x0002, 0x6700, 0x0084, 0x3F3C, 0x000B, 0x4E41, 0x548F, 0x4A80, 0x6700, 0x0054, 0x3F3C, 0x0008,
-    0x4E41, 0x548F, 0xB03C, 0x001B, 0x6700, 0x0026, 0x2600, 0x3E3C, 0x0003, 0x48E7, 0x7F00, 0x7204, 0x303C, 0x0001, 0x6100, 0x0100,
-    0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0x0020, 0x3E3C, 0x0003, 0x48E7, 0x7F00, 0x7200, 0x303C, 0x0000, 0x6100,
-    0x00DE, 0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x6000, 0xFEC0, 0x2C3C, 0x000F, 0xFFFF, 0x5386, 0x66FC, 0x42B8, 0x0420,
-    0x42B8, 0x043A, 0x42B8, 0x051A, 0x2078, 0x0004, 0x4ED0, 0x4E71, 0x4E75, 0x2038, 0x05A0, 0x6700, 0x001A, 0x2040, 0x2018, 0x6700,
-    0x0012, 0xB0BC, 0x5F4D, 0x4348, 0x6704, 0x5848, 0x60EE, 0x2818, 0x6002, 0x4284, 0x2F04, 0x263C, 0x0000, 0x0000, 0x3E3C, 0x0003,
-    0x48E7, 0x7F00, 0x7208, 0x303C, 0x0001, 0x6100, 0x0072, 0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x4A40, 0x6604, 0x201F,
-    0x4E75, 0x281F, 0x60CE, 0x3F3C, 0x0030, 0x4E41, 0x548F, 0xC0BC, 0x0000, 0xFFFF, 0x0C78, 0x00FC, 0x0004, 0x6608, 0x3239, 0x00FC,
-    0x0002, 0x6006, 0x3239, 0x00E0, 0x0002, 0xC2BC, 0x0000, 0xFFFF, 0x4841, 0x8081, 0x263C, 0x0000, 0x0001, 0x2800, 0x3E3C, 0x0003,
-    0x48E7, 0x7F00, 0x7208, 0x303C, 0x0001, 0x6100, 0x0012, 0x4CDF, 0x00FE, 0x4A40, 0x6704, 0x51CF, 0xFFE8, 0x4A40, 0x4E75, 0x2439,
-    0x00FA, 0xF004, 0x5841, 0x43F9, 0x00FA, 0xF000, 0x207C, 0x00FB, 0x0000, 0xD1FC, 0x0000, 0x8000, 0x3E3C, 0xABCD, 0x4A30, 0x7000,
-    0x4287, 0xDE40, 0x4A30, 0x0000, 0xDE41, 0x4A30, 0x1000, 0x4A41, 0x6700, 0x0088, 0xDE42, 0x4A30, 0x2000, 0xB27C, 0x0002, 0x6700,
-    0x007A, 0x4842, 0xDE42, 0x4A30, 0x2000, 0xB27C, 0x0004, 0x6700, 0x006A, 0xDE43, 0x4A30, 0x3000, 0xB27C, 0x0006, 0x6700, 0x005C,
-    0x4843, 0xDE43, 0x4A30, 0x3000, 0xB27C, 0x0008, 0x6700, 0x004C, 0xDE44, 0x4A30, 0x4000, 0xB27C, 0x000A, 0x6700, 0x003E, 0x4844,
-    0xDE44, 0x4A30, 0x4000, 0xB27C, 0x000C, 0x672E, 0xDE45, 0x4A30, 0x5000, 0xB27C, 0x000E, 0x6722, 0x4845, 0xDE45, 0x4A30, 0x5000,
-    0xB27C, 0x0010, 0x6714, 0xDE46, 0x4A30, 0x6000, 0xB27C, 0x0012, 0x6708, 0x4846, 0xDE46, 0x4A30, 0x6000, 0x4A30, 0x7000, 0x4842,
-    0x2E3C, 0x0000, 0xFFFF, 0x7000, 0xB491, 0x6706, 0x5387, 0x66F8, 0x5380, 0x4E75, 0x2439, 0x00FA, 0xF004, 0xCCBC, 0x0000, 0xFFFF,
-    0x7210, 0xD286, 0x5281, 0xE289, 0xE389, 0x43F9, 0x00FA, 0xF000, 0x207C, 0x00FB, 0x0000, 0xD1FC, 0x0000, 0x8000, 0x3E3C, 0xABCD,
-    0x4A30, 0x7000, 0x4287, 0xDE40, 0x4A30, 0x0000, 0xDE41, 0x4A30, 0x1000, 0xDE42, 0x4A30, 0x2000, 0x4842, 0xDE42, 0x4A30, 0x2000,
-    0xDE43, 0x4A30, 0x3000, 0x4843, 0xDE43, 0x4A30, 0x3000, 0xDE44, 0x4A30, 0x4000, 0x4844, 0xDE44, 0x4A30, 0x4000, 0xDE45, 0x4A30,
-    0x5000, 0x4845, 0xDE45, 0x4A30, 0x5000, 0x2A06, 0x2C07, 0x4287, 0x0805, 0x0000, 0x662E, 0x5285, 0xE24D, 0x5345, 0x200C, 0x0800,
-    0x0000, 0x6712, 0x161C, 0xE14B, 0x161C, 0x4A30, 0x3000, 0xDE43, 0x51CD, 0xFFF2, 0x605E, 0x301C, 0xDE40, 0x4A30, 0x0000, 0x51CD,
-    0xFFF6, 0x6050, 0x5285, 0xE24D, 0x200C, 0x0800, 0x0000, 0x6726, 0x5345, 0x6712, 0x5345, 0x161C, 0xE14B, 0x161C, 0x4A30, 0x3000,
-    0xDE43, 0x51CD, 0xFFF2, 0x101C, 0xE148, 0xC07C, 0xFF00, 0xDE40, 0x4A30, 0x0000, 0x601E, 0x5345, 0x670E, 0x5345, 0x301C, 0xDE40,
-    0x4A30, 0x0000, 0x51CD, 0xFFF6, 0x301C, 0xC07C, 0xFF00, 0xDE40, 0x4A30, 0x0000, 0xDC47, 0x4A30, 0x6000, 0x4842, 0x2C3C, 0x0000,
-    0xFFFF, 0x7000, 0xB491, 0x6706, 0x5386, 0x66F8, 0x5380, 0x4E75
+#define TARGET_FIRMWARE_LZ4 1
+
+const uint8_t target_firmware_lz4[] = {
+    0xB0, 0xCD, 0xAB, 0x42, 0xEF, 0x00, 0x00, 0x00, 0x00, 0xFA, 0x08, 0x1E, 0x07, 0x00, 0xF0, 0x36,
+    0x00, 0x40, 0x2F, 0x4E, 0x5D, 0x00, 0x00, 0x2E, 0x0D, 0x45, 0x54, 0x4D, 0x52, 0x00, 0x00, 0x3C,
+    0x3F, 0x02, 0x00, 0x4E, 0x4E, 0x8F, 0x54, 0x40, 0x24, 0xEA, 0x45, 0x00, 0xF0, 0x4A, 0x26, 0x3C,
+    0x2C, 0x00, 0x00, 0x09, 0x0D, 0xF9, 0x43, 0xFA, 0x00, 0x46, 0x00, 0x4E, 0xE4, 0x46, 0x53, 0xD9,
+    0x24, 0xCE, 0x51, 0xFC, 0xFF, 0xD3, 0x4E, 0x40, 0x2C, 0x00, 0x61, 0x2E, 0x07, 0xBC, 0xB8, 0x01,
+    0x00, 0x00, 0x00, 0x08, 0x67, 0x08, 0x00, 0xF1, 0x28, 0x10, 0x00, 0x10, 0x66, 0x7C, 0x26, 0xFF,
+    0xFF, 0x00, 0x8A, 0x6B, 0x42, 0x38, 0x00, 0xFA, 0x41, 0xC6, 0x06, 0x8B, 0x20, 0x00, 0x61, 0xCC,
+    0x07, 0x38, 0x00, 0x08, 0x00, 0x84, 0x04, 0xF9, 0x49, 0xFA, 0x00, 0x44, 0x9F, 0xFA, 0x4B, 0x7A,
+    0x06, 0x18, 0x7A, 0x1C, 0x3C, 0x46, 0x46, 0xC6, 0x3A, 0xCD, 0x51, 0xF8, 0xFF, 0x3C, 0x3F, 0x04,
+    0x6E, 0x00, 0xF1, 0x30, 0x00, 0x78, 0x00, 0x38, 0x08, 0x76, 0x3C, 0x3E, 0x03, 0x00, 0xE7, 0x48,
+    0x00, 0x7F, 0x14, 0x70, 0x3C, 0x32, 0x03, 0x00, 0x47, 0x92, 0xA8, 0xE3, 0x40, 0x48, 0x08, 0x72,
+    0x3C, 0x30, 0x03, 0x00, 0x00, 0x61, 0xC2, 0x07, 0x00, 0x61, 0xE2, 0x0B, 0xDF, 0x4C, 0xFE, 0x00,
+    0x40, 0x4A, 0x04, 0x67, 0xCF, 0x51, 0xD8, 0xFF, 0x7C, 0xB8, 0x02, 0x00, 0x00, 0x67, 0x1C, 0x02,
+    0x3C, 0x3F, 0x25, 0x44, 0x00, 0x84, 0x4E, 0x20, 0x7C, 0x22, 0xFA, 0x00, 0x00, 0x80, 0x6A, 0x00,
+    0x11, 0x10, 0x6A, 0x00, 0xF1, 0x4A, 0x55, 0xBC, 0x00, 0x67, 0x1E, 0x00, 0x86, 0x3A, 0x3C, 0x20,
+    0x00, 0x00, 0x9F, 0x00, 0x19, 0x32, 0x59, 0xE1, 0x01, 0x34, 0x42, 0x48, 0x01, 0x34, 0xC2, 0x20,
+    0xC2, 0x20, 0xC8, 0x51, 0xF0, 0xFF, 0x08, 0x60, 0xE9, 0x43, 0x40, 0x01, 0xE8, 0x41, 0x00, 0x05,
+    0x8D, 0x54, 0xCD, 0x51, 0xD0, 0xFF, 0x39, 0x2C, 0xFA, 0x00, 0x40, 0x9F, 0xBC, 0xBC, 0x00, 0x00,
+    0x03, 0x00, 0x00, 0x66, 0xCE, 0x00, 0x00, 0x76, 0x00, 0x78, 0x00, 0x7A, 0x00, 0x7C, 0x03, 0x7E,
+    0x3C, 0x3F, 0x0B, 0x00, 0x41, 0x4E, 0x8F, 0x54, 0x80, 0x4A, 0x1A, 0x67, 0x3C, 0x3F, 0x08, 0x0C,
+    0x00, 0xFF, 0x09, 0x3C, 0xB0, 0x1B, 0x00, 0x44, 0x67, 0x04, 0x26, 0x05, 0x28, 0x06, 0x2A, 0x00,
+    0x2C, 0xCF, 0x51, 0xDC, 0xFF, 0x86, 0x4A, 0x00, 0x67, 0x94, 0x00, 0xCA, 0x00, 0x01, 0xD9, 0x10,
+    0x72, 0x3C, 0x30, 0x02, 0x00, 0x00, 0x61, 0xF8, 0x06, 0x00, 0x61, 0x18, 0xCA, 0x00, 0x8F, 0x00,
+    0x60, 0x62, 0x00, 0x86, 0x4A, 0x2E, 0x67, 0x36, 0x00, 0x09, 0x68, 0xC2, 0x06, 0x00, 0x61, 0xE2,
+    0x0A, 0x00, 0x01, 0x0F, 0x2E, 0x00, 0x01, 0xD9, 0x00, 0x72, 0x3C, 0x30, 0x00, 0x00, 0x00, 0x61,
+    0x94, 0x06, 0x00, 0x61, 0xB4, 0x2E, 0x00, 0x40, 0x00, 0x60, 0xEE, 0x00, 0xD6, 0x00, 0xB1, 0x05,
+    0x00, 0x08, 0x66, 0x00, 0x61, 0x0E, 0x04, 0x00, 0x60, 0xDE, 0x10, 0x00, 0x60, 0x01, 0x00, 0x00,
+    0x67, 0xE0, 0x03, 0x1A, 0x00, 0x00, 0x4E, 0x01, 0x2F, 0xF4, 0x03, 0xF0, 0x00, 0x3F, 0x5B, 0x08,
+    0x06, 0x00, 0x61, 0x28, 0x8C, 0x00, 0x0F, 0xF0, 0x00, 0x0F, 0x6F, 0xD2, 0x05, 0x00, 0x61, 0xF2,
+    0x09, 0xF0, 0x00, 0x15, 0x59, 0xA4, 0x05, 0x00, 0x61, 0xC4, 0x2E, 0x00, 0x45, 0x00, 0x60, 0xE8,
+    0xFD, 0x1A, 0x02, 0xF2, 0x04, 0x22, 0x4E, 0x24, 0xEA, 0x45, 0x50, 0x00, 0x7C, 0x20, 0xFA, 0x00,
+    0x00, 0x20, 0x7C, 0x26, 0xFA, 0x00, 0x00, 0x10, 0x26, 0x02, 0xF0, 0x01, 0x7A, 0x26, 0x20, 0x04,
+    0xFC, 0xB6, 0x00, 0x00, 0x3C, 0x67, 0x7C, 0x37, 0x02, 0x00, 0x20, 0x00, 0x06, 0x00, 0xF1, 0x06,
+    0x22, 0x00, 0x7C, 0x27, 0xFF, 0xFF, 0xFF, 0xFF, 0x28, 0x00, 0x7C, 0x37, 0xFF, 0xFF, 0x2C, 0x00,
+    0x7C, 0x37, 0x28, 0x00, 0x36, 0x1A, 0x00, 0xF0, 0x0D, 0x2E, 0x00, 0x7C, 0x37, 0x52, 0x00, 0x30,
+    0x00, 0x7C, 0x17, 0x02, 0x00, 0x3A, 0x00, 0x7C, 0x17, 0x03, 0x00, 0x3B, 0x00, 0x2B, 0x42, 0x3D,
+    0x00, 0xFA, 0x4B, 0xA4, 0x03, 0xD6, 0x02, 0x00, 0x6C, 0x02, 0x40, 0xA6, 0x00, 0x86, 0x3A, 0x52,
+    0x00, 0xFA, 0x11, 0x40, 0x67, 0xEB, 0x08, 0x07, 0x00, 0x3C, 0x00, 0x71, 0x4E, 0xF6, 0x66, 0x48,
+    0x27, 0x24, 0x00, 0x49, 0x27, 0x32, 0x00, 0x7C, 0x37, 0x08, 0x00, 0x38, 0x00, 0x7C, 0x17, 0x80,
+    0x00, 0x3C, 0x00, 0x1E, 0x00, 0x1B, 0x4A, 0x1E, 0x00, 0x40, 0x00, 0x60, 0x5E, 0x00, 0xB2, 0x02,
+    0xB1, 0x07, 0x00, 0xD8, 0x4C, 0x5E, 0x00, 0xE9, 0x48, 0x5E, 0x00, 0x00, 0x06, 0x00, 0x15, 0x50,
+    0x10, 0x00, 0x11, 0x14, 0x10, 0x00, 0x15, 0x64, 0x10, 0x00, 0x11, 0x28, 0x10, 0x00, 0x15, 0x78,
+    0x10, 0x00, 0x11, 0x3C, 0x10, 0x00, 0x60, 0x8C, 0x00, 0xE9, 0x43, 0x50, 0x00, 0xFC, 0x00, 0x04,
+    0x08, 0x00, 0xF2, 0x01, 0xC8, 0x51, 0xAE, 0xFF, 0x0C, 0x60, 0xE8, 0x41, 0x80, 0x02, 0xE9, 0x43,
+    0x00, 0x05, 0xEA, 0x45, 0xF8, 0x02, 0x20, 0x44, 0xFF, 0xB4, 0x00, 0x17, 0x0A, 0xB4, 0x00, 0x0F,
+    0x08, 0x03, 0x4F, 0x68, 0xF0, 0x03, 0x00, 0x61, 0x10, 0x08, 0xE2, 0x01, 0x0F, 0x08, 0x03, 0x11,
+    0x68, 0xBA, 0x03, 0x00, 0x61, 0xDA, 0x07, 0x36, 0x00, 0x0F, 0x08, 0x03, 0x09, 0x59, 0x8C, 0x03,
+    0x00, 0x61, 0xAC, 0x2E, 0x00, 0x0A, 0x08, 0x03, 0x28, 0x06, 0x01, 0x08, 0x03, 0x11, 0xD8, 0x12,
+    0x03, 0x00, 0x08, 0x03, 0x1F, 0xEC, 0xF8, 0x03, 0x40, 0x5B, 0x00, 0x03, 0x00, 0x61, 0x20, 0x8C,
+    0x00, 0x0F, 0x08, 0x03, 0x0F, 0x6F, 0xCA, 0x02, 0x00, 0x61, 0xEA, 0x06, 0xF0, 0x00, 0x15, 0x59,
+    0x9C, 0x02, 0x00, 0x61, 0xBC, 0x2E, 0x00, 0xFF, 0x25, 0x00, 0x60, 0xFA, 0xFC, 0x3C, 0x2C, 0x0F,
+    0x00, 0xFF, 0xFF, 0x86, 0x53, 0xFC, 0x66, 0xB8, 0x42, 0x20, 0x04, 0xB8, 0x42, 0x3A, 0x04, 0xB8,
+    0x42, 0x1A, 0x05, 0x78, 0x20, 0x04, 0x00, 0xD0, 0x4E, 0x71, 0x4E, 0x75, 0x4E, 0x3A, 0x26, 0x16,
+    0x01, 0x3C, 0x34, 0x3F, 0x00, 0x03, 0x28, 0x84, 0x46, 0x00, 0x61, 0x0E, 0x07, 0x52, 0x01, 0x01,
+    0x00, 0xBE, 0x04, 0x99, 0x10, 0x00, 0x00, 0x61, 0x3A, 0x02, 0x00, 0x61, 0x5A, 0x62, 0x00, 0xF0,
+    0x0A, 0x83, 0x52, 0xCA, 0x51, 0xC6, 0xFF, 0xEF, 0x4F, 0x00, 0xFF, 0x4F, 0x28, 0x03, 0x30, 0x3C,
+    0x32, 0x7F, 0x00, 0xC0, 0x38, 0x40, 0x52, 0xC9, 0x51, 0xFA, 0x10, 0x00, 0x00, 0x52, 0x00, 0x30,
+    0x7A, 0x3C, 0x3C, 0xD8, 0x05, 0x13, 0x08, 0xD8, 0x05, 0x11, 0x46, 0xD8, 0x05, 0x40, 0x3C, 0x30,
+    0x11, 0x00, 0x5C, 0x06, 0x90, 0x00, 0x01, 0x00, 0x61, 0x58, 0x03, 0x00, 0x61, 0x06, 0x54, 0x00,
+    0x10, 0x10, 0xDC, 0x05, 0x30, 0xCE, 0x51, 0xD4, 0x4E, 0x00, 0xD6, 0x01, 0x83, 0x52, 0xFA, 0x41,
+    0x7E, 0x00, 0x83, 0x20, 0x00, 0x61, 0x0A, 0x06, 0x7C, 0x05, 0x16, 0x36, 0x7C, 0x05, 0x0F, 0x2E,
+    0x06, 0x00, 0x00, 0x00, 0x05, 0x10, 0x12, 0x00, 0x05, 0x58, 0x01, 0x00, 0x61, 0xB4, 0x05, 0x36,
+    0x01, 0x21, 0x75, 0x4E, 0xED, 0x06, 0x0F, 0x05, 0x00, 0x23, 0x70, 0x61, 0x44, 0x00, 0x04, 0x2F,
+    0x3C, 0x26, 0x3D, 0x00, 0x0F, 0x1C, 0x01, 0x01, 0x00, 0xA4, 0x06, 0x99, 0x01, 0x00, 0x00, 0x61,
+    0x1E, 0x01, 0x00, 0x61, 0x3E, 0x76, 0x00, 0xF2, 0x29, 0x40, 0x4A, 0x04, 0x66, 0x1F, 0x20, 0x75,
+    0x4E, 0x1F, 0x28, 0xBE, 0x60, 0x38, 0x20, 0xA0, 0x05, 0x00, 0x67, 0x1A, 0x00, 0x40, 0x20, 0x18,
+    0x20, 0x00, 0x67, 0x12, 0x00, 0xBC, 0xB0, 0x4D, 0x5F, 0x48, 0x43, 0x04, 0x67, 0x48, 0x58, 0xEE,
+    0x60, 0x18, 0x28, 0x02, 0x60, 0x84, 0x42, 0xFA, 0x41, 0x9C, 0x05, 0x7C, 0x31, 0xB0, 0x04, 0x00,
+    0x00, 0x50, 0x07, 0xB0, 0x18, 0x67, 0xBC, 0xB8, 0x03, 0x00, 0x00, 0x00, 0x10, 0x67, 0xBC, 0xEC,
+    0x06, 0xF0, 0x08, 0x00, 0x0E, 0x66, 0x7C, 0x31, 0xC0, 0x12, 0x00, 0x00, 0x06, 0x60, 0x7C, 0x31,
+    0x60, 0x09, 0x00, 0x00, 0x75, 0x4E, 0x00, 0x61, 0x3C, 0x00, 0x98, 0x00, 0x4F, 0x01, 0x00, 0x00,
+    0x28, 0x9A, 0x00, 0x09, 0x68, 0x84, 0x00, 0x00, 0x61, 0xA4, 0x04, 0x10, 0x01, 0x71, 0x40, 0x4A,
+    0x75, 0x4E, 0x3C, 0x3F, 0x30, 0xC6, 0x06, 0xF0, 0x0F, 0xBC, 0xC0, 0x00, 0x00, 0xFF, 0xFF, 0x78,
+    0x0C, 0xFC, 0x00, 0x04, 0x00, 0x08, 0x66, 0x39, 0x32, 0xFC, 0x00, 0x02, 0x00, 0x06, 0x60, 0x39,
+    0x32, 0xE0, 0x00, 0x02, 0x00, 0xBC, 0xC2, 0x1C, 0x00, 0x40, 0x41, 0x48, 0x81, 0x80, 0x6E, 0x00,
+    0xBF, 0xCE, 0xFF, 0x00, 0x2F, 0x00, 0x61, 0x36, 0xFF, 0x1F, 0x2A, 0x00, 0xAE, 0x07, 0x02, 0x13,
+    0x0C, 0xAE, 0x07, 0x59, 0x14, 0x00, 0x00, 0x61, 0x34, 0x70, 0x00, 0xA0, 0x75, 0x4E, 0x39, 0x24,
+    0xFA, 0x00, 0x04, 0xF0, 0x41, 0x58, 0x4C, 0x08, 0xF0, 0x10, 0x00, 0xF0, 0x7C, 0x20, 0xFB, 0x00,
+    0x00, 0x00, 0xFC, 0xD1, 0x00, 0x00, 0x00, 0x80, 0x3C, 0x3E, 0xCD, 0xAB, 0x30, 0x4A, 0x00, 0x70,
+    0x87, 0x42, 0x40, 0xDE, 0x30, 0x4A, 0x00, 0x00, 0x41, 0x06, 0x00, 0x80, 0x10, 0x41, 0x4A, 0x00,
+    0x67, 0x88, 0x00, 0x42, 0x0C, 0x00, 0x30, 0x20, 0x7C, 0xB2, 0x96, 0x03, 0x44, 0x7A, 0x00, 0x42,
+    0x48, 0x10, 0x00, 0x70, 0x04, 0x00, 0x00, 0x67, 0x6A, 0x00, 0x43, 0x1E, 0x00, 0xB4, 0x30, 0x7C,
+    0xB2, 0x06, 0x00, 0x00, 0x67, 0x5C, 0x00, 0x43, 0x48, 0x10, 0x00, 0x70, 0x08, 0x00, 0x00, 0x67,
+    0x4C, 0x00, 0x44, 0x1E, 0x00, 0xB4, 0x40, 0x7C, 0xB2, 0x0A, 0x00, 0x00, 0x67, 0x3E, 0x00, 0x44,
+    0x48, 0x10, 0x00, 0x50, 0x0C, 0x00, 0x2E, 0x67, 0x45, 0x1C, 0x00, 0x94, 0x50, 0x7C, 0xB2, 0x0E,
+    0x00, 0x22, 0x67, 0x45, 0x48, 0x0E, 0x00, 0x50, 0x10, 0x00, 0x14, 0x67, 0x46, 0x1A, 0x00, 0x92,
+    0x60, 0x7C, 0xB2, 0x12, 0x00, 0x08, 0x67, 0x46, 0x48, 0x0E, 0x00, 0x00, 0x9E, 0x00, 0xFF, 0x25,
+    0x40, 0x48, 0x00, 0x7C, 0x00, 0x3C, 0x02, 0x66, 0x14, 0x7C, 0x06, 0x2E, 0xFA, 0xCE, 0xF2, 0x03,
+    0x38, 0x2A, 0xBA, 0x04, 0x85, 0xDC, 0x42, 0x48, 0x00, 0x70, 0x91, 0xB4, 0x0C, 0x67, 0xB8, 0xBC,
+    0xBA, 0x04, 0x04, 0x65, 0x87, 0x53, 0xF2, 0x66, 0x80, 0x53, 0x38, 0x22, 0xBA, 0x04, 0x85, 0x92,
+    0x75, 0x4E, 0x41, 0x58, 0xE6, 0x00, 0x0F, 0x02, 0xD0, 0x00, 0x04, 0xD8, 0x00, 0x82, 0x42, 0x48,
+    0x7C, 0xB2, 0x04, 0x00, 0x26, 0x67, 0xC8, 0x00, 0x04, 0xD0, 0x00, 0x82, 0x43, 0x48, 0x7C, 0xB2,
+    0x08, 0x00, 0x10, 0x67, 0xC0, 0x00, 0x04, 0xC8, 0x00, 0x20, 0x44, 0x48, 0x96, 0x00, 0x40, 0x75,
+    0x4E, 0x3C, 0x2E, 0xA2, 0x01, 0xC2, 0x00, 0x70, 0x39, 0x22, 0xFA, 0x00, 0x08, 0xF0, 0x82, 0x92,
+    0x06, 0x6A, 0x86, 0x00, 0x04, 0x72, 0x01, 0x20, 0xBC, 0xCC, 0x20, 0x00, 0xAF, 0x10, 0x72, 0x86,
+    0xD2, 0x81, 0x52, 0x89, 0xE2, 0x89, 0xE3, 0x80, 0x01, 0x15, 0x0A, 0x9A, 0x00, 0x0A, 0x92, 0x00,
+    0x0A, 0x8A, 0x00, 0x02, 0x3E, 0x01, 0x04, 0x46, 0x01, 0xF2, 0x35, 0x06, 0x2A, 0x07, 0x2C, 0x87,
+    0x42, 0x05, 0x08, 0x00, 0x00, 0x00, 0x66, 0xBE, 0x00, 0x4D, 0xE2, 0x0C, 0x30, 0x00, 0x08, 0x00,
+    0x00, 0x16, 0x67, 0x45, 0x53, 0x1C, 0x1F, 0x1F, 0x36, 0x1C, 0x16, 0x30, 0x4A, 0x00, 0x30, 0x43,
+    0xDE, 0xCD, 0x51, 0xF2, 0xFF, 0x00, 0x60, 0x78, 0x01, 0x05, 0x32, 0x7C, 0xC2, 0x0F, 0x00, 0x4D,
+    0xE8, 0x49, 0xE7, 0x41, 0x44, 0xFA, 0x45, 0x86, 0x00, 0xF2, 0x4E, 0x00, 0x10, 0x1C, 0x30, 0x08,
+    0x02, 0x0F, 0x08, 0x00, 0x65, 0xA4, 0xCD, 0x51, 0x7E, 0xFF, 0x00, 0x60, 0xDC, 0x00, 0x85, 0x52,
+    0xBE, 0x00, 0x5F, 0x28, 0x67, 0x45, 0x53, 0x12, 0xC2, 0x00, 0x00, 0x82, 0x1C, 0x10, 0x48, 0xE1,
+    0x7C, 0xC0, 0x00, 0xFF, 0xB0, 0x00, 0x6F, 0x00, 0x60, 0xA8, 0x00, 0x45, 0x53, 0xD2, 0x00, 0x85,
+    0x26, 0x1C, 0x30, 0xAA, 0x00, 0x6A, 0x47, 0xDC, 0x30, 0x4A, 0x00, 0x60, 0xD2, 0x02, 0x2F, 0x20,
+    0x01, 0xD2, 0x02, 0x0F, 0xF0, 0x07, 0x04, 0x2F, 0x08, 0x72, 0x00, 0x61, 0x36, 0xFC, 0x00, 0x61,
+    0x56, 0x00, 0x1F, 0x28, 0x00, 0x72, 0x40, 0x4A, 0x4A, 0x66, 0xF9, 0x41, 0x56, 0x09, 0xF0, 0x1A,
+    0x18, 0x22, 0x84, 0xB2, 0x02, 0x63, 0x04, 0x22, 0x01, 0x30, 0x48, 0xEA, 0x12, 0x67, 0x40, 0x53,
+    0xD8, 0x4C, 0xFC, 0x06, 0xD4, 0x48, 0xFC, 0x06, 0xEC, 0x49, 0x20, 0x00, 0xC8, 0x51, 0xF2, 0xFF,
+    0x01, 0x30, 0x7C, 0xC0, 0x1F, 0x00, 0x48, 0xE4, 0x08, 0x1C, 0x00, 0xF0, 0x01, 0x28, 0xC8, 0x51,
+    0xFC, 0xFF, 0x01, 0x08, 0x01, 0x00, 0x02, 0x67, 0xD8, 0x38, 0x01, 0x08, 0x00, 0x08, 0x00, 0xF1,
+    0x0B, 0x18, 0x00, 0x70, 0x75, 0x4E, 0xFA, 0x41, 0x9A, 0x00, 0xA8, 0x52, 0x04, 0x00, 0xA8, 0xD3,
+    0x08, 0x00, 0xA8, 0xB2, 0x0C, 0x00, 0x04, 0x63, 0x41, 0x21, 0x0C, 0xF2, 0x0B, 0xFF, 0x04, 0xA8,
+    0x52, 0x10, 0x00, 0x75, 0x4E, 0x04, 0x76, 0x3A, 0x28, 0x7C, 0x00, 0x3A, 0x2A, 0x7C, 0x00, 0x3A,
+    0x2C, 0x7C, 0x66, 0x0B, 0x06, 0x00, 0x30, 0x0C, 0x68, 0x92, 0xFB, 0x00, 0x61, 0xB2, 0xFF, 0xF2,
+    0x04, 0x5F, 0x07, 0x76, 0x3A, 0x28, 0x4C, 0x34, 0x00, 0x02, 0x00, 0xC0, 0x05, 0x00, 0x34, 0x00,
+    0x59, 0x5E, 0xFB, 0x00, 0x61, 0x7E, 0x34, 0x00, 0xE0, 0x75, 0x4E, 0x3A, 0x2A, 0x18, 0x00, 0x3A,
+    0x2C, 0x10, 0x00, 0x75, 0x4E, 0xB0, 0x04
 };
-uint16_t target_firmware_length = sizeof(target_firmware) / sizeof(target_firmware[0]);
+uint32_t target_firmware_lz4_length = sizeof(target_firmware_lz4);
+uint32_t target_firmware_size = 3386;
 
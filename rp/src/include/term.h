@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include "pico.h"
+#include "tprotocol.h"
 
 #define ADDRESS_HIGH_BIT 0x8000  // High bit of the address
 
@@ -29,6 +30,14 @@
 #define TERM_RANDON_TOKEN_SEED_OFFSET \
   (TERM_RANDOM_TOKEN_OFFSET +         \
    4)  // Random token seed offset in the shared memory: 0xF004
+#define TERM_ACK_SEQUENCE_OFFSET \
+  (TERM_RANDOM_TOKEN_OFFSET +    \
+   8)  // Last acknowledged pipelined sequence number: 0xF008
+
+// Block of shared variables with a sequence counter, see
+// memfunc_sharedBlockBegin. Same indices as the shared variables: 0xF100
+#define TERM_SHARED_BLOCK_OFFSET (TERM_RANDOM_TOKEN_OFFSET + 0x100)
+#define TERM_SHARED_BLOCK_VARS 32  // Variables of the block
 
 // Size of the shared variables of the shared functions
 #define SHARED_VARIABLE_SHARED_FUNCTIONS_SIZE \
@@ -43,13 +52,33 @@
 // Shared variables for common use. Must be set in the init function
 #define TERM_HARDWARE_TYPE (0)     // Hardware type. 0xF200
 #define TERM_HARDWARE_VERSION (1)  // Hardware version.  0xF204
+// Boot summary, only if BOOTTRACE_SHARED_SUMMARY is 1. See term_publishBoot
+#define TERM_BOOT_TIME_MS (2)  // Time from reset to the menu in ms. 0xF208
+#define TERM_BOOT_SLOWEST (3)  // Slowest stage: index << 16 | ms. 0xF20C
+// First index in the shared block of the boot summary, both variables above
+#define TERM_BOOT_TIME_INDEX TERM_BOOT_TIME_MS
+// Round trip of the sync commands measured by the remote computer in 200 Hz
+// ticks, sent by publish_command_stats of sidecart_functions.s
+#define TERM_CMD_COUNT (4)      // Sync commands sent. 0xF210
+#define TERM_CMD_TICKS (5)      // Sum of the round trips. 0xF214
+#define TERM_CMD_MAX_TICKS (6)  // Slowest round trip. 0xF218
+#define TERM_CMD_TIMEOUTS (7)   // Sync commands that timed out. 0xF21C
+// Screen resolution of XBIOS Getrez, sent by the remote computer at start
+#define TERM_SCREEN_REZ (8)  // 0 low, 1 medium, 2 high. 0xF220
+#define TERM_SCREEN_REZ_HIGH 2
 
 // App commands for the terminal
 #define APP_TERMINAL 0x00  // The terminal app
 
 // App terminal commands
-#define APP_TERMINAL_START 0x00      // Enter terminal command
-#define APP_TERMINAL_KEYSTROKE 0x01  // Keystroke command
+#define APP_TERMINAL_START 0x00       // Enter terminal command
+#define APP_TERMINAL_KEYSTROKE 0x01   // Keystroke command
+#define APP_TERMINAL_KEYSTROKES 0x02  // Batch of keystrokes, 0 if empty
+#define APP_TERMINAL_SET_SHARED_VARS \
+  0x03  // First index and values of the shared block
+
+// Keys of an APP_TERMINAL_KEYSTROKES command
+#define TERM_KEYSTROKES_BATCH 4
 
 #ifdef DISPLAY_ATARIST
 // Terminal size for Atari ST
@@ -62,8 +91,10 @@
   (TERM_DISPLAY_BYTES_PER_CHAR * TERM_SCREEN_SIZE_X)
 #endif
 
+// Screen rows of a page of "print". Any key shows the next page, 'q' stops
+#define TERM_PRINT_PAGE_ROWS (TERM_SCREEN_SIZE_Y - 1)
+
 // Holds up to one line of user input (between '\n' or '\r')
-#define TERM_PRINT_SETTINGS_BUFFER_SIZE 2048
 #define TERM_INPUT_BUFFER_SIZE 256
 #define TERM_ESC_BUFFLINE_SIZE 16
 #define TERM_BOOL_INPUT_BUFF 8
@@ -82,6 +113,16 @@
 
 #define TERM_PARAMETERS_MAX_SIZE 20  // Maximum size of the parameters
 
+// Number of slots of the protocol command ring. Must be a power of two
+#ifndef TERM_PROTOCOL_RING_SLOTS
+#define TERM_PROTOCOL_RING_SLOTS 8
+#endif
+#define TERM_PROTOCOL_RING_MASK (TERM_PROTOCOL_RING_SLOTS - 1)
+
+#if (TERM_PROTOCOL_RING_SLOTS & TERM_PROTOCOL_RING_MASK) != 0
+#error "TERM_PROTOCOL_RING_SLOTS must be a power of two"
+#endif
+
 // Display command to enter the terminal mode and ignore other keys
 #define DISPLAY_COMMAND_TERM 0x3  // Enter terminal mode
 
@@ -98,8 +139,148 @@ typedef struct {
   void (*handler)(const char *arg);
 } Command;
 
+// Most entries of the terminal command table, aliases included
+#ifndef TERM_MAX_COMMANDS
+#define TERM_MAX_COMMANDS 128
+#endif
+
+#if TERM_MAX_COMMANDS > 255
+#error "TERM_MAX_COMMANDS must fit in a byte"
+#endif
+
+// Called before the handler of every terminal command
+typedef void (*TermCommandHook)(void);
+
+// Size of the protocol command handler table. Command ids at or above it are
+// reported as unknown
+#ifndef TERM_PROTOCOL_MAX_COMMANDS
+#define TERM_PROTOCOL_MAX_COMMANDS 64
+#endif
+
+// Flags of the protocol command handlers
+#define TERM_PROTOCOL_FLAG_IRQ 0x01       // Run in the bus IRQ, skip the ring
+#define TERM_PROTOCOL_FLAG_DEFERRED 0x02  // Run from term_loop
+#define TERM_PROTOCOL_FLAG_ACK 0x04       // Write the random token when done
+#define TERM_PROTOCOL_FLAG_TRACE 0x08     // Print the command in debug builds
+// The token is the sequence number of a pipelined command. The ack writes it
+// to TERM_ACK_SEQUENCE_OFFSET instead of the random token
+#define TERM_PROTOCOL_FLAG_PIPELINED 0x10
+
+// Handler of a protocol command. The payload starts with the random token
+typedef void (*TermProtocolHandler)(const TransmissionProtocol *protocol);
+
+// Protocol command lookup entry
+typedef struct {
+  TermProtocolHandler handler;
+  uint8_t flags;
+} TermProtocolEntry;
+
+/**
+ * @brief Register the handler of a protocol command.
+ *
+ * The handlers live in a RAM table indexed by the command id, so the lookup is
+ * O(1). Exactly one of TERM_PROTOCOL_FLAG_IRQ or TERM_PROTOCOL_FLAG_DEFERRED
+ * must be set. IRQ handlers run in the bus interrupt (or core1): they must be
+ * short and placed in RAM with __not_in_flash_func. Unregistered commands are
+ * acknowledged and ignored. term_init registers the terminal commands.
+ *
+ * @param commandId The command id sent by the remote computer.
+ * @param handler The handler, or NULL to remove it.
+ * @param flags Combination of TERM_PROTOCOL_FLAG_* values.
+ * @return 0 on success, -1 if the id or the flags are not valid.
+ */
+int term_setProtocolHandler(uint16_t commandId, TermProtocolHandler handler,
+                            uint8_t flags);
+
+// Called in interrupt context on core0 when a command is queued for term_loop
+typedef void (*TermCommandNotify)(void);
+
+/**
+ * @brief Register the function that wakes up the main loop.
+ *
+ * The notify function runs in interrupt context on core0 every time a new
+ * command is published, so the main loop can stop waiting and call term_loop
+ * right away. When the bus is serviced by core1 the notification goes through
+ * the inter-core FIFO, so call it after the ROM emulator is initialized. A
+ * SEV is always issued too, to wake up a core waiting in WFE.
+ *
+ * @param notify The function to call, or NULL for none.
+ */
+void term_setCommandNotify(TermCommandNotify notify);
+
+/**
+ * @brief Check if there are commands waiting for term_loop.
+ *
+ * @return true if the command ring is not empty.
+ */
+bool __not_in_flash_func(term_hasPendingCommands)(void);
+
+// Counters of the protocol commands since the last "stats reset"
+typedef struct {
+  uint32_t commands;        // Commands received with a good checksum
+  uint32_t drops;           // Commands lost because the ring was full
+  uint32_t checksumErrors;  // Commands with a bad checksum
+  uint32_t highWater;       // Most ring slots in use at once
+} TermProtocolStats;
+
+/**
+ * @brief Get the counters of the protocol commands.
+ *
+ * The same counters shown by "stats". They are updated by the bus IRQ, so
+ * they can move while they are read.
+ *
+ * @param stats Filled with the counters.
+ */
+void term_getProtocolStats(TermProtocolStats *stats);
+
+// Time to lock out core1 before and after a flash write
+#define TERM_FLASH_SAFE_TIMEOUT_MS 100
+
+/**
+ * @brief Run a flash erase or program without stopping the bus.
+ *
+ * Calls flash_safe_execute with the terminal safety helper: the DMA IRQ that
+ * feeds the protocol parser stays enabled in core0 and the other core0
+ * interrupts are masked. If core1 runs code from flash it must call
+ * flash_safe_execute_core_init first, so it can be locked out. The commands
+ * received meanwhile are queued and notified when the write ends. term_init
+ * installs it as the flash executor of the settings.
+ *
+ * @param func Function doing the flash write, placed in RAM.
+ * @param param Parameter passed to func.
+ * @return PICO_OK on success, a PICO_ERROR_* value on failure.
+ */
+int term_flashSafeExecute(void (*func)(void *), void *param);
+
+// Period of the ROM3 capture buffer polling when ROMEMUL_ROM3_CAPTURE is 1.
+// Must be well below PROTOCOL_READ_RESTART_MICROSECONDS
+#define TERM_ROM3_CAPTURE_POLL_US 1000
+
 void __not_in_flash_func(term_dma_irq_handler_lookup)(void);
 
+/**
+ * @brief Parse the ROM3 words captured by the PIO since the last call.
+ *
+ * Alternative to term_dma_irq_handler_lookup when the ROM3 accesses are
+ * captured by romemul_initRom3Capture. Parsed commands are published to the
+ * same ring consumed by term_loop. Must always be called from the same
+ * context.
+ *
+ * The words are parsed with the time of the poll that found them. If no word
+ * came for more than PROTOCOL_READ_RESTART_MICROSECONDS after the last one,
+ * the command in progress is dropped before the new words are parsed.
+ */
+void __not_in_flash_func(term_pollRom3Capture)(void);
+
+/**
+ * @brief Start a repeating timer that calls term_pollRom3Capture.
+ *
+ * The timer runs every TERM_ROM3_CAPTURE_POLL_US microseconds.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int term_startRom3Capture(void);
+
 void term_init(void);
 
 /**
@@ -114,6 +295,24 @@ void term_init(void);
  */
 void term_printString(const char *str);
 
+/**
+ * @brief Start a batch of terminal output.
+ *
+ * Until the matching term_endBatch, the output is only drawn in the buffer:
+ * the cursor is not redrawn after each character and the display is not
+ * refreshed. Batches can be nested. term_loop wraps the commands it runs in a
+ * batch.
+ */
+void term_beginBatch(void);
+
+/**
+ * @brief End a batch of terminal output.
+ *
+ * When the outermost batch ends, the cursor is drawn and the display is
+ * refreshed once, if the batch printed anything.
+ */
+void term_endBatch(void);
+
 /**
  * @brief Clear the terminal display area
  *
@@ -122,6 +321,15 @@ void term_printString(const char *str);
  */
 void term_clearScreen(void);
 
+/**
+ * @brief Draw every cell of the terminal again and refresh the display.
+ *
+ * The glyphs are drawn from the characters kept for the screen, so the cells
+ * written in reverse video come back in normal video. Used to measure the
+ * worst case of the terminal output.
+ */
+void term_redraw(void);
+
 /**
  * @brief Register terminal command handlers
  *
@@ -129,8 +337,24 @@ void term_clearScreen(void);
  * structures linking command strings with their respective function pointers,
  * enabling interactive command processing at the terminal. Used to register new
  * commands.
+ *
+ * The names are sorted once here, at most TERM_MAX_COMMANDS of them, so a line
+ * is resolved with a binary search and Tab completes a command name. Rows with
+ * the same handler are aliases; rows with the same name all run, in the order
+ * of the table. The row with the empty name is called with the whole line
+ * when no name matches. The table must outlive the terminal.
  */
 void term_setCommands(const Command *cmds, size_t count);
+
+/**
+ * @brief Set a function called before the handler of every command.
+ *
+ * Holds what every handler of an app would do first, such as leaving the
+ * menu screen, so the table can point to the term_cmd handlers directly.
+ *
+ * @param hook Function to call, or NULL for none.
+ */
+void term_setCommandHook(TermCommandHook hook);
 /**
  * @brief Clears the terminal's input buffer.
  *
@@ -159,6 +383,26 @@ void term_cmdGet(const char *arg);
 void term_cmdPutInt(const char *arg);
 void term_cmdPutBool(const char *arg);
 void term_cmdPutString(const char *arg);
+// Show the command and bus statistics. "stats reset" clears them
+void term_cmdStats(const char *arg);
+// Show the boot checkpoints and the time of each stage
+void term_cmdBoot(const char *arg);
+// Show the progress, speed and time split of the download. "download stats",
+// or "download bench <url>" to measure a download without keeping the file
+void term_cmdDownload(const char *arg);
+// Show the RSSI trend, link losses, TCP retransmissions and lwIP alloc errors
+void term_cmdNet(const char *arg);
+// Show the networks of the last WiFi scans, without waiting for a new one
+void term_cmdScan(const char *arg);
+
+/**
+ * @brief Publish the boot time summary in the shared variables.
+ *
+ * Writes TERM_BOOT_TIME_MS and TERM_BOOT_SLOWEST from the checkpoints
+ * recorded so far, so the remote computer can read them. Does nothing
+ * unless BOOTTRACE_SHARED_SUMMARY is 1. Call after term_init.
+ */
+void term_publishBoot(void);
 void term_printNetworkInfo(void);
 void term_markMenuPromptCursor(void);
 void term_refreshMenuLiveInfo(void);
@@ -9,6 +9,7 @@
 #ifndef TPROTOCOL_H
 #define TPROTOCOL_H
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,10 +23,15 @@
 #define PROTOCOL_HEADER 0xABCD
 #define PROTOCOL_READ_RESTART_MICROSECONDS 10000
 #define MAX_PROTOCOL_PAYLOAD_SIZE \
-  2048 + 64  // 2048 bytes of payload plus 64 bytes of overhead for safety
+  (2048 + 64)  // 2048 bytes of payload plus 64 bytes of overhead for safety
 
 #define SHOW_COMMANDS 0  // Set to 1 to show commands received
 
+// Parse with tprotocol_parseFast instead of tprotocol_parse
+#ifndef TPROTOCOL_FAST_PARSE
+#define TPROTOCOL_FAST_PARSE 1
+#endif
+
 /**
  * @brief Macro to get a random token from a payload.
  *
@@ -100,7 +106,229 @@ typedef void (*ProtocolChecksumErrorCallback)(const TransmissionProtocol *);
 extern uint32_t tprotocol_last_header_found;
 extern uint32_t tprotocol_new_header_found;
 extern TPParseStep tprotocol_nextTPstep;
-extern TransmissionProtocol tprotocol_transmission;
+extern TransmissionProtocol *tprotocol_transmission;
+
+// Time of the words for the PROTOCOL_READ_RESTART_MICROSECONDS timeout. The
+// parsers read the timer, unless tprotocol_setWordTime gave the time the words
+// were captured
+extern bool tprotocol_wordTimeSet;
+extern uint32_t tprotocol_wordTime;
+
+static inline uint32_t __not_in_flash_func(tprotocol_getWordTime)(void) {
+  return tprotocol_wordTimeSet ? tprotocol_wordTime : timer_hw->timerawl;
+}
+
+/**
+ * @brief Parse the next words with the time they were captured.
+ *
+ * For words parsed in batches after they were captured, so the restart
+ * timeout measures the gaps of the bus and not the time of the parse. Once
+ * called, the parsers never read the timer again.
+ *
+ * @param timeUs Capture time of the next words, in microseconds of the timer.
+ */
+static inline void __not_in_flash_func(tprotocol_setWordTime)(uint32_t timeUs) {
+  tprotocol_wordTime = timeUs;
+  tprotocol_wordTimeSet = true;
+}
+
+// Step of tprotocol_parseFast: handles a word and selects the next step
+typedef void (*TPStepHandler)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback);
+
+// Step for the next word of tprotocol_parseFast
+extern TPStepHandler tprotocol_step;
+
+// First step of tprotocol_parseFast, waits for PROTOCOL_HEADER
+void __not_in_flash_func(tprotocol_stepHeader)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback);
+
+/**
+ * @brief Select the buffer the parser writes the next command into.
+ *
+ * The parser stores the command id, size, checksum and payload words directly
+ * in the target buffer, so a consumer can hand out its own queue slots and
+ * publish them without copying. Only call it from the context that runs
+ * tprotocol_parse, and only between commands (from the command callback or
+ * while the parser is in HEADER_DETECTION).
+ *
+ * @param target The buffer to parse into, or NULL to use the internal default
+ * buffer.
+ */
+void __not_in_flash_func(tprotocol_setTarget)(TransmissionProtocol *target);
+
+// --------------------------------------
+// Bulk transfers
+// --------------------------------------
+// Large uploads from the remote computer are split in frames. Each frame is a
+// regular command (same PROTOCOL_HEADER framing and additive checksum) whose
+// payload starts with the random token and a bulk header, followed by the
+// data words:
+//  - PARAM32 #1: transfer id (low word) | frame index (high word)
+//  - PARAM32 #2: byte offset of the frame data in the transfer
+//  - PARAM32 #3: frame data length in bytes (low word) |
+//                CRC16 of the transfer up to and including this frame (high)
+// The frames are reassembled in a caller provided window of
+// TPROTO_BULK_WINDOW_SIZE bytes. A frame must not straddle a window boundary.
+// The CRC16 is CCITT (poly 0x1021, init 0xFFFF) computed over the data bytes
+// in the order the remote computer holds them (high byte of each word first).
+
+#ifndef TPROTO_BULK_WINDOW_SIZE
+#define TPROTO_BULK_WINDOW_SIZE (16 * 1024)  // Reassembly window in bytes
+#endif
+
+#if (TPROTO_BULK_WINDOW_SIZE < (8 * 1024)) || \
+    (TPROTO_BULK_WINDOW_SIZE > (32 * 1024))
+#error "TPROTO_BULK_WINDOW_SIZE must be between 8KB and 32KB"
+#endif
+
+#define TPROTO_BULK_HEADER_SIZE 16  // Random token plus three 32 bit params
+#define TPROTO_BULK_MAX_FRAME_DATA \
+  (MAX_PROTOCOL_PAYLOAD_SIZE - TPROTO_BULK_HEADER_SIZE)
+#define TPROTO_CRC16_INIT 0xFFFF
+
+typedef enum {
+  TPROTO_BULK_IN_PROGRESS = 0,   // Frame accepted, more frames expected
+  TPROTO_BULK_WINDOW_FULL,       // Window full. Consume it before next frame
+  TPROTO_BULK_COMPLETE,          // Last frame received, window holds the tail
+  TPROTO_BULK_DUPLICATE,         // Retry of the previous frame. Ignored
+  TPROTO_BULK_ERR_SEQUENCE = -1, // Unexpected transfer id, frame or offset
+  TPROTO_BULK_ERR_CRC = -2,      // Running CRC16 mismatch
+  TPROTO_BULK_ERR_OVERFLOW = -3  // Frame too large or crosses the window
+} tprotocol_bulk_status_t;
+
+typedef struct {
+  uint8_t *window;        // Reassembly window, in remote byte order
+  uint32_t windowSize;    // Size of the window in bytes
+  uint32_t windowFill;    // Valid bytes in the window
+  uint32_t totalSize;     // Total bytes of the transfer
+  uint32_t received;      // Bytes received so far
+  uint16_t crc;           // Running CRC16 of the received bytes
+  uint16_t transferId;    // Transfer id announced by the remote computer
+  uint16_t nextFrame;     // Index of the next expected frame
+} TransmissionBulk;
+
+/**
+ * @brief Update a CRC16-CCITT with a block of bytes.
+ *
+ * Table driven, one lookup per byte.
+ *
+ * @param crc The current CRC value, TPROTO_CRC16_INIT to start.
+ * @param data The bytes to add.
+ * @param length Number of bytes.
+ * @return The updated CRC value.
+ */
+uint16_t tprotocol_crc16(uint16_t crc, const uint8_t *data, size_t length);
+
+/**
+ * @brief Start receiving a bulk transfer.
+ *
+ * @param bulk The transfer context to initialize.
+ * @param window Buffer to reassemble the frames. At least windowSize bytes.
+ * @param windowSize Size of the window. Usually TPROTO_BULK_WINDOW_SIZE.
+ * @param transferId Transfer id the frames will carry.
+ * @param totalSize Total number of bytes of the transfer.
+ */
+void tprotocol_bulkBegin(TransmissionBulk *bulk, uint8_t *window,
+                         uint32_t windowSize, uint16_t transferId,
+                         uint32_t totalSize);
+
+/**
+ * @brief Add a received frame to the bulk transfer.
+ *
+ * Verifies the sequence and the running CRC16, and copies the frame data to
+ * the window. When the result is TPROTO_BULK_WINDOW_FULL or
+ * TPROTO_BULK_COMPLETE the first windowFill bytes of the window are valid
+ * until the next call. Acknowledge the command (random token) for every
+ * result but errors, so the remote computer moves on or retries.
+ *
+ * @param bulk The transfer context.
+ * @param protocol The command carrying the frame.
+ * @return The status of the transfer after the frame.
+ */
+tprotocol_bulk_status_t tprotocol_bulkFrame(
+    TransmissionBulk *bulk, const TransmissionProtocol *protocol);
+
+// --------------------------------------
+// Bulk reads
+// --------------------------------------
+// The remote computer reads large blocks from a window of the ROM4 image. It
+// sends a regular command whose payload is the random token followed by:
+//  - PARAM32 #1: position of the data in the source, defined by the command
+//  - PARAM32 #2: bytes requested, at most TPROTO_READ_MAX_SIZE
+// The handler publishes the data in the window and then acknowledges the
+// command with the random token. The window starts with a longword holding
+// the number of valid bytes, followed by the data in the remote byte order.
+// The remote computer copies it with movem.l, see
+// send_sync_read_command_to_sidecart. The default window shares the ROM4
+// image with the display buffers, so do not read while the display is used.
+
+#ifndef TPROTO_READ_WINDOW_OFFSET
+#define TPROTO_READ_WINDOW_OFFSET 0x2000  // $FA2000 in the remote computer
+#endif
+
+#ifndef TPROTO_READ_WINDOW_SIZE
+#define TPROTO_READ_WINDOW_SIZE 0xD000  // Up to $FAEFFF
+#endif
+
+// The terminal shared memory starts at 0xF000 of the ROM4 image
+#if (TPROTO_READ_WINDOW_OFFSET + TPROTO_READ_WINDOW_SIZE) > 0xF000
+#error "The read window overlaps the terminal shared memory"
+#endif
+
+#define TPROTO_READ_HEADER_SIZE 4  // Number of valid bytes
+#define TPROTO_READ_MAX_SIZE \
+  (TPROTO_READ_WINDOW_SIZE - TPROTO_READ_HEADER_SIZE)
+
+typedef struct {
+  uint32_t position;  // Position of the data in the source
+  uint32_t length;    // Bytes requested, at most TPROTO_READ_MAX_SIZE
+} TransmissionRead;
+
+/**
+ * @brief Get the parameters of a bulk read command.
+ *
+ * @param protocol The command received.
+ * @param read Filled with the position and the length, clamped to
+ * TPROTO_READ_MAX_SIZE.
+ */
+void tprotocol_readRequest(const TransmissionProtocol *protocol,
+                           TransmissionRead *read);
+
+/**
+ * @brief Get the data area of the read window.
+ *
+ * For sources that can write in place, like f_read. Call
+ * tprotocol_readPublish once the data is there.
+ *
+ * @return The first byte of the data, TPROTO_READ_MAX_SIZE bytes available.
+ */
+uint8_t *tprotocol_readData(void);
+
+/**
+ * @brief Publish the data written in the data area of the read window.
+ *
+ * Swaps the bytes of each word in place to the remote byte order and writes
+ * the number of valid bytes. Acknowledge the command after it.
+ *
+ * @param length Valid bytes in the data area. Clamped to TPROTO_READ_MAX_SIZE.
+ * @return The number of bytes published.
+ */
+uint32_t tprotocol_readPublish(uint32_t length);
+
+/**
+ * @brief Copy a block to the read window and publish it.
+ *
+ * The copy swaps the bytes with the DMA. If length is odd, the byte after the
+ * block is read too. Acknowledge the command after it.
+ *
+ * @param data The block to publish, 16-bit aligned.
+ * @param length Bytes of the block. Clamped to TPROTO_READ_MAX_SIZE.
+ * @return The number of bytes published.
+ */
+uint32_t tprotocol_readFill(const void *data, uint32_t length);
 
 // --------------------------------------
 // Inline assembly example for storing a 16-bit payload value (ARM).
@@ -125,7 +353,7 @@ static inline __attribute__((always_inline)) void __not_in_flash_func(
     tprotocol_nextTPstep = COMMAND_READ;
     // Reset the checksum each time we detect a new header
     // (since we start sum from the command ID forward)
-    tprotocol_transmission.final_checksum = 0;
+    tprotocol_transmission->final_checksum = 0;
   }
 }
 
@@ -134,9 +362,9 @@ static inline __attribute__((always_inline)) void __not_in_flash_func(
 // --------------------------------------
 static inline __attribute__((always_inline)) void __not_in_flash_func(
     read_command)(uint16_t data) {
-  tprotocol_transmission.command_id = data;
+  tprotocol_transmission->command_id = data;
   // Accumulate command ID into final_checksum
-  tprotocol_transmission.final_checksum += data;
+  tprotocol_transmission->final_checksum += data;
 
   tprotocol_nextTPstep = PAYLOAD_SIZE_READ;
 }
@@ -146,18 +374,24 @@ static inline __attribute__((always_inline)) void __not_in_flash_func(
 // --------------------------------------
 static inline __attribute__((always_inline)) void __not_in_flash_func(
     read_payload_size)(uint16_t data) {
+  if (data > MAX_PROTOCOL_PAYLOAD_SIZE) {
+    // The payload does not fit in the target buffer. Ignore the command
+    tprotocol_nextTPstep = HEADER_DETECTION;
+    return;
+  }
+  // Always overwrite the size: the target buffer may hold a previous command
+  tprotocol_transmission->payload_size = data;
   if (data > 0) {
-    tprotocol_transmission.payload_size = data;
     tprotocol_nextTPstep = PAYLOAD_READ_START;
   } else {
     // Zero payload => skip to end
     tprotocol_nextTPstep = PAYLOAD_READ_END;
   }
   // Accumulate payload size into final_checksum
-  tprotocol_transmission.final_checksum += data;
+  tprotocol_transmission->final_checksum += data;
 
   // Reset for reading payload
-  tprotocol_transmission.bytes_read = 0;
+  tprotocol_transmission->bytes_read = 0;
 }
 
 // --------------------------------------
@@ -167,13 +401,15 @@ static inline __attribute__((always_inline)) void __not_in_flash_func(
     read_payload)(uint16_t data) {
   // Store the 16-bit chunk into the payload array
   store_payload_16_asm(
-      data, &tprotocol_transmission.payload[tprotocol_transmission.bytes_read]);
+      data,
+      &tprotocol_transmission->payload[tprotocol_transmission->bytes_read]);
 
   // Accumulate the data into final_checksum
-  tprotocol_transmission.final_checksum += data;
+  tprotocol_transmission->final_checksum += data;
 
-  tprotocol_transmission.bytes_read += 2;
-  if (tprotocol_transmission.bytes_read >= tprotocol_transmission.payload_size) {
+  tprotocol_transmission->bytes_read += 2;
+  if (tprotocol_transmission->bytes_read >=
+      tprotocol_transmission->payload_size) {
     tprotocol_nextTPstep = PAYLOAD_READ_END;
   } else {
     tprotocol_nextTPstep = PAYLOAD_READ_INPROGRESS;
@@ -184,9 +420,10 @@ static inline __attribute__((always_inline)) void __not_in_flash_func(
     tprotocol_resetParserState)(void) {
   tprotocol_last_header_found = 0;
   tprotocol_nextTPstep = HEADER_DETECTION;
-  tprotocol_transmission.bytes_read = 0;
-  tprotocol_transmission.payload_size = 0;
-  tprotocol_transmission.final_checksum = 0;
+  tprotocol_step = tprotocol_stepHeader;
+  tprotocol_transmission->bytes_read = 0;
+  tprotocol_transmission->payload_size = 0;
+  tprotocol_transmission->final_checksum = 0;
 }
 
 // This function is called once we finish reading the command + payload
@@ -195,17 +432,19 @@ static inline __attribute__((always_inline)) void __not_in_flash_func(
 #if defined(_DEBUG) && (_DEBUG != 0) && defined(SHOW_COMMANDS) && \
     (SHOW_COMMANDS != 0)
   DPRINTF("COMMAND: %d / PAYLOAD SIZE: %d / CHECKSUM: 0x%04X\n",
-          tprotocol_transmission.command_id, tprotocol_transmission.payload_size,
-          tprotocol_transmission.final_checksum);
+          tprotocol_transmission->command_id,
+          tprotocol_transmission->payload_size,
+          tprotocol_transmission->final_checksum);
 #endif
 
+  // The callback may select a new target buffer for the next command
   if (callback) {
-    callback(&tprotocol_transmission);
+    callback(tprotocol_transmission);
   }
 
 #if PROTOCOL_CLEAR_MEMORY == 1
   // Reset for next message
-  memset(&tprotocol_transmission, 0, sizeof(TransmissionProtocol));
+  memset(tprotocol_transmission, 0, sizeof(TransmissionProtocol));
 #endif
 
   tprotocol_resetParserState();
@@ -229,7 +468,7 @@ static inline void __not_in_flash_func(tprotocol_parse)(
     uint16_t data, ProtocolCallback callback,
     ProtocolChecksumErrorCallback protocolChecksumErrorCallback) {
   // Time-based logic to detect if we should restart parsing
-  tprotocol_new_header_found = timer_hw->timerawl;
+  tprotocol_new_header_found = tprotocol_getWordTime();
   if (tprotocol_new_header_found - tprotocol_last_header_found >
       PROTOCOL_READ_RESTART_MICROSECONDS) {
     tprotocol_nextTPstep = HEADER_DETECTION;
@@ -251,22 +490,47 @@ static inline void __not_in_flash_func(tprotocol_parse)(
 
     case PAYLOAD_READ_START:
     case PAYLOAD_READ_INPROGRESS:
-      if (tprotocol_transmission.bytes_read < tprotocol_transmission.payload_size) {
+      if (tprotocol_transmission->bytes_read <
+          tprotocol_transmission->payload_size) {
         read_payload(data);
       }
       break;
     case PAYLOAD_READ_END:
       // "data" is the checksum
-      if (data == tprotocol_transmission.final_checksum) {
+      if (data == tprotocol_transmission->final_checksum) {
         // Checksum matches
         process_command(callback);
       } else {
         // Checksum mismatch. Notify the caller
-        protocolChecksumErrorCallback(&tprotocol_transmission);
+        protocolChecksumErrorCallback(tprotocol_transmission);
         tprotocol_resetParserState();
       }
       break;
   }
 };
 
+/**
+ * @brief Same as tprotocol_parse, with a step table and fewer timer reads.
+ *
+ * The current step is a function pointer, so each word is a single indirect
+ * call instead of the timer read, the timeout comparison and the switch of
+ * tprotocol_parse. The timer is only read for PROTOCOL_HEADER words: when a
+ * header is found, and when one arrives inside a command that started more
+ * than PROTOCOL_READ_RESTART_MICROSECONDS ago, which restarts the parser at
+ * that header. A command cut by the remote computer is then dropped at the
+ * next header, as tprotocol_parse does. tprotocol_nextTPstep is kept for the
+ * callers that check it. Do not mix it with tprotocol_parse.
+ *
+ * @param data The incoming 16-bit data.
+ * @param callback Function pointer that is called upon successful command
+ * parsing.
+ * @param protocolChecksumErrorCallback Function pointer that is called when a
+ * checksum error is detected.
+ */
+static inline void __not_in_flash_func(tprotocol_parseFast)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback) {
+  tprotocol_step(data, callback, protocolChecksumErrorCallback);
+}
+
 #endif  // TPROTOCOL_H
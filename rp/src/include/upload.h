@@ -0,0 +1,72 @@
+/**
+ * File: upload.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the HTTP server of the uploads to the SD card
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "debug.h"
+#include "download.h"
+
+// Start the upload server when the WiFi connects. Anyone in the network can
+// write files to the app folder, so it is meant for development
+#ifndef UPLOAD_SERVER
+#define UPLOAD_SERVER 0
+#endif
+
+// Port advertised by the mDNS service of network_wifiStaConnect
+#define UPLOAD_PORT 80
+
+// Room for the request line and the headers
+#define UPLOAD_HEADER_SIZE 512
+
+// Longest file name and path in the app folder
+#define UPLOAD_NAME_SIZE 64
+#define UPLOAD_PATH_SIZE 256
+
+// The body goes to this file of the app folder and is renamed when complete
+#define UPLOAD_TMP_FILE "tmp.upload"
+
+// Same rules as DOWNLOAD_STAGING_SIZE: sector multiple, smaller than TCP_WND
+#ifndef UPLOAD_STAGING_SIZE
+#define UPLOAD_STAGING_SIZE DOWNLOAD_STAGING_SIZE
+#endif
+
+// Room for the JSON of "GET /telemetry"
+#define UPLOAD_TELEMETRY_SIZE 512
+
+// Checks of an idle connection, every 500 ms, before it is dropped
+#define UPLOAD_IDLE_POLLS 20
+
+/**
+ * @brief Start the HTTP server of the uploads.
+ *
+ * Listens on UPLOAD_PORT for "PUT /<name>" or "POST /<name>" requests with a
+ * Content-Length, for example "curl -T image.img http://sidecart.local/".
+ * The body is written to the app folder as it arrives, in blocks of
+ * UPLOAD_STAGING_SIZE, and TCP only opens the window again once a block is
+ * on the SD card. When complete the file replaces <name> and the server
+ * answers 201. One upload runs at a time; others get 503. "GET /telemetry"
+ * answers the JSON of network_formatTelemetryJson.
+ *
+ * @return 0 on success or if already started, -1 if lwIP has no memory.
+ */
+int upload_init(void);
+
+/**
+ * @brief Check if an upload is in progress.
+ *
+ * @return true while a request is being received.
+ */
+bool upload_isActive(void);
+
+#endif  // UPLOAD_H
@@ -0,0 +1,69 @@
+/**
+ * File: viewer.h
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Header file for the network viewer of the framebuffer
+ */
+
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "debug.h"
+#include "display.h"
+
+// Start the viewer when the WiFi connects. Anyone in the network can watch
+// the screen of the remote computer, so it is meant for support and tests
+#ifndef VIEWER_SERVER
+#define VIEWER_SERVER 0
+#endif
+
+#define VIEWER_PORT 5800
+
+// Shortest time between two frames. The rows changed meanwhile go together
+#define VIEWER_FRAME_MS 100
+
+// Row number of the message that ends a frame
+#define VIEWER_FRAME_END 0xFF
+
+// Longest message of a row: the row number, the length and the row encoded
+// with PackBits, which adds a byte to each 128 bytes at worst
+#define VIEWER_ROW_MAX_BYTES \
+  (3 + DISPLAY_DIRTY_ROW_BYTES + ((DISPLAY_DIRTY_ROW_BYTES + 127) / 128))
+
+/**
+ * @brief Start the TCP server of the viewer.
+ *
+ * Listens on VIEWER_PORT for one client at a time. The client gets all the
+ * rows of the screen first, and then the rows published by display_refresh,
+ * at most once every VIEWER_FRAME_MS. Each row is a message with the row
+ * number (a byte), the length of the data (a little endian word) and the
+ * DISPLAY_DIRTY_ROW_BYTES bytes of display_getRowPixels packed with PackBits.
+ * A message with the row VIEWER_FRAME_END and no data ends a frame. The
+ * client sends nothing; rp/tools/viewer.py is one.
+ *
+ * @return 0 on success or if already started, -1 if lwIP has no memory.
+ */
+int viewer_init(void);
+
+/**
+ * @brief Send the rows changed since the last call to the client.
+ *
+ * Only sends the rows that fit in the TCP send buffer; the others wait for
+ * the next call, so the viewer never blocks the main loop. Call it every
+ * VIEWER_FRAME_MS.
+ */
+void viewer_poll(void);
+
+/**
+ * @brief Check if a client is watching the screen.
+ *
+ * @return true while a client is connected.
+ */
+bool viewer_isActive(void);
+
+#endif  // VIEWER_H
@@ -15,37 +15,76 @@
 #endif
 #if PICO_CYW43_ARCH_POLL
 #define MEM_LIBC_MALLOC 1
+// The "libc" heap of lwIP is the fixed pools: a pbuf of a full segment fits a
+// 2KB block, and no heap is left fragmented after a transfer
+#include "pool.h"
+#define mem_clib_malloc pool_alloc
+#define mem_clib_free pool_free
+#define mem_clib_calloc pool_calloc
 #else
 // MEM_LIBC_MALLOC is incompatible with non polling versions
 #define MEM_LIBC_MALLOC 0
 #endif
 
+// Memory profile: 0 small, enough for the settings and small files. 1 for
+// bulk transfers, with a TCP window, a pbuf pool and 2KB blocks of pool.h
+// for twice as many segments (about 30KB more of RAM). Measure it with the
+// "download bench" command
+#ifndef NETWORK_LWIP_PROFILE
+#define NETWORK_LWIP_PROFILE 0
+#endif
+
 #define MEM_ALIGNMENT 4
-#define MEM_SIZE 4096
 
 #define MEM_SANITY_CHECK 0
 #define MEM_OVERFLOW_CHECK 0
 
 #define MEMP_NUM_PBUF 8
 #define MEMP_NUM_TCP_PCB 4
-#define MEMP_NUM_TCP_SEG 16
 #define MEMP_NUM_ARP_QUEUE 2
-#define PBUF_POOL_SIZE 12
 #define LWIP_ARP 1
 #define LWIP_ETHERNET 1
 #define LWIP_ICMP 1
 #define LWIP_RAW 0
 #define TCP_MSS 1460
+#if NETWORK_LWIP_PROFILE == 1
+// The pool holds the received segments until acknowledged, so it covers the
+// whole window and the frames in flight
+#define MEM_SIZE 8192
+#define MEMP_NUM_TCP_SEG 32
+#define PBUF_POOL_SIZE 24
+#define TCP_WND (8 * TCP_MSS)
+#define TCP_SND_BUF (8 * TCP_MSS)
+#else
+#define MEM_SIZE 4096
+#define MEMP_NUM_TCP_SEG 16
+#define PBUF_POOL_SIZE 12
 #define TCP_WND (4 * TCP_MSS)
 #define TCP_SND_BUF (4 * TCP_MSS)
+#endif
 #define TCP_SND_QUEUELEN ((2 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
+#if MEM_LIBC_MALLOC && (POOL_CLASS2_BLOCKS < (TCP_WND / TCP_MSS) + 2)
+#error "POOL_CLASS2_BLOCKS must hold a TCP_WND of segments, see pool.h"
+#endif
 #define LWIP_NETIF_STATUS_CALLBACK 1
 #define LWIP_NETIF_LINK_CALLBACK 1
 #define LWIP_NETIF_HOSTNAME 1
 #define LWIP_NETCONN 0
+// Keep the counters read by network_getTelemetry: TCP segments and
+// retransmissions, and the allocation failures of the heap and the pools
+#ifndef NETWORK_TELEMETRY
+#define NETWORK_TELEMETRY 0
+#endif
+#if NETWORK_TELEMETRY == 1
+#define LWIP_STATS 1
+#define MEM_STATS 1
+#define MEMP_STATS 1
+#define MIB2_STATS 1
+#else
 #define MEM_STATS 0
-#define SYS_STATS 0
 #define MEMP_STATS 0
+#endif
+#define SYS_STATS 0
 #define LINK_STATS 0
 // #define ETH_PAD_SIZE                2
 #define LWIP_CHKSUM_ALGORITHM 3
@@ -54,6 +93,8 @@
 #define LWIP_TCP 1
 #define LWIP_UDP 1
 #define LWIP_DNS 1
+// Room for the prefetched hosts, NETWORK_DNS_PREFETCH_HOSTS, and a few more
+#define DNS_TABLE_SIZE 8
 #define LWIP_TCP_KEEPALIVE 0
 #define LWIP_NETIF_TX_SINGLE_PBUF 1
 #define DHCP_DOES_ARP_CHECK 0
@@ -62,7 +103,9 @@
 
 #ifndef NDEBUG
 #define LWIP_DEBUG 1
+#ifndef LWIP_STATS
 #define LWIP_STATS 1
+#endif
 #define LWIP_STATS_DISPLAY 1
 #endif
 
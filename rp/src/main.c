@@ -7,13 +7,18 @@
  */
 
 #include "aconfig.h"
+#include "boottrace.h"
 #include "constants.h"
 #include "debug.h"
 #include "emul.h"
 #include "gconfig.h"
 #include "hardware/clocks.h"
 #include "hardware/vreg.h"
+#include "memfunc.h"
+#include "memwatch.h"
+#include "perf.h"
 #include "pico/stdlib.h"
+#include "pool.h"
 #include "reset.h"
 
 // This is the main.c file for the app or microfirmware. It is the entry point
@@ -34,6 +39,12 @@
 // should be modified when adding new features to the application.
 
 int main() {
+  // Time spent by the boot ROM and the runtime before main
+  boottrace_mark("main");
+
+  // Paint the stacks first, to measure their high water marks with "ram"
+  memwatch_paintStacks();
+
   // Set the clock frequency. Keep in mind that if you are managing remote
   // commands you should overclock the CPU to >=225MHz
   set_sys_clock_khz(RP2040_CLOCK_FREQ_KHZ, true);
@@ -53,6 +64,7 @@ int main() {
   stdio_init_all();
   setvbuf(stdout, NULL, _IONBF,
           1);  // specify that the stream should be unbuffered
+  debug_logInit();
 
   // Only startup information to display
   // You should modify this to show the information you need
@@ -96,6 +108,12 @@ int main() {
 
 #endif
 
+  // The settings buffers of the steady state come from the fixed pools
+  settings_setAllocator(pool_alloc, pool_free);
+
+  // The DMA copies of the interrupts need the channels claimed here
+  memfunc_dmaInit();
+
   // Load the global configuration parameters
   int err = gconfig_init(CURRENT_APP_UUID_KEY);
   // If the global settings are not intialized, jump to the booster app to
@@ -104,6 +122,7 @@ int main() {
     DPRINTF("Settings not initialized. Jump to Booster application\n");
     reset_jump_to_booster();
   }
+  boottrace_mark("gconfig");
 
   // If we are here, it means the app uuid key is correct. So we can read or
   // initialize the app settings
@@ -133,6 +152,12 @@ int main() {
       settings_print(aconfig_getContext(), NULL);
       break;
   }
+  boottrace_mark("aconfig");
+
+  // Switch to the clock and voltage profile of the app settings. It falls back
+  // to the default values above if the profile is not stable
+  perf_init();
+  boottrace_mark("perf");
 
   // Start the application
   emul_start();
@@ -7,18 +7,36 @@
 #define MBEDTLS_NO_PLATFORM_ENTROPY
 #define MBEDTLS_ENTROPY_HARDWARE_ALT
 
+// Profile of the HTTPS downloads: 0 works with any server. 1 shortens the
+// handshake: only ECDHE-ECDSA with P-256, no RSA key exchange and a smaller
+// output buffer. Measure it with the "download bench" command
+#ifndef APP_DOWNLOAD_TLS_PROFILE
+#define APP_DOWNLOAD_TLS_PROFILE 0
+#endif
+
 // Buffers
 #define MBEDTLS_SSL_MAX_CONTENT_LEN 4096
 #define MBEDTLS_SSL_IN_CONTENT_LEN MBEDTLS_SSL_MAX_CONTENT_LEN
+#if APP_DOWNLOAD_TLS_PROFILE == 1
+// The client only sends the requests
+#define MBEDTLS_SSL_OUT_CONTENT_LEN 2048
+#else
 #define MBEDTLS_SSL_OUT_CONTENT_LEN MBEDTLS_SSL_MAX_CONTENT_LEN
+#endif
 
 // Protocol / extensions
 #define MBEDTLS_SSL_PROTO_TLS1_2
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION
 #define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+// Resume the session of the last connection with a ticket of the server
+#define MBEDTLS_SSL_SESSION_TICKETS
 
 // Key exchange suites
+#if APP_DOWNLOAD_TLS_PROFILE == 1
+#define MBEDTLS_SSL_CIPHERSUITES MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256
+#else
 #define MBEDTLS_KEY_EXCHANGE_ECDHE_RSA_ENABLED
+#endif
 #define MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
 
 // Curves
@@ -31,8 +49,13 @@
 #define MBEDTLS_GCM_C
 #define MBEDTLS_BASE64_C
 #define MBEDTLS_MD_C
+#define MBEDTLS_MD5_C
 #define MBEDTLS_SHA256_C
 
+// Count the heap of the TLS connections, see http_client_get_tls_heap
+#define MBEDTLS_PLATFORM_C
+#define MBEDTLS_PLATFORM_MEMORY
+
 // RNG / entropy
 #define MBEDTLS_ENTROPY_C
 #define MBEDTLS_CTR_DRBG_C
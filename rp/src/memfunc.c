@@ -0,0 +1,287 @@
+/**
+ * File: memfunc.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Asynchronous DMA copies
+ */
+
+#include "memfunc.h"
+
+#include <string.h>
+
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+
+typedef struct {
+  int dataChannel;
+  int controlChannel;
+  volatile bool busy;
+  MemfuncDmaCallback callback;
+  void *context;
+} MemfuncDmaSlot;
+
+static MemfuncDmaSlot dmaSlots[MEMFUNC_DMA_SLOTS];
+static int dmaSlotCount = 0;
+
+static void memfuncDmaIrqHandler(void) {
+  for (int i = 0; i < dmaSlotCount; i++) {
+    MemfuncDmaSlot *slot = &dmaSlots[i];
+    uint32_t mask = 1u << (uint)slot->dataChannel;
+    if (dma_hw->ints0 & mask) {
+      dma_hw->ints0 = mask;
+      slot->busy = false;
+      if (slot->callback != NULL) {
+        slot->callback(slot->context);
+      }
+    }
+  }
+}
+
+// The slots claimed are kept even if there are not enough channels for all
+// of them
+void memfunc_dmaInit(void) {
+  if (dmaSlotCount > 0) {
+    return;
+  }
+  for (int i = 0; i < MEMFUNC_DMA_SLOTS; i++) {
+    int dataChannel = dma_claim_unused_channel(false);
+    int controlChannel = dma_claim_unused_channel(false);
+    if ((dataChannel < 0) || (controlChannel < 0)) {
+      if (dataChannel >= 0) dma_channel_unclaim((uint)dataChannel);
+      if (controlChannel >= 0) dma_channel_unclaim((uint)controlChannel);
+      DPRINTF("Only %d DMA copy slots available.\n", dmaSlotCount);
+      break;
+    }
+    dmaSlots[dmaSlotCount].dataChannel = dataChannel;
+    dmaSlots[dmaSlotCount].controlChannel = controlChannel;
+    dmaSlots[dmaSlotCount].busy = false;
+    dma_channel_set_irq0_enabled((uint)dataChannel, true);
+    dmaSlotCount++;
+  }
+  if (dmaSlotCount > 0) {
+    // DMA_IRQ_1 belongs to the ROM emulator. Share DMA_IRQ_0 with others
+    irq_add_shared_handler(DMA_IRQ_0, memfuncDmaIrqHandler,
+                           PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+  }
+}
+
+// Take a free slot, or NULL if all are busy
+static MemfuncDmaSlot *memfuncDmaAcquire(MemfuncDmaCallback callback,
+                                         void *context) {
+  MemfuncDmaSlot *found = NULL;
+  uint32_t ints = save_and_disable_interrupts();
+  for (int i = 0; i < dmaSlotCount; i++) {
+    if (!dmaSlots[i].busy) {
+      found = &dmaSlots[i];
+      found->busy = true;
+      found->callback = callback;
+      found->context = context;
+      break;
+    }
+  }
+  restore_interrupts(ints);
+  return found;
+}
+
+static dma_channel_config memfuncDmaConfig(const MemfuncDmaSlot *slot,
+                                           bool swap16) {
+  dma_channel_config config =
+      dma_channel_get_default_config((uint)slot->dataChannel);
+  channel_config_set_transfer_data_size(&config,
+                                        swap16 ? DMA_SIZE_16 : DMA_SIZE_32);
+  channel_config_set_read_increment(&config, true);
+  channel_config_set_write_increment(&config, true);
+  channel_config_set_bswap(&config, swap16);
+  return config;
+}
+
+// Copy on the CPU when there is no DMA slot free
+static void memfuncCpuCopy(void *dest, const void *source, size_t numBytes,
+                           bool swap16) {
+  if (!swap16) {
+    memcpy(dest, source, numBytes);
+    return;
+  }
+  size_t done = 0;
+  if ((((uintptr_t)dest | (uintptr_t)source) & 3u) == 0) {
+    // Two words per load and store
+    const uint32_t *src32 = (const uint32_t *)source;
+    uint32_t *dst32 = (uint32_t *)dest;
+    for (size_t i = 0; i < numBytes / 4; i++) {
+      dst32[i] = SWAP_WORDS32(src32[i]);
+    }
+    done = numBytes & ~(size_t)3;
+  }
+  const uint16_t *src = (const uint16_t *)((const uint8_t *)source + done);
+  uint16_t *dst = (uint16_t *)((uint8_t *)dest + done);
+  for (size_t i = 0; i < (numBytes - done) / 2; i++) {
+    dst[i] = SWAP_WORD(src[i]);
+  }
+}
+
+void memfunc_dmaCopySwap16(void *dest, const void *source, size_t numBytes) {
+  MemfuncDmaSlot *slot = NULL;
+  if (numBytes >= MEMFUNC_DMA_MIN_BYTES) {
+    slot = memfuncDmaAcquire(NULL, NULL);
+  }
+  if (slot == NULL) {
+    memfuncCpuCopy(dest, source, numBytes, true);
+    return;
+  }
+
+  // Quiet: the slot is freed here, so the interrupt must not see this copy
+  dma_channel_config config = memfuncDmaConfig(slot, true);
+  channel_config_set_irq_quiet(&config, true);
+  dma_channel_configure((uint)slot->dataChannel, &config, dest, source,
+                        numBytes / 2, true);
+  dma_channel_wait_for_finish_blocking((uint)slot->dataChannel);
+  slot->busy = false;
+}
+
+int memfunc_dmaCopyAsync(void *dest, const void *source, size_t numBytes,
+                         bool swap16, MemfuncDmaCallback callback,
+                         void *context) {
+  MemfuncDmaSlot *slot = memfuncDmaAcquire(callback, context);
+  if (slot == NULL) {
+    memfuncCpuCopy(dest, source, numBytes, swap16);
+    if (callback != NULL) {
+      callback(context);
+    }
+    return MEMFUNC_DMA_NO_JOB;
+  }
+
+  dma_channel_config config = memfuncDmaConfig(slot, swap16);
+  dma_channel_configure((uint)slot->dataChannel, &config, dest, source,
+                        numBytes >> (swap16 ? 1 : 2), true);
+  return (int)(slot - dmaSlots);
+}
+
+int memfunc_dmaCopyListAsync(MemfuncDmaBlock *blocks, bool swap16,
+                             MemfuncDmaCallback callback, void *context) {
+  MemfuncDmaSlot *slot = memfuncDmaAcquire(callback, context);
+  if (slot == NULL) {
+    for (MemfuncDmaBlock *block = blocks; block->count > 0; block++) {
+      memfuncCpuCopy(block->write, block->read, block->count, swap16);
+    }
+    if (callback != NULL) {
+      callback(context);
+    }
+    return MEMFUNC_DMA_NO_JOB;
+  }
+
+  // Each block restarts the control channel when done. Only the null trigger
+  // of the last block raises the interrupt
+  dma_channel_config config = memfuncDmaConfig(slot, swap16);
+  channel_config_set_chain_to(&config, (uint)slot->controlChannel);
+  channel_config_set_irq_quiet(&config, true);
+  uint32_t ctrl = channel_config_get_ctrl_value(&config);
+  MemfuncDmaBlock *block = blocks;
+  for (; block->count > 0; block++) {
+    block->ctrl = ctrl;
+    block->count >>= swap16 ? 1 : 2;
+  }
+  block->ctrl = ctrl;
+
+  // The control channel writes the four words of a block into the alias 1
+  // registers of the data channel, and the last one triggers it
+  dma_channel_config control =
+      dma_channel_get_default_config((uint)slot->controlChannel);
+  channel_config_set_transfer_data_size(&control, DMA_SIZE_32);
+  channel_config_set_read_increment(&control, true);
+  channel_config_set_write_increment(&control, true);
+  channel_config_set_ring(&control, true, 4);
+  dma_channel_configure((uint)slot->controlChannel, &control,
+                        &dma_hw->ch[slot->dataChannel].al1_ctrl, blocks,
+                        sizeof(MemfuncDmaBlock) / sizeof(uint32_t), true);
+  return (int)(slot - dmaSlots);
+}
+
+bool memfunc_dmaIsBusy(int job) {
+  if ((job < 0) || (job >= dmaSlotCount)) {
+    return false;
+  }
+  return dmaSlots[job].busy;
+}
+
+void memfunc_dmaWait(int job) {
+  while (memfunc_dmaIsBusy(job)) {
+    tight_loop_contents();
+  }
+}
+
+// Lengths of 15 go on in the next bytes, each 255 adds and ends the run
+static inline bool __not_in_flash_func(lz4Length)(const uint8_t **in,
+                                                 const uint8_t *end,
+                                                 size_t *length) {
+  uint8_t extra;
+  do {
+    if (*in >= end) {
+      return false;
+    }
+    extra = *(*in)++;
+    *length += extra;
+  } while (extra == 255);
+  return true;
+}
+
+int __not_in_flash_func(memfunc_lz4Decompress)(void *dest, const void *source,
+                                               size_t sourceSize,
+                                               size_t destSize) {
+  const uint8_t *in = (const uint8_t *)source;
+  const uint8_t *inEnd = in + sourceSize;
+  uint8_t *out = (uint8_t *)dest;
+  uint8_t *outEnd = out + destSize;
+
+  while (in < inEnd) {
+    uint8_t token = *in++;
+    size_t literals = token >> 4;
+    if ((literals == 15) && !lz4Length(&in, inEnd, &literals)) {
+      return -1;
+    }
+    if ((literals > (size_t)(inEnd - in)) ||
+        (literals > (size_t)(outEnd - out))) {
+      return -1;
+    }
+    memcpy(out, in, literals);
+    in += literals;
+    out += literals;
+    // The last sequence has only literals
+    if (in == inEnd) {
+      break;
+    }
+
+    if ((inEnd - in) < 2) {
+      return -1;
+    }
+    size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+    in += 2;
+    size_t length = token & 0x0F;
+    if ((length == 15) && !lz4Length(&in, inEnd, &length)) {
+      return -1;
+    }
+    length += 4;
+    if ((offset == 0) || (offset > (size_t)(out - (uint8_t *)dest)) ||
+        (length > (size_t)(outEnd - out))) {
+      return -1;
+    }
+    const uint8_t *match = out - offset;
+    if (offset >= sizeof(uint32_t)) {
+      // No overlap within a word: copy four bytes at a time
+      while (length >= sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, match, sizeof(word));
+        memcpy(out, &word, sizeof(word));
+        match += sizeof(word);
+        out += sizeof(word);
+        length -= sizeof(word);
+      }
+    }
+    // Overlapping matches repeat the last offset bytes
+    while (length-- > 0) {
+      *out++ = *match++;
+    }
+  }
+  return (int)(out - (uint8_t *)dest);
+}
@@ -0,0 +1,70 @@
+/**
+ * File: memwatch.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Stack and RAM usage watermarks
+ */
+
+#include "memwatch.h"
+
+#include <malloc.h>
+
+// Linker script symbols
+extern uint32_t __scratch_x_end__;
+extern uint32_t __scratch_y_end__;
+extern uint32_t __StackOneTop;
+extern uint32_t __StackTop;
+extern uint32_t __data_start__;
+extern uint32_t __bss_end__;
+extern uint32_t __end__;
+extern uint32_t __rom_in_ram_start__;
+
+static bool stacksPainted = false;
+
+static void paint(uint32_t *start, uint32_t *end) {
+  for (uint32_t *word = start; word < end; word++) {
+    *word = MEMWATCH_PAINT;
+  }
+}
+
+static void measure(uint32_t *bottom, uint32_t *top, uint32_t *sp,
+                    MemwatchRegion *region) {
+  uint32_t *word = bottom;
+  while ((word < top) && (*word == MEMWATCH_PAINT)) {
+    word++;
+  }
+  region->size = (uint32_t)(top - bottom) * sizeof(uint32_t);
+  region->highWater = (uint32_t)(top - word) * sizeof(uint32_t);
+  region->used = ((sp >= bottom) && (sp <= top))
+                     ? (uint32_t)(top - sp) * sizeof(uint32_t)
+                     : 0;
+}
+
+static uint32_t *currentSp(void) {
+  uint32_t *sp;
+  __asm volatile("mov %0, sp" : "=r"(sp));
+  return sp;
+}
+
+void memwatch_paintStacks(void) {
+  paint(&__scratch_y_end__, currentSp() - MEMWATCH_PAINT_MARGIN);
+  paint(&__scratch_x_end__, &__StackOneTop);
+  stacksPainted = true;
+}
+
+void memwatch_getReport(MemwatchReport *report) {
+  uint32_t *sp = currentSp();
+  measure(&__scratch_y_end__, &__StackTop, sp, &report->stack[0]);
+  // The stack pointer of core1 is not known from core0
+  measure(&__scratch_x_end__, &__StackOneTop, NULL, &report->stack[1]);
+  report->painted = stacksPainted;
+
+  struct mallinfo info = mallinfo();
+  report->heap.size = (uint32_t)((uint8_t *)&__rom_in_ram_start__ -
+                                 (uint8_t *)&__end__);
+  report->heap.used = (uint32_t)info.uordblks;
+  report->heap.highWater = (uint32_t)info.arena;
+  report->staticBytes =
+      (uint32_t)((uint8_t *)&__bss_end__ - (uint8_t *)&__data_start__);
+}
@@ -0,0 +1,223 @@
+/**
+ * File: metrics.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: UDP exporter of the device metrics
+ */
+
+#include "metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "boottrace.h"
+#include "download.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "memwatch.h"
+#include "network.h"
+#include "pico/cyw43_arch.h"
+#include "pico/time.h"
+#include "romemul.h"
+#include "term.h"
+
+static struct udp_pcb *metricsPcb = NULL;
+static char collectorHost[NETWORK_DNS_HOST_SIZE];
+static uint16_t collectorPort = METRICS_DEFAULT_PORT;
+static uint32_t intervalUs = 0;
+static uint64_t nextSendUs = 0;
+static uint32_t sendErrors = 0;
+
+// Commands at the last line, for the rate
+static uint32_t lastCommands = 0;
+static uint64_t lastCommandsUs = 0;
+
+// Split "host:port" into the collector. False if it is not valid
+static bool parseCollector(const char *value) {
+  const char *colon = strrchr(value, ':');
+  size_t hostLength = (colon != NULL) ? (size_t)(colon - value) : strlen(value);
+  if ((hostLength == 0) || (hostLength >= sizeof(collectorHost))) {
+    return false;
+  }
+  collectorPort = METRICS_DEFAULT_PORT;
+  if (colon != NULL) {
+    char *end = NULL;
+    unsigned long port = strtoul(colon + 1, &end, 10);
+    if ((end == colon + 1) || (*end != '\0') || (port == 0) ||
+        (port > 0xFFFF)) {
+      return false;
+    }
+    collectorPort = (uint16_t)port;
+  }
+  memcpy(collectorHost, value, hostLength);
+  collectorHost[hostLength] = '\0';
+  return true;
+}
+
+int metrics_init(void) {
+  if (metricsPcb != NULL) {
+    return 0;
+  }
+  SettingsContext *ctx = gconfig_getContext();
+  const char *collector = settings_get_string(
+      ctx, settings_get_handle(ctx, PARAM_METRICS_COLLECTOR));
+  int interval = 0;
+  if ((collector == NULL) || (collector[0] == '\0') ||
+      (settings_get_int(ctx, settings_get_handle(ctx, PARAM_METRICS_INTERVAL),
+                        &interval) != 0) ||
+      (interval <= 0)) {
+    DPRINTF("Metrics exporter disabled\n");
+    return 0;
+  }
+  if (!parseCollector(collector)) {
+    DPRINTF("Invalid metrics collector: %s\n", collector);
+    return 0;
+  }
+  if (interval < METRICS_MIN_INTERVAL_S) {
+    interval = METRICS_MIN_INTERVAL_S;
+  }
+  cyw43_arch_lwip_begin();
+  metricsPcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+  cyw43_arch_lwip_end();
+  if (metricsPcb == NULL) {
+    DPRINTF("No memory for the metrics exporter\n");
+    return -1;
+  }
+  intervalUs = (uint32_t)interval * 1000000u;
+  nextSendUs = time_us_64();
+  lastCommandsUs = 0;
+  // Resolve it now, so the first datagram does not wait an interval
+  ip_addr_t addr;
+  network_dnsLookup(collectorHost, &addr);
+  DPRINTF("Metrics to %s:%u every %d s\n", collectorHost,
+          (unsigned)collectorPort, interval);
+  return 0;
+}
+
+// Append a field while the buffer has room. len is -1 once it is full
+static void appendField(char *buffer, size_t size, int *len, const char *fmt,
+                        ...) {
+  if ((*len < 0) || ((size_t)*len >= size)) {
+    *len = -1;
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  int added = vsnprintf(buffer + *len, size - (size_t)*len, fmt, args);
+  va_end(args);
+  *len = (added < 0) ? -1 : (*len + added);
+}
+
+int metrics_formatLine(char *buffer, size_t size) {
+  uint64_t nowUs = time_us_64();
+  const SettingsConfigEntry *hostname =
+      settings_find_entry(gconfig_getContext(), PARAM_HOSTNAME);
+  int len = snprintf(buffer, size, "%s,host=%s uptime=%llui",
+                     METRICS_MEASUREMENT,
+                     ((hostname != NULL) && (hostname->value[0] != '\0'))
+                         ? hostname->value
+                         : "sidecart",
+                     (unsigned long long)(nowUs / 1000000));
+
+  size_t marks = boottrace_getCount();
+  if (marks > 0) {
+    appendField(buffer, size, &len, ",boot_ms=%lui",
+                (unsigned long)(boottrace_get(marks - 1)->timeUs / 1000));
+  }
+
+  TermProtocolStats protocol;
+  term_getProtocolStats(&protocol);
+  appendField(buffer, size, &len,
+              ",commands=%lui,drops=%lui,checksum_errors=%lui,ring_hw=%lui",
+              (unsigned long)protocol.commands, (unsigned long)protocol.drops,
+              (unsigned long)protocol.checksumErrors,
+              (unsigned long)protocol.highWater);
+  if (lastCommandsUs > 0) {
+    // A "stats reset" starts the counters again
+    uint32_t commands = (protocol.commands >= lastCommands)
+                            ? (protocol.commands - lastCommands)
+                            : protocol.commands;
+    uint64_t elapsedUs = nowUs - lastCommandsUs;
+    appendField(buffer, size, &len, ",command_rate=%lui",
+                (unsigned long)(((uint64_t)commands * 1000000) /
+                                ((elapsedUs > 0) ? elapsedUs : 1)));
+  }
+  lastCommands = protocol.commands;
+  lastCommandsUs = nowUs;
+
+  RomemulBusStats bus;
+  if ((romemul_getBusStats(&bus) == 0) && (bus.samples > 0)) {
+    appendField(buffer, size, &len,
+                ",irq_latency_avg_us=%lui,irq_latency_max_us=%lui",
+                (unsigned long)(bus.latencySumUs / bus.samples),
+                (unsigned long)bus.latencyMaxUs);
+  }
+
+  MemwatchReport memory;
+  memwatch_getReport(&memory);
+  appendField(buffer, size, &len, ",heap_hw=%lui",
+              (unsigned long)memory.heap.highWater);
+  if (memory.painted) {
+    appendField(buffer, size, &len, ",stack0_hw=%lui,stack1_hw=%lui",
+                (unsigned long)memory.stack[0].highWater,
+                (unsigned long)memory.stack[1].highWater);
+  }
+
+  // Bytes written by the time spent in f_write
+  download_stats_t download;
+  download_getStats(&download);
+  if (download.writeUs > 0) {
+    appendField(buffer, size, &len, ",sd_write_kbps=%lui",
+                (unsigned long)(((uint64_t)download.receivedBytes * 1000000) /
+                                download.writeUs / 1024));
+  }
+
+  network_telemetry_t network;
+  network_getTelemetry(&network);
+  if (network.rssi != INT16_MIN) {
+    appendField(buffer, size, &len, ",rssi=%di", network.rssi);
+  }
+  appendField(buffer, size, &len, ",send_errors=%lui",
+              (unsigned long)sendErrors);
+
+  return ((len < 0) || ((size_t)len >= size)) ? -1 : len;
+}
+
+void metrics_poll(void) {
+  if (metricsPcb == NULL) {
+    return;
+  }
+  uint64_t nowUs = time_us_64();
+  if (nowUs < nextSendUs) {
+    return;
+  }
+  // The DNS answer comes in the background. Try again in the next poll
+  ip_addr_t addr;
+  if (!network_dnsLookup(collectorHost, &addr)) {
+    return;
+  }
+  nextSendUs = nowUs + intervalUs;
+
+  char line[METRICS_LINE_SIZE];
+  int len = metrics_formatLine(line, sizeof(line));
+  if (len < 0) {
+    DPRINTF("The metrics do not fit in %d bytes\n", METRICS_LINE_SIZE);
+    return;
+  }
+  cyw43_arch_lwip_begin();
+  struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)len, PBUF_RAM);
+  err_t err = ERR_MEM;
+  if (p != NULL) {
+    memcpy(p->payload, line, (size_t)len);
+    err = udp_sendto(metricsPcb, p, &addr, collectorPort);
+    pbuf_free(p);
+  }
+  cyw43_arch_lwip_end();
+  if (err != ERR_OK) {
+    sendErrors++;
+    DPRINTF("Error sending the metrics: %d\n", err);
+  }
+}
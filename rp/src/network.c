@@ -12,6 +12,48 @@ static char cyw43MacStr[NETWORK_MAX_STRING_LENGTH];
 static wifi_sta_conn_status_t connectionStatus = DISCONNECTED;
 static char connectionStatusStr[NETWORK_MAX_STRING_LENGTH] = {0};
 
+// State of the connection started by network_wifiStaConnectStart
+static bool staConnPending = false;
+static absolute_time_t staConnStatusTime;
+static absolute_time_t staConnTimeout;
+static wifi_sta_conn_status_t staConnPrevStatus = DISCONNECTED;
+
+// Access point and lease of the last connection, used once after the boot
+typedef struct {
+  uint8_t bssid[NETWORK_MAC_SIZE];
+  uint32_t channel;
+  ip_addr_t ip;
+} wifi_cache_t;
+static bool wifiCacheTried = false;
+
+// Background connection of network_wifiStaConnectAsync
+static bool staConnAsync = false;
+static int staConnAttempt = 0;
+static int staConnAttempts = 0;
+static async_at_time_worker_t staConnWorker;
+static NetworkConnectCallback networkConnectCallback = NULL;
+
+// Hosts resolved when the link comes up. Empty slots start with '\0'
+static char dnsPrefetchHosts[NETWORK_DNS_PREFETCH_HOSTS]
+                            [NETWORK_DNS_HOST_SIZE];
+static int dnsPrefetchNext = 0;
+
+// Power management mode of the settings, the one set in the chip and the
+// transfers in progress
+static uint32_t configuredPm = NETWORK_POWER_MGMT_DISABLED;
+static uint32_t currentPm = 0;
+static int activityCount = 0;
+static async_at_time_worker_t powerWorker;
+
+// RSSI samples of the telemetry, oldest first from rssiNext once full
+static int16_t rssiHistory[NETWORK_TELEMETRY_RSSI_SAMPLES];
+static int rssiCount = 0;
+static int rssiNext = 0;
+static uint32_t linkDownCount = 0;
+static uint32_t connectAttempts = 0;
+static async_at_time_worker_t telemetryWorker;
+static bool telemetryStarted = false;
+
 // Static variable to store the callback function
 static NetworkPollingCallback networkPollingCallback = NULL;
 
@@ -301,6 +343,23 @@ int network_initChipOnly() {
 }
 #endif
 
+// Set the mode of the activity, or the one of the settings without the policy
+static void applyPowerMode(void) {
+  uint32_t pm = configuredPm;
+#if NETWORK_POWER_POLICY == 1
+  if (wifiCurrentMode == WIFI_MODE_STA) {
+    pm = (activityCount > 0) ? NETWORK_POWER_BUSY_PM : NETWORK_POWER_IDLE_PM;
+  }
+#endif
+  if (pm == currentPm) {
+    return;
+  }
+  DPRINTF("Setting power management to: %08x\n", pm);
+  if (cyw43_wifi_pm(&cyw43_state, pm) == 0) {
+    currentPm = pm;
+  }
+}
+
 /**
  * @brief Initialize the WiFi network with the specified mode.
  *
@@ -323,7 +382,7 @@ int network_wifiInit(wifi_mode_t mode) {
   cyw43Initialized = true;
   DPRINTF("CYW43 Logging level: %d\n", CYW43_VERBOSE_DEBUG);
   uint32_t country = CYW43_COUNTRY_WORLDWIDE;
-  SettingsConfigEntry *countryEntry =
+  const SettingsConfigEntry *countryEntry =
       settings_find_entry(gconfig_getContext(), PARAM_WIFI_COUNTRY);
   if (countryEntry != NULL) {
     char *valid;
@@ -389,7 +448,7 @@ int network_wifiInit(wifi_mode_t mode) {
 
   // Setting the power management
   uint32_t pmValue = NETWORK_POWER_MGMT_DISABLED;  // 0: Disable PM
-  SettingsConfigEntry *pmEntry =
+  const SettingsConfigEntry *pmEntry =
       settings_find_entry(gconfig_getContext(), PARAM_WIFI_POWER);
   if (pmEntry != NULL) {
     pmValue = strtoul(pmEntry->value, NULL, HEX_BASE);
@@ -413,12 +472,46 @@ int network_wifiInit(wifi_mode_t mode) {
         break;
     }
   }
-  DPRINTF("Setting power management to: %08x\n", pmValue);
-  cyw43_wifi_pm(&cyw43_state, pmValue);
+  configuredPm = pmValue;
+  currentPm = 0;
+  applyPowerMode();
   return 0;
 }
 #endif
 
+#if NETWORK_POWER_POLICY == 1
+static void powerWorkerFn(async_context_t *context,
+                          async_at_time_worker_t *worker) {
+  (void)context;
+  (void)worker;
+  applyPowerMode();
+}
+#endif
+
+// Change the mode from the async context, out of the lwIP and CYW43 callbacks
+static void schedulePowerMode(void) {
+#if NETWORK_POWER_POLICY == 1
+  if (cyw43Initialized) {
+    async_context_t *context = cyw43_arch_async_context();
+    powerWorker.do_work = powerWorkerFn;
+    async_context_remove_at_time_worker(context, &powerWorker);
+    async_context_add_at_time_worker_in_ms(context, &powerWorker, 0);
+  }
+#endif
+}
+
+void network_activityBegin(void) {
+  if (++activityCount == 1) {
+    schedulePowerMode();
+  }
+}
+
+void network_activityEnd(void) {
+  if ((activityCount > 0) && (--activityCount == 0)) {
+    schedulePowerMode();
+  }
+}
+
 /**
  * @brief Safely polls the network if the CYW43 module is initialized.
  *
@@ -433,12 +526,122 @@ void network_safePoll() {
   }
 }
 
+// Scans missed by each entry of wifiScanData, in the same order
+static uint8_t wifiScanAge[MAX_NETWORKS];
+static absolute_time_t wifiScanNextTime;
+static absolute_time_t wifiScanDoneTime;
+static bool wifiScanDone = false;
+
+static void swapScanEntries(int a, int b) {
+  wifi_network_info_t network = wifiScanData.networks[a];
+  wifiScanData.networks[a] = wifiScanData.networks[b];
+  wifiScanData.networks[b] = network;
+  uint8_t age = wifiScanAge[a];
+  wifiScanAge[a] = wifiScanAge[b];
+  wifiScanAge[b] = age;
+}
+
+// Move an entry to its place after a change of RSSI. The table stays sorted,
+// strongest first, and only the changed entry moves
+static void sortScanEntry(int index) {
+  while ((index > 0) && (wifiScanData.networks[index].rssi >
+                         wifiScanData.networks[index - 1].rssi)) {
+    swapScanEntries(index, index - 1);
+    index--;
+  }
+  while ((index + 1 < wifiScanData.count) &&
+         (wifiScanData.networks[index].rssi <
+          wifiScanData.networks[index + 1].rssi)) {
+    swapScanEntries(index, index + 1);
+    index++;
+  }
+}
+
+// Merge one result of the scan in the table. A known BSSID only refreshes its
+// RSSI. With the table full, a new network replaces the weakest one
+static int mergeScanResult(void *env, const cyw43_ev_scan_result_t *result) {
+  (void)env;
+  if ((result == NULL) || (result->ssid_len == 0)) {
+    return 0;
+  }
+  char bssid[MAX_BSSID_LENGTH];
+  snprintf(bssid, sizeof(bssid), "%02x:%02x:%02x:%02x:%02x:%02x",
+           result->bssid[0], result->bssid[1], result->bssid[2],
+           result->bssid[3], result->bssid[4], result->bssid[5]);
+
+  int index = -1;
+  for (int i = 0; i < wifiScanData.count; i++) {
+    if (strcmp(wifiScanData.networks[i].bssid, bssid) == 0) {
+      index = i;
+      break;
+    }
+  }
+  if (index < 0) {
+    if (wifiScanData.count < MAX_NETWORKS) {
+      index = wifiScanData.count++;
+    } else if (result->rssi >
+               wifiScanData.networks[wifiScanData.count - 1].rssi) {
+      index = wifiScanData.count - 1;
+    } else {
+      return 0;
+    }
+    wifi_network_info_t *network = &wifiScanData.networks[index];
+    snprintf(network->ssid, sizeof(network->ssid), "%.*s",
+             (int)result->ssid_len, result->ssid);
+    snprintf(network->bssid, sizeof(network->bssid), "%s", bssid);
+    DPRINTF("FOUND NETWORK %s (%s) with auth %d and RSSI %d\n",
+            network->ssid, network->bssid, result->auth_mode, result->rssi);
+  }
+  wifiScanData.networks[index].auth_mode = result->auth_mode;
+  wifiScanData.networks[index].rssi = result->rssi;
+  wifiScanAge[index] = 0;
+  sortScanEntry(index);
+  return 0;
+}
+
+static bool startScan(bool passive) {
+  cyw43_wifi_scan_options_t scanOptions = {0};
+  scanOptions.scan_type = passive ? NETWORK_SCAN_TYPE_PASSIVE : 0;
+  int err =
+      cyw43_wifi_scan(&cyw43_state, &scanOptions, NULL, mergeScanResult);
+  if (err != 0) {
+    DPRINTF("Failed to start scan: %d\n", err);
+    return false;
+  }
+  // The results refresh the entries still in range back to age 0
+  for (int i = 0; i < wifiScanData.count; i++) {
+    if (wifiScanAge[i] < UINT8_MAX) {
+      wifiScanAge[i]++;
+    }
+  }
+  DPRINTF("Performing %s wifi scan\n", passive ? "passive" : "active");
+  wifiScanInProgress = true;
+  return true;
+}
+
+// Drop the networks missed by too many scans. The order is kept
+static void finishScan(void) {
+  uint16_t kept = 0;
+  for (int i = 0; i < wifiScanData.count; i++) {
+    if (wifiScanAge[i] <= NETWORK_SCAN_MAX_AGE) {
+      wifiScanData.networks[kept] = wifiScanData.networks[i];
+      wifiScanAge[kept] = wifiScanAge[i];
+      kept++;
+    }
+  }
+  wifiScanData.count = kept;
+  wifiScanInProgress = false;
+  wifiScanDone = true;
+  wifiScanDoneTime = get_absolute_time();
+  DPRINTF("Scan done. %d networks\n", wifiScanData.count);
+}
+
 /**
  * @brief Scans for available Wi-Fi networks and stores the results.
  *
  * This function initiates a Wi-Fi network scan if the network is initialized
- * and the scan interval has elapsed. It processes the scan results and stores
- * unique networks in the global `wifi_scan_data` structure.
+ * and the scan interval has elapsed. The results are merged in the global
+ * `wifiScanData` table, sorted by RSSI.
  *
  * @param wifi_scan_time Pointer to the absolute time of the last scan.
  * @param wifi_scan_interval Interval between scans in seconds.
@@ -449,78 +652,59 @@ int network_scan(absolute_time_t *wifiScanTime, int wifiScanInterval) {
     // If the network is not initialized, we cancel the scan
     return -1;
   }
-  int scan_result(void *env, const cyw43_ev_scan_result_t *result) {
-    // Check if the BSSID already exists in the found networks
-    bool bssid_exists(wifi_network_info_t * network) {
-      for (size_t i = 0; i < wifiScanData.count; i++) {
-        if (strcmp(wifiScanData.networks[i].bssid, network->bssid) == 0) {
-          return true;  // BSSID found
-        }
-      }
-      return false;  // BSSID not found
-    }
-    if (result && wifiScanData.count < MAX_NETWORKS) {
-      wifi_network_info_t network;
-
-      // Copy SSID
-      snprintf(network.ssid, sizeof(network.ssid), "%s", result->ssid);
-
-      // Format BSSID
-      snprintf(network.bssid, sizeof(network.bssid),
-               "%02x:%02x:%02x:%02x:%02x:%02x", result->bssid[0],
-               result->bssid[1], result->bssid[2], result->bssid[3],
-               result->bssid[4], result->bssid[5]);
-
-      // Store authentication mode
-      network.auth_mode = result->auth_mode;
-
-      // Store signal strength
-      network.rssi = result->rssi;
-
-      // Check if BSSID already exists
-      if (!bssid_exists(&network)) {
-        if (strlen(network.ssid) > 0) {
-          wifiScanData.networks[wifiScanData.count] = network;
-          wifiScanData.count++;
-          DPRINTF("FOUND NETWORK %s (%s) with auth %d and RSSI %d\n",
-                  network.ssid, network.bssid, network.auth_mode, network.rssi);
-        }
-      }
-    }
+  if (absolute_time_diff_us(get_absolute_time(), *wifiScanTime) >= 0) {
     return 0;
   }
-  // DPRINTF("Time diff: %lld\n", absolute_time_diff_us(get_absolute_time(),
-  // (absolute_time_t)*wifi_scan_time));
-  if (absolute_time_diff_us(get_absolute_time(), *wifiScanTime) < 0) {
-    if (!wifiScanInProgress) {
-      DPRINTF("Scanning networks...\n");
-      cyw43_wifi_scan_options_t scanOptions = {0};
-      int err = cyw43_wifi_scan(&cyw43_state, &scanOptions, NULL, scan_result);
-      if (err == 0) {
-        DPRINTF("Performing wifi scan\n");
-        wifiScanInProgress = true;
-      } else {
-        DPRINTF("Failed to start scan: %d\n", err);
-        *wifiScanTime = make_timeout_time_ms(wifiScanInterval * SEC_TO_MS);
-      }
-    } else {
-      if (!cyw43_wifi_scan_active(&cyw43_state)) {
-        DPRINTF("Continue scanning...\n");
-        wifiScanInProgress = false;
-      }
+  if (!wifiScanInProgress) {
+    DPRINTF("Scanning networks...\n");
+    if (!startScan(false)) {
       *wifiScanTime = make_timeout_time_ms(wifiScanInterval * SEC_TO_MS);
     }
+  } else {
+    if (!cyw43_wifi_scan_active(&cyw43_state)) {
+      finishScan();
+    }
+    *wifiScanTime = make_timeout_time_ms(wifiScanInterval * SEC_TO_MS);
   }
-  // else {
-  //     DPRINTF("Scan already in progress\n");
-  // }
+  return 0;
+}
+
+int network_scanBackground(void) {
+  if (!cyw43Initialized) {
+    return -1;
+  }
+  if (wifiScanInProgress) {
+    if (!cyw43_wifi_scan_active(&cyw43_state)) {
+      finishScan();
+    }
+    return 0;
+  }
+  // The radio belongs to the connection while it is being made
+  if ((wifiCurrentMode != WIFI_MODE_STA) || staConnPending || staConnAsync) {
+    return 0;
+  }
+  if (absolute_time_diff_us(get_absolute_time(), wifiScanNextTime) > 0) {
+    return 0;
+  }
+  startScan(true);
+  wifiScanNextTime = make_timeout_time_ms(NETWORK_SCAN_INTERVAL_MS);
+  return 0;
+}
+
+uint32_t network_scanAgeMs(void) {
+  if (!wifiScanDone) {
+    return UINT32_MAX;
+  }
+  return (uint32_t)(absolute_time_diff_us(wifiScanDoneTime,
+                                          get_absolute_time()) /
+                    1000);
 }
 
 int network_scanIsActive() {
   if (!cyw43Initialized) {
-    // If the network is not initialized, we cancel the scan
+    // If the network is not initialized, no scan can be running
     DPRINTF("WiFi not initialized.\n");
-    return -1;
+    return 0;
   }
   return (int)cyw43_wifi_scan_active(&cyw43_state);
 }
@@ -537,6 +721,175 @@ wifi_scan_data_t *network_getFoundNetworks() { return &wifiScanData; }
 
 static void wifiLinkCallback(struct netif *netif) {
   DPRINTF("WiFi Link: %s\n", (netif_is_link_up(netif) ? "UP" : "DOWN"));
+  if (!netif_is_link_up(netif)) {
+    linkDownCount++;
+    handoff_clear();
+  }
+}
+
+// Sample the RSSI of the access point while connected
+static void telemetryWorkerFn(async_context_t *context,
+                              async_at_time_worker_t *worker) {
+  int32_t rssi = 0;
+  if ((connectionStatus == CONNECTED_WIFI_IP) &&
+      (cyw43_wifi_get_rssi(&cyw43_state, &rssi) == 0)) {
+    rssiHistory[rssiNext] = (int16_t)rssi;
+    rssiNext = (rssiNext + 1) % NETWORK_TELEMETRY_RSSI_SAMPLES;
+    if (rssiCount < NETWORK_TELEMETRY_RSSI_SAMPLES) {
+      rssiCount++;
+    }
+  }
+  async_context_add_at_time_worker_in_ms(context, worker,
+                                         NETWORK_TELEMETRY_SAMPLE_MS);
+}
+
+void network_getTelemetry(network_telemetry_t *out) {
+  memset(out, 0, sizeof(*out));
+  out->rssi = INT16_MIN;
+  out->rssiSamples = (uint16_t)rssiCount;
+  out->linkDownCount = linkDownCount;
+  out->connectAttempts = connectAttempts;
+  if (rssiCount > 0) {
+    int oldest = (rssiCount < NETWORK_TELEMETRY_RSSI_SAMPLES) ? 0 : rssiNext;
+    int last = (rssiNext + NETWORK_TELEMETRY_RSSI_SAMPLES - 1) %
+               NETWORK_TELEMETRY_RSSI_SAMPLES;
+    int32_t sum = 0;
+    out->rssiMin = INT16_MAX;
+    out->rssiMax = INT16_MIN;
+    for (int i = 0; i < rssiCount; i++) {
+      int16_t sample = rssiHistory[i];
+      sum += sample;
+      out->rssiMin = (sample < out->rssiMin) ? sample : out->rssiMin;
+      out->rssiMax = (sample > out->rssiMax) ? sample : out->rssiMax;
+    }
+    out->rssi = rssiHistory[last];
+    out->rssiAvg = (int16_t)(sum / rssiCount);
+    out->rssiTrend = (int16_t)(rssiHistory[last] - rssiHistory[oldest]);
+  }
+#if LWIP_STATS
+  out->lwipStats = true;
+#if MIB2_STATS
+  out->tcpOutSegs = lwip_stats.mib2.tcpoutsegs;
+  out->tcpRetransSegs = lwip_stats.mib2.tcpretranssegs;
+  out->tcpInErrors = lwip_stats.mib2.tcpinerrs;
+#endif
+#if MEMP_STATS
+  const struct stats_mem *pool = lwip_stats.memp[MEMP_PBUF_POOL];
+  out->pbufPoolUsed = pool->used;
+  out->pbufPoolMax = pool->max;
+  out->pbufPoolErrors = pool->err;
+  for (int i = 0; i < MEMP_MAX; i++) {
+    out->mempErrors += lwip_stats.memp[i]->err;
+  }
+#endif
+#if MEM_STATS
+  out->memErrors = lwip_stats.mem.err;
+#endif
+#endif
+}
+
+int network_formatTelemetryJson(char *buffer, size_t size) {
+  network_telemetry_t t;
+  network_getTelemetry(&t);
+  int len = snprintf(
+      buffer, size,
+      "{\"rssi\":%d,\"rssiMin\":%d,\"rssiMax\":%d,\"rssiAvg\":%d,"
+      "\"rssiTrend\":%d,\"rssiSamples\":%u,\"linkDown\":%lu,"
+      "\"connectAttempts\":%lu,\"tcpOutSegs\":%lu,\"tcpRetransSegs\":%lu,"
+      "\"tcpInErrors\":%lu,\"pbufPoolUsed\":%u,\"pbufPoolMax\":%u,"
+      "\"pbufPoolErrors\":%lu,\"mempErrors\":%lu,\"memErrors\":%lu,"
+      "\"lwipStats\":%s}",
+      t.rssi, t.rssiMin, t.rssiMax, t.rssiAvg, t.rssiTrend, t.rssiSamples,
+      (unsigned long)t.linkDownCount, (unsigned long)t.connectAttempts,
+      (unsigned long)t.tcpOutSegs, (unsigned long)t.tcpRetransSegs,
+      (unsigned long)t.tcpInErrors, t.pbufPoolUsed, t.pbufPoolMax,
+      (unsigned long)t.pbufPoolErrors, (unsigned long)t.mempErrors,
+      (unsigned long)t.memErrors, t.lwipStats ? "true" : "false");
+  return ((len < 0) || ((size_t)len >= size)) ? -1 : len;
+}
+
+static void dnsFoundCallback(const char *name, const ip_addr_t *addr,
+                             void *arg) {
+  (void)arg;
+  DPRINTF("DNS %s: %s\n", name, (addr != NULL) ? ipaddr_ntoa(addr) : "-");
+}
+
+// Start the query of a host. Runs with the lwIP lock held. A host already
+// in the DNS table is not asked again until its TTL expires
+static void dnsResolve(const char *host, ip_addr_t *addr, err_t *err) {
+  ip_addr_t found;
+  *err = dns_gethostbyname(host, &found, dnsFoundCallback, NULL);
+  if ((*err == ERR_OK) && (addr != NULL)) {
+    ip_addr_copy(*addr, found);
+  }
+}
+
+// Copy the host of a URL, without the port. A bare host is copied as is
+static bool hostFromUrl(const char *url, char *host, size_t size) {
+  const char *start = strstr(url, "://");
+  start = (start != NULL) ? start + 3 : url;
+  size_t len = strcspn(start, ":/?#");
+  if ((len == 0) || (len >= size)) {
+    return false;
+  }
+  memcpy(host, start, len);
+  host[len] = '\0';
+  return true;
+}
+
+// Resolve the catalog host and the hosts added by network_dnsPrefetch. Runs
+// with the lwIP lock held
+static void dnsPrefetchAll(void) {
+  char host[NETWORK_DNS_HOST_SIZE];
+  err_t err;
+  const SettingsConfigEntry *entry =
+      settings_find_entry(gconfig_getContext(), PARAM_APPS_CATALOG_URL);
+  if ((entry != NULL) && hostFromUrl(entry->value, host, sizeof(host))) {
+    dnsResolve(host, NULL, &err);
+  }
+  for (int i = 0; i < NETWORK_DNS_PREFETCH_HOSTS; i++) {
+    if (dnsPrefetchHosts[i][0] != '\0') {
+      dnsResolve(dnsPrefetchHosts[i], NULL, &err);
+    }
+  }
+}
+
+int network_dnsPrefetch(const char *urlOrHost) {
+  char host[NETWORK_DNS_HOST_SIZE];
+  if ((urlOrHost == NULL) || !hostFromUrl(urlOrHost, host, sizeof(host))) {
+    return -1;
+  }
+  int slot = -1;
+  for (int i = 0; i < NETWORK_DNS_PREFETCH_HOSTS; i++) {
+    if (strcmp(dnsPrefetchHosts[i], host) == 0) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    // The oldest host gives its slot to the new one
+    slot = dnsPrefetchNext;
+    dnsPrefetchNext = (dnsPrefetchNext + 1) % NETWORK_DNS_PREFETCH_HOSTS;
+    snprintf(dnsPrefetchHosts[slot], NETWORK_DNS_HOST_SIZE, "%s", host);
+  }
+  if (cyw43Initialized && (connectionStatus == CONNECTED_WIFI_IP)) {
+    err_t err;
+    cyw43_arch_lwip_begin();
+    dnsResolve(host, NULL, &err);
+    cyw43_arch_lwip_end();
+  }
+  return 0;
+}
+
+bool network_dnsLookup(const char *host, ip_addr_t *addr) {
+  if (!cyw43Initialized || (host == NULL) || (addr == NULL)) {
+    return false;
+  }
+  err_t err;
+  cyw43_arch_lwip_begin();
+  dnsResolve(host, addr, &err);
+  cyw43_arch_lwip_end();
+  return err == ERR_OK;
 }
 
 static void networkStatusCallback(struct netif *netif) {
@@ -546,6 +899,20 @@ static void networkStatusCallback(struct netif *netif) {
     snprintf(connectionStatusStr, sizeof(connectionStatusStr), "LINK UP");
     DPRINTF("IP address allocated: %s\n", ipaddr_ntoa(netif_ip_addr4(netif)));
     ip_addr_set(&currentIp, netif_ip_addr4(netif));
+    // Resolve the download hosts while the app is still starting
+    dnsPrefetchAll();
+    if (!telemetryStarted) {
+      telemetryStarted = true;
+      telemetryWorker.do_work = telemetryWorkerFn;
+      async_context_add_at_time_worker_in_ms(cyw43_arch_async_context(),
+                                             &telemetryWorker, 0);
+    }
+    // Do not wait for the next check of the background connection
+    if (staConnAsync) {
+      async_context_t *context = cyw43_arch_async_context();
+      async_context_remove_at_time_worker(context, &staConnWorker);
+      async_context_add_at_time_worker_in_ms(context, &staConnWorker, 0);
+    }
   } else {
     DPRINTF("WiFi Status: DOWN\n");
   }
@@ -585,7 +952,98 @@ static void srv_txt(struct mdns_service *service, void *txt_userdata) {
 }
 #endif
 
-wifi_sta_conn_process_status_t network_wifiStaConnect() {
+// FNV-1a of the SSID, so the cache of another network is never used
+static uint32_t ssidHash(const char *ssid) {
+  uint32_t hash = 2166136261u;
+  for (const char *c = ssid; *c != '\0'; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  return hash;
+}
+
+// Channel the interface is connected on
+static uint32_t currentChannel(void) {
+  uint32_t channelInfo[3] = {0};  // Hardware, target and scan channel
+  if (cyw43_ioctl(&cyw43_state, CYW43_IOCTL_GET_CHANNEL, sizeof(channelInfo),
+                  (uint8_t *)channelInfo, CYW43_ITF_STA) != 0) {
+    return CYW43_CHANNEL_NONE;
+  }
+  return channelInfo[0];
+}
+
+// The cache of the SSID, if any
+static bool loadWifiCache(const char *ssid, wifi_cache_t *cache) {
+  const SettingsConfigEntry *entry =
+      settings_find_entry(aconfig_getContext(), ACONFIG_PARAM_WIFI_CACHE);
+  if ((entry == NULL) || (entry->value[0] == '\0')) {
+    return false;
+  }
+  unsigned long hash = 0;
+  unsigned int mac[NETWORK_MAC_SIZE] = {0};
+  unsigned long channel = 0;
+  char ip[IPADDR_STRLEN_MAX + 1] = {0};
+  if ((sscanf(entry->value, "%lx,%x:%x:%x:%x:%x:%x,%lu,%16s", &hash, &mac[0],
+              &mac[1], &mac[2], &mac[3], &mac[4], &mac[5], &channel,
+              ip) != 9) ||
+      (hash != ssidHash(ssid)) || !ipaddr_aton(ip, &cache->ip)) {
+    return false;
+  }
+  for (int i = 0; i < NETWORK_MAC_SIZE; i++) {
+    cache->bssid[i] = (uint8_t)mac[i];
+  }
+  cache->channel = (uint32_t)channel;
+  return true;
+}
+
+// Keep the access point and the address of the connection. The settings are
+// written only if they changed
+static void saveWifiCache(const char *ssid) {
+  uint8_t bssid[NETWORK_MAC_SIZE] = {0};
+  if (cyw43_wifi_get_bssid(&cyw43_state, bssid) != 0) {
+    return;
+  }
+  char value[SETTINGS_MAX_VALUE_LENGTH] = {0};
+  snprintf(value, sizeof(value), "%08lx,%02x:%02x:%02x:%02x:%02x:%02x,%lu,%s",
+           (unsigned long)ssidHash(ssid), bssid[0], bssid[1], bssid[2],
+           bssid[3], bssid[4], bssid[5], (unsigned long)currentChannel(),
+           ipaddr_ntoa(&currentIp));
+  SettingsContext *ctx = aconfig_getContext();
+  const SettingsConfigEntry *entry =
+      settings_find_entry(ctx, ACONFIG_PARAM_WIFI_CACHE);
+  if ((entry == NULL) || (strcmp(entry->value, value) == 0)) {
+    return;
+  }
+  DPRINTF("Saving the WiFi cache: %s\n", value);
+  settings_put_string(ctx, ACONFIG_PARAM_WIFI_CACHE, value);
+  settings_save(ctx, true);
+}
+
+// The link state left by the previous app, if it was connected to the SSID
+static bool loadHandoff(const char *ssid, wifi_cache_t *cache) {
+  HandoffLink link;
+  if (!handoff_takeLink(&link) || (link.ssidHash != ssidHash(ssid))) {
+    return false;
+  }
+  memcpy(cache->bssid, link.bssid, NETWORK_MAC_SIZE);
+  cache->channel = link.channel;
+  ip_addr_set_ip4_u32(&cache->ip, link.ip);
+  return true;
+}
+
+// Leave the link state to the next app, so it can join without scanning
+static void saveHandoff(const char *ssid) {
+  HandoffLink link = {0};
+  if (cyw43_wifi_get_bssid(&cyw43_state, link.bssid) != 0) {
+    return;
+  }
+  link.ssidHash = ssidHash(ssid);
+  link.channel = (uint16_t)currentChannel();
+  link.ip = ip4_addr_get_u32(ip_2_ip4(&currentIp));
+  handoff_saveLink(&link);
+}
+
+wifi_sta_conn_process_status_t network_wifiStaConnectStart() {
+  staConnPending = false;
   if (!cyw43Initialized) {
     DPRINTF("WiFi not initialized. Cancelling connection\n");
     return NETWORK_WIFI_STA_CONN_ERR_NOT_INITIALIZED;
@@ -598,12 +1056,21 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
   int res;
 
   // Set hostname
-  char *hostname =
+  const char *hostname =
       settings_find_entry(gconfig_getContext(), PARAM_HOSTNAME)->value;
 
   // Set the STA mode interface mode
   struct netif *nif = &cyw43_state.netif[CYW43_ITF_STA];
 
+  // Only the first attempt after the boot uses the cache. If it fails, the
+  // access point or the lease may have changed
+  const SettingsConfigEntry *ssid =
+      settings_find_entry(gconfig_getContext(), PARAM_WIFI_SSID);
+  wifi_cache_t cache;
+  bool useCache = !wifiCacheTried && (loadHandoff(ssid->value, &cache) ||
+                                      loadWifiCache(ssid->value, &cache));
+  wifiCacheTried = true;
+
   cyw43_arch_lwip_begin();
 
   if ((hostname != NULL) && (strlen(hostname) > 0)) {
@@ -629,12 +1096,22 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
   netif_set_status_callback(nif, networkStatusCallback);
 
   // DHCP or static IP
-  if ((settings_find_entry(gconfig_getContext(), PARAM_WIFI_DHCP) != NULL) &&
-      (settings_find_entry(gconfig_getContext(), PARAM_WIFI_DHCP)->value[0] ==
-           't' ||
-       settings_find_entry(gconfig_getContext(), PARAM_WIFI_DHCP)->value[0] ==
-           'T')) {
+  bool dhcp = false;
+  settings_get_bool(gconfig_getContext(),
+                    settings_get_handle(gconfig_getContext(), PARAM_WIFI_DHCP),
+                    &dhcp);
+  if (dhcp) {
     DPRINTF("DHCP enabled\n");
+    // lwIP has no call for INIT-REBOOT. A client in REBOOTING when the link
+    // comes up sends a REQUEST for the offered address instead of a
+    // DISCOVER, and starts over with a DISCOVER on a NAK
+    struct dhcp *dhcpClient = netif_dhcp_data(nif);
+    if (useCache && (dhcpClient != NULL) && !netif_is_link_up(nif) &&
+        (dhcpClient->state == DHCP_STATE_INIT)) {
+      DPRINTF("DHCP asking for %s\n", ipaddr_ntoa(&cache.ip));
+      ip_addr_set(&dhcpClient->offered_ip_addr, &cache.ip);
+      dhcpClient->state = DHCP_STATE_REBOOTING;
+    }
   } else {
     DPRINTF("Static IP enabled\n");
     dhcp_stop(nif);
@@ -655,14 +1132,14 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
     // Now set the DNS
     // The values in PARAM_WIFI_DNS are separated by commas. Only one or two
     // values are allowed
-    SettingsConfigEntry *entry =
+    const SettingsConfigEntry *entry =
         settings_find_entry(gconfig_getContext(), PARAM_WIFI_DNS);
     if (entry == NULL || entry->value == NULL) {
       DPRINTF("Error: DNS configuration is missing.\n");
     } else {
-      char *dns = entry->value;
-      char *dnsCopy = strdup(
-          dns);  // Make a copy of the string to avoid modifying the original
+      const char *dns = entry->value;
+      // Make a copy of the string to avoid modifying the original
+      char *dnsCopy = pool_strdup(dns);
       if (dnsCopy == NULL) {
         DPRINTF("Error: Memory allocation failed.\n");
       } else {
@@ -673,7 +1150,6 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
         ip_addr_t dns2Ip;
         if (dns1 == NULL || (dns1Ip.addr = ipaddr_addr(dns1)) == IPADDR_NONE) {
           DPRINTF("Error: Invalid DNS1 address.\n");
-          free(dnsCopy);  // Free the allocated memory
         } else {
           dns_setserver(0, &dns1Ip);
           DPRINTF("DNS1: %s\n", ipaddr_ntoa(&dns1Ip));
@@ -687,9 +1163,8 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
             }
           }
         }
+        pool_free(dnsCopy);  // Free the copied string after use
       }
-
-      free(dnsCopy);  // Free the copied string after use
     }
   }
   netif_set_up(nif);
@@ -702,23 +1177,21 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
     return NETWORK_WIFI_STA_CONN_ERR_MAC_FAILED;
   }
 
-  SettingsConfigEntry *ssid =
-      settings_find_entry(gconfig_getContext(), PARAM_WIFI_SSID);
   if (strlen(ssid->value) == 0) {
     DPRINTF("No SSID found in config. Can't connect\n");
     return NETWORK_WIFI_STA_CONN_ERR_NO_SSID;
   }
-  SettingsConfigEntry *authMode =
+  const SettingsConfigEntry *authMode =
       settings_find_entry(gconfig_getContext(), PARAM_WIFI_AUTH);
   if (strlen(authMode->value) == 0) {
     DPRINTF("No auth mode found in config. Can't connect\n");
     return NETWORK_WIFI_STA_CONN_ERR_NO_AUTH_MODE;
   }
   char *passwordValue = NULL;
-  SettingsConfigEntry *password =
+  const SettingsConfigEntry *password =
       settings_find_entry(gconfig_getContext(), PARAM_WIFI_PASSWORD);
   if (strlen(password->value) > 0) {
-    passwordValue = strdup(password->value);
+    passwordValue = pool_strdup(password->value);
   } else {
     DPRINTF(
         "No password found in config. Trying to connect without password\n");
@@ -734,28 +1207,123 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
   int errorCode = 0;
   DPRINTF("Connecting to SSID=%s, password=%s, auth=%08x. ASYNC\n", ssid->value,
           passwordValue, authValue);
-  errorCode =
-      cyw43_arch_wifi_connect_async(ssid->value, passwordValue, authValue);
-  free(passwordValue);
+  if (useCache) {
+    // Join the access point of the last boot without scanning. Same as
+    // cyw43_arch_wifi_connect_bssid_async, with the channel
+    DPRINTF("Connecting to the last BSSID on channel %lu\n",
+            (unsigned long)cache.channel);
+    if (passwordValue == NULL) {
+      authValue = CYW43_AUTH_OPEN;
+    }
+    errorCode = cyw43_wifi_join(
+        &cyw43_state, strlen(ssid->value), (const uint8_t *)ssid->value,
+        (passwordValue != NULL) ? strlen(passwordValue) : 0,
+        (const uint8_t *)passwordValue, authValue, cache.bssid,
+        cache.channel);
+  } else {
+    errorCode =
+        cyw43_arch_wifi_connect_async(ssid->value, passwordValue, authValue);
+  }
+  pool_free(passwordValue);
   if (errorCode != 0) {
     DPRINTF("Failed to connect to WiFi: %d\n", errorCode);
     return NETWORK_WIFI_STA_CONN_ERR_CONNECTION_FAILED;
   }
 
+  staConnStatusTime = make_timeout_time_ms(1 * SEC_TO_MS);
+  staConnTimeout = make_timeout_time_ms(
+      (useCache ? NETWORK_FAST_CONNECT_TIMEOUT : NETWORK_CONNECT_TIMEOUT) *
+      SEC_TO_MS);
+  staConnPrevStatus = DISCONNECTED;
+  connectAttempts++;
+  staConnPending = true;
+  return NETWORK_WIFI_STA_CONN_PENDING;
+}
+
+wifi_sta_conn_process_status_t network_wifiStaConnectPoll() {
+  if (!staConnPending) {
+    return NETWORK_WIFI_STA_CONN_ERR_NOT_INITIALIZED;
+  }
+  // Check the link once per second
+  wifi_sta_conn_status_t status =
+      network_wifiConnStatus(&staConnStatusTime, 1);
+  if (status != staConnPrevStatus) {
+    DPRINTF("WiFi connection status: %s[%i]\n", network_wifiConnStatusStr(),
+            status);
+    staConnPrevStatus = status;
+  }
+  if (status == CONNECTED_WIFI_IP) {
+    staConnPending = false;
+#ifdef BLINK_H
+    blink_on();
+#endif
+    DPRINTF("Connected. Check the connection status...\n");
+    network_updateCurrentNetworkInfoRadio();
+    const char *ssid =
+        settings_find_entry(gconfig_getContext(), PARAM_WIFI_SSID)->value;
+    saveWifiCache(ssid);
+    saveHandoff(ssid);
+    return NETWORK_WIFI_STA_CONN_OK;
+  }
+  if (absolute_time_diff_us(get_absolute_time(), staConnTimeout) <= 0) {
+    staConnPending = false;
+    DPRINTF("WiFi connection timeout\n");
+    return NETWORK_WIFI_STA_CONN_ERR_TIMEOUT;
+  }
+  return NETWORK_WIFI_STA_CONN_PENDING;
+}
+
+// Step of the background connection. The worker runs once per schedule
+static void staConnWorkerFn(async_context_t *context,
+                            async_at_time_worker_t *worker) {
+  wifi_sta_conn_process_status_t status = network_wifiStaConnectPoll();
+  if ((status == NETWORK_WIFI_STA_CONN_ERR_TIMEOUT) &&
+      (staConnAttempt < staConnAttempts)) {
+    staConnAttempt++;
+    DPRINTF("WiFi connection attempt %d\n", staConnAttempt);
+    status = network_wifiStaConnectStart();
+  }
+  if (status == NETWORK_WIFI_STA_CONN_PENDING) {
+    async_context_add_at_time_worker_in_ms(context, worker,
+                                           NETWORK_CONNECT_CHECK_MS);
+    return;
+  }
+  staConnAsync = false;
+  if (networkConnectCallback != NULL) {
+    networkConnectCallback(status, staConnAttempt);
+  }
+}
+
+wifi_sta_conn_process_status_t network_wifiStaConnectAsync(int attempts) {
+  async_context_t *context = cyw43_arch_async_context();
+  async_context_remove_at_time_worker(context, &staConnWorker);
+  staConnAsync = false;
+  wifi_sta_conn_process_status_t status = network_wifiStaConnectStart();
+  if (status != NETWORK_WIFI_STA_CONN_PENDING) {
+    return status;
+  }
+  staConnAttempt = 1;
+  staConnAttempts = attempts;
+  staConnAsync = true;
+  staConnWorker.do_work = staConnWorkerFn;
+  async_context_add_at_time_worker_in_ms(context, &staConnWorker,
+                                         NETWORK_CONNECT_CHECK_MS);
+  return status;
+}
+
+void network_setConnectCallback(NetworkConnectCallback callback) {
+  networkConnectCallback = callback;
+}
+
+wifi_sta_conn_process_status_t network_wifiStaConnect() {
+  wifi_sta_conn_process_status_t err = network_wifiStaConnectStart();
+
   // Enter a loop until the device has a WiFi connection with an IP address. Or
   // timesout.
-  wifi_sta_conn_status_t prevStatus = DISCONNECTED;
-  int wifiConnPollingInterval = 1;  // 1 seconds
-  absolute_time_t wifiConnStatusTime = make_timeout_time_ms(1 * SEC_TO_MS);
-  absolute_time_t wifiConnConnTimeout =
-      make_timeout_time_ms(NETWORK_CONNECT_TIMEOUT * SEC_TO_MS);  // 30 seconds
-  while (absolute_time_diff_us(get_absolute_time(), wifiConnConnTimeout) > 0) {
+  while (err == NETWORK_WIFI_STA_CONN_PENDING) {
 #ifdef BLINK_H
     blink_morse('T');
 #endif
-
-    wifi_sta_conn_status_t status =
-        network_wifiConnStatus(&wifiConnStatusTime, wifiConnPollingInterval);
 #if PICO_CYW43_ARCH_POLL
     network_safePoll();
     cyw43_arch_wait_for_work_until(make_timeout_time_ms(2 * SEC_TO_MS));
@@ -765,27 +1333,9 @@ wifi_sta_conn_process_status_t network_wifiStaConnect() {
     if (networkPollingCallback != NULL) {
       networkPollingCallback();
     }
-    if (status != prevStatus) {
-      DPRINTF("WiFi connection status: %s[%i]\n", network_wifiConnStatusStr(),
-              status);
-      prevStatus = status;
-    }
-    if (status == CONNECTED_WIFI_IP) {
-#ifdef BLINK_H
-      blink_on();
-#endif
-      break;
-    }
-  }
-  if (absolute_time_diff_us(get_absolute_time(), wifiConnConnTimeout) <= 0) {
-    DPRINTF("WiFi connection timeout\n");
-    // Return the error code
-    return NETWORK_WIFI_STA_CONN_ERR_TIMEOUT;
+    err = network_wifiStaConnectPoll();
   }
-
-  DPRINTF("Connected. Check the connection status...\n");
-  network_updateCurrentNetworkInfoRadio();
-  return 0;
+  return err;
 }
 
 char *network_wifiConnStatusStr() { return connectionStatusStr; }
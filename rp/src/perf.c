@@ -0,0 +1,252 @@
+/**
+ * File: perf.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Clock and voltage performance profiles
+ */
+
+#include "perf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aconfig.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/structs/bus_ctrl.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hardware/sync.h"
+#include "hardware/uart.h"
+#include "pico/stdlib.h"
+
+// The SD card SPI clocks are exact dividers of each system clock below the
+// 25 MHz of the SD SPI mode. The turbo profile slows down the PIO to keep the
+// bus timing of the default profile; the low power one can not speed it up,
+// so it shortens the waits instead. The RP2350 turbo profile goes up to
+// 300 MHz, 4/3 of the default clock, with the PIO divided to match.
+static const PerfProfile profiles[PERF_PROFILE_COUNT] = {
+    [PERF_PROFILE_LOW_POWER] = {"low-power", 150000, VREG_VOLTAGE_1_10, 1.f, 2,
+                                25000},
+    [PERF_PROFILE_DEFAULT] = {"default", RP2040_CLOCK_FREQ_KHZ, RP2040_VOLTAGE,
+                              SAMPLE_DIV_FREQ, 3, 22500},
+#if PICO_RP2350
+    [PERF_PROFILE_TURBO] = {"turbo", 300000, VREG_VOLTAGE_1_20, 1.3333f, 3,
+                            25000},
+#else
+    [PERF_PROFILE_TURBO] = {"turbo", 270000, VREG_VOLTAGE_1_20, 1.2f, 3,
+                            22500},
+#endif
+};
+
+// main sets the default profile before anything else
+static perf_profile_id_t activeProfileId = PERF_PROFILE_DEFAULT;
+
+// Counters sampled by the repeating timer
+static repeating_timer_t counterTimer;
+static PerfCounters counterWindow;
+static PerfCounters counterPartial;
+static PerfCounters counterTotal;
+static uint32_t counterSamples = 0;
+
+#define BUS_COUNTER_MAX 0x00FFFFFFu
+
+#if PICO_RP2040
+static const bus_ctrl_perf_counter_t busEvents[PERF_BUS_COUNTERS] = {
+    [PERF_BUS_XIP] = arbiter_xip_main_perf_event_access,
+    [PERF_BUS_XIP_CONTESTED] = arbiter_xip_main_perf_event_access_contested,
+    [PERF_BUS_SRAM0_CONTESTED] = arbiter_sram0_perf_event_access_contested,
+    [PERF_BUS_FASTPERI_CONTESTED] =
+        arbiter_fastperi_perf_event_access_contested,
+};
+#endif
+
+static bool applyProfile(const PerfProfile *profile) {
+  uint32_t currentKhz = clock_get_hz(clk_sys) / 1000;
+
+  // Raise the voltage before the clock, and lower it after
+  if (profile->clockKhz > currentKhz) {
+    vreg_set_voltage(profile->voltage);
+    busy_wait_us(PERF_VREG_SETTLE_US);
+    if (!set_sys_clock_khz(profile->clockKhz, false)) {
+      return false;
+    }
+  } else {
+    if (!set_sys_clock_khz(profile->clockKhz, false)) {
+      return false;
+    }
+    vreg_set_voltage(profile->voltage);
+    busy_wait_us(PERF_VREG_SETTLE_US);
+  }
+
+#if defined(_DEBUG) && (_DEBUG != 0) && defined(PICO_DEFAULT_UART)
+  // clk_peri follows clk_sys, so the debug UART needs a new divider
+  uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+#endif
+  return true;
+}
+
+// Checksum of the start of the flash read through the uncached XIP alias
+static uint32_t flashChecksum(void) {
+  const volatile uint32_t *flash =
+      (const volatile uint32_t *)XIP_NOCACHE_NOALLOC_BASE;
+  uint32_t checksum = 0;
+  for (size_t i = 0; i < (PERF_SELFTEST_FLASH_BYTES / sizeof(uint32_t));
+       i++) {
+    checksum = ((checksum << 1) | (checksum >> 31)) ^ flash[i];
+  }
+  return checksum;
+}
+
+// Move random patterns with the DMA and compare them with the CPU
+static bool selfTestRam(void) {
+  int channel = dma_claim_unused_channel(false);
+  if (channel < 0) {
+    DPRINTF("No DMA channel for the self-test. Skipping.\n");
+    return true;
+  }
+  uint32_t *src = malloc(PERF_SELFTEST_RAM_WORDS * sizeof(uint32_t));
+  uint32_t *dst = malloc(PERF_SELFTEST_RAM_WORDS * sizeof(uint32_t));
+  bool passed = (src != NULL) && (dst != NULL);
+
+  dma_channel_config config = dma_channel_get_default_config((uint)channel);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+  channel_config_set_read_increment(&config, true);
+  channel_config_set_write_increment(&config, true);
+
+  uint32_t seed = 0x9E3779B9u;
+  for (int round = 0; passed && (round < PERF_SELFTEST_ROUNDS); round++) {
+    for (size_t i = 0; i < PERF_SELFTEST_RAM_WORDS; i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      src[i] = seed;
+    }
+    memset(dst, 0, PERF_SELFTEST_RAM_WORDS * sizeof(uint32_t));
+    dma_channel_configure((uint)channel, &config, dst, src,
+                          PERF_SELFTEST_RAM_WORDS, true);
+    dma_channel_wait_for_finish_blocking((uint)channel);
+    passed = (memcmp(src, dst, PERF_SELFTEST_RAM_WORDS * sizeof(uint32_t)) ==
+              0);
+  }
+
+  free(dst);
+  free(src);
+  dma_channel_unclaim((uint)channel);
+  return passed;
+}
+
+static bool selfTest(const PerfProfile *profile, uint32_t flashReference) {
+  uint32_t measuredKhz = frequency_count_khz(CLOCKS_FC0_SRC_VALUE_CLK_SYS);
+  if ((measuredKhz + PERF_SELFTEST_CLOCK_TOLERANCE_KHZ < profile->clockKhz) ||
+      (measuredKhz > profile->clockKhz + PERF_SELFTEST_CLOCK_TOLERANCE_KHZ)) {
+    DPRINTF("Self-test: clock is %lu KHz\n", (unsigned long)measuredKhz);
+    return false;
+  }
+  if (!selfTestRam()) {
+    DPRINTF("Self-test: DMA transfer mismatch\n");
+    return false;
+  }
+  if (flashChecksum() != flashReference) {
+    DPRINTF("Self-test: flash read mismatch\n");
+    return false;
+  }
+  return true;
+}
+
+// Read and clear the counters. Writing any value clears them
+static bool counterSample(repeating_timer_t *timer) {
+  (void)timer;
+  counterPartial.xipHits += xip_ctrl_hw->ctr_hit;
+  counterPartial.xipAccesses += xip_ctrl_hw->ctr_acc;
+  xip_ctrl_hw->ctr_hit = 0;
+  xip_ctrl_hw->ctr_acc = 0;
+#if PICO_RP2040
+  bool saturated = false;
+  for (int i = 0; i < PERF_BUS_COUNTERS; i++) {
+    uint32_t value = bus_ctrl_hw->counter[i].value;
+    bus_ctrl_hw->counter[i].value = 0;
+    counterPartial.bus[i] += value;
+    saturated |= (value >= BUS_COUNTER_MAX);
+  }
+  if (saturated) {
+    counterPartial.saturated++;
+  }
+#endif
+  counterPartial.elapsedMs += PERF_COUNTER_SAMPLE_MS;
+
+  if (++counterSamples >= PERF_COUNTER_WINDOW) {
+    counterSamples = 0;
+    counterWindow = counterPartial;
+    counterTotal.xipHits += counterPartial.xipHits;
+    counterTotal.xipAccesses += counterPartial.xipAccesses;
+    for (int i = 0; i < PERF_BUS_COUNTERS; i++) {
+      counterTotal.bus[i] += counterPartial.bus[i];
+    }
+    counterTotal.saturated += counterPartial.saturated;
+    counterTotal.elapsedMs += counterPartial.elapsedMs;
+    memset(&counterPartial, 0, sizeof(counterPartial));
+  }
+  return true;
+}
+
+static void counterStart(void) {
+#if PICO_RP2040
+  for (int i = 0; i < PERF_BUS_COUNTERS; i++) {
+    bus_ctrl_hw->counter[i].sel = busEvents[i];
+    bus_ctrl_hw->counter[i].value = 0;
+  }
+#endif
+  xip_ctrl_hw->ctr_hit = 0;
+  xip_ctrl_hw->ctr_acc = 0;
+  if (!add_repeating_timer_ms(-PERF_COUNTER_SAMPLE_MS, counterSample, NULL,
+                              &counterTimer)) {
+    DPRINTF("No alarm for the performance counters\n");
+  }
+}
+
+perf_profile_id_t perf_init(void) {
+  int profileId = PERF_PROFILE_DEFAULT;
+  settings_get_int(aconfig_getContext(),
+                   settings_get_handle(aconfig_getContext(),
+                                       ACONFIG_PARAM_PERF_PROFILE),
+                   &profileId);
+  if ((profileId < 0) || (profileId >= PERF_PROFILE_COUNT)) {
+    DPRINTF("Invalid performance profile %d. Using default.\n", profileId);
+    profileId = PERF_PROFILE_DEFAULT;
+  }
+
+  if (profileId != (int)activeProfileId) {
+    // Read the flash with the known good clock to compare it later
+    uint32_t flashReference = flashChecksum();
+    const PerfProfile *profile = &profiles[profileId];
+    if (!applyProfile(profile) || !selfTest(profile, flashReference)) {
+      DPRINTF("Profile %s failed the self-test. Using default.\n",
+              profile->name);
+      applyProfile(&profiles[PERF_PROFILE_DEFAULT]);
+      profileId = PERF_PROFILE_DEFAULT;
+    }
+    activeProfileId = (perf_profile_id_t)profileId;
+  }
+
+  const PerfProfile *active = perf_getProfile();
+  DPRINTF("Performance profile: %s. %lu KHz, %s\n", active->name,
+          (unsigned long)active->clockKhz, VOLTAGE_VALUES[active->voltage]);
+  counterStart();
+  return activeProfileId;
+}
+
+const PerfProfile *perf_getProfile(void) { return &profiles[activeProfileId]; }
+
+bool perf_getCounters(PerfCounters *window, PerfCounters *total) {
+  // The timer writes them in an IRQ of this core
+  uint32_t ints = save_and_disable_interrupts();
+  *window = counterWindow;
+  *total = counterTotal;
+  restore_interrupts(ints);
+#if PICO_RP2040
+  return true;
+#else
+  return false;
+#endif
+}
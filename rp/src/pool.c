@@ -0,0 +1,150 @@
+/**
+ * File: pool.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Fixed block memory pools
+ */
+
+#include "pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/sync.h"
+
+static const uint32_t classSizes[POOL_CLASSES] = {
+    POOL_CLASS0_SIZE, POOL_CLASS1_SIZE, POOL_CLASS2_SIZE, POOL_CLASS3_SIZE};
+static const uint32_t classBlocks[POOL_CLASSES] = {
+    POOL_CLASS0_BLOCKS, POOL_CLASS1_BLOCKS, POOL_CLASS2_BLOCKS,
+    POOL_CLASS3_BLOCKS};
+
+// The blocks of every class one after the other
+static uint8_t poolMemory[POOL_CLASS0_SIZE * POOL_CLASS0_BLOCKS +
+                          POOL_CLASS1_SIZE * POOL_CLASS1_BLOCKS +
+                          POOL_CLASS2_SIZE * POOL_CLASS2_BLOCKS +
+                          POOL_CLASS3_SIZE * POOL_CLASS3_BLOCKS]
+    __attribute__((aligned(4)));
+
+static uint8_t *classStart[POOL_CLASSES];
+static uint32_t classFree[POOL_CLASSES];  // Bit set: block in use
+static PoolStats poolStats;
+static bool poolReady = false;
+
+static void poolInit(void) {
+  uint8_t *start = poolMemory;
+  for (int i = 0; i < POOL_CLASSES; i++) {
+    classStart[i] = start;
+    start += classSizes[i] * classBlocks[i];
+    poolStats.classes[i].blockSize = classSizes[i];
+    poolStats.classes[i].blocks = classBlocks[i];
+  }
+  poolReady = true;
+}
+
+// Take a block of the class, or NULL if all are in use. Interrupts off
+static void *poolTake(int cls) {
+  uint32_t all = (classBlocks[cls] >= 32) ? 0xFFFFFFFFu
+                                          : ((1u << classBlocks[cls]) - 1);
+  uint32_t freeBlocks = ~classFree[cls] & all;
+  if (freeBlocks == 0) {
+    return NULL;
+  }
+  uint32_t block = (uint32_t)__builtin_ctz(freeBlocks);
+  classFree[cls] |= (1u << block);
+  PoolClassStats *stats = &poolStats.classes[cls];
+  stats->inUse++;
+  if (stats->inUse > stats->highWater) {
+    stats->highWater = stats->inUse;
+  }
+  return classStart[cls] + block * classSizes[cls];
+}
+
+void *pool_alloc(size_t size) {
+  if (size == 0) {
+    size = 1;
+  }
+  uint32_t ints = save_and_disable_interrupts();
+  if (!poolReady) {
+    poolInit();
+  }
+  void *ptr = NULL;
+  bool first = true;
+  for (int cls = 0; (cls < POOL_CLASSES) && (ptr == NULL); cls++) {
+    if (size > classSizes[cls]) {
+      continue;
+    }
+    ptr = poolTake(cls);
+    if ((ptr == NULL) && first) {
+      poolStats.classes[cls].misses++;
+    }
+    first = false;
+  }
+  if (ptr == NULL) {
+    poolStats.heapFallbacks++;
+  }
+  restore_interrupts(ints);
+
+  if (ptr == NULL) {
+    ptr = malloc(size);
+    if (ptr != NULL) {
+      ints = save_and_disable_interrupts();
+      poolStats.heapInUse++;
+      restore_interrupts(ints);
+    }
+  }
+  return ptr;
+}
+
+void *pool_calloc(size_t count, size_t size) {
+  if ((size != 0) && (count > SIZE_MAX / size)) {
+    return NULL;
+  }
+  void *ptr = pool_alloc(count * size);
+  if (ptr != NULL) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void pool_free(void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+  uint8_t *address = (uint8_t *)ptr;
+  if ((address < poolMemory) || (address >= poolMemory + sizeof(poolMemory))) {
+    uint32_t ints = save_and_disable_interrupts();
+    poolStats.heapInUse--;
+    restore_interrupts(ints);
+    free(ptr);
+    return;
+  }
+  uint32_t ints = save_and_disable_interrupts();
+  for (int cls = POOL_CLASSES - 1; cls >= 0; cls--) {
+    if (address >= classStart[cls]) {
+      uint32_t block = (uint32_t)(address - classStart[cls]) / classSizes[cls];
+      classFree[cls] &= ~(1u << block);
+      poolStats.classes[cls].inUse--;
+      break;
+    }
+  }
+  restore_interrupts(ints);
+}
+
+char *pool_strdup(const char *str) {
+  size_t length = strlen(str) + 1;
+  char *copy = (char *)pool_alloc(length);
+  if (copy != NULL) {
+    memcpy(copy, str, length);
+  }
+  return copy;
+}
+
+void pool_getStats(PoolStats *stats) {
+  uint32_t ints = save_and_disable_interrupts();
+  if (!poolReady) {
+    poolInit();
+  }
+  *stats = poolStats;
+  restore_interrupts(ints);
+}
@@ -2,6 +2,7 @@
 
 void reset_device() {
   DPRINTF("Resetting the device\n");
+  debug_logFlush();
 
   save_and_disable_interrupts();
   // watchdog_enable(RESET_WATCHDOG_TIMEOUT, 0);
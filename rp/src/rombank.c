@@ -0,0 +1,108 @@
+/**
+ * File: rombank.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Bank switched ROM4 images
+ */
+
+#include "rombank.h"
+
+#include <string.h>
+
+#include "memfunc.h"
+#include "romemul.h"
+#include "term.h"
+#include "tprotocol.h"
+
+_Static_assert(ROMBANK_PAGE_SIZE <= DISPLAY_HIGHRES_OFFSET &&
+                   ROMBANK_PAGE_SIZE <= DISPLAY_BUFFER_OFFSET &&
+                   ROMBANK_PAGE_SIZE <= TERM_RANDOM_TOKEN_OFFSET,
+               "A page overlaps the display buffers or the shared memory");
+#if DISPLAY_DOUBLE_BUFFER == 1
+_Static_assert(ROMBANK_PAGE_SIZE <= DISPLAY_BUFFER_BANK1_OFFSET,
+               "A page overlaps the second display bank");
+#endif
+
+static const uint8_t *bankImage = NULL;
+static uint32_t bankPages = 0;
+static int bankPage = -1;
+static RombankPageStats bankStats[ROMBANK_MAX_PAGES];
+
+// ROM4 access count when the counters were last updated
+static uint32_t bankLastCount = 0;
+
+// Give the ROM4 accesses since the last update to the page mapped
+static void bankUpdateHits(void) {
+  uint32_t count = romemul_getRom4AccessCount();
+  if (bankPage >= 0) {
+    bankStats[bankPage].hits += count - bankLastCount;
+  }
+  bankLastCount = count;
+}
+
+static void bankProtocolSelect(const TransmissionProtocol *protocol) {
+  uint16_t *payload = ((uint16_t *)protocol->payload);
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  uint32_t page = TPROTO_GET_PAYLOAD_PARAM32(payload);
+  if (rombank_select(page) != 0) {
+    DPRINTF("Page %lu not in the bank switched image\n",
+            (unsigned long)page);
+  }
+}
+
+int rombank_init(const void *image, uint32_t pages) {
+  if ((image == NULL) || (pages == 0) || (pages > ROMBANK_MAX_PAGES) ||
+      (((uintptr_t)image & 3u) != 0)) {
+    DPRINTF("Invalid bank switched image: %lu pages\n", (unsigned long)pages);
+    return -1;
+  }
+  bankImage = (const uint8_t *)image;
+  bankPages = pages;
+  bankPage = -1;
+  memset(bankStats, 0, sizeof(bankStats));
+  bankLastCount = romemul_getRom4AccessCount();
+
+  term_setProtocolHandler(APP_ROMBANK_SELECT, bankProtocolSelect,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK |
+                              TERM_PROTOCOL_FLAG_TRACE);
+  DPRINTF("Bank switched image of %lu pages at 0x%08x\n",
+          (unsigned long)pages, (unsigned int)(uintptr_t)image);
+  return 0;
+}
+
+int rombank_select(uint32_t page) {
+  if ((bankImage == NULL) || (page >= bankPages)) {
+    return -1;
+  }
+  bankUpdateHits();
+  bankStats[page].selects++;
+  if ((int)page == bankPage) {
+    return 0;
+  }
+
+  const uint8_t *source = bankImage + (page * ROMBANK_PAGE_SIZE);
+  if (source != (const uint8_t *)&__rom_in_ram_start__) {
+    if (((uintptr_t)source >= XIP_BASE) && ((uintptr_t)source < SRAM_BASE)) {
+      // Streams the page from the XIP with the DMA
+      COPY_FLASH_TO_RAM_DMA((void *)&__rom_in_ram_start__,
+                            (const uint16_t *)source, ROMBANK_PAGE_SIZE / 2);
+    } else {
+      memcpy(&__rom_in_ram_start__, source, ROMBANK_PAGE_SIZE);
+    }
+  }
+  bankPage = (int)page;
+  return 0;
+}
+
+int rombank_getPage(void) { return bankPage; }
+
+uint32_t rombank_getStats(RombankPageStats *stats) {
+  if (bankImage == NULL) {
+    return 0;
+  }
+  bankUpdateHits();
+  memcpy(stats, bankStats, sizeof(bankStats));
+  return bankPages;
+}
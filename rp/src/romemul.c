@@ -8,6 +8,11 @@
 
 #include "romemul.h"
 
+#include <string.h>
+
+#include "hardware/structs/systick.h"
+#include "hardware/sync.h"
+
 // Global variables to access them in the IRQ handlers
 static int readAddrRomDmaChannel = -1;
 static int lookupDataRomDmaChannel = -1;
@@ -15,6 +20,222 @@ static int lookupDataRomDmaChannel = -1;
 // Default PIO to use
 static PIO defaultPio = pio0;
 
+// State machine counting the ROM4 accesses in its X register
+static int romMonitorRom4Sm = -1;
+
+// State machine serving the reads, the address of its idle wait and the
+// base of the ROM image pushed to its X register
+static int romReadSm = -1;
+static uint romReadWaitPc = 0;
+static uintptr_t romBaseAddress = 0;
+
+// Copy of romemul_read with the wait cycles of the performance profile
+static uint16_t romemulReadInstructions[count_of(
+    romemul_read_program_instructions)];
+
+// Position of the delay in the side-set/delay field of romemul_read, which
+// uses 2 optional side-set bits and leaves 2 bits for the delay
+#define ROMEMUL_READ_DELAY_LSB 8
+#define ROMEMUL_READ_DELAY_MASK (0x3u << ROMEMUL_READ_DELAY_LSB)
+
+// DMA IRQ handler to install from core1
+static IRQInterceptionCallback core1ResponseCallback = NULL;
+
+// ROM3 capture ring. Must be aligned to its size for the DMA ring wrap
+static volatile uint16_t rom3CaptureBuffer[ROMEMUL_ROM3_CAPTURE_WORDS]
+    __attribute__((aligned(1u << ROMEMUL_ROM3_CAPTURE_RING_BITS)));
+static int rom3CaptureDmaChannel = -1;
+
+#define ROM3_CAPTURE_TRANSFER_COUNT 0xFFFFFFFFu
+
+#if ROMEMUL_BUS_STATS == 1
+// Bus instrumentation. Only written by the DMA IRQ handler
+static RomemulBusStats busStats;
+static IRQInterceptionCallback statsCallback = NULL;
+static int stampDmaChannel = -1;
+static uint statsReadSm = 0;
+
+// Written by the stamp DMA channel every time the lookup DMA finishes
+static volatile uint32_t lookupDoneUs = 0;
+
+#define SYSTICK_MAX_COUNT 0x00FFFFFFu
+
+static inline uint32_t __not_in_flash_func(statsLog2Bin)(uint32_t value) {
+  uint32_t bin = 0;
+  while ((value > 0) && (bin < (ROMEMUL_BUS_STATS_BINS - 1))) {
+    value >>= 1;
+    bin++;
+  }
+  return bin;
+}
+
+// Wraps the DMA IRQ handler to measure it. Must be as short as possible
+static void __not_in_flash_func(romemulStatsIrqHandler)(void) {
+  uint32_t entryUs = timer_hw->timerawl;
+  uint32_t startTicks = systick_hw->cvr;
+
+  statsCallback();
+
+  // The SysTick counts down and wraps at 24 bits
+  uint32_t endTicks = systick_hw->cvr;
+  uint32_t duration = (startTicks - endTicks) & SYSTICK_MAX_COUNT;
+  uint32_t latency = entryUs - lookupDoneUs;
+  if ((int32_t)latency < 0) {
+    latency = 0;
+  }
+
+  busStats.samples++;
+  busStats.latencySumUs += latency;
+  busStats.durationSumCycles += duration;
+  if (latency < busStats.latencyMinUs) {
+    busStats.latencyMinUs = latency;
+  }
+  if (latency > busStats.latencyMaxUs) {
+    busStats.latencyMaxUs = latency;
+  }
+  if (duration < busStats.durationMinCycles) {
+    busStats.durationMinCycles = duration;
+  }
+  if (duration > busStats.durationMaxCycles) {
+    busStats.durationMaxCycles = duration;
+  }
+  busStats.latencyHistogram[statsLog2Bin(latency)]++;
+  busStats.durationHistogram[statsLog2Bin(duration)]++;
+
+  // The stall flags are sticky. Clear them to count the next ones
+  uint32_t txStall = 1u << (PIO_FDEBUG_TXSTALL_LSB + statsReadSm);
+  uint32_t rxStall = 1u << (PIO_FDEBUG_RXSTALL_LSB + statsReadSm);
+  uint32_t stalls = defaultPio->fdebug & (txStall | rxStall);
+  if (stalls != 0) {
+    if (stalls & txStall) {
+      busStats.txStalls++;
+    }
+    if (stalls & rxStall) {
+      busStats.rxStalls++;
+    }
+    defaultPio->fdebug = stalls;
+  }
+}
+
+// Chain a DMA channel after the lookup one to timestamp its end. Returns the
+// channel the lookup DMA must chain to
+static uint initStatsStamp(uint smReadROM, uint readAddrChannel) {
+  statsReadSm = smReadROM;
+
+  // The SysTick of the core running init_romemul measures the handler
+  systick_hw->rvr = SYSTICK_MAX_COUNT;
+  systick_hw->cvr = 0;
+  systick_hw->csr =
+      M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+
+  if (stampDmaChannel < 0) {
+    stampDmaChannel = dma_claim_unused_channel(false);
+  }
+  if (stampDmaChannel < 0) {
+    DPRINTF("No DMA channel for the bus stats. Latency not measured.\n");
+    return readAddrChannel;
+  }
+
+  dma_channel_config cdmaStamp =
+      dma_channel_get_default_config((uint)stampDmaChannel);
+  channel_config_set_transfer_data_size(&cdmaStamp, DMA_SIZE_32);
+  channel_config_set_read_increment(&cdmaStamp, false);
+  channel_config_set_write_increment(&cdmaStamp, false);
+  channel_config_set_chain_to(&cdmaStamp, readAddrChannel);
+  dma_channel_configure((uint)stampDmaChannel, &cdmaStamp, &lookupDoneUs,
+                        &timer_hw->timerawl, 1, false);
+
+  DPRINTF("Bus stats enabled. Stamp DMA channel: %d\n", stampDmaChannel);
+  return (uint)stampDmaChannel;
+}
+#endif
+
+#if ROMEMUL_TRACE == 1
+// Ring of the addresses served, the write address wraps at its size
+static volatile uint32_t traceRing[ROMEMUL_TRACE_ENTRIES]
+    __attribute__((aligned(1u << ROMEMUL_TRACE_RING_BITS)));
+static volatile uint32_t traceHistogram[ROMEMUL_TRACE_PAGES];
+static volatile romemul_trace_mode_t traceMode = ROMEMUL_TRACE_OFF;
+static volatile RomemulTraceStats traceStats;
+static int traceDmaChannel = -1;
+
+// Chain a DMA channel after the lookup one to copy the address it read.
+// Returns the channel the lookup DMA must chain to
+static uint initTrace(uint chainTo) {
+  if (traceDmaChannel < 0) {
+    traceDmaChannel = dma_claim_unused_channel(false);
+  }
+  if (traceDmaChannel < 0) {
+    DPRINTF("No DMA channel for the ROM trace.\n");
+    return chainTo;
+  }
+
+  // One transfer per trigger. The write address is kept between triggers,
+  // so each address goes to the next entry of the ring
+  dma_channel_config cdmaTrace =
+      dma_channel_get_default_config((uint)traceDmaChannel);
+  channel_config_set_transfer_data_size(&cdmaTrace, DMA_SIZE_32);
+  channel_config_set_read_increment(&cdmaTrace, false);
+  channel_config_set_write_increment(&cdmaTrace, true);
+  channel_config_set_ring(&cdmaTrace, true, ROMEMUL_TRACE_RING_BITS);
+  channel_config_set_chain_to(&cdmaTrace, chainTo);
+  dma_channel_configure((uint)traceDmaChannel, &cdmaTrace, traceRing,
+                        &dma_hw->ch[lookupDataRomDmaChannel].read_addr, 1,
+                        false);
+
+  DPRINTF("ROM trace enabled. DMA channel: %d\n", traceDmaChannel);
+  return (uint)traceDmaChannel;
+}
+
+// Entry of the ring the trace DMA writes next
+static inline uint32_t __not_in_flash_func(traceHead)(void) {
+  uintptr_t next = dma_hw->ch[(uint)traceDmaChannel].write_addr;
+  return (uint32_t)((next - (uintptr_t)traceRing) / sizeof(uint32_t)) &
+         ROMEMUL_TRACE_MASK;
+}
+
+// Core1 loop. Only RAM code and the hardware registers, so the flash can be
+// written meanwhile
+static void __not_in_flash_func(traceCore1Entry)(void) {
+  uint32_t tail = traceHead();
+  while (true) {
+    romemul_trace_mode_t mode = traceMode;
+    uint32_t head = traceHead();
+    uint32_t pending = (head - tail) & ROMEMUL_TRACE_MASK;
+    if ((mode == ROMEMUL_TRACE_SAMPLED) &&
+        (pending > ROMEMUL_TRACE_SAMPLE_ENTRIES)) {
+      traceStats.skipped += pending - ROMEMUL_TRACE_SAMPLE_ENTRIES;
+      pending = ROMEMUL_TRACE_SAMPLE_ENTRIES;
+      tail = (head - pending) & ROMEMUL_TRACE_MASK;
+    }
+    while (tail != head) {
+      uint32_t offset = traceRing[tail] & (ROMEMUL_ROM_BASE_ALIGN - 1);
+      traceHistogram[offset >> ROMEMUL_TRACE_PAGE_BITS]++;
+      tail = (tail + 1) & ROMEMUL_TRACE_MASK;
+    }
+    traceStats.folded += pending;
+    traceStats.passes++;
+    if (mode == ROMEMUL_TRACE_SAMPLED) {
+      uint32_t start = timer_hw->timerawl;
+      while ((timer_hw->timerawl - start) < ROMEMUL_TRACE_SAMPLE_US) {
+        tight_loop_contents();
+      }
+    }
+  }
+}
+#endif
+
+// Handler to install in DMA_IRQ_1 for the callback
+static IRQInterceptionCallback irqHandlerFor(
+    IRQInterceptionCallback callback) {
+#if ROMEMUL_BUS_STATS == 1
+  statsCallback = callback;
+  return romemulStatsIrqHandler;
+#else
+  return callback;
+#endif
+}
+
 // Interrupt handler for DMA completion
 // We don't use at runtime, but they are useful for debugging
 // Keep in mind that printing in an interrupt handler is not a good idea
@@ -54,7 +275,7 @@ static int initMonitorRom4(PIO pio) {
 
   // Start the state machine, executing the PIO read program
   monitor_rom4_program_init(pio, smMonitorROM4, (uint)offsetMonitorROM4,
-                            SAMPLE_DIV_FREQ);
+                            perf_getProfile()->sampleDiv);
 
   // Enable the state machine
   pio_sm_set_enabled(pio, smMonitorROM4, true);
@@ -77,10 +298,10 @@ static int initMonitorRom3(PIO pio) {
   // Claim a free state machine from the PIO read program
   uint smMonitorROM3 = pio_claim_unused_sm(pio, true);
 
-  // Start the state machine, executing the PIO read program
-  // monitor rom3 and rom4 share the same init function
-  monitor_rom4_program_init(pio, smMonitorROM3, (uint)offsetMonitorROM3,
-                            SAMPLE_DIV_FREQ);
+  // Start the state machine, executing the PIO read program. Its own init
+  // function: the wrap of monitor_rom4 is one instruction longer
+  monitor_rom3_program_init(pio, smMonitorROM3, (uint)offsetMonitorROM3,
+                            perf_getProfile()->sampleDiv);
 
   // Enable the state machine
   pio_sm_set_enabled(pio, smMonitorROM3, true);
@@ -89,6 +310,24 @@ static int initMonitorRom3(PIO pio) {
   return smMonitorROM3;
 }
 
+// Replace READ_ADDRESS_SAFE_WAIT_CYCLES in the delays of romemul_read. It
+// is the only delay used by the program, and already the maximum allowed
+static pio_program_t tuneReadProgram(uint8_t waitCycles) {
+  pio_program_t program = romemul_read_program;
+  for (size_t i = 0; i < count_of(romemul_read_program_instructions); i++) {
+    uint16_t instr = romemul_read_program_instructions[i];
+    if (((instr & ROMEMUL_READ_DELAY_MASK) >> ROMEMUL_READ_DELAY_LSB) ==
+        READ_ADDRESS_SAFE_WAIT_CYCLES) {
+      instr = (uint16_t)((instr & ~ROMEMUL_READ_DELAY_MASK) |
+                         ((waitCycles << ROMEMUL_READ_DELAY_LSB) &
+                          ROMEMUL_READ_DELAY_MASK));
+    }
+    romemulReadInstructions[i] = instr;
+  }
+  program.instructions = romemulReadInstructions;
+  return program;
+}
+
 static int initRomEmulator(PIO pio, IRQInterceptionCallback requestCallback,
                            IRQInterceptionCallback responseCallback) {
   // Configure DMAs
@@ -124,7 +363,9 @@ static int initRomEmulator(PIO pio, IRQInterceptionCallback requestCallback,
   // Configure the read PIO state machine
   // Add the assembled program to the PIO into the memory where there are enough
   // space
-  int offsetReadROM = pio_add_program(pio, &romemul_read_program);
+  pio_program_t readProgram =
+      tuneReadProgram(perf_getProfile()->readWaitCycles);
+  int offsetReadROM = pio_add_program(pio, &readProgram);
   if (offsetReadROM < 0) {
     DPRINTF("Error loading ROM emulator PIO program. Error code: %d\n",
             offsetReadROM);
@@ -138,11 +379,13 @@ static int initRomEmulator(PIO pio, IRQInterceptionCallback requestCallback,
   // Claim a free state machine from the PIO read program
   uint smReadROM = pio_claim_unused_sm(pio, true);
 
+  romReadWaitPc = (uint)offsetReadROM + romemul_read_wrap_target;
+
   // Start the state machine, executing the PIO read program
   romemul_read_program_init(pio, smReadROM, (uint)offsetReadROM,
                             READ_ADDR_GPIO_BASE,
                             READ_ADDR_PIN_COUNT, READ_SIGNAL_GPIO_BASE,
-                            SAMPLE_DIV_FREQ);
+                            perf_getProfile()->sampleDiv);
 
   // Need to clear _input shift counter_, as well as FIFO, because there may be
   // partial ISR contents left over from a previous run. sm_restart does this.
@@ -155,13 +398,20 @@ static int initRomEmulator(PIO pio, IRQInterceptionCallback requestCallback,
   // from the chained previous DMA channel (read_addr_rom_dma_channel) into the
   // read address trigger register. Then push the 16 bit result of the lookup
   // into the FIFO
+  uint lookupChainTo = (uint)readAddrRomDmaChannel;
+#if ROMEMUL_BUS_STATS == 1
+  lookupChainTo = initStatsStamp(smReadROM, lookupChainTo);
+#endif
+#if ROMEMUL_TRACE == 1
+  lookupChainTo = initTrace(lookupChainTo);
+#endif
   dma_channel_config cdmaLookup =
       dma_channel_get_default_config(lookupDataRomDmaChannel);
   channel_config_set_transfer_data_size(&cdmaLookup, DMA_SIZE_16);
   channel_config_set_read_increment(&cdmaLookup, false);
   channel_config_set_write_increment(&cdmaLookup, false);
   channel_config_set_dreq(&cdmaLookup, pio_get_dreq(pio, smReadROM, true));
-  channel_config_set_chain_to(&cdmaLookup, readAddrRomDmaChannel);
+  channel_config_set_chain_to(&cdmaLookup, lookupChainTo);
   dma_channel_configure(lookupDataRomDmaChannel, &cdmaLookup,
                         &pio->txf[smReadROM], NULL, 1, false);
 
@@ -202,7 +452,7 @@ static int initRomEmulator(PIO pio, IRQInterceptionCallback requestCallback,
       DPRINTF("Enabling DMA IRQ for lookup_data_rom_dma_channel.\n");
       dma_channel_set_irq1_enabled(lookupDataRomDmaChannel, true);
     }
-    irq_set_exclusive_handler(DMA_IRQ_1, irqHandler);
+    irq_set_exclusive_handler(DMA_IRQ_1, irqHandlerFor(irqHandler));
     irq_set_enabled(DMA_IRQ_1, true);
   } else {
     irq_set_enabled(DMA_IRQ_1, false);
@@ -228,7 +478,7 @@ void dma_setResponseCB(IRQInterceptionCallback responseCallback) {
     irq_remove_handler(DMA_IRQ_1, irq_get_exclusive_handler(DMA_IRQ_1));
 
     // Now safely set the new one
-    irq_set_exclusive_handler(DMA_IRQ_1, responseCallback);
+    irq_set_exclusive_handler(DMA_IRQ_1, irqHandlerFor(responseCallback));
 
     // Re-enable
     dma_channel_set_irq1_enabled(lookupDataRomDmaChannel, true);
@@ -237,7 +487,7 @@ void dma_setResponseCB(IRQInterceptionCallback responseCallback) {
   }
 }
 
-int romemul_getLookupDataRomDmaChannel(void) {
+int __not_in_flash_func(romemul_getLookupDataRomDmaChannel)(void) {
   return lookupDataRomDmaChannel;
 }
 
@@ -266,6 +516,7 @@ int init_romemul(IRQInterceptionCallback requestCallback,
     DPRINTF("Error initializing ROM4 monitor. Error code: %d\n", smMonitorROM4);
     return -1;
   }
+  romMonitorRom4Sm = smMonitorROM4;
 
   int smMonitorROM3 = initMonitorRom3(defaultPio);
   if (smMonitorROM3 < 0) {
@@ -296,6 +547,13 @@ int init_romemul(IRQInterceptionCallback requestCallback,
   pio_sm_put_blocking(
       defaultPio, smReadROM,
       ((unsigned long int)&__rom_in_ram_start__ >> ROMEMUL_BUS_BITS));
+  romBaseAddress = (uintptr_t)&__rom_in_ram_start__;
+  romReadSm = smReadROM;
+
+#if ROMEMUL_BUS_STATS == 1
+  // Discard the stall of the initial pull waiting for the value above
+  romemul_resetBusStats();
+#endif
 
   // Setting the signals after configuring the PIO makes the ROM emulator to not
   // put inconsistent data in the address or data bus at any time, avoiding
@@ -335,3 +593,256 @@ int init_romemul(IRQInterceptionCallback requestCallback,
 
   return smReadROM;
 }
+
+int romemul_setRomBase(const void *base) {
+  uintptr_t address = (uintptr_t)base;
+  if ((romReadSm < 0) || ((address & (ROMEMUL_ROM_BASE_ALIGN - 1)) != 0)) {
+    DPRINTF("Can't switch the ROM base to 0x%08x.\n", (unsigned int)address);
+    return -1;
+  }
+  if (address == romBaseAddress) {
+    return 0;
+  }
+
+  uint sm = (uint)romReadSm;
+  uint32_t ints = save_and_disable_interrupts();
+  // Wait between bus cycles: the state machine waits for the next access and
+  // its TX FIFO is empty. Nothing is in flight
+  uint32_t start = time_us_32();
+  while ((pio_sm_get_pc(defaultPio, sm) != romReadWaitPc) ||
+         (defaultPio->irq & (1u << ROMEMUL_ACCESS_IRQ)) ||
+         !pio_sm_is_tx_fifo_empty(defaultPio, sm)) {
+    if ((time_us_32() - start) > ROMEMUL_ROM_BASE_SWITCH_TIMEOUT_US) {
+      restore_interrupts(ints);
+      DPRINTF("Timeout waiting for the bus to switch the ROM base.\n");
+      return -1;
+    }
+  }
+  // Stopped, the access signalled meanwhile is served when enabled again.
+  // The executed instructions run even if the state machine is disabled
+  pio_sm_set_enabled(defaultPio, sm, false);
+  pio_sm_put(defaultPio, sm, (uint32_t)(address >> ROMEMUL_BUS_BITS));
+  pio_sm_exec(defaultPio, sm, pio_encode_pull(false, true));
+  pio_sm_exec(defaultPio, sm, pio_encode_mov(pio_x, pio_osr));
+  pio_sm_set_enabled(defaultPio, sm, true);
+  romBaseAddress = address;
+  restore_interrupts(ints);
+
+  DPRINTF("ROM base switched to 0x%08x.\n", (unsigned int)address);
+  return 0;
+}
+
+const void *romemul_getRomBase(void) { return (const void *)romBaseAddress; }
+
+uint32_t romemul_getRom4AccessCount(void) {
+  if (romMonitorRom4Sm < 0) {
+    return 0;
+  }
+  uint sm = (uint)romMonitorRom4Sm;
+  // The exec'd instructions run between two of the program, which goes on
+  // with its wait afterwards. X counts down from 0
+  uint32_t ints = save_and_disable_interrupts();
+  pio_sm_exec(defaultPio, sm, pio_encode_mov(pio_isr, pio_x));
+  pio_sm_exec(defaultPio, sm, pio_encode_push(false, false));
+  uint32_t count = pio_sm_get_blocking(defaultPio, sm);
+  restore_interrupts(ints);
+  return 0u - count;
+}
+
+int romemul_loadImage(const void *image) {
+  const void *ramBase = (const void *)&__rom_in_ram_start__;
+  if (image == ramBase) {
+    return 0;
+  }
+  // The copy streams the image from the XIP
+  if (((uintptr_t)image < XIP_BASE) || ((uintptr_t)image >= SRAM_BASE)) {
+    DPRINTF("The image to load must be in the flash.\n");
+    return -1;
+  }
+  // Serve the complete image from the flash while the RAM is overwritten
+  if (romemul_setRomBase(image) != 0) {
+    return -1;
+  }
+  COPY_FIRMWARE_TO_RAM((const uint16_t *)image, ROM_SIZE_WORDS * ROM_BANKS);
+  return romemul_setRomBase(ramBase);
+}
+
+int romemul_initRom3Capture(void) {
+  int offsetCaptureROM3 = pio_add_program(defaultPio, &capture_rom3_program);
+  if (offsetCaptureROM3 < 0) {
+    DPRINTF("Error loading capture ROM3 PIO program. Error code: %d\n",
+            offsetCaptureROM3);
+    return -1;
+  }
+
+  int smCaptureROM3 = pio_claim_unused_sm(defaultPio, false);
+  if (smCaptureROM3 < 0) {
+    DPRINTF("No free state machine for the ROM3 capture.\n");
+    pio_remove_program(defaultPio, &capture_rom3_program,
+                       (uint)offsetCaptureROM3);
+    return -1;
+  }
+
+  rom3CaptureDmaChannel = dma_claim_unused_channel(false);
+  if (rom3CaptureDmaChannel < 0) {
+    DPRINTF("Failed to claim a DMA channel for the ROM3 capture.\n");
+    pio_sm_unclaim(defaultPio, (uint)smCaptureROM3);
+    pio_remove_program(defaultPio, &capture_rom3_program,
+                       (uint)offsetCaptureROM3);
+    return -1;
+  }
+
+  capture_rom3_program_init(defaultPio, (uint)smCaptureROM3,
+                            (uint)offsetCaptureROM3, READ_ADDR_GPIO_BASE,
+                            READ_ADDR_PIN_COUNT, perf_getProfile()->sampleDiv);
+  pio_sm_clear_fifos(defaultPio, (uint)smCaptureROM3);
+
+  // Move the 16 bit samples from the FIFO RX to the ring. The write address
+  // wraps at the ring size, so the channel runs unattended
+  dma_channel_config cdmaCapture =
+      dma_channel_get_default_config((uint)rom3CaptureDmaChannel);
+  channel_config_set_transfer_data_size(&cdmaCapture, DMA_SIZE_16);
+  channel_config_set_read_increment(&cdmaCapture, false);
+  channel_config_set_write_increment(&cdmaCapture, true);
+  channel_config_set_ring(&cdmaCapture, true, ROMEMUL_ROM3_CAPTURE_RING_BITS);
+  channel_config_set_dreq(&cdmaCapture,
+                          pio_get_dreq(defaultPio, (uint)smCaptureROM3, false));
+  dma_channel_configure((uint)rom3CaptureDmaChannel, &cdmaCapture,
+                        rom3CaptureBuffer, &defaultPio->rxf[smCaptureROM3],
+                        ROM3_CAPTURE_TRANSFER_COUNT, true);
+
+  pio_sm_set_enabled(defaultPio, (uint)smCaptureROM3, true);
+
+  DPRINTF("ROM3 capture initialized. SM: %d, DMA channel: %d\n",
+          smCaptureROM3, rom3CaptureDmaChannel);
+  return 0;
+}
+
+uint32_t __not_in_flash_func(romemul_getRom3CaptureCount)(void) {
+  if (rom3CaptureDmaChannel < 0) {
+    return 0;
+  }
+  return ROM3_CAPTURE_TRANSFER_COUNT -
+         dma_hw->ch[(uint)rom3CaptureDmaChannel].transfer_count;
+}
+
+const volatile uint16_t *romemul_getRom3CaptureBuffer(void) {
+  return rom3CaptureBuffer;
+}
+
+int romemul_getBusStats(RomemulBusStats *stats) {
+#if ROMEMUL_BUS_STATS == 1
+  *stats = busStats;
+  return 0;
+#else
+  (void)stats;
+  return -1;
+#endif
+}
+
+void romemul_resetBusStats(void) {
+#if ROMEMUL_BUS_STATS == 1
+  memset(&busStats, 0, sizeof(busStats));
+  busStats.latencyMinUs = UINT32_MAX;
+  busStats.durationMinCycles = UINT32_MAX;
+  defaultPio->fdebug = (1u << (PIO_FDEBUG_TXSTALL_LSB + statsReadSm)) |
+                       (1u << (PIO_FDEBUG_RXSTALL_LSB + statsReadSm));
+#endif
+}
+
+int romemul_startTrace(romemul_trace_mode_t mode) {
+#if ROMEMUL_TRACE == 1
+  if ((traceDmaChannel < 0) || ((mode != ROMEMUL_TRACE_FULL) &&
+                                (mode != ROMEMUL_TRACE_SAMPLED))) {
+    return -1;
+  }
+  bool running = (traceMode != ROMEMUL_TRACE_OFF);
+  traceMode = mode;
+  traceStats.mode = mode;
+  if (!running) {
+    multicore_reset_core1();
+    multicore_launch_core1(traceCore1Entry);
+  }
+  DPRINTF("ROM trace started. Mode: %d\n", mode);
+  return 0;
+#else
+  (void)mode;
+  return -1;
+#endif
+}
+
+void romemul_stopTrace(void) {
+#if ROMEMUL_TRACE == 1
+  if (traceMode == ROMEMUL_TRACE_OFF) {
+    return;
+  }
+  multicore_reset_core1();
+  traceMode = ROMEMUL_TRACE_OFF;
+  traceStats.mode = ROMEMUL_TRACE_OFF;
+  DPRINTF("ROM trace stopped.\n");
+#endif
+}
+
+void romemul_resetTrace(void) {
+#if ROMEMUL_TRACE == 1
+  // The aggregator may be adding to them meanwhile, a few counts can remain
+  for (uint32_t i = 0; i < ROMEMUL_TRACE_PAGES; i++) {
+    traceHistogram[i] = 0;
+  }
+  traceStats.folded = 0;
+  traceStats.skipped = 0;
+  traceStats.passes = 0;
+#endif
+}
+
+const volatile uint32_t *romemul_getTraceHistogram(void) {
+#if ROMEMUL_TRACE == 1
+  return traceHistogram;
+#else
+  return NULL;
+#endif
+}
+
+void romemul_getTraceStats(RomemulTraceStats *stats) {
+#if ROMEMUL_TRACE == 1
+  stats->mode = traceStats.mode;
+  stats->folded = traceStats.folded;
+  stats->skipped = traceStats.skipped;
+  stats->passes = traceStats.passes;
+#else
+  memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+// Core1 entry point: configure the emulator so DMA_IRQ_1 is enabled in the
+// core1 NVIC, report the result to core0 and sleep between interrupts.
+static void __not_in_flash_func(romemulCore1Entry)(void) {
+  int smReadROM = init_romemul(NULL, core1ResponseCallback, false);
+  multicore_fifo_push_blocking((uint32_t)smReadROM);
+  while (true) {
+    __wfi();
+  }
+}
+
+int romemul_initOnCore1(IRQInterceptionCallback responseCallback,
+                        bool copyFlashToRAM) {
+  if (responseCallback == NULL) {
+    DPRINTF("Core1 bus service needs a response callback.\n");
+    return -1;
+  }
+
+  // Copy from flash in core0, core1 must never touch the XIP
+  if (copyFlashToRAM) {
+    const uint16_t *srcAddr =
+        (const uint16_t *)(XIP_BASE + FLASH_ROM_LOAD_OFFSET);
+    COPY_FIRMWARE_TO_RAM(srcAddr, ROM_SIZE_WORDS * ROM_BANKS);
+  }
+
+  core1ResponseCallback = responseCallback;
+  multicore_reset_core1();
+  multicore_launch_core1(romemulCore1Entry);
+
+  int smReadROM = (int)multicore_fifo_pop_blocking();
+  DPRINTF("ROM emulator bus service running on core1. SM: %d\n", smReadROM);
+  return smReadROM;
+}
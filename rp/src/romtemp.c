@@ -0,0 +1,92 @@
+/**
+ * File: romtemp.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: ROM image kept in the ROM_TEMP flash
+ */
+
+#include "romtemp.h"
+
+#include <string.h>
+
+#include "hardware/regs/addressmap.h"
+#include "pico/flash.h"
+#include "pico/time.h"
+#include "romemul.h"
+
+// One sector write, run by flash_safe_execute
+typedef struct {
+  uint32_t offset;
+  const uint8_t *data;
+  bool erase;
+} RomtempSectorOp;
+
+static void __not_in_flash_func(writeSector)(void *param) {
+  const RomtempSectorOp *op = (const RomtempSectorOp *)param;
+  if (op->erase) {
+    flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+  }
+  flash_range_program(op->offset, op->data, FLASH_SECTOR_SIZE);
+}
+
+// Programming only clears bits. Without an erase the data must not set any
+static bool needsErase(const uint8_t *flash, const uint8_t *data) {
+  const uint32_t *oldWords = (const uint32_t *)flash;
+  const uint32_t *newWords = (const uint32_t *)data;
+  for (size_t i = 0; i < FLASH_SECTOR_SIZE / sizeof(uint32_t); i++) {
+    if ((oldWords[i] & newWords[i]) != newWords[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const void *romtemp_getImage(void) { return (const void *)&_rom_temp_start; }
+
+int romtemp_update(const void *image, size_t size, RomtempUpdateStats *stats) {
+  RomtempUpdateStats result = {0};
+  const uint8_t *flash = (const uint8_t *)&_rom_temp_start;
+  const uint8_t *data = (const uint8_t *)image;
+  if ((size == 0) || (size > ROMTEMP_SIZE_BYTES) ||
+      ((size % FLASH_SECTOR_SIZE) != 0) || ((uintptr_t)data & 3) ||
+      ((uintptr_t)data < SRAM_BASE)) {
+    DPRINTF("Invalid image to write to ROM_TEMP.\n");
+    return -1;
+  }
+  if (romemul_getRomBase() == (const void *)flash) {
+    DPRINTF("ROM_TEMP is in use by the ROM emulator.\n");
+    return -1;
+  }
+
+  uint32_t start = time_us_32();
+  for (size_t offset = 0; offset < size; offset += FLASH_SECTOR_SIZE) {
+    result.sectorsChecked++;
+    if (memcmp(flash + offset, data + offset, FLASH_SECTOR_SIZE) == 0) {
+      continue;
+    }
+    RomtempSectorOp op = {
+        .offset = (uint32_t)((uintptr_t)(flash + offset) - XIP_BASE),
+        .data = data + offset,
+        .erase = needsErase(flash + offset, data + offset),
+    };
+    int err = flash_safe_execute(writeSector, &op,
+                                 ROMTEMP_FLASH_SAFE_TIMEOUT_MS);
+    if ((err != PICO_OK) ||
+        (memcmp(flash + offset, data + offset, FLASH_SECTOR_SIZE) != 0)) {
+      DPRINTF("Error writing ROM_TEMP sector at 0x%x: %d\n",
+              (unsigned int)op.offset, err);
+      return -1;
+    }
+    result.sectorsErased += op.erase ? 1 : 0;
+    result.sectorsProgrammed++;
+  }
+  result.timeUs = time_us_32() - start;
+  DPRINTF("ROM_TEMP updated: %lu of %lu sectors written in %lu us\n",
+          (unsigned long)result.sectorsProgrammed,
+          (unsigned long)result.sectorsChecked, (unsigned long)result.timeUs);
+  if (stats != NULL) {
+    *stats = result;
+  }
+  return 0;
+}
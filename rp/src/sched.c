@@ -0,0 +1,204 @@
+/**
+ * File: sched.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Cooperative scheduler of the main loop
+ */
+
+#include "sched.h"
+
+typedef struct {
+  SchedTaskFn fn;
+  void *context;
+  SchedReadyFn ready;
+  absolute_time_t deadline;
+  bool ran;    // Already run in the current pass
+  bool retry;  // Returned false: run in the next pass, not at the deadline
+  SchedTaskStats stats;
+} SchedTask;
+
+static SchedTask tasks[SCHED_MAX_TASKS];
+static int taskCount = 0;
+static SchedReadyFn busPending = NULL;
+
+// Task running now, for sched_shouldYield
+static SchedTask *currentTask = NULL;
+static uint32_t currentStartUs = 0;
+
+int sched_addTask(const char *name, SchedTaskFn fn, void *context,
+                  uint32_t periodMs, uint32_t budgetUs,
+                  sched_priority_t priority, SchedReadyFn ready) {
+  if ((taskCount >= SCHED_MAX_TASKS) || (fn == NULL)) {
+    DPRINTF("No room for the task %s\n", name);
+    return -1;
+  }
+  SchedTask *task = &tasks[taskCount];
+  task->fn = fn;
+  task->context = context;
+  task->ready = ready;
+  task->deadline = make_timeout_time_ms(periodMs);
+  task->stats = (SchedTaskStats){.name = name,
+                                 .priority = priority,
+                                 .periodMs = periodMs,
+                                 .budgetUs = budgetUs};
+  DPRINTF("Task %s: period %lu ms, budget %lu us, priority %d\n", name,
+          (unsigned long)periodMs, (unsigned long)budgetUs, priority);
+  return taskCount++;
+}
+
+void sched_setBusPending(SchedReadyFn pending) { busPending = pending; }
+
+static bool isBusPending(void) {
+  return (busPending != NULL) && busPending();
+}
+
+static bool isDue(const SchedTask *task, absolute_time_t now) {
+  if (task->stats.periodMs == SCHED_EVERY_PASS) {
+    return true;
+  }
+  if ((task->ready != NULL) && task->ready()) {
+    return true;
+  }
+  return absolute_time_diff_us(now, task->deadline) <= 0;
+}
+
+static void runTask(SchedTask *task) {
+  SchedTaskStats *stats = &task->stats;
+  absolute_time_t start = get_absolute_time();
+  if (stats->periodMs != SCHED_EVERY_PASS) {
+    int64_t late = absolute_time_diff_us(task->deadline, start);
+    if ((late > 0) && ((uint64_t)late > stats->maxLateUs)) {
+      stats->maxLateUs = (late > UINT32_MAX) ? UINT32_MAX : (uint32_t)late;
+    }
+  }
+
+  currentTask = task;
+  currentStartUs = time_us_32();
+  bool done = task->fn(task->context);
+  uint32_t elapsed = time_us_32() - currentStartUs;
+  currentTask = NULL;
+
+  stats->runs++;
+  stats->lastUs = elapsed;
+  stats->totalUs += elapsed;
+  if (elapsed > stats->maxUs) {
+    stats->maxUs = elapsed;
+  }
+  if (elapsed > stats->budgetUs) {
+    stats->overruns++;
+  }
+  task->retry = !done;
+  if (done) {
+    // Keep the phase of the period, unless the task fell a period behind
+    task->deadline = delayed_by_ms(task->deadline, stats->periodMs);
+    if (absolute_time_diff_us(start, task->deadline) <= 0) {
+      task->deadline = delayed_by_ms(start, stats->periodMs);
+    }
+  }
+}
+
+static void runBusTasks(void) {
+  absolute_time_t now = get_absolute_time();
+  for (int i = 0; i < taskCount; i++) {
+    SchedTask *task = &tasks[i];
+    if ((task->stats.priority == SCHED_PRIORITY_BUS) &&
+        (!task->ran || isBusPending()) && isDue(task, now)) {
+      task->ran = true;
+      runTask(task);
+    }
+  }
+}
+
+// The due task of the priority with the earliest deadline, or NULL
+static SchedTask *nextTask(sched_priority_t priority, absolute_time_t now) {
+  SchedTask *next = NULL;
+  for (int i = 0; i < taskCount; i++) {
+    SchedTask *task = &tasks[i];
+    if ((task->stats.priority != priority) || task->ran ||
+        !isDue(task, now)) {
+      continue;
+    }
+    if ((next == NULL) ||
+        (absolute_time_diff_us(task->deadline, next->deadline) > 0)) {
+      next = task;
+    }
+  }
+  return next;
+}
+
+void sched_run(void) {
+  for (int i = 0; i < taskCount; i++) {
+    tasks[i].ran = false;
+  }
+  runBusTasks();
+  for (sched_priority_t priority = SCHED_PRIORITY_NORMAL;
+       priority <= SCHED_PRIORITY_IDLE; priority++) {
+    SchedTask *task;
+    while ((task = nextTask(priority, get_absolute_time())) != NULL) {
+      if ((priority == SCHED_PRIORITY_IDLE) && isBusPending()) {
+        return;
+      }
+      task->ran = true;
+      runTask(task);
+      // Commands that arrived meanwhile do not wait for the rest of the pass
+      if (isBusPending()) {
+        runBusTasks();
+      }
+    }
+  }
+}
+
+uint32_t sched_getWaitMs(uint32_t maxMs) {
+  uint32_t waitMs = maxMs;
+  absolute_time_t now = get_absolute_time();
+  for (int i = 0; i < taskCount; i++) {
+    // A task that could not do its work runs again in the next pass
+    if (tasks[i].retry) {
+      return 0;
+    }
+    if (tasks[i].stats.periodMs == SCHED_EVERY_PASS) {
+      continue;
+    }
+    int64_t left = absolute_time_diff_us(now, tasks[i].deadline);
+    if (left <= 0) {
+      return 0;
+    }
+    if ((uint64_t)left < (uint64_t)waitMs * 1000) {
+      waitMs = (uint32_t)((left + 999) / 1000);
+    }
+  }
+  return waitMs;
+}
+
+bool sched_shouldYield(void) {
+  if (currentTask == NULL) {
+    return false;
+  }
+  if ((currentTask->stats.priority != SCHED_PRIORITY_BUS) && isBusPending()) {
+    return true;
+  }
+  return (time_us_32() - currentStartUs) >= currentTask->stats.budgetUs;
+}
+
+int sched_getTaskCount(void) { return taskCount; }
+
+int sched_getTaskStats(int task, SchedTaskStats *stats) {
+  if ((task < 0) || (task >= taskCount)) {
+    return -1;
+  }
+  *stats = tasks[task].stats;
+  return 0;
+}
+
+void sched_resetStats(void) {
+  for (int i = 0; i < taskCount; i++) {
+    SchedTaskStats *stats = &tasks[i].stats;
+    stats->runs = 0;
+    stats->overruns = 0;
+    stats->lastUs = 0;
+    stats->maxUs = 0;
+    stats->totalUs = 0;
+    stats->maxLateUs = 0;
+  }
+}
@@ -1,7 +1,328 @@
 #include "sdcard.h"
 
+#include <string.h>
+
+#include "diskio.h"
+#include "hardware/clocks.h"
+#include "hardware/spi.h"
+#include "memfunc.h"
+#include "perf.h"
+
 static FATFS *mountedFsPtr = NULL;
 static bool sdMounted = false;
+// The free clusters count failed for the mounted volume. Do not retry it
+static bool freeSpaceFailed = false;
+// Free clusters count in progress, see sdcard_refreshFreeSpace
+static bool freeScanActive = false;
+static DWORD freeScanSector = 0;    // Next FAT sector, from the FAT start
+static DWORD freeScanClusters = 0;  // Free clusters in the sectors read
+static DWORD freeScanLastClst = 0;  // last_clst of FatFs when it started
+static uint8_t freeScanBuffer[NUM_BYTES_PER_SECTOR] __attribute__((aligned(4)));
+
+// Sectors written and read back by the calibration
+static uint8_t calibrationBuffer[SDCARD_CALIBRATION_SECTORS *
+                                 NUM_BYTES_PER_SECTOR]
+    __attribute__((aligned(4)));
+
+// The FatFs disk_read and disk_write are wrapped by the linker, so the cache
+// sits under FatFs without changing the SD library
+DRESULT __real_disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count);
+DRESULT __real_disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector,
+                          UINT count);
+
+static uint32_t cacheHits = 0;
+static uint32_t cacheMisses = 0;
+
+#if SDCARD_CACHE_KB > 0
+#if SDCARD_CACHE_LINES < 2
+#error "SDCARD_CACHE_KB must hold at least two cache lines"
+#endif
+
+// Aligned group of SDCARD_CACHE_LINE_SECTORS sectors
+typedef struct {
+  LBA_t firstSector;
+  uint32_t lastUse;
+  BYTE pdrv;
+  bool valid;
+} SdcardCacheLine;
+
+static SdcardCacheLine cacheLines[SDCARD_CACHE_LINES];
+static uint8_t cacheData[SDCARD_CACHE_LINES][SDCARD_CACHE_LINE_SECTORS *
+                                             NUM_BYTES_PER_SECTOR]
+    __attribute__((aligned(4)));
+static uint32_t cacheClock = 0;
+// First sector of the line after the last one read from the card
+static LBA_t nextLineSector = 0;
+
+static int findLine(BYTE pdrv, LBA_t firstSector) {
+  for (int i = 0; i < SDCARD_CACHE_LINES; i++) {
+    if (cacheLines[i].valid && (cacheLines[i].pdrv == pdrv) &&
+        (cacheLines[i].firstSector == firstSector)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// A free line, or the least recently used one
+static int victimLine(void) {
+  int victim = 0;
+  for (int i = 0; i < SDCARD_CACHE_LINES; i++) {
+    if (!cacheLines[i].valid) {
+      return i;
+    }
+    if (cacheLines[i].lastUse < cacheLines[victim].lastUse) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+// Read a whole line from the card. Returns the line or -1 on error
+static int fillLine(BYTE pdrv, LBA_t firstSector) {
+  int line = victimLine();
+  cacheLines[line].valid = false;
+  if (__real_disk_read(pdrv, cacheData[line], firstSector,
+                       SDCARD_CACHE_LINE_SECTORS) != RES_OK) {
+    return -1;
+  }
+  cacheLines[line].firstSector = firstSector;
+  cacheLines[line].pdrv = pdrv;
+  cacheLines[line].lastUse = ++cacheClock;
+  cacheLines[line].valid = true;
+  nextLineSector = firstSector + SDCARD_CACHE_LINE_SECTORS;
+  return line;
+}
+#endif
+
+DRESULT __wrap_disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
+#if SDCARD_CACHE_KB > 0
+  // Large reads are already one multi-block transfer. Only the small ones
+  // of the emulated disks pay the command round trip for each sector
+  if (count < SDCARD_CACHE_LINE_SECTORS) {
+    for (UINT i = 0; i < count; i++) {
+      LBA_t target = sector + i;
+      LBA_t firstSector = target - (target % SDCARD_CACHE_LINE_SECTORS);
+      int line = findLine(pdrv, firstSector);
+      if (line < 0) {
+        bool sequential = (firstSector == nextLineSector);
+        line = fillLine(pdrv, firstSector);
+        if (line < 0) {
+          // Past the end of the card, or a read error
+          cacheMisses += count - i;
+          return __real_disk_read(pdrv, buff + i * NUM_BYTES_PER_SECTOR,
+                                  target, count - i);
+        }
+        cacheMisses++;
+        for (int ahead = 1;
+             sequential && (ahead <= SDCARD_CACHE_READAHEAD_LINES); ahead++) {
+          LBA_t aheadSector = firstSector + ahead * SDCARD_CACHE_LINE_SECTORS;
+          if ((findLine(pdrv, aheadSector) < 0) &&
+              (fillLine(pdrv, aheadSector) < 0)) {
+            break;
+          }
+        }
+        // The read ahead must not push out the line being read
+        cacheLines[line].lastUse = ++cacheClock;
+      } else {
+        cacheHits++;
+        cacheLines[line].lastUse = ++cacheClock;
+      }
+      memcpy(buff + i * NUM_BYTES_PER_SECTOR,
+             &cacheData[line][(target - firstSector) * NUM_BYTES_PER_SECTOR],
+             NUM_BYTES_PER_SECTOR);
+    }
+    return RES_OK;
+  }
+#endif
+  cacheMisses += count;
+  return __real_disk_read(pdrv, buff, sector, count);
+}
+
+DRESULT __wrap_disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector,
+                          UINT count) {
+  DRESULT res = __real_disk_write(pdrv, buff, sector, count);
+#if SDCARD_CACHE_KB > 0
+  // Write through: the cached copies of the sectors get the new data, or go
+  // away if the write failed
+  for (int i = 0; i < SDCARD_CACHE_LINES; i++) {
+    SdcardCacheLine *line = &cacheLines[i];
+    if (!line->valid || (line->pdrv != pdrv) ||
+        (line->firstSector + SDCARD_CACHE_LINE_SECTORS <= sector) ||
+        (line->firstSector >= sector + count)) {
+      continue;
+    }
+    if (res != RES_OK) {
+      line->valid = false;
+      continue;
+    }
+    LBA_t from = (line->firstSector > sector) ? line->firstSector : sector;
+    LBA_t to = line->firstSector + SDCARD_CACHE_LINE_SECTORS;
+    if (to > sector + count) {
+      to = sector + count;
+    }
+    memcpy(&cacheData[i][(from - line->firstSector) * NUM_BYTES_PER_SECTOR],
+           buff + (from - sector) * NUM_BYTES_PER_SECTOR,
+           (to - from) * NUM_BYTES_PER_SECTOR);
+  }
+#endif
+  return res;
+}
+
+sdcard_rom_status_t sdcard_loadRomImage(const char *folderName,
+                                        const char *fileName, bool swapBytes,
+                                        uint32_t *loadUs) {
+  if (!sdcard_isMounted() || (folderName == NULL) || (fileName == NULL)) {
+    return SDCARD_ROM_NOT_MOUNTED;
+  }
+  uint32_t start = time_us_32();
+  char path[FF_MAX_LFN] = {0};
+  snprintf(path, sizeof(path), "%s/%s", folderName, fileName);
+  FIL file;
+  if (f_open(&file, path, FA_READ) != FR_OK) {
+    DPRINTF("Can't open the ROM image %s\n", path);
+    return SDCARD_ROM_OPEN_ERROR;
+  }
+  FSIZE_t size = f_size(&file);
+  if ((size != ROM_SIZE_BYTES) && (size != ROM_SIZE_BYTES * ROM_BANKS)) {
+    DPRINTF("Invalid ROM image size: %lu\n", (unsigned long)size);
+    f_close(&file);
+    return SDCARD_ROM_SIZE_ERROR;
+  }
+
+  // Read a piece while the previous one is swapped
+  uint8_t *dest = (uint8_t *)&__rom_in_ram_start__;
+  int swapJob = MEMFUNC_DMA_NO_JOB;
+  sdcard_rom_status_t status = SDCARD_ROM_OK;
+  for (FSIZE_t offset = 0; offset < size; offset += SDCARD_ROM_CHUNK_BYTES) {
+    UINT chunk = SDCARD_ROM_CHUNK_BYTES;
+    if (chunk > size - offset) {
+      chunk = (UINT)(size - offset);
+    }
+    UINT bytesRead = 0;
+    FRESULT res = f_read(&file, dest + offset, chunk, &bytesRead);
+    if ((res != FR_OK) || (bytesRead != chunk)) {
+      DPRINTF("Error reading the ROM image: %i\n", res);
+      status = SDCARD_ROM_READ_ERROR;
+      break;
+    }
+    if (swapBytes) {
+      memfunc_dmaWait(swapJob);
+      swapJob = memfunc_dmaCopyAsync(dest + offset, dest + offset, chunk,
+                                     true, NULL, NULL);
+    }
+  }
+  memfunc_dmaWait(swapJob);
+  f_close(&file);
+
+  uint32_t elapsed = time_us_32() - start;
+  if (loadUs != NULL) {
+    *loadUs = elapsed;
+  }
+  if (status == SDCARD_ROM_OK) {
+    DPRINTF("ROM image %s loaded: %lu bytes in %lu us\n", path,
+            (unsigned long)size, (unsigned long)elapsed);
+  }
+  return status;
+}
+
+sdcard_image_status_t sdcard_openImage(SdcardImage *image,
+                                       const char *folderName,
+                                       const char *fileName, bool writable) {
+  if (!sdcard_isMounted() || (folderName == NULL) || (fileName == NULL)) {
+    return SDCARD_IMAGE_NOT_MOUNTED;
+  }
+  char path[FF_MAX_LFN] = {0};
+  snprintf(path, sizeof(path), "%s/%s", folderName, fileName);
+  BYTE mode = writable ? (FA_READ | FA_WRITE) : FA_READ;
+  if (f_open(&image->file, path, mode) != FR_OK) {
+    DPRINTF("Can't open the image %s\n", path);
+    return SDCARD_IMAGE_OPEN_ERROR;
+  }
+  image->fastSeek = false;
+#if FF_USE_FASTSEEK
+  // The first word is the size of the map. FatFs puts the words it needs
+  // there if the map is too small
+  image->linkMap[0] = SDCARD_IMAGE_LINK_WORDS;
+  image->file.cltbl = image->linkMap;
+  FRESULT res = f_lseek(&image->file, CREATE_LINKMAP);
+  if (res == FR_OK) {
+    image->fastSeek = true;
+  } else {
+    DPRINTF("No link map for %s (%i), it needs %lu words\n", path, res,
+            (unsigned long)image->linkMap[0]);
+    image->file.cltbl = NULL;
+  }
+#endif
+  DPRINTF("Image %s open: %lu bytes, fast seek %d\n", path,
+          (unsigned long)f_size(&image->file), image->fastSeek);
+  return SDCARD_IMAGE_OK;
+}
+
+// Move to the offset of a transfer that must end inside the image
+static sdcard_image_status_t seekImage(SdcardImage *image, FSIZE_t offset,
+                                       UINT length) {
+  FSIZE_t size = f_size(&image->file);
+  if ((offset > size) || (length > size - offset)) {
+    return SDCARD_IMAGE_RANGE_ERROR;
+  }
+  if ((f_tell(&image->file) != offset) &&
+      (f_lseek(&image->file, offset) != FR_OK)) {
+    return SDCARD_IMAGE_IO_ERROR;
+  }
+  return SDCARD_IMAGE_OK;
+}
+
+sdcard_image_status_t sdcard_readImage(SdcardImage *image, FSIZE_t offset,
+                                       void *buffer, UINT length) {
+  sdcard_image_status_t status = seekImage(image, offset, length);
+  if (status != SDCARD_IMAGE_OK) {
+    return status;
+  }
+  UINT bytesRead = 0;
+  if ((f_read(&image->file, buffer, length, &bytesRead) != FR_OK) ||
+      (bytesRead != length)) {
+    return SDCARD_IMAGE_IO_ERROR;
+  }
+  return SDCARD_IMAGE_OK;
+}
+
+sdcard_image_status_t sdcard_writeImage(SdcardImage *image, FSIZE_t offset,
+                                        const void *buffer, UINT length) {
+  sdcard_image_status_t status = seekImage(image, offset, length);
+  if (status != SDCARD_IMAGE_OK) {
+    return status;
+  }
+  UINT bytesWritten = 0;
+  if ((f_write(&image->file, buffer, length, &bytesWritten) != FR_OK) ||
+      (bytesWritten != length)) {
+    return SDCARD_IMAGE_IO_ERROR;
+  }
+  return SDCARD_IMAGE_OK;
+}
+
+FSIZE_t sdcard_getImageSize(const SdcardImage *image) {
+  return f_size(&image->file);
+}
+
+void sdcard_closeImage(SdcardImage *image) {
+  f_close(&image->file);
+  image->fastSeek = false;
+}
+
+void sdcard_cacheInvalidate(void) {
+#if SDCARD_CACHE_KB > 0
+  for (int i = 0; i < SDCARD_CACHE_LINES; i++) {
+    cacheLines[i].valid = false;
+  }
+  nextLineSector = 0;
+#endif
+}
+
+void sdcard_getCacheStats(uint32_t *hits, uint32_t *misses) {
+  *hits = cacheHits;
+  *misses = cacheMisses;
+}
 
 static void sdcard_warnDebugRisk(void) {
   size_t sdCount = sd_get_num();
@@ -56,6 +377,9 @@ bool sdcard_dirExist(const char *dir) {
 sdcard_status_t sdcard_initFilesystem(FATFS *fsPtr, const char *folderName) {
   sdMounted = false;
   mountedFsPtr = NULL;
+  freeSpaceFailed = false;
+  freeScanActive = false;
+  sdcard_cacheInvalidate();
 
   if ((fsPtr == NULL) || (folderName == NULL) || (folderName[0] == '\0')) {
     DPRINTF("Invalid SD filesystem initialization arguments.\n");
@@ -72,6 +396,13 @@ sdcard_status_t sdcard_initFilesystem(FATFS *fsPtr, const char *folderName) {
   // Now try to mount the filesystem
   FRESULT fres;
   fres = sdcard_mountFilesystem(fsPtr, "0:");
+  if (((fres == FR_NOT_READY) || (fres == FR_DISK_ERR)) &&
+      sd_fallback_to_spi()) {
+    // The card does not answer in SDIO mode. Try again with SPI
+    DPRINTF("SDIO mount failed. Falling back to SPI.\n");
+    sdcard_setSpiSpeedSettings();
+    fres = sdcard_mountFilesystem(fsPtr, "0:");
+  }
   if (fres != FR_OK) {
     DPRINTF("Error mounting the filesystem.\n");
     return SDCARD_MOUNT_ERROR;
@@ -94,9 +425,196 @@ sdcard_status_t sdcard_initFilesystem(FATFS *fsPtr, const char *folderName) {
   }
   mountedFsPtr = fsPtr;
   sdMounted = true;
+#if SDCARD_SPI_CALIBRATION == 1
+  sdcard_calibrateSpiSpeed(folderName);
+#endif
   return SDCARD_INIT_OK;
 }
 
+// The card of the SPI interface, or NULL
+static sd_card_t *spiCard(void) {
+  size_t sdNum = sd_get_num();
+  if (sdNum == 0) {
+    return NULL;
+  }
+  sd_card_t *sdCard = sd_get_by_num(sdNum - 1);
+  if ((sdCard == NULL) || (sdCard->type != SD_IF_SPI) ||
+      (sdCard->spi_if_p == NULL) || (sdCard->spi_if_p->spi == NULL)) {
+    return NULL;
+  }
+  return sdCard;
+}
+
+// FNV-1a of the CID register, the key of the calibration of a card
+static int cardKey(const sd_card_t *sdCard) {
+  const uint8_t *cid = (const uint8_t *)&sdCard->state.CID;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(sdCard->state.CID); i++) {
+    hash = (hash ^ cid[i]) * 16777619u;
+  }
+  return (int)hash;
+}
+
+// Set the SPI clock now, and for the next initialization of the card
+static uint32_t applySpiBaudRate(sd_card_t *sdCard, uint32_t baudRate) {
+  spi_t *spi = sdCard->spi_if_p->spi;
+  spi->baud_rate = spi_set_baudrate(spi->hw_inst, baudRate);
+  return spi->baud_rate;
+}
+
+// Initialize the card again at a clock. A failed transfer can leave the card
+// in the middle of a command, and the next ones would fail at any clock
+static bool reinitSpiCard(sd_card_t *sdCard, uint32_t baudRate) {
+  applySpiBaudRate(sdCard, baudRate);
+  sdCard->state.m_Status |= STA_NOINIT;
+  return (sdCard->init(sdCard) & STA_NOINIT) == 0;
+}
+
+// Write and read back the sectors with a different pattern in each round
+static bool testSpiBaudRate(sd_card_t *sdCard, uint32_t sector,
+                            uint32_t count) {
+  size_t length = count * NUM_BYTES_PER_SECTOR;
+  for (uint32_t round = 0; round < SDCARD_CALIBRATION_ROUNDS; round++) {
+    uint32_t seed = (sdCard->spi_if_p->spi->baud_rate << 4) | round;
+    for (size_t i = 0; i < length; i++) {
+      calibrationBuffer[i] = (uint8_t)((i * 167u) ^ (seed >> (i & 7)));
+    }
+    if (sdCard->write_blocks(sdCard, calibrationBuffer, sector, count) != 0) {
+      return false;
+    }
+    memset(calibrationBuffer, 0, length);
+    if (sdCard->read_blocks(sdCard, calibrationBuffer, sector, count) != 0) {
+      return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+      if (calibrationBuffer[i] != (uint8_t)((i * 167u) ^ (seed >> (i & 7)))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Create the scratch file and return the first sector of its data. The file
+// is written only through the card, so FatFs metadata is never touched at a
+// clock under test
+static bool createCalibrationFile(const char *path, uint32_t *sector,
+                                  uint32_t *count) {
+  FIL file;
+  if (f_open(&file, path, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+    return false;
+  }
+  memset(calibrationBuffer, 0, sizeof(calibrationBuffer));
+  UINT bytesWritten = 0;
+  FRESULT res = f_write(&file, calibrationBuffer, sizeof(calibrationBuffer),
+                        &bytesWritten);
+  // Only the first cluster is known to be contiguous
+  FATFS *fs = file.obj.fs;
+  *sector = (uint32_t)(fs->database + (LBA_t)fs->csize * (file.obj.sclust - 2));
+  *count = SDCARD_CALIBRATION_SECTORS;
+  if (fs->csize < *count) {
+    *count = fs->csize;
+  }
+  if ((f_close(&file) != FR_OK) || (res != FR_OK) ||
+      (bytesWritten != sizeof(calibrationBuffer)) || (file.obj.sclust < 2)) {
+    f_unlink(path);
+    return false;
+  }
+  return true;
+}
+
+int sdcard_calibrateSpiSpeed(const char *folderName) {
+  sd_card_t *sdCard = spiCard();
+  if ((sdCard == NULL) || (folderName == NULL) || !sdcard_isMounted()) {
+    DPRINTF("SD card not available for the SPI calibration\n");
+    return 0;
+  }
+  uint32_t baseRate = sdCard->spi_if_p->spi->baud_rate;
+  if (baseRate == 0) {
+    return 0;
+  }
+  int maxRateKb = perf_getProfile()->sdBaudRateKb;
+  if (maxRateKb <= 0) {
+    maxRateKb = SDCARD_CALIBRATION_MAX_KB;
+  }
+
+  // The same card as the last calibration: just apply the result
+  SettingsContext *ctx = aconfig_getContext();
+  int key = cardKey(sdCard);
+  int storedKey = 0;
+  int storedRateKb = 0;
+  settings_get_int(ctx, settings_get_handle(ctx, ACONFIG_PARAM_SD_CAL_CARD),
+                   &storedKey);
+  settings_get_int(ctx,
+                   settings_get_handle(ctx, ACONFIG_PARAM_SD_CAL_BAUD_KB),
+                   &storedRateKb);
+  if ((storedRateKb > 0) && (storedKey == key)) {
+    if (storedRateKb > maxRateKb) {
+      storedRateKb = maxRateKb;
+    }
+    uint32_t rate = applySpiBaudRate(
+        sdCard, (uint32_t)storedRateKb * SDCARD_KILOBAUD);
+    DPRINTF("SD card SPI clock from the calibration: %lu\n",
+            (unsigned long)rate);
+    return (int)(rate / SDCARD_KILOBAUD);
+  }
+
+  char path[FF_MAX_LFN] = {0};
+  snprintf(path, sizeof(path), "%s/%s", folderName, SDCARD_CALIBRATION_FILE);
+  uint32_t sector = 0;
+  uint32_t count = 0;
+  if (!createCalibrationFile(path, &sector, &count)) {
+    DPRINTF("Can't create the SPI calibration file %s\n", path);
+    return (int)(baseRate / SDCARD_KILOBAUD);
+  }
+
+  // The SPI clock is the peripheral clock divided by an even number
+  uint32_t clkPeri = clock_get_hz(clk_peri);
+  uint32_t maxRate = (uint32_t)maxRateKb * SDCARD_KILOBAUD;
+  uint32_t bestRate = baseRate;
+  for (uint32_t div = clkPeri / (2 * baseRate); div >= 1; div--) {
+    uint32_t rate = clkPeri / (2 * div);
+    if (rate <= bestRate) {
+      continue;
+    }
+    if (rate > maxRate) {
+      break;
+    }
+    applySpiBaudRate(sdCard, rate);
+    bool stable = testSpiBaudRate(sdCard, sector, count);
+    DPRINTF("SD card SPI clock %lu: %s\n", (unsigned long)rate,
+            stable ? "OK" : "failed");
+    if (!stable) {
+      reinitSpiCard(sdCard, bestRate);
+      break;
+    }
+    bestRate = rate;
+  }
+
+  // Check the card again after a failed clock, and keep the result only if
+  // it works
+  applySpiBaudRate(sdCard, bestRate);
+  bool stable = testSpiBaudRate(sdCard, sector, count);
+  if (!stable) {
+    reinitSpiCard(sdCard, baseRate);
+  }
+  // The test wrote the card without FatFs
+  sdcard_cacheInvalidate();
+  f_unlink(path);
+  if (!stable) {
+    DPRINTF("SD card SPI calibration failed. Keeping %lu\n",
+            (unsigned long)baseRate);
+    return (int)(baseRate / SDCARD_KILOBAUD);
+  }
+
+  DPRINTF("SD card SPI clock calibrated: %lu\n", (unsigned long)bestRate);
+  settings_put_integer(ctx, ACONFIG_PARAM_SD_CAL_CARD, key);
+  settings_put_integer(ctx, ACONFIG_PARAM_SD_CAL_BAUD_KB,
+                       (int)(bestRate / SDCARD_KILOBAUD));
+  settings_save(ctx, true);
+  return (int)(bestRate / SDCARD_KILOBAUD);
+}
+
 void sdcard_changeSpiSpeed(int baudRateKbits) {
   size_t sdNum = sd_get_num();
   if (sdNum > 0) {
@@ -104,8 +622,9 @@ void sdcard_changeSpiSpeed(int baudRateKbits) {
     if (baudRate > 0) {
       DPRINTF("Changing SD card baud rate to %i\n", baudRate);
       sd_card_t *sdCard = sd_get_by_num(sdNum - 1);
-      if ((sdCard == NULL) || (sdCard->spi_if_p == NULL) ||
-          (sdCard->spi_if_p->spi == NULL)) {
+      // The SDIO interface has its own clock
+      if ((sdCard == NULL) || (sdCard->type != SD_IF_SPI) ||
+          (sdCard->spi_if_p == NULL) || (sdCard->spi_if_p->spi == NULL)) {
         DPRINTF("SD card SPI interface is not available\n");
         return;
       }
@@ -120,11 +639,15 @@ void sdcard_changeSpiSpeed(int baudRateKbits) {
 
 void sdcard_setSpiSpeedSettings() {
   // Get the SPI speed from the configuration
-  SettingsConfigEntry *spiSpeed =
-      settings_find_entry(gconfig_getContext(), PARAM_SD_BAUD_RATE_KB);
   int baudRate = 0;
-  if (spiSpeed != NULL) {
-    baudRate = atoi(spiSpeed->value);
+  settings_get_int(gconfig_getContext(),
+                   settings_get_handle(gconfig_getContext(),
+                                       PARAM_SD_BAUD_RATE_KB),
+                   &baudRate);
+  // Do not go over the SPI clock of the performance profile
+  int maxBaudRate = perf_getProfile()->sdBaudRateKb;
+  if ((maxBaudRate > 0) && (baudRate > maxBaudRate)) {
+    baudRate = maxBaudRate;
   }
   sdcard_changeSpiSpeed(baudRate);
 }
@@ -165,6 +688,19 @@ void sdcard_getInfo(FATFS *fsPtr, uint32_t *totalSizeMb,
 
 bool sdcard_isMounted(void) { return sdMounted && (mountedFsPtr != NULL); }
 
+// Total and free megabytes of a volume with a known free clusters count
+static void sdcard_sizesFromClusters(const FATFS *fs, DWORD freeClusters,
+                                     uint32_t *totalSizeMb,
+                                     uint32_t *freeSpaceMb) {
+  uint64_t totalSectors = (uint64_t)(fs->n_fatent - 2U) * fs->csize;
+  *totalSizeMb =
+      (uint32_t)((totalSectors * NUM_BYTES_PER_SECTOR) / SDCARD_MEGABYTE);
+
+  uint64_t freeSpaceBytes =
+      (uint64_t)freeClusters * fs->csize * NUM_BYTES_PER_SECTOR;
+  *freeSpaceMb = (uint32_t)(freeSpaceBytes / SDCARD_MEGABYTE);
+}
+
 bool sdcard_getMountedInfo(uint32_t *totalSizeMb, uint32_t *freeSpaceMb) {
   if ((totalSizeMb == NULL) || (freeSpaceMb == NULL)) {
     return false;
@@ -185,12 +721,119 @@ bool sdcard_getMountedInfo(uint32_t *totalSizeMb, uint32_t *freeSpaceMb) {
     return false;
   }
 
-  uint64_t totalSectors = (uint64_t)(fs->n_fatent - 2U) * fs->csize;
-  *totalSizeMb =
-      (uint32_t)((totalSectors * NUM_BYTES_PER_SECTOR) / SDCARD_MEGABYTE);
+  sdcard_sizesFromClusters(fs, freeClusters, totalSizeMb, freeSpaceMb);
+  return true;
+}
 
-  uint64_t freeSpaceBytes =
-      (uint64_t)freeClusters * fs->csize * NUM_BYTES_PER_SECTOR;
-  *freeSpaceMb = (uint32_t)(freeSpaceBytes / SDCARD_MEGABYTE);
+bool sdcard_getCachedInfo(uint32_t *totalSizeMb, uint32_t *freeSpaceMb) {
+  if ((totalSizeMb == NULL) || (freeSpaceMb == NULL)) {
+    return false;
+  }
+
+  *totalSizeMb = 0;
+  *freeSpaceMb = 0;
+
+#if !FF_FS_READONLY
+  if (!sdcard_isMounted()) {
+    return false;
+  }
+
+  // FatFs keeps free_clst up to date in every write once it is known. Above
+  // the clusters count it is not known yet
+  const FATFS *fs = mountedFsPtr;
+  if (fs->free_clst > fs->n_fatent - 2U) {
+    return false;
+  }
+  sdcard_sizesFromClusters(fs, fs->free_clst, totalSizeMb, freeSpaceMb);
   return true;
+#else
+  return false;
+#endif
+}
+
+#if !FF_FS_READONLY
+// Count the free entries of a FAT sector. FatFs keeps its last FAT sector in
+// its window, maybe with changes not written yet
+static bool freeScanSectorRead(FATFS *fs) {
+  LBA_t sector = fs->fatbase + freeScanSector;
+  const uint8_t *data = freeScanBuffer;
+  if (fs->winsect == sector) {
+    data = fs->win;
+  } else if (disk_read(fs->pdrv, freeScanBuffer, sector, 1) != RES_OK) {
+    DPRINTF("Error reading the FAT sector %lu\n", (unsigned long)sector);
+    return false;
+  }
+  bool fat32 = (fs->fs_type == FS_FAT32);
+  DWORD entries = NUM_BYTES_PER_SECTOR / (fat32 ? 4 : 2);
+  DWORD cluster = freeScanSector * entries;
+  for (DWORD i = 0; (i < entries) && (cluster < fs->n_fatent);
+       i++, cluster++) {
+    uint32_t value;
+    if (fat32) {
+      const uint8_t *entry = &data[i * 4];
+      value = ((uint32_t)entry[0] | ((uint32_t)entry[1] << 8) |
+               ((uint32_t)entry[2] << 16) | ((uint32_t)entry[3] << 24)) &
+              0x0FFFFFFFu;
+    } else {
+      value = (uint32_t)data[i * 2] | ((uint32_t)data[i * 2 + 1] << 8);
+    }
+    // The first two entries are not clusters
+    if ((cluster >= 2) && (value == 0)) {
+      freeScanClusters++;
+    }
+  }
+  freeScanSector++;
+  return true;
+}
+#endif
+
+bool sdcard_refreshFreeSpace(void) {
+#if !FF_FS_READONLY
+  uint32_t totalSizeMb = 0;
+  uint32_t freeSpaceMb = 0;
+  if (freeSpaceFailed || !sdcard_isMounted() ||
+      sdcard_getCachedInfo(&totalSizeMb, &freeSpaceMb)) {
+    freeScanActive = false;
+    return false;
+  }
+  FATFS *fs = mountedFsPtr;
+  if ((fs->fs_type != FS_FAT16) && (fs->fs_type != FS_FAT32)) {
+    DPRINTF("Counting the free clusters of the SD card...\n");
+    freeSpaceFailed = !sdcard_getMountedInfo(&totalSizeMb, &freeSpaceMb);
+    return false;
+  }
+
+  // A cluster allocated during the count can be in a sector already read.
+  // A cluster released meanwhile is only missed, so the count is never high
+  if (!freeScanActive || (fs->last_clst != freeScanLastClst)) {
+    DPRINTF("Counting the free clusters of the SD card...\n");
+    freeScanActive = true;
+    freeScanSector = 0;
+    freeScanClusters = 0;
+    freeScanLastClst = fs->last_clst;
+  }
+  DWORD entries = NUM_BYTES_PER_SECTOR / ((fs->fs_type == FS_FAT32) ? 4 : 2);
+  for (int i = 0; i < SDCARD_FREE_SCAN_SECTORS; i++) {
+    if (!freeScanSectorRead(fs)) {
+      freeSpaceFailed = true;
+      freeScanActive = false;
+      return false;
+    }
+    if (freeScanSector * entries >= fs->n_fatent) {
+      // As f_getfree does: the FSInfo sector gets the count in the next sync
+      fs->free_clst = freeScanClusters;
+      fs->fsi_flag |= 1;
+      freeScanActive = false;
+      DPRINTF("Free clusters: %lu\n", (unsigned long)freeScanClusters);
+      return false;
+    }
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool sdcard_hasFreeSpaceError(void) {
+  return sdcard_isMounted() && freeSpaceFailed;
 }
@@ -2,54 +2,90 @@
 
 static reset_callback_t reset_cb = NULL;
 static reset_callback_t reset_long_cb = NULL;
-static volatile bool core1WaitActive = false;
-static bool selectPressedLatched = false;
-
-static bool select_detectStableState(bool expectedState) {
-  bool firstSample = select_detectPush();
-  sleep_ms(SELECT_DEBOUNCE_DELAY);
-  bool secondSample = select_detectPush();
-  return ((firstSample == expectedState) && (secondSample == expectedState));
-}
-
-void __not_in_flash_func(select_waitPush)() {
-  DPRINTF("Waiting for SELECT button release\n");
 
-  if (!select_detectStableState(true)) {
-    DPRINTF("SELECT button was not stably pressed\n");
-    return;
-  }
+// Debounced state, updated by the alarm after the last edge
+static volatile bool selectPressed = false;
+static volatile uint64_t selectPressUs = 0;
+static volatile uint32_t selectPressCount = 0;
+static uint32_t selectPressSeen = 0;
+static volatile select_event_t selectEvent = SELECT_EVENT_NONE;
+static volatile alarm_id_t selectAlarm = 0;
 
-  uint32_t press_duration = 0;
-  bool longPressDetected = false;
-  while (select_detectPush()) {
-    tight_loop_contents();
-    sleep_ms(SELECT_LOOP_DELAY);
-    if (press_duration < SELECT_LONG_RESET) {
-      press_duration += SELECT_LOOP_DELAY;
-      if (press_duration >= SELECT_LONG_RESET) {
-        longPressDetected = true;
-      }
-    }
-  }
+// Call the callbacks from the alarm instead of select_waitPush
+static volatile bool backgroundActive = false;
 
-  while (!select_detectStableState(false)) {
-    tight_loop_contents();
-    sleep_ms(SELECT_LOOP_DELAY);
-  }
+#define SELECT_EDGES (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)
 
-  DPRINTF("SELECT button released after %lu ms\n", (unsigned long)press_duration);
-  if (longPressDetected) {
+static void selectDispatch(select_event_t event) {
+  if (event == SELECT_EVENT_LONG) {
     if (reset_long_cb != NULL) {
       DPRINTF("Long press detected. Executing long reset callback\n");
       reset_long_cb();
     }
-  } else {
+  } else if (event == SELECT_EVENT_SHORT) {
     if (reset_cb != NULL) {
       DPRINTF("Short press detected. Executing reset callback\n");
       reset_cb();
     }
   }
+}
+
+// The pin kept its level for SELECT_DEBOUNCE_DELAY after the last edge
+static int64_t selectDebounceAlarm(alarm_id_t id, void *userData) {
+  (void)id;
+  (void)userData;
+  selectAlarm = 0;
+  bool pressed = select_detectPush();
+  if (pressed == selectPressed) {
+    return 0;
+  }
+  selectPressed = pressed;
+  uint64_t now = time_us_64();
+  if (pressed) {
+    selectPressUs = now;
+    selectPressCount++;
+  } else {
+    uint32_t pressMs = (uint32_t)((now - selectPressUs) / 1000);
+    select_event_t event = (pressMs >= SELECT_LONG_RESET) ? SELECT_EVENT_LONG
+                                                          : SELECT_EVENT_SHORT;
+    DPRINTF("SELECT button released after %lu ms\n", (unsigned long)pressMs);
+    if (backgroundActive) {
+      selectDispatch(event);
+    } else {
+      selectEvent = event;
+    }
+  }
+  // Wake up select_waitPush on any core
+  __sev();
+  return 0;
+}
+
+// Every edge restarts the debounce alarm, so a bounce never reaches it
+static void selectGpioIrq(void) {
+  if ((gpio_get_irq_event_mask(SELECT_GPIO) & SELECT_EDGES) == 0) {
+    return;
+  }
+  gpio_acknowledge_irq(SELECT_GPIO, SELECT_EDGES);
+  if (selectAlarm > 0) {
+    cancel_alarm(selectAlarm);
+  }
+  selectAlarm =
+      add_alarm_in_ms(SELECT_DEBOUNCE_DELAY, selectDebounceAlarm, NULL, true);
+}
+
+void __not_in_flash_func(select_waitPush)() {
+  DPRINTF("Waiting for SELECT button release\n");
+
+  select_event_t event = select_getEvent();
+  while ((event == SELECT_EVENT_NONE) && selectPressed) {
+    __wfe();
+    event = select_getEvent();
+  }
+  if (event == SELECT_EVENT_NONE) {
+    DPRINTF("SELECT button was not stably pressed\n");
+    return;
+  }
+  selectDispatch(event);
   DPRINTF("SELECT button callback returned!\n");
 }
 
@@ -59,71 +95,61 @@ void select_configure() {
   gpio_set_dir(SELECT_GPIO, GPIO_IN);
   gpio_set_pulls(SELECT_GPIO, false, true);  // Pull down (false, true)
   gpio_pull_down(SELECT_GPIO);
+
+  // A button held at boot counts as a press for select_checkPushReset
+  selectPressed = select_detectPush();
+  selectPressUs = time_us_64();
+  if (selectPressed) {
+    selectPressCount++;
+  }
+  gpio_add_raw_irq_handler(SELECT_GPIO, selectGpioIrq);
+  gpio_set_irq_enabled(SELECT_GPIO, SELECT_EDGES, true);
+  irq_set_enabled(IO_IRQ_BANK0, true);
 }
 
 bool select_detectPush() { return (gpio_get(SELECT_GPIO) != 0); }
 
-void select_coreWaitPush(reset_callback_t reset, reset_callback_t resetLong) {
-  inline void core1_waitPush(void) {
-    DPRINTF("Waiting for SELECT button to be pushed\n");
-    while (core1WaitActive && !select_detectStableState(true)) {
-      tight_loop_contents();
-      sleep_ms(SELECT_LOOP_DELAY);
-    }
-
-    if (!core1WaitActive) {
-      return;
-    }
-
-    DPRINTF("SELECT button pushed!\n");
-    select_waitPush();
-    core1WaitActive = false;
-  }
+select_event_t select_getEvent(void) {
+  uint32_t ints = save_and_disable_interrupts();
+  select_event_t event = selectEvent;
+  selectEvent = SELECT_EVENT_NONE;
+  restore_interrupts(ints);
+  return event;
+}
 
+void select_coreWaitPush(reset_callback_t reset, reset_callback_t resetLong) {
   reset_cb = reset;
   reset_long_cb = resetLong;
 
-  if (core1WaitActive) {
-    DPRINTF("Core 1 wait for SELECT is already active\n");
+  if (backgroundActive) {
+    DPRINTF("Background wait for SELECT is already active\n");
     return;
   }
 
-  DPRINTF("Launching core 1 to wait for SELECT button push\n");
-  core1WaitActive = true;
-  multicore_launch_core1(core1_waitPush);
+  DPRINTF("Waiting for SELECT button push in the background\n");
+  backgroundActive = true;
 }
 
 void select_coreWaitPushDisable() {
-  if (!core1WaitActive) {
-    DPRINTF("Core 1 wait for SELECT is already disabled\n");
+  if (!backgroundActive) {
+    DPRINTF("Background wait for SELECT is already disabled\n");
     return;
   }
 
-  DPRINTF("Disabling core 1\n");
-  core1WaitActive = false;
-  multicore_reset_core1();
+  DPRINTF("Disabling the background wait for SELECT\n");
+  backgroundActive = false;
 }
 
 void select_checkPushReset() {
-  bool isPressed = select_detectPush();
-  if (isPressed && !selectPressedLatched) {
-    if (!select_detectStableState(true)) {
-      return;
-    }
-
-    selectPressedLatched = true;
-    DPRINTF("SELECT button pushed. Resetting the device\n");
-    if (reset_cb != NULL) {
-      DPRINTF("SELECT button pushed. Executing reset callback\n");
-      reset_cb();
-    }
+  uint32_t presses = selectPressCount;
+  if (presses == selectPressSeen) {
     return;
   }
-
-  if (!isPressed && selectPressedLatched) {
-    if (select_detectStableState(false)) {
-      selectPressedLatched = false;
-    }
+  selectPressSeen = presses;
+  DPRINTF("SELECT button pushed. Resetting the device\n");
+  if (reset_cb != NULL) {
+    DPRINTF("SELECT button pushed. Executing reset callback\n");
+    reset_cb();
   }
 }
 
@@ -4,6 +4,10 @@
 
 #include "settings.h"
 
+// Allocator of the runtime buffers. The context itself stays on the heap
+static void *(*settingsAlloc)(size_t) = malloc;
+static void (*settingsRelease)(void *) = free;
+
 /*
  * -----------
  * STATIC HELPER FUNCTIONS
@@ -15,14 +19,15 @@
  */
 static int checkKeyFormat(const char key[SETTINGS_MAX_KEY_LENGTH]) {
   // Check if the key is empty
-  if (strlen(key) == 0) {
+  if (key[0] == '\0') {
     DPRINTF("Error: Key is empty.\n");
     return -1;  // Invalid key format
   }
 
-  // Loop through each character in the key
-  for (size_t i = 0; i < strlen(key); i++) {
-    char chr = key[i];
+  // Loop through each character in the key. Keys read from flash may not be
+  // terminated
+  for (size_t i = 0; (i < SETTINGS_MAX_KEY_LENGTH) && (key[i] != '\0'); i++) {
+    unsigned char chr = (unsigned char)key[i];
 
     // Check if the character is not an uppercase letter, digit or underscore
     if (!isupper(chr) && !isdigit(chr) && chr != '_') {
@@ -49,16 +54,188 @@ static int checkTypeFormat(SettingsDataType type) {
   return 0;
 }
 
+/**
+ * @brief Get the data of an entry.
+ */
+static inline const SettingsConfigEntry *settingsEntry(
+    const SettingsContext *ctx, size_t position) {
+#if SETTINGS_LAZY_LOAD == 1
+  return ctx->records[position];
+#else
+  return &ctx->configData.entries[position];
+#endif
+}
+
+/**
+ * @brief Set the data of an entry. With SETTINGS_LAZY_LOAD only the pointer
+ * is kept, so the source must outlive the context.
+ */
+static void settingsMapEntry(SettingsContext *ctx, size_t position,
+                             const SettingsConfigEntry *source) {
+#if SETTINGS_LAZY_LOAD == 1
+  if (ctx->copied[position]) {
+    settingsRelease((void *)ctx->records[position]);
+    ctx->copied[position] = false;
+  }
+  ctx->records[position] = source;
+#else
+  ctx->configData.entries[position] = *source;
+#endif
+}
+
+/**
+ * @brief Get an entry that can be modified, copied to RAM first if needed.
+ *
+ * @return The entry, or NULL if the copy could not be allocated.
+ */
+static SettingsConfigEntry *settingsWritableEntry(SettingsContext *ctx,
+                                                  size_t position) {
+#if SETTINGS_LAZY_LOAD == 1
+  if (!ctx->copied[position]) {
+    SettingsConfigEntry *copy =
+        (SettingsConfigEntry *)settingsAlloc(sizeof(SettingsConfigEntry));
+    if (!copy) {
+      DPRINTF("Error: Unable to allocate memory for the entry copy.\n");
+      return NULL;
+    }
+    *copy = *ctx->records[position];
+    ctx->records[position] = copy;
+    ctx->copied[position] = true;
+  }
+  return (SettingsConfigEntry *)ctx->records[position];
+#else
+  return &ctx->configData.entries[position];
+#endif
+}
+
+/**
+ * @brief FNV-1a hash of a key, up to SETTINGS_MAX_KEY_LENGTH characters.
+ */
+static uint32_t hashKey(const char *key) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; (i < SETTINGS_MAX_KEY_LENGTH) && (key[i] != '\0'); i++) {
+    hash ^= (uint8_t)key[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * @brief Build the hash index of the keys of the loaded entries.
+ *
+ * The table has at least twice the slots of the entries that fit in the flash
+ * region, so the probes stay short. Keys are never added after settings_init.
+ */
+static int settingsBuildIndex(SettingsContext *ctx, size_t maxEntries) {
+  size_t slots = 1;
+  while (slots < (maxEntries * 2)) {
+    slots <<= 1;
+  }
+  ctx->keyIndex = (uint16_t *)calloc(slots, sizeof(uint16_t));
+  if (!ctx->keyIndex) {
+    DPRINTF("Error: Unable to allocate memory for the key index.\n");
+    ctx->keyIndexMask = 0;
+    return -1;
+  }
+  ctx->keyIndexMask = (uint16_t)(slots - 1);
+
+  for (size_t i = 0; i < ctx->configData.count; i++) {
+    uint32_t slot = hashKey(settingsEntry(ctx, i)->key);
+    while (ctx->keyIndex[slot & ctx->keyIndexMask] != 0) {
+      slot++;
+    }
+    ctx->keyIndex[slot & ctx->keyIndexMask] = (uint16_t)(i + 1);
+  }
+  return 0;
+}
+
+/**
+ * @brief Find the index of the entry of a key, or -1 if not found.
+ *
+ * Falls back to a linear search if the index could not be built.
+ */
+static int settingsLookup(const SettingsContext *ctx, const char *key) {
+  if (!ctx->keyIndex) {
+    for (size_t i = 0; i < ctx->configData.count; i++) {
+      if (strncmp(settingsEntry(ctx, i)->key, key, SETTINGS_MAX_KEY_LENGTH) ==
+          0) {
+        return (int)i;
+      }
+    }
+    return -1;
+  }
+
+  uint32_t slot = hashKey(key);
+  uint16_t position;
+  while ((position = ctx->keyIndex[slot & ctx->keyIndexMask]) != 0) {
+    if (strncmp(settingsEntry(ctx, position - 1)->key, key,
+                SETTINGS_MAX_KEY_LENGTH) == 0) {
+      return position - 1;
+    }
+    slot++;
+  }
+  return -1;
+}
+
+/**
+ * @brief Release the key index.
+ */
+static void settingsFreeIndex(SettingsContext *ctx) {
+  free(ctx->keyIndex);
+  ctx->keyIndex = NULL;
+  ctx->keyIndexMask = 0;
+}
+
+/**
+ * @brief Parse the value of an int or bool entry into ctx->numbers.
+ *
+ * The booleans are true if the value starts with 't' or 'T'.
+ */
+static void settingsParseNumber(SettingsContext *ctx, size_t position) {
+  const SettingsConfigEntry *entry = settingsEntry(ctx, position);
+  int32_t number = 0;
+  if (entry->dataType == SETTINGS_TYPE_INT) {
+    number = (int32_t)strtol(entry->value, NULL, SETTINGS_BASE_10);
+  } else if (entry->dataType == SETTINGS_TYPE_BOOL) {
+    number = ((entry->value[0] == 't') || (entry->value[0] == 'T')) ? 1 : 0;
+  }
+  ctx->numbers[position] = number;
+}
+
+/**
+ * @brief Release the entries and everything built from them.
+ */
+static void settingsFreeEntries(SettingsContext *ctx) {
+#if SETTINGS_LAZY_LOAD == 1
+  if (ctx->records && ctx->copied) {
+    for (size_t i = 0; i < ctx->configData.count; i++) {
+      if (ctx->copied[i]) {
+        settingsRelease((void *)ctx->records[i]);
+      }
+    }
+  }
+  free((void *)ctx->records);
+  ctx->records = NULL;
+  free(ctx->copied);
+  ctx->copied = NULL;
+#endif
+  free(ctx->configData.entries);
+  ctx->configData.entries = NULL;
+  free(ctx->numbers);
+  ctx->numbers = NULL;
+  ctx->configData.count = 0;
+  settingsFreeIndex(ctx);
+}
+
 /**
  * @brief Load the default entries into memory as the initial config.
  *
- * Populates the context's configData with the entries that pass validation.
+ * Appends to the context's configData the entries that pass validation.
  */
 static void settingsLoadDefaultEntries(SettingsContext *ctx,
                                        const SettingsConfigEntry *entries,
                                        uint16_t numEntries) {
-  // Start with zero count
-  ctx->configData.count = 0;
+  size_t loaded = 0;
 
   for (uint16_t i = 0; i < numEntries; i++) {
     if (entries[i].key[0] == '\0' || strlen(entries[i].key) == 0) {
@@ -79,20 +256,19 @@ static void settingsLoadDefaultEntries(SettingsContext *ctx,
             SETTINGS_MAX_KEY_LENGTH, entries[i].key, strlen(entries[i].key));
       }
 
-      // Copy the entry
-      SettingsConfigEntry tmpEntry = entries[i];
-      ctx->configData.entries[ctx->configData.count] = tmpEntry;
+      settingsMapEntry(ctx, ctx->configData.count, &entries[i]);
       ctx->configData.count++;
+      loaded++;
     }
   }
 
-  if (ctx->configData.count != numEntries) {
+  if (loaded != numEntries) {
     DPRINTF(
         "WARNING: Mismatch between the number of default entries (%d) "
         "and the number of entries loaded (%zu).\n",
-        numEntries, ctx->configData.count);
+        numEntries, loaded);
   } else {
-    DPRINTF("Loaded %zu default entries.\n", ctx->configData.count);
+    DPRINTF("Loaded %zu default entries.\n", loaded);
   }
 }
 
@@ -104,17 +280,21 @@ static int settingsLoadAllEntries(SettingsContext *ctx,
                                   uint16_t numEntries, uint16_t maxEntries) {
   uint8_t *currentAddress = (uint8_t *)(ctx->flashSettingsOffset + XIP_BASE);
 
-  // Avoid overflows
-  if (numEntries > maxEntries) {
+  // Avoid overflows. The magic entry goes first
+  if (numEntries > maxEntries - 1) {
     DPRINTF(
         "Warning: Number of entries (%d) exceeds the maximum allowed (%d). "
         "Fixing.\n",
-        numEntries, maxEntries);
-    numEntries = maxEntries;
+        numEntries, maxEntries - 1);
+    numEntries = maxEntries - 1;
   }
 
-  // First, load default entries
+  // First, load the magic and the default entries. The entries read from
+  // flash only replace them, so the keys can be indexed now
+  ctx->configData.count = 0;
+  settingsLoadDefaultEntries(ctx, &ctx->magicEntry, 1);
   settingsLoadDefaultEntries(ctx, entries, numEntries);
+  settingsBuildIndex(ctx, maxEntries);
 
   // The magic value is stored as a string in the first "entry",
   // i.e. at offset = first entry's value field. By design, your code
@@ -160,21 +340,23 @@ static int settingsLoadAllEntries(SettingsContext *ctx,
           storedMagic);
 
   // Now read each entry in a loop
-  // We'll simply read as many entries as we can, up to numEntries
+  // We'll read as many entries as the region holds: the journal of
+  // settings_save appends the updated entries after the first ones
   uint16_t count = 0;
-  while (count < numEntries &&
+  while (count < maxEntries &&
          (currentAddress + sizeof(SettingsConfigEntry)) <=
              (uint8_t *)(ctx->flashSettingsOffset + XIP_BASE +
                          ctx->flashSettingsSize)) {
-    SettingsConfigEntry entry = {0};
-    memcpy(&entry, currentAddress, sizeof(SettingsConfigEntry));
+    // Read in place: with SETTINGS_LAZY_LOAD the entries point here
+    const SettingsConfigEntry *stored =
+        (const SettingsConfigEntry *)currentAddress;
     currentAddress += sizeof(SettingsConfigEntry);
 
-    if (entry.key[0] == '\0') {
-      // This indicates we've reached the end
+    if ((stored->key[0] == '\0') || ((uint8_t)stored->key[0] == 0xFF)) {
+      // This indicates we've reached the end, or the erased journal slots
       break;
     }
-    if (checkKeyFormat(entry.key) != 0) {
+    if (checkKeyFormat(stored->key) != 0) {
       DPRINTF(
           "Invalid key format for key at address %p. "
           "Likely end of entries in FLASH.\n",
@@ -182,22 +364,19 @@ static int settingsLoadAllEntries(SettingsContext *ctx,
       break;
     }
 
-    if (checkTypeFormat(entry.dataType) != 0) {
+    if (checkTypeFormat(stored->dataType) != 0) {
       DPRINTF(
-          "Invalid type format for key %s stored. "
+          "Invalid type format for key %.*s stored. "
           "Likely end of entries in FLASH.\n",
-          entry.key);
+          SETTINGS_MAX_KEY_LENGTH, stored->key);
       break;
     }
 
     // Overwrite the matching default entry in ctx->configData
     // if it exists:
-    for (size_t i = 0; i < ctx->configData.count; i++) {
-      if (strncmp(ctx->configData.entries[i].key, entry.key,
-                  SETTINGS_MAX_KEY_LENGTH) == 0) {
-        ctx->configData.entries[i] = entry;
-        break;  // Found the match, updated, done
-      }
+    int position = settingsLookup(ctx, stored->key);
+    if (position >= 0) {
+      settingsMapEntry(ctx, (size_t)position, stored);
     }
     count++;
   }
@@ -232,32 +411,39 @@ int settings_init(SettingsContext *ctx,
   assert(defaultNumEntries <= maxEntries);
   DPRINTF("Default entries count: %d\n", defaultNumEntries);
 
-  // 3) Prepare the configData structure
+  // 3) Prepare the configData structure. Keys are never added after init, so
+  // the defaults and the magic entry are all the room needed
+  size_t numEntries = (size_t)defaultNumEntries + 1;
+#if SETTINGS_LAZY_LOAD == 1
+  ctx->configData.entries = NULL;
+  ctx->records = (const SettingsConfigEntry **)calloc(
+      numEntries, sizeof(const SettingsConfigEntry *));
+  ctx->copied = (bool *)calloc(numEntries, sizeof(bool));
+  bool allocated = (ctx->records != NULL) && (ctx->copied != NULL);
+#else
   ctx->configData.entries =
-      (SettingsConfigEntry *)malloc(ctx->flashSettingsSize);
-  if (!ctx->configData.entries) {
+      (SettingsConfigEntry *)malloc(numEntries * sizeof(SettingsConfigEntry));
+  ctx->records = NULL;
+  ctx->copied = NULL;
+  bool allocated = (ctx->configData.entries != NULL);
+#endif
+  ctx->numbers = (int32_t *)calloc(numEntries, sizeof(int32_t));
+  ctx->configData.count = 0;
+  ctx->keyIndex = NULL;
+  ctx->keyIndexMask = 0;
+  if (!allocated || !ctx->numbers) {
     DPRINTF("Error: Unable to allocate memory for config entries.\n");
+    settingsFreeEntries(ctx);
     return -1;
   }
-  ctx->configData.count = 0;
 
   // 4) Build the 32-bit magic from (magic << 16) | version
   ctx->configData.magic =
       ((uint32_t)magic << SETTINGS_SHIFT_LEFT_16_BITS) | version;
   DPRINTF("Combined magic: 0x%08lx\n", (unsigned long)ctx->configData.magic);
 
-  // 5) Create an augmented default array with the MAGICVERSION entry at the
-  // front.
-  defaultNumEntries++;  // Add one for the magic entry
-  SettingsConfigEntry *defaultEntriesWithMagic = (SettingsConfigEntry *)malloc(
-      defaultNumEntries * sizeof(SettingsConfigEntry));
-  if (!defaultEntriesWithMagic) {
-    DPRINTF(
-        "Error: Unable to allocate memory for default entries with magic.\n");
-    return -1;
-  }
-
-  // Fill the special "MAGICVERSION" entry
+  // 5) Fill the special "MAGICVERSION" entry. It is kept in the context and
+  // loaded in front of the user's defaults
   char magicValue[SETTINGS_MAX_VALUE_LENGTH];
   snprintf(magicValue, sizeof(magicValue), "%lu",
            (unsigned long)ctx->configData.magic);
@@ -265,42 +451,205 @@ int settings_init(SettingsContext *ctx,
       SETTINGS_MAGICVERSION_KEY, SETTINGS_TYPE_INT, {0}};
   strncpy(magicEntry.value, magicValue, SETTINGS_MAX_VALUE_LENGTH - 1);
   magicEntry.value[SETTINGS_MAX_VALUE_LENGTH - 1] = '\0';
-
-  // Put the magic entry first, then copy the user’s defaults
-  defaultEntriesWithMagic[0] = magicEntry;
-  memcpy(defaultEntriesWithMagic + 1, defaultEntries,
-         (defaultNumEntries - 1) * sizeof(SettingsConfigEntry));
+  ctx->magicEntry = magicEntry;
 
   // 6) Load from flash (or default) into ctx->configData
-  int error =
-      settingsLoadAllEntries(ctx, defaultEntriesWithMagic,
-                             (uint16_t)defaultNumEntries, (uint16_t)maxEntries);
+  int error = settingsLoadAllEntries(ctx, defaultEntries, defaultNumEntries,
+                                     (uint16_t)maxEntries);
 
-  free(defaultEntriesWithMagic);
+  for (size_t i = 0; i < ctx->configData.count; i++) {
+    settingsParseNumber(ctx, i);
+  }
 
   // Return the number of entries loaded, or error
   return (error == 0 ? (int)ctx->configData.count : error);
 }
 
+void settings_setAllocator(void *(*alloc)(size_t), void (*release)(void *)) {
+  settingsAlloc = (alloc != NULL) ? alloc : malloc;
+  settingsRelease = (release != NULL) ? release : free;
+}
+
 int settings_deinit(SettingsContext *ctx) {
   if (!ctx) return -1;
 
   // Reset the entire structure
-  if (ctx->configData.entries) {
-    free(ctx->configData.entries);
-    ctx->configData.entries = NULL;
-  }
-  ctx->configData.count = 0;
+  settingsFreeEntries(ctx);
   ctx->flashSettingsSize = SETTINGS_DEFAULT_FLASH_SIZE;
   ctx->flashSettingsOffset = 0;
 
   return 0;
 }
 
+/**
+ * @brief One erase and program of a flash region, run by the executor.
+ */
+typedef struct {
+  uint32_t offset;      ///< Flash offset of the region
+  uint32_t eraseSize;   ///< Bytes to erase first, 0 for none
+  const uint8_t *data;  ///< Data to program at the offset
+  size_t programSize;   ///< Bytes to program, 0 for none
+  bool done;            ///< Set once the flash has been written
+} SettingsFlashOp;
+
+static SettingsFlashExecutor flashExecutor = NULL;
+
+/**
+ * @brief Run a flash operation. Called by the executor, so it lives in RAM.
+ */
+static void __not_in_flash_func(settingsFlashOp)(void *param) {
+  SettingsFlashOp *op = (SettingsFlashOp *)param;
+  if (op->eraseSize > 0) {
+    flash_range_erase(op->offset, op->eraseSize);
+  }
+  if (op->programSize > 0) {
+    flash_range_program(op->offset, op->data, op->programSize);
+  }
+  op->done = true;
+}
+
+/**
+ * @brief Run a flash operation through the executor, with the interrupts
+ * disabled if there is none, or right away if the caller made it safe.
+ *
+ * @return 0 on success, the error of the executor on failure.
+ */
+static int settingsRunFlashOp(SettingsFlashOp *op, bool disable_interrupts) {
+  if (!disable_interrupts) {
+    settingsFlashOp((void *)op);
+    return 0;
+  }
+  if (flashExecutor != NULL) {
+    int err = flashExecutor(settingsFlashOp, (void *)op);
+    if (err != 0) {
+      DPRINTF("Error: flash executor failed: %d\n", err);
+    }
+    return err;
+  }
+  uint32_t ints = save_and_disable_interrupts();
+  settingsFlashOp((void *)op);
+  restore_interrupts(ints);
+  return 0;
+}
+
+#if SETTINGS_JOURNAL == 1
+/**
+ * @brief Program one entry at an offset of the flash region.
+ *
+ * The flash is programmed in whole pages, so the rest of the pages touched is
+ * written with 0xFF, which leaves the bytes already programmed unchanged.
+ * The entry is then read from its new record.
+ */
+static int settingsProgramEntry(SettingsContext *ctx, size_t offset,
+                                size_t position, bool disable_interrupts) {
+  const SettingsConfigEntry *entry = settingsEntry(ctx, position);
+  uint8_t pages[2 * FLASH_PAGE_SIZE];
+  size_t pageStart = offset & ~(size_t)(FLASH_PAGE_SIZE - 1);
+  size_t pageEnd =
+      (offset + sizeof(SettingsConfigEntry) + FLASH_PAGE_SIZE - 1) &
+      ~(size_t)(FLASH_PAGE_SIZE - 1);
+  memset(pages, 0xFF, sizeof(pages));
+  memcpy(pages + (offset - pageStart), entry, sizeof(SettingsConfigEntry));
+  SettingsFlashOp op = {ctx->flashSettingsOffset + pageStart, 0, pages,
+                        pageEnd - pageStart, false};
+  int err = settingsRunFlashOp(&op, disable_interrupts);
+#if SETTINGS_LAZY_LOAD == 1
+  if (op.done) {
+    settingsMapEntry(ctx, position,
+                     (const SettingsConfigEntry *)(ctx->flashSettingsOffset +
+                                                   XIP_BASE + offset));
+  }
+#endif
+  return err;
+}
+
+/**
+ * @brief Append the entries that changed after the ones stored in flash.
+ *
+ * @return 0 if flash is up to date, -1 if the region must be rewritten.
+ */
+static int settingsAppendChanges(SettingsContext *ctx,
+                                 bool disable_interrupts) {
+  const uint8_t *stored =
+      (const uint8_t *)(ctx->flashSettingsOffset + XIP_BASE);
+  size_t maxEntries = ctx->flashSettingsSize / sizeof(SettingsConfigEntry);
+  size_t count = ctx->configData.count;
+  if (count == 0) return -1;
+
+  // The first stored entry must be the magic of the current settings
+  const SettingsConfigEntry *first = (const SettingsConfigEntry *)stored;
+  if ((strncmp(first->key, SETTINGS_MAGICVERSION_KEY,
+               SETTINGS_MAX_KEY_LENGTH) != 0) ||
+      (memcmp(first, settingsEntry(ctx, 0),
+              sizeof(SettingsConfigEntry)) != 0)) {
+    return -1;
+  }
+
+  // Find the last stored entry of each key and the first free slot
+  int *lastStored = (int *)settingsAlloc(count * sizeof(int));
+  if (!lastStored) return -1;
+  for (size_t i = 0; i < count; i++) {
+    lastStored[i] = -1;
+  }
+  size_t used = 0;
+  while (used < maxEntries) {
+    const SettingsConfigEntry *entry =
+        (const SettingsConfigEntry *)(stored +
+                                      used * sizeof(SettingsConfigEntry));
+    if ((uint8_t)entry->key[0] == 0xFF) {
+      break;  // erased, end of the journal
+    }
+    if ((checkKeyFormat(entry->key) != 0) ||
+        (checkTypeFormat(entry->dataType) != 0)) {
+      settingsRelease(lastStored);
+      return -1;
+    }
+    int position = settingsLookup(ctx, entry->key);
+    if (position >= 0) {
+      lastStored[position] = (int)used;
+    }
+    used++;
+  }
+
+  // Collect the entries that differ from their last stored copy
+  size_t changed = 0;
+  for (size_t i = 0; i < count; i++) {
+    if ((lastStored[i] < 0) ||
+        (memcmp(stored + lastStored[i] * sizeof(SettingsConfigEntry),
+                settingsEntry(ctx, i),
+                sizeof(SettingsConfigEntry)) != 0)) {
+      lastStored[changed++] = (int)i;
+    }
+  }
+  if (used + changed > maxEntries) {
+    DPRINTF("Journal full: %zu used, %zu changed. Compacting.\n", used,
+            changed);
+    settingsRelease(lastStored);
+    return -1;
+  }
+
+  DPRINTF("Appending %zu changed entries after %zu stored.\n", changed, used);
+  // One entry at a time keeps each flash window short
+  int err = 0;
+  for (size_t i = 0; (i < changed) && (err == 0); i++) {
+    err = settingsProgramEntry(ctx, (used + i) * sizeof(SettingsConfigEntry),
+                               (size_t)lastStored[i], disable_interrupts);
+  }
+  settingsRelease(lastStored);
+  return (err == 0) ? 0 : -1;
+}
+#endif
+
 int __not_in_flash_func(settings_save)(SettingsContext *ctx,
                                        bool disable_interrupts) {
   if (!ctx) return -1;
 
+#if SETTINGS_JOURNAL == 1
+  if (settingsAppendChanges(ctx, disable_interrupts) == 0) {
+    return 0;
+  }
+#endif
+
   // Check if we don't exceed the reserved space
   size_t totalUsed = ctx->configData.count * sizeof(SettingsConfigEntry);
   if (totalUsed > ctx->flashSettingsSize) {
@@ -324,77 +673,115 @@ int __not_in_flash_func(settings_save)(SettingsContext *ctx,
       programSize = ctx->flashSettingsSize;
     }
 
-    padded = (uint8_t *)malloc(programSize);
+    padded = (uint8_t *)settingsAlloc(programSize);
     if (padded == NULL) {
       DPRINTF("Error: Unable to allocate padding buffer.\n");
       return -1;
     }
     memset(padded, 0xFF, programSize);  // match erased flash default
-    memcpy(padded, ctx->configData.entries,
-           totalUsed < programSize ? totalUsed : programSize);
-  }
-
-  uint32_t ints = 0;
-  if (disable_interrupts) {
-    ints = save_and_disable_interrupts();
-    DPRINTF("Interrupts disabled for flash programming.\n");
-  }
-  flash_range_erase(ctx->flashSettingsOffset, ctx->flashSettingsSize);
-  DPRINTF("Flash erased at offset 0x%lx, size %lu bytes.\n",
-          (unsigned long)ctx->flashSettingsOffset,
-          (unsigned long)ctx->flashSettingsSize);
-  if (programSize > 0) {
-    flash_range_program(ctx->flashSettingsOffset, padded, programSize);
-    DPRINTF("Flash programmed at offset 0x%lx, size %zu bytes.\n",
-            (unsigned long)ctx->flashSettingsOffset, programSize);
+    for (size_t i = 0; i < ctx->configData.count; i++) {
+      memcpy(padded + i * sizeof(SettingsConfigEntry), settingsEntry(ctx, i),
+             sizeof(SettingsConfigEntry));
+    }
   }
 
-  if (disable_interrupts) {
-    restore_interrupts(ints);
-    DPRINTF("Interrupts restored after flash programming.\n");
+  SettingsFlashOp op = {ctx->flashSettingsOffset, ctx->flashSettingsSize,
+                        padded, programSize, false};
+  int err = settingsRunFlashOp(&op, disable_interrupts);
+  if (err == 0) {
+    DPRINTF("Flash erased and programmed at offset 0x%lx, %zu bytes.\n",
+            (unsigned long)ctx->flashSettingsOffset, programSize);
+  }
+#if SETTINGS_LAZY_LOAD == 1
+  // The old records are gone. Read the entries from the new ones
+  if (op.done) {
+    const SettingsConfigEntry *records =
+        (const SettingsConfigEntry *)(ctx->flashSettingsOffset + XIP_BASE);
+    for (size_t i = 0; i < ctx->configData.count; i++) {
+      settingsMapEntry(ctx, i, &records[i]);
+    }
   }
+#endif
 
   if (padded) {
-    free(padded);
+    settingsRelease(padded);
   }
 
-  return 0;
+  return (err == 0) ? 0 : -1;
 }
 
 int settings_erase(SettingsContext *ctx) {
   if (!ctx) return -1;
 
   // Erase the flash region
-  uint32_t ints = save_and_disable_interrupts();
-  flash_range_erase(ctx->flashSettingsOffset, ctx->flashSettingsSize);
-  restore_interrupts(ints);
+  SettingsFlashOp op = {ctx->flashSettingsOffset, ctx->flashSettingsSize, NULL,
+                        0, false};
+  if (settingsRunFlashOp(&op, true) != 0) {
+    return -1;
+  }
 
   // Free and reset
-  if (ctx->configData.entries) {
-    free(ctx->configData.entries);
-    ctx->configData.entries = NULL;
-  }
-  ctx->configData.count = 0;
+  settingsFreeEntries(ctx);
 
   return 0;
 }
 
-SettingsConfigEntry *settings_find_entry(SettingsContext *ctx,
-                                         const char *key) {
-  if (!ctx) return NULL;
+void settings_set_flash_executor(SettingsFlashExecutor executor) {
+  flashExecutor = executor;
+}
+
+const SettingsConfigEntry *settings_find_entry(SettingsContext *ctx,
+                                               const char *key) {
+  return settings_get_entry(ctx, settings_get_handle(ctx, key));
+}
+
+SettingsHandle settings_get_handle(SettingsContext *ctx, const char *key) {
+  if (!ctx || !key) return SETTINGS_INVALID_HANDLE;
+
+  // Stored keys are always valid, so the format is checked only on a miss
+  int position = settingsLookup(ctx, key);
+  if (position >= 0) {
+    return position;
+  }
   if (checkKeyFormat(key) != 0) {
     DPRINTF("Invalid key format for key %s.\n", key);
+  } else {
+    DPRINTF("Key %s not found.\n", key);
+  }
+  return SETTINGS_INVALID_HANDLE;
+}
+
+const SettingsConfigEntry *settings_get_entry(SettingsContext *ctx,
+                                              SettingsHandle handle) {
+  if (!ctx || (handle < 0) || ((size_t)handle >= ctx->configData.count)) {
     return NULL;
   }
+  return settingsEntry(ctx, (size_t)handle);
+}
 
-  for (size_t i = 0; i < ctx->configData.count; i++) {
-    if (strncmp(ctx->configData.entries[i].key, key, SETTINGS_MAX_KEY_LENGTH) ==
-        0) {
-      return &ctx->configData.entries[i];
-    }
+int settings_get_int(SettingsContext *ctx, SettingsHandle handle,
+                     int *value) {
+  const SettingsConfigEntry *entry = settings_get_entry(ctx, handle);
+  if (!entry || !value || (entry->dataType != SETTINGS_TYPE_INT)) {
+    return -1;
   }
-  DPRINTF("Key %s not found.\n", key);
-  return NULL;
+  *value = (int)ctx->numbers[handle];
+  return 0;
+}
+
+int settings_get_bool(SettingsContext *ctx, SettingsHandle handle,
+                      bool *value) {
+  const SettingsConfigEntry *entry = settings_get_entry(ctx, handle);
+  if (!entry || !value || (entry->dataType != SETTINGS_TYPE_BOOL)) {
+    return -1;
+  }
+  *value = (ctx->numbers[handle] != 0);
+  return 0;
+}
+
+const char *settings_get_string(SettingsContext *ctx, SettingsHandle handle) {
+  const SettingsConfigEntry *entry = settings_get_entry(ctx, handle);
+  return entry ? entry->value : NULL;
 }
 
 /**
@@ -402,28 +789,31 @@ SettingsConfigEntry *settings_find_entry(SettingsContext *ctx,
  */
 static int settingsUpdateEntry(SettingsContext *ctx, const char *key,
                                SettingsDataType dataType, const char *value) {
-  if (checkKeyFormat(key) != 0) {
-    DPRINTF("Invalid key format: %s\n", key);
-    return -1;
-  }
   if (checkTypeFormat(dataType) != 0) {
     DPRINTF("Invalid data type for key: %s\n", key);
     return -1;
   }
 
-  for (size_t i = 0; i < ctx->configData.count; i++) {
-    if (strncmp(ctx->configData.entries[i].key, key, SETTINGS_MAX_KEY_LENGTH) ==
-        0) {
-      // Key found, update
-      ctx->configData.entries[i].dataType = dataType;
-      strncpy(ctx->configData.entries[i].value, value,
-              SETTINGS_MAX_VALUE_LENGTH - 1);
-      ctx->configData.entries[i].value[SETTINGS_MAX_VALUE_LENGTH - 1] = '\0';
-      return 0;
-    }
+  SettingsHandle handle = settings_get_handle(ctx, key);
+  const SettingsConfigEntry *current = settings_get_entry(ctx, handle);
+  if (!current) {
+    DPRINTF("Key %s not found (cannot update).\n", key);
+    return -1;
   }
-  DPRINTF("Key %s not found (cannot update).\n", key);
-  return -1;
+  // Do not copy an entry to RAM if the value does not change
+  if ((current->dataType == dataType) &&
+      (strncmp(current->value, value, SETTINGS_MAX_VALUE_LENGTH - 1) == 0)) {
+    return 0;
+  }
+  SettingsConfigEntry *entry = settingsWritableEntry(ctx, (size_t)handle);
+  if (!entry) {
+    return -1;
+  }
+  entry->dataType = dataType;
+  strncpy(entry->value, value, SETTINGS_MAX_VALUE_LENGTH - 1);
+  entry->value[SETTINGS_MAX_VALUE_LENGTH - 1] = '\0';
+  settingsParseNumber(ctx, (size_t)handle);
+  return 0;
 }
 
 int settings_put_bool(SettingsContext *ctx, const char *key, bool value) {
@@ -451,66 +841,70 @@ int settings_put_integer(SettingsContext *ctx, const char *key, int value) {
   return settingsUpdateEntry(ctx, key, SETTINGS_TYPE_INT, buffer);
 }
 
+/**
+ * @brief Format an entry as one line of the table of settings_print.
+ */
+int settings_format_entry(SettingsContext *ctx, size_t index, char *buffer,
+                          size_t size) {
+  if (!ctx || !buffer || size == 0 || index >= ctx->configData.count) {
+    return -1;
+  }
+  const char *typeStr = "UNK";
+  const SettingsConfigEntry *entry = settingsEntry(ctx, index);
+  switch (entry->dataType) {
+    case SETTINGS_TYPE_INT:
+      typeStr = "INT";
+      break;
+    case SETTINGS_TYPE_STRING:
+      typeStr = "STR";
+      break;
+    case SETTINGS_TYPE_BOOL:
+      typeStr = "BOOL";
+      break;
+    default:
+      typeStr = "UNK";
+      break;
+  }
+
+  // Print in the format: "KEY (TYPE): Value\n". Entries read from flash may
+  // not be terminated
+  int len = snprintf(buffer, size, "%.*s (%s): %.*s\n",
+                     SETTINGS_MAX_KEY_LENGTH, entry->key, typeStr,
+                     SETTINGS_MAX_VALUE_LENGTH, entry->value);
+  if (len < 0) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  return ((size_t)len < size) ? len : (int)(size - 1);
+}
+
 /**
  * @brief Print the current configuration in a tabular format.
  */
 void settings_print(SettingsContext *ctx, char *buffer) {
   if (!ctx) return;
 
-  // We'll use a fixed-size buffer if none is provided
-  size_t remaining = 2048;
-  char *outputBuffer = NULL;
-
-  if (buffer == NULL) {
-    // Allocate a buffer if none is provided
-    outputBuffer = (char *)malloc(remaining);
-    if (!outputBuffer) {
-      DPRINTF("Error: Unable to allocate memory for output buffer.\n");
-      return;
-    }
-  } else {
-    // Use the provided buffer
-    outputBuffer = buffer;
+  char line[SETTINGS_PRINT_LINE_SIZE];
+  size_t remaining = SETTINGS_PRINT_BUFFER_SIZE;
+  char *ptr = buffer;
+  if (ptr != NULL) {
+    *ptr = '\0';
   }
 
-  char *ptr = outputBuffer;
-  size_t len = 0;
-
   // Loop through each entry
-  for (size_t i = 0; i < ctx->configData.count && remaining > 0; i++) {
-    const char *typeStr = "UNK";
-    switch (ctx->configData.entries[i].dataType) {
-      case SETTINGS_TYPE_INT:
-        typeStr = "INT";
-        break;
-      case SETTINGS_TYPE_STRING:
-        typeStr = "STR";
-        break;
-      case SETTINGS_TYPE_BOOL:
-        typeStr = "BOOL";
-        break;
-      default:
-        typeStr = "UNK";
-        break;
+  int len = 0;
+  for (size_t i = 0;
+       (len = settings_format_entry(ctx, i, line, sizeof(line))) >= 0; i++) {
+    if (buffer == NULL) {
+      // No buffer: print the line right away
+      DPRINTFRAW("%s", line);
+      continue;
     }
-
-    // Print in the format: "KEY (TYPE): Value\n"
-    len = snprintf(ptr, remaining, "%s (%s): %s\n",
-                   ctx->configData.entries[i].key, typeStr,
-                   ctx->configData.entries[i].value);
-
+    if ((size_t)len >= remaining) {
+      break;
+    }
+    memcpy(ptr, line, (size_t)len + 1);
     ptr += len;
-    remaining = (len < remaining) ? (remaining - len) : 0;
-  }
-
-  // Ensure null-termination
-  if (remaining > 0) {
-    *ptr = '\0';
-  }
-
-  // If no external buffer was provided, print and free
-  if (buffer == NULL) {
-    DPRINTFRAW("%s", outputBuffer);
-    free(outputBuffer);
+    remaining -= (size_t)len;
   }
 }
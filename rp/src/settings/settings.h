@@ -72,6 +72,24 @@
  #define SETTINGS_MAGICVERSION_KEY "MAGICVERSION"
  
  #define SETTINGS_FLASH_PAGE_SIZE 4096
+ 
+ /**
+  * @brief If 1, settings_save appends the changed entries after the ones in
+  * flash and erases the region only when it is full.
+  */
+ #ifndef SETTINGS_JOURNAL
+ #define SETTINGS_JOURNAL 1
+ #endif
+ 
+ /**
+  * @brief If 1, settings_init does not copy the entries: they are read from
+  * flash through the XIP, or from the default entries, and an entry is copied
+  * to RAM only when it is updated. The default entries must then outlive the
+  * context, and the entries returned by settings_find_entry are read-only.
+  */
+ #ifndef SETTINGS_LAZY_LOAD
+ #define SETTINGS_LAZY_LOAD 1
+ #endif
  #define SETTINGS_DEFAULT_FLASH_SIZE 4096
  
  #define SETTINGS_BASE_10 10
@@ -112,8 +130,30 @@
    ConfigData configData;
    uint32_t flashSettingsSize;
    uint32_t flashSettingsOffset;
+   uint16_t *keyIndex;     ///< Open addressed hash of the keys: entry + 1
+   uint16_t keyIndexMask;  ///< Number of slots of keyIndex - 1
+   int32_t *numbers;       ///< Parsed value of the int and bool entries
+   const SettingsConfigEntry **records;  ///< Lazy load: data of each entry
+   bool *copied;                         ///< Lazy load: record is in RAM
+   SettingsConfigEntry magicEntry;       ///< The MAGICVERSION entry
  } SettingsContext;
  
+ /**
+  * @brief Handle of a configuration entry, resolved once from its key.
+  */
+ typedef int SettingsHandle;
+ 
+ #define SETTINGS_INVALID_HANDLE (-1)
+ 
+ /**
+  * @brief Function that runs a flash operation when it is safe to do so.
+  *
+  * Same contract as flash_safe_execute without the timeout: call func(param)
+  * with nothing reading the flash and return 0 (PICO_OK) or a negative error.
+  * func is placed in RAM.
+  */
+ typedef int (*SettingsFlashExecutor)(void (*func)(void *), void *param);
+ 
  /**
   * @brief Initialize the settings configuration (for one context).
   *
@@ -137,6 +177,16 @@
                    uint16_t defaultNumEntries, uint32_t flashOffset,
                    uint32_t flashSize, uint16_t magic, uint16_t version);
  
+ /**
+  * @brief Set the allocator of the buffers used after settings_init: the
+  * copies of the updated entries and the temporary buffers of settings_save.
+  * malloc and free by default.
+  *
+  * @param alloc   Allocation function, like malloc.
+  * @param release Release function, like free.
+  */
+ void settings_setAllocator(void *(*alloc)(size_t), void (*release)(void *));
+
  /**
   * @brief Deinitializes the settings module (for one context).
   *
@@ -150,8 +200,16 @@
  /**
   * @brief Save the current configuration settings to flash (for one context).
   *
+  * With SETTINGS_JOURNAL, only the entries that differ from the ones in flash
+  * are written, appended after the last entry stored. The entries are read in
+  * order, so the last one of a key wins. When there is no room left, or the
+  * flash does not hold valid settings, the region is erased and all the
+  * entries are written again.
+  *
   * @param ctx               Pointer to the SettingsContext.
-  * @param disable_interrupts If true, interrupts will be disabled while writing.
+  * @param disable_interrupts If true, the flash is written through the flash
+  *                           executor, or with the interrupts disabled if
+  *                           there is none.
   * @return int             0 on success, non-zero on failure.
   */
  int settings_save(SettingsContext *ctx, bool disable_interrupts);
@@ -168,24 +226,123 @@
   */
  int settings_erase(SettingsContext *ctx);
  
+ /**
+  * @brief Set the function that erases and programs the flash for all the
+  * contexts.
+  *
+  * By default the flash is written with the interrupts disabled. The firmware
+  * can install an executor that keeps some RAM resident work running, like
+  * flash_safe_execute with its own safety helper.
+  *
+  * @param executor The executor, or NULL to disable the interrupts again.
+  */
+ void settings_set_flash_executor(SettingsFlashExecutor executor);
+ 
  /**
   * @brief Print the current configuration in a tabular format.
   *
   * @param ctx    Pointer to the SettingsContext.
-  * @param buffer Optional buffer for storing output. If NULL, a buffer is
-  *               allocated internally and printed to stderr.
+  * @param buffer Optional buffer of at least SETTINGS_PRINT_BUFFER_SIZE bytes
+  *               for storing output. If NULL, the entries are printed to
+  *               stderr one at a time, with no buffer.
   */
  void settings_print(SettingsContext *ctx, char *buffer);
+
+ // Size of the buffer of settings_print
+ #define SETTINGS_PRINT_BUFFER_SIZE 2048
+
+ // Longest line of settings_format_entry, terminator included
+ #define SETTINGS_PRINT_LINE_SIZE \
+   (SETTINGS_MAX_KEY_LENGTH + SETTINGS_MAX_VALUE_LENGTH + 12)
+
+ /**
+  * @brief Format an entry as a line of settings_print.
+  *
+  * Walk the entries with an index from 0 until it returns -1, to print the
+  * settings one line at a time instead of in one buffer:
+  * "KEY (TYPE): Value\n".
+  *
+  * @param ctx    Pointer to the SettingsContext.
+  * @param index  Position of the entry.
+  * @param buffer Destination of the line, SETTINGS_PRINT_LINE_SIZE bytes.
+  * @param size   Size of the buffer. A longer line is cut.
+  * @return int   Length of the line, or -1 when there is no entry at index.
+  */
+ int settings_format_entry(SettingsContext *ctx, size_t index, char *buffer,
+                           size_t size);
  
  /**
   * @brief Find a configuration entry by its key.
   *
+  * The entry is read-only: with SETTINGS_LAZY_LOAD it may be in flash, so use
+  * the settings_put functions to change it. The pointer is valid until the
+  * entry is updated or the settings are saved.
+  *
   * @param ctx Pointer to the SettingsContext.
   * @param key The key of the configuration entry to find.
-  * @return Pointer to the found entry, or NULL if not found or invalid key.
+  * @return Pointer to the read-only entry, or NULL if not found or invalid
+  *         key.
+  */
+ const SettingsConfigEntry *settings_find_entry(SettingsContext *ctx,
+                                               const char *key);
+ 
+ /**
+  * @brief Resolve the key of a configuration entry to a handle.
+  *
+  * The keys are hashed once by settings_init, so resolving a key and
+  * settings_find_entry are O(1). A handle stays valid until settings_deinit or
+  * settings_erase.
+  *
+  * @param ctx Pointer to the SettingsContext.
+  * @param key The key of the configuration entry.
+  * @return The handle, or SETTINGS_INVALID_HANDLE if not found or invalid key.
+  */
+ SettingsHandle settings_get_handle(SettingsContext *ctx, const char *key);
+ 
+ /**
+  * @brief Get a configuration entry from its handle, without any key lookup.
+  *
+  * @param ctx    Pointer to the SettingsContext.
+  * @param handle Handle returned by settings_get_handle.
+  * @return Pointer to the read-only entry, or NULL if the handle is not valid.
+  *         See settings_find_entry.
+  */
+ const SettingsConfigEntry *settings_get_entry(SettingsContext *ctx,
+                                               SettingsHandle handle);
+ 
+ /**
+  * @brief Get the value of an integer entry without parsing it.
+  *
+  * The integer and boolean values are parsed once when loaded and when
+  * updated, so hot reads do not call atoi.
+  *
+  * @param ctx    Pointer to the SettingsContext.
+  * @param handle Handle returned by settings_get_handle.
+  * @param value  Where to store the value.
+  * @return int 0 on success, -1 if the handle is not valid or not an integer.
+  */
+ int settings_get_int(SettingsContext *ctx, SettingsHandle handle,
+                      int *value);
+ 
+ /**
+  * @brief Get the value of a boolean entry without parsing it.
+  *
+  * @param ctx    Pointer to the SettingsContext.
+  * @param handle Handle returned by settings_get_handle.
+  * @param value  Where to store the value.
+  * @return int 0 on success, -1 if the handle is not valid or not a boolean.
+  */
+ int settings_get_bool(SettingsContext *ctx, SettingsHandle handle,
+                       bool *value);
+ 
+ /**
+  * @brief Get the value of an entry as a string.
+  *
+  * @param ctx    Pointer to the SettingsContext.
+  * @param handle Handle returned by settings_get_handle.
+  * @return The value, or NULL if the handle is not valid.
   */
- SettingsConfigEntry *settings_find_entry(
-     SettingsContext *ctx, const char *key);
+ const char *settings_get_string(SettingsContext *ctx, SettingsHandle handle);
  
  /**
   * @brief Update a boolean configuration entry.
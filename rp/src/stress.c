@@ -0,0 +1,201 @@
+/**
+ * File: stress.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Bus stress test
+ */
+
+#include "stress.h"
+
+#include <string.h>
+
+#include "display.h"
+#include "pico/stdlib.h"
+#include "term.h"
+#include "tprotocol.h"
+
+static bool stressActive = false;
+static StressStats stressStats;
+static TermProtocolStats stressBaseline;
+static absolute_time_t stressStartTime;
+static absolute_time_t stressRefreshTime;
+
+// Next sequence number expected, once the first command is received
+static bool stressSequenceStarted = false;
+static uint32_t stressNextSequence = 0;
+
+// Timeouts of the remote computer before the test
+static bool stressTimeoutsStarted = false;
+static uint32_t stressTimeoutsBase = 0;
+
+// A retry after a timeout repeats the last sequence number, and a command
+// given up by the remote computer skips one
+static void stressCheckSequence(uint32_t sequence) {
+  if (stressSequenceStarted) {
+    uint32_t gap = sequence - stressNextSequence;
+    if (sequence == stressNextSequence - 1) {
+      stressStats.repeated++;
+      return;
+    }
+    if (gap >= STRESS_MAX_SEQUENCE_GAP) {
+      stressStats.orderErrors++;
+    } else {
+      stressStats.missing += gap;
+    }
+  }
+  stressSequenceStarted = true;
+  stressNextSequence = sequence + 1;
+}
+
+static void stressProtocolSync(const TransmissionProtocol *protocol) {
+  stressStats.syncCommands++;
+  if (protocol->payload_size != STRESS_SYNC_PAYLOAD_SIZE) {
+    stressStats.patternErrors++;
+    return;
+  }
+  uint16_t *payload = ((uint16_t *)protocol->payload);
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  uint32_t sequence = TPROTO_GET_PAYLOAD_PARAM32(payload);
+  uint32_t complement = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+  uint32_t timeouts = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+  uint32_t maxTicks = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+  if (complement != ~sequence) {
+    stressStats.patternErrors++;
+    return;
+  }
+  if (!stressTimeoutsStarted) {
+    stressTimeoutsBase = timeouts;
+    stressTimeoutsStarted = true;
+  }
+  stressStats.timeouts = timeouts - stressTimeoutsBase;
+  stressStats.maxTicks = maxTicks;
+  stressCheckSequence(sequence);
+}
+
+static void stressProtocolWrite(const TransmissionProtocol *protocol) {
+  stressStats.writeCommands++;
+  if (protocol->payload_size != STRESS_WRITE_PAYLOAD_SIZE) {
+    stressStats.patternErrors++;
+    return;
+  }
+  uint16_t *payload = ((uint16_t *)protocol->payload);
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  uint32_t sequence = TPROTO_GET_PAYLOAD_PARAM32(payload);
+  uint32_t complement = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+  // Jump d4 and d5 to the pattern
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  if (complement != ~sequence) {
+    stressStats.patternErrors++;
+    return;
+  }
+  uint16_t expected = (uint16_t)sequence;
+  for (int i = 0; i < STRESS_WRITE_SIZE / 2; i++) {
+    if (payload[i] != expected) {
+      stressStats.patternErrors++;
+      return;
+    }
+    expected++;
+  }
+  stressCheckSequence(sequence);
+}
+
+// Add the protocol counters since stress_start and the time
+static void stressUpdate(void) {
+  TermProtocolStats protocolStats;
+  term_getProtocolStats(&protocolStats);
+  stressStats.checksumErrors =
+      protocolStats.checksumErrors - stressBaseline.checksumErrors;
+  stressStats.drops = protocolStats.drops - stressBaseline.drops;
+  stressStats.highWater = protocolStats.highWater;
+  if (stressActive) {
+    stressStats.elapsedMs = (uint32_t)(
+        absolute_time_diff_us(stressStartTime, get_absolute_time()) / 1000);
+  }
+}
+
+static void stressShow(void) {
+  stressUpdate();
+  uint32_t commands = stressStats.syncCommands + stressStats.writeCommands;
+  uint32_t seconds = stressStats.elapsedMs / 1000;
+  term_beginBatch();
+  term_printString("\x1B" "H");
+  term_printString("Bus stress test. Any key stops it.\n\n");
+  TPRINTF("Time: %lu s\x1B" "K\n", (unsigned long)seconds);
+  TPRINTF("Sync: %lu  Write: %lu\x1B" "K\n",
+          (unsigned long)stressStats.syncCommands,
+          (unsigned long)stressStats.writeCommands);
+  TPRINTF("Rate: %lu commands/s\x1B" "K\n",
+          (unsigned long)((seconds > 0) ? commands / seconds : commands));
+  TPRINTF("Missing: %lu  Repeated: %lu\x1B" "K\n",
+          (unsigned long)stressStats.missing,
+          (unsigned long)stressStats.repeated);
+  TPRINTF("Order: %lu  Pattern: %lu\x1B" "K\n",
+          (unsigned long)stressStats.orderErrors,
+          (unsigned long)stressStats.patternErrors);
+  TPRINTF("Checksum errors: %lu\x1B" "K\n",
+          (unsigned long)stressStats.checksumErrors);
+  TPRINTF("Ring drops: %lu  High water: %lu/%d\x1B" "K\n",
+          (unsigned long)stressStats.drops,
+          (unsigned long)stressStats.highWater, TERM_PROTOCOL_RING_SLOTS);
+  TPRINTF("Timeouts: %lu  Slowest: %lu ticks\x1B" "K\n",
+          (unsigned long)stressStats.timeouts,
+          (unsigned long)stressStats.maxTicks);
+  term_endBatch();
+}
+
+static void stressProtocolStop(const TransmissionProtocol *protocol) {
+  (void)protocol;
+  if (!stressActive) {
+    return;
+  }
+  stressActive = false;
+  SEND_COMMAND_TO_DISPLAY(DISPLAY_COMMAND_NOP);
+  stressShow();
+  term_printString("\nTest stopped. Type 'm' for the menu.\n");
+  DPRINTF("Stress test stopped after %lu commands\n",
+          (unsigned long)(stressStats.syncCommands +
+                          stressStats.writeCommands));
+}
+
+void stress_start(void) {
+  term_setProtocolHandler(APP_STRESS_SYNC, stressProtocolSync,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK);
+  term_setProtocolHandler(APP_STRESS_WRITE, stressProtocolWrite,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK);
+  term_setProtocolHandler(APP_STRESS_STOP, stressProtocolStop,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK |
+                              TERM_PROTOCOL_FLAG_TRACE);
+
+  memset(&stressStats, 0, sizeof(stressStats));
+  term_getProtocolStats(&stressBaseline);
+  stressSequenceStarted = false;
+  stressTimeoutsStarted = false;
+  stressStartTime = get_absolute_time();
+  stressRefreshTime = make_timeout_time_ms(STRESS_REFRESH_MS);
+  stressActive = true;
+
+  term_clearScreen();
+  stressShow();
+  SEND_COMMAND_TO_DISPLAY(DISPLAY_COMMAND_STRESS);
+  DPRINTF("Stress test started\n");
+}
+
+bool stress_isActive(void) { return stressActive; }
+
+void stress_refresh(void) {
+  if (!stressActive ||
+      (absolute_time_diff_us(get_absolute_time(), stressRefreshTime) > 0)) {
+    return;
+  }
+  stressShow();
+  stressRefreshTime = make_timeout_time_ms(STRESS_REFRESH_MS);
+}
+
+void stress_getStats(StressStats *stats) {
+  stressUpdate();
+  *stats = stressStats;
+}
@@ -15,30 +15,65 @@
 #include <time.h>
 
 #include "aconfig.h"
+#include "boottrace.h"
 #include "constants.h"
 #include "debug.h"
 #include "display.h"
 #include "display_term.h"
+#include "download.h"
+#include "hardware/clocks.h"
 #include "hardware/dma.h"
+#include "hardware/structs/sio.h"
 #include "hardware/sync.h"
 #include "gconfig.h"
 #include "memfunc.h"
 #include "network.h"
+#include "pico/flash.h"
 #include "reset.h"
 #include "romemul.h"
 #include "sdcard.h"
 #include "select.h"
 #include "tprotocol.h"
 
-static TransmissionProtocol protocolBuffers[2];
-static volatile uint8_t protocolReadIndex = 0;
-static volatile uint8_t protocolWriteIndex = 1;
-static volatile bool protocolBufferReady = false;
-static volatile uint32_t protocolOverwriteCount = 0;
+// Single-producer (DMA IRQ) / single-consumer (term_loop) command ring. The
+// head is only written by the IRQ and the tail only by the main loop, so no
+// lock is needed to hand over a slot, even when the IRQ runs on core1.
+static TransmissionProtocol protocolRing[TERM_PROTOCOL_RING_SLOTS];
+static volatile uint32_t protocolRingHead = 0;
+static volatile uint32_t protocolRingTail = 0;
+static volatile uint32_t protocolCommandCount = 0;
+static volatile uint32_t protocolDropCount = 0;
+static volatile uint32_t protocolHighWater = 0;
+static volatile uint32_t protocolChecksumErrorCount = 0;
+// True when the parser is writing into protocolRing[head]
+static bool protocolTargetInRing = false;
 
 static uint32_t memorySharedAddress = 0;
 static uint32_t memoryRandomTokenAddress = 0;
+static uint32_t memorySharedBlockAddress = 0;
 static uint32_t memoryRandomTokenSeedAddress = 0;
+static uint32_t memoryAckSequenceAddress = 0;
+
+// Protocol command handlers indexed by command id. Kept in RAM so the IRQ
+// can look them up while the flash is busy
+static TermProtocolEntry protocolHandlers[TERM_PROTOCOL_MAX_COMMANDS];
+
+// Wakes up the main loop when a command is queued
+static TermCommandNotify commandNotify = NULL;
+
+// True while the flash is written. The notify runs from flash, so core0 only
+// sends the SEV then
+static volatile bool flashWriteActive = false;
+// Core0 interrupts masked and core1 locked out for the flash write
+static uint32_t flashMaskedIrqs = 0;
+static bool flashCore1LockedOut = false;
+
+// Value pushed to the inter-core FIFO to notify a command from core1
+#define TERM_NOTIFY_FIFO_TOKEN 0x5445524Du
+
+// State of the generator of the random token seeds. It must be usable from
+// the IRQ, so rand() is only used to seed it
+static uint32_t randomSeedState = 1;
 
 #define TERM_NETWORK_INFO_VALUE_SIZE 64
 #define TERM_MENU_LIVE_LINE_MAX 128
@@ -50,7 +85,8 @@ static void term_getConfigValueOrNA(const char *key, char *buffer,
   }
 
   buffer[0] = '\0';
-  SettingsConfigEntry *entry = settings_find_entry(gconfig_getContext(), key);
+  const SettingsConfigEntry *entry =
+      settings_find_entry(gconfig_getContext(), key);
   if ((entry != NULL) && (entry->value != NULL) && (entry->value[0] != '\0')) {
     snprintf(buffer, bufferSize, "%s", entry->value);
     return;
@@ -88,7 +124,7 @@ static void term_getConfiguredDns(char *dns1, size_t dns1Size, char *dns2,
     snprintf(dns2, dns2Size, "N/A");
   }
 
-  SettingsConfigEntry *entry =
+  const SettingsConfigEntry *entry =
       settings_find_entry(gconfig_getContext(), PARAM_WIFI_DNS);
   if ((entry == NULL) || (entry->value == NULL) || (entry->value[0] == '\0')) {
     return;
@@ -122,64 +158,351 @@ static void cmdExit(const char *arg);
 static void cmdHelp(const char *arg);
 static void cmdUnknown(const char *arg);
 
+// Protocol command handlers
+static void termProtocolStart(const TransmissionProtocol *protocol);
+static void termProtocolKeystroke(const TransmissionProtocol *protocol);
+static void termProtocolKeystrokes(const TransmissionProtocol *protocol);
+static void termProtocolSetSharedVars(const TransmissionProtocol *protocol);
+
 // Command table
 static const Command *commands;
 
 // Number of commands in the table
 static size_t numCommands = 0;
 
-// Setter for commands and numCommands
+// Positions in the table of the named commands, sorted by name, and of the
+// catch-all entry with the empty name
+static uint8_t commandOrder[TERM_MAX_COMMANDS];
+static size_t numSortedCommands = 0;
+static int catchAllCommand = -1;
+
+// Called before every command handler
+static TermCommandHook commandHook = NULL;
+
+// Setter for commands and numCommands. Sorts the names once, so a line is
+// resolved with a binary search
 void term_setCommands(const Command *cmds, size_t count) {
   commands = cmds;
   numCommands = count;
+  numSortedCommands = 0;
+  catchAllCommand = -1;
+  if (count > TERM_MAX_COMMANDS) {
+    DPRINTF("Only the first %d commands are registered\n", TERM_MAX_COMMANDS);
+    count = TERM_MAX_COMMANDS;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (cmds[i].command[0] == '\0') {
+      catchAllCommand = (int)i;
+      continue;
+    }
+    // Insertion sort. Aliases of a name keep the order of the table
+    size_t pos = numSortedCommands++;
+    while ((pos > 0) &&
+           (strcmp(cmds[commandOrder[pos - 1]].command, cmds[i].command) > 0)) {
+      commandOrder[pos] = commandOrder[pos - 1];
+      pos--;
+    }
+    commandOrder[pos] = (uint8_t)i;
+  }
+}
+
+void term_setCommandHook(TermCommandHook hook) { commandHook = hook; }
+
+// First sorted position whose name is not below the given one, compared on
+// the first length chars only
+static size_t termLowerBound(const char *name, size_t length) {
+  size_t low = 0;
+  size_t high = numSortedCommands;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (strncmp(commands[commandOrder[mid]].command, name, length) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static void termRunCommand(size_t index, const char *arg) {
+  if (commandHook != NULL) {
+    commandHook();
+  }
+  commands[index].handler(arg);
+}
+
+int term_setProtocolHandler(uint16_t commandId, TermProtocolHandler handler,
+                            uint8_t flags) {
+  if (commandId >= TERM_PROTOCOL_MAX_COMMANDS) {
+    DPRINTF("Command id %u out of the handler table\n", commandId);
+    return -1;
+  }
+  bool irq = (flags & TERM_PROTOCOL_FLAG_IRQ) != 0;
+  bool deferred = (flags & TERM_PROTOCOL_FLAG_DEFERRED) != 0;
+  if ((handler != NULL) && (irq == deferred)) {
+    DPRINTF("Command id %u must be either IRQ or deferred\n", commandId);
+    return -1;
+  }
+  // Never leave a handler with stale flags visible to the IRQ
+  protocolHandlers[commandId].handler = NULL;
+  __dmb();
+  protocolHandlers[commandId].flags = flags;
+  __dmb();
+  protocolHandlers[commandId].handler = handler;
+  return 0;
+}
+
+static inline const TermProtocolEntry *__not_in_flash_func(
+    termGetProtocolEntry)(uint16_t commandId) {
+  if (commandId >= TERM_PROTOCOL_MAX_COMMANDS) {
+    return NULL;
+  }
+  const TermProtocolEntry *entry = &protocolHandlers[commandId];
+  return (entry->handler != NULL) ? entry : NULL;
+}
+
+// xorshift32, cheap enough for the IRQ
+static inline uint32_t __not_in_flash_func(termNextRandomSeed)(void) {
+  uint32_t x = randomSeedState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  randomSeedState = x;
+  return x;
+}
+
+// Write the random token of the last processed command back to the shared
+// memory, and a new seed for the next one
+static inline void __not_in_flash_func(termAckToken)(uint32_t randomToken) {
+  if (memoryRandomTokenAddress == 0) {
+    return;
+  }
+  TPROTO_SET_RANDOM_TOKEN(memoryRandomTokenAddress, randomToken);
+  TPROTO_SET_RANDOM_TOKEN(memoryRandomTokenSeedAddress, termNextRandomSeed());
+}
+
+// Publish the sequence number of the last processed pipelined command. The
+// pipelined commands send an increasing sequence number instead of the seed
+// as token, and never touch the random token
+static inline void __not_in_flash_func(termAckSequence)(uint32_t sequence) {
+  if (memoryAckSequenceAddress == 0) {
+    return;
+  }
+  TPROTO_SET_RANDOM_TOKEN(memoryAckSequenceAddress, sequence);
+}
+
+static inline void __not_in_flash_func(termAckCommand)(
+    const TransmissionProtocol *protocol, uint8_t flags) {
+  uint32_t token = TPROTO_GET_RANDOM_TOKEN(protocol->payload);
+  if (flags & TERM_PROTOCOL_FLAG_PIPELINED) {
+    termAckSequence(token);
+  } else {
+    termAckToken(token);
+  }
+}
+
+// Tell the main loop there is work. Must be callable from any core
+static inline void __not_in_flash_func(termNotifyCommand)(void) {
+  __sev();
+  if (commandNotify == NULL) {
+    return;
+  }
+  if (get_core_num() == 0) {
+    if (!flashWriteActive) {
+      commandNotify();
+    }
+  } else if (sio_hw->fifo_st & SIO_FIFO_ST_RDY_BITS) {
+    // Raises SIO_IRQ_PROC0 in core0. If the FIFO is full a notification is
+    // already pending
+    sio_hw->fifo_wr = TERM_NOTIFY_FIFO_TOKEN;
+    __sev();
+  }
+}
+
+#if ROMEMUL_BUS_SERVICE_CORE1 == 1
+// Core0 side of the notifications sent by core1
+static void termFifoIrqHandler(void) {
+  while (multicore_fifo_rvalid()) {
+    (void)sio_hw->fifo_rd;
+  }
+  multicore_fifo_clear_irq();
+  if (commandNotify != NULL) {
+    commandNotify();
+  }
+}
+#endif
+
+void term_setCommandNotify(TermCommandNotify notify) {
+  commandNotify = notify;
+#if ROMEMUL_BUS_SERVICE_CORE1 == 1
+  if (notify != NULL) {
+    multicore_fifo_drain();
+    multicore_fifo_clear_irq();
+    irq_set_exclusive_handler(SIO_IRQ_PROC0, termFifoIrqHandler);
+    irq_set_enabled(SIO_IRQ_PROC0, true);
+  } else {
+    irq_set_enabled(SIO_IRQ_PROC0, false);
+    irq_remove_handler(SIO_IRQ_PROC0, termFifoIrqHandler);
+  }
+#endif
+}
+
+bool __not_in_flash_func(term_hasPendingCommands)(void) {
+  return protocolRingHead != protocolRingTail;
+}
+
+void term_getProtocolStats(TermProtocolStats *stats) {
+  stats->commands = protocolCommandCount;
+  stats->drops = protocolDropCount;
+  stats->checksumErrors = protocolChecksumErrorCount;
+  stats->highWater = protocolHighWater;
+}
+
+// Same as the default helper of pico_flash, but the bus interrupt stays
+// enabled in core0 and core1 is only locked out if it runs from flash
+static bool termFlashCoreInitDeinit(bool init) {
+  if (init) {
+    multicore_lockout_victim_init();
+  } else {
+    multicore_lockout_victim_deinit();
+  }
+  return true;
+}
+
+static int termFlashEnterSafeZone(uint32_t timeoutMs) {
+  flashCore1LockedOut = false;
+  if (multicore_lockout_victim_is_initialized(1u - get_core_num())) {
+    if (!multicore_lockout_start_timeout_us((uint64_t)timeoutMs * 1000)) {
+      return PICO_ERROR_TIMEOUT;
+    }
+    flashCore1LockedOut = true;
+  }
+
+  // With the bus in core1 DMA_IRQ_1 is not enabled here, so all is masked
+  uint32_t ints = save_and_disable_interrupts();
+  flashWriteActive = true;
+  flashMaskedIrqs = 0;
+  for (uint irq = 0; irq < NUM_IRQS; irq++) {
+    if ((irq != DMA_IRQ_1) && irq_is_enabled(irq)) {
+      flashMaskedIrqs |= 1u << irq;
+    }
+  }
+  irq_set_mask_enabled(flashMaskedIrqs, false);
+  restore_interrupts(ints);
+  return PICO_OK;
+}
+
+static int termFlashExitSafeZone(uint32_t timeoutMs) {
+  irq_set_mask_enabled(flashMaskedIrqs, true);
+  flashWriteActive = false;
+  int err = PICO_OK;
+  if (flashCore1LockedOut &&
+      !multicore_lockout_end_timeout_us((uint64_t)timeoutMs * 1000)) {
+    err = PICO_ERROR_TIMEOUT;
+  }
+  flashCore1LockedOut = false;
+
+  // Wake up the main loop for the commands queued meanwhile
+  if (term_hasPendingCommands()) {
+    termNotifyCommand();
+  }
+  return err;
+}
+
+static flash_safety_helper_t termFlashSafetyHelper = {
+    .core_init_deinit = termFlashCoreInitDeinit,
+    .enter_safe_zone_timeout_ms = termFlashEnterSafeZone,
+    .exit_safe_zone_timeout_ms = termFlashExitSafeZone,
+};
+
+// Replaces the weak helper of pico_flash used by flash_safe_execute
+flash_safety_helper_t *get_flash_safety_helper(void) {
+  return &termFlashSafetyHelper;
+}
+
+int term_flashSafeExecute(void (*func)(void *), void *param) {
+  return flash_safe_execute(func, param, TERM_FLASH_SAFE_TIMEOUT_MS);
+}
+
+// Point the parser at the next free ring slot, or at the parser's own buffer
+// if the ring is full. Commands parsed into the parser's buffer are dropped.
+static inline void __not_in_flash_func(termAcquireProtocolSlot)(void) {
+  uint32_t head = protocolRingHead;
+  if ((head - protocolRingTail) < TERM_PROTOCOL_RING_SLOTS) {
+    tprotocol_setTarget(&protocolRing[head & TERM_PROTOCOL_RING_MASK]);
+    protocolTargetInRing = true;
+  } else {
+    tprotocol_setTarget(NULL);
+    protocolTargetInRing = false;
+  }
 }
 
 /**
  * @brief Callback that handles the protocol command received.
  *
- * This callback copy the content of the protocol to the last_protocol
- * structure. The last_protocol_valid flag is set to true to indicate that the
- * last_protocol structure contains a valid protocol. We return to the
- * dma_irq_handler_lookup function to continue asap with the next
+ * The parser has written the command straight into the ring slot at the head,
+ * so publishing it is just advancing the head index. If the ring was full the
+ * command was parsed into the parser's own buffer and it is dropped and
+ * counted. We return to the dma_irq_handler_lookup function to continue asap
+ * with the next
  *
  * @param protocol The TransmissionProtocol structure containing the protocol
  * information.
  */
 static inline void __not_in_flash_func(handle_protocol_command)(
     const TransmissionProtocol *protocol) {
-  uint8_t writeIndex = protocolWriteIndex;
-  TransmissionProtocol *writeBuffer = &protocolBuffers[writeIndex];
-
-  // Copy the content of protocol to the active write buffer.
-  writeBuffer->command_id = protocol->command_id;
-  writeBuffer->payload_size = protocol->payload_size;
-  writeBuffer->bytes_read = protocol->bytes_read;
-  writeBuffer->final_checksum = protocol->final_checksum;
-
-  // Sanity check: clamp payload_size to avoid overflow
-  uint16_t size = protocol->payload_size;
-  if (size > MAX_PROTOCOL_PAYLOAD_SIZE) {
-    size = MAX_PROTOCOL_PAYLOAD_SIZE;
+  protocolCommandCount++;
+  // High rate commands run right here and never reach the ring
+  const TermProtocolEntry *entry = termGetProtocolEntry(protocol->command_id);
+  if ((entry != NULL) && (entry->flags & TERM_PROTOCOL_FLAG_IRQ)) {
+    entry->handler(protocol);
+    if (entry->flags & TERM_PROTOCOL_FLAG_ACK) {
+      termAckCommand(protocol, entry->flags);
+    }
+    return;
   }
 
-  // Copy only used payload bytes
-  memcpy(writeBuffer->payload, protocol->payload, size);
+  if (protocolTargetInRing) {
+    uint32_t head = protocolRingHead;
+    uint32_t used = head - protocolRingTail + 1;
 
-  if (protocolBufferReady) {
-    protocolOverwriteCount++;
-  }
+    // Make the slot content visible before publishing the new head
+    __dmb();
+    protocolRingHead = head + 1;
 
-  // Publish atomically by swapping read/write roles.
-  uint8_t readIndex = protocolReadIndex;
-  protocolReadIndex = writeIndex;
-  protocolWriteIndex = readIndex;
-  protocolBufferReady = true;
-};
+    if (used > protocolHighWater) {
+      protocolHighWater = used;
+    }
+    termNotifyCommand();
+  } else {
+    protocolDropCount++;
+  }
+  termAcquireProtocolSlot();
+}
 
+// Only count the error: printing from the IRQ is slow and runs from flash,
+// which is not allowed when the bus is serviced by core1
 static inline void __not_in_flash_func(handle_protocol_checksum_error)(
     const TransmissionProtocol *protocol) {
-  DPRINTF("Checksum error detected (ID=%u, Size=%u)\n", protocol->command_id,
-          protocol->payload_size);
+  (void)protocol;
+  protocolChecksumErrorCount++;
+}
+
+// Feed one bus word to the protocol parser
+static inline void __not_in_flash_func(termParseWord)(uint16_t addrLsb) {
+  // Move back to the ring as soon as the consumer frees a slot, but only
+  // between commands
+  if (!protocolTargetInRing && (tprotocol_nextTPstep == HEADER_DETECTION)) {
+    termAcquireProtocolSlot();
+  }
+
+#if TPROTOCOL_FAST_PARSE == 1
+  tprotocol_parseFast(addrLsb, handle_protocol_command,
+                      handle_protocol_checksum_error);
+#else
+  tprotocol_parse(addrLsb, handle_protocol_command,
+                  handle_protocol_checksum_error);
+#endif
 }
 
 // Interrupt handler for DMA completion
@@ -200,14 +523,80 @@ void __not_in_flash_func(term_dma_irq_handler_lookup)(void) {
   // the compilar to run faster
   if (__builtin_expect(addr & 0x00010000, 0)) {
     // Invert highest bit of low word to get 16-bit address
-    uint16_t addr_lsb = (uint16_t)(addr ^ ADDRESS_HIGH_BIT);
+    termParseWord((uint16_t)(addr ^ ADDRESS_HIGH_BIT));
+  }
+}
 
-    tprotocol_parse(addr_lsb, handle_protocol_command,
-                    handle_protocol_checksum_error);
+#if ROMEMUL_ROM3_CAPTURE == 1
+static uint32_t rom3CaptureTail = 0;
+static volatile uint32_t rom3CaptureOverrunCount = 0;
+static repeating_timer_t rom3CaptureTimer;
+// Polls that found the last captured word and, after it, no new word. The
+// words are captured after the idle poll and before the poll that finds them
+static uint32_t rom3CaptureWordUs = 0;
+static uint32_t rom3CaptureIdleUs = 0;
+
+void __not_in_flash_func(term_pollRom3Capture)(void) {
+  const volatile uint16_t *captureBuffer = romemul_getRom3CaptureBuffer();
+  uint32_t head = romemul_getRom3CaptureCount();
+  uint32_t nowUs = timer_hw->timerawl;
+  if (head == rom3CaptureTail) {
+    rom3CaptureIdleUs = nowUs;
+    return;
+  }
+  uint32_t pending = head - rom3CaptureTail;
+  if (pending > ROMEMUL_ROM3_CAPTURE_WORDS) {
+    // The DMA lapped us. The partial command is lost, restart the parser
+    rom3CaptureOverrunCount += pending - ROMEMUL_ROM3_CAPTURE_WORDS;
+    rom3CaptureTail = head - ROMEMUL_ROM3_CAPTURE_WORDS;
+    tprotocol_resetParserState();
+  } else if (rom3CaptureIdleUs - rom3CaptureWordUs >
+             PROTOCOL_READ_RESTART_MICROSECONDS) {
+    // The bus was idle longer than the timeout after the last word, so the
+    // remote computer gave up the command in progress
+    tprotocol_resetParserState();
+  }
+  rom3CaptureWordUs = nowUs;
+  rom3CaptureIdleUs = nowUs;
+  // Stamp the words with the poll that found them, not the time of the parse
+  tprotocol_setWordTime(nowUs);
+
+  while (rom3CaptureTail != head) {
+    uint16_t addrLsb =
+        captureBuffer[rom3CaptureTail & ROMEMUL_ROM3_CAPTURE_MASK];
+    termParseWord((uint16_t)(addrLsb ^ ADDRESS_HIGH_BIT));
+    rom3CaptureTail++;
   }
 }
 
+static bool __not_in_flash_func(termRom3CaptureTimerCallback)(
+    repeating_timer_t *timer) {
+  (void)timer;
+  term_pollRom3Capture();
+  return true;
+}
+
+int term_startRom3Capture(void) {
+  rom3CaptureTail = romemul_getRom3CaptureCount();
+  rom3CaptureWordUs = timer_hw->timerawl;
+  rom3CaptureIdleUs = rom3CaptureWordUs;
+  // Negative period: keep a fixed interval between callback starts
+  if (!add_repeating_timer_us(-TERM_ROM3_CAPTURE_POLL_US,
+                              termRom3CaptureTimerCallback, NULL,
+                              &rom3CaptureTimer)) {
+    DPRINTF("Error starting the ROM3 capture timer\n");
+    return -1;
+  }
+  return 0;
+}
+#endif
+
+// Characters on screen. The rows are a ring starting at screenTop, so a
+// scroll does not move them
 static char screen[TERM_SCREEN_SIZE];
+static uint8_t screenTop = 0;
+#define SCREEN_CELL(x, y) \
+  screen[(((screenTop + (y)) % TERM_SCREEN_SIZE_Y) * TERM_SCREEN_SIZE_X) + (x)]
 static uint8_t cursorX = 0;
 static uint8_t cursorY = 0;
 
@@ -222,58 +611,90 @@ static bool menuPromptValid = false;
 // Store previous cursor position for block removal
 static uint8_t prevCursorX = 0;
 static uint8_t prevCursorY = 0;
+static bool cursorShown = false;
+
+// VT52 modes: ESC e/f cursor on/off, ESC p/q reverse video, ESC v/w wrap at
+// the end of the line, and the cursor saved by ESC j
+static bool cursorEnabled = true;
+static bool reverseVideo = false;
+static bool wrapEnabled = true;
+static uint8_t savedCursorX = 0;
+static uint8_t savedCursorY = 0;
+
+// Output batch. While it is open the cursor is drawn and the display is
+// refreshed only once, when the outermost batch ends
+static uint8_t batchDepth = 0;
+static bool batchCursorPending = false;
+static bool batchRefreshPending = false;
 
 // Buffer to keep track of chars entered between newlines
 static char inputBuffer[TERM_INPUT_BUFFER_SIZE];
 static size_t inputLength = 0;
 
+// Next settings entry of the "print" pager, -1 when it is not paging
+static int printPagerNext = -1;
+
 // Getter method for inputBuffer
 char *term_getInputBuffer(void) { return inputBuffer; }
 
 // Clears entire screen buffer and resets cursor
 void term_clearScreen(void) {
   memset(screen, 0, TERM_SCREEN_SIZE);
+  screenTop = 0;
   cursorX = 0;
   cursorY = 0;
+  cursorShown = false;
+  cursorEnabled = true;
+  reverseVideo = false;
+  wrapEnabled = true;
   menuRowsValid = false;
   menuPromptValid = false;
   display_termClear();
 }
 
+void term_redraw(void) {
+  term_beginBatch();
+  termHideCursor();
+  for (uint8_t row = 0; row < TERM_SCREEN_SIZE_Y; row++) {
+    for (uint8_t col = 0; col < TERM_SCREEN_SIZE_X; col++) {
+      char chr = SCREEN_CELL(col, row);
+      display_termChar(col, row, (chr != '\0') ? chr : ' ');
+    }
+  }
+  batchCursorPending = true;
+  termRefresh();
+  term_endBatch();
+}
+
 // Clears the input buffer
 void term_clearInputBuffer(void) {
   memset(inputBuffer, 0, TERM_INPUT_BUFFER_SIZE);
   inputLength = 0;
 }
 
-// Custom scrollup function to scroll except for the last row
-void termScrollupBuffer(uint16_t blankBytes) {
-  // blank bytes is the number of bytes to blank out at the bottom of the
-  // screen
-
-  unsigned char *u8g2Buffer = u8g2_GetBufferPtr(display_getU8g2Ref());
-  memmove(u8g2Buffer, u8g2Buffer + blankBytes,
-          DISPLAY_BUFFER_SIZE - blankBytes -
-              TERM_SCREEN_SIZE_X * DISPLAY_TERM_CHAR_HEIGHT);
-  memset(u8g2Buffer + DISPLAY_BUFFER_SIZE - blankBytes -
-             TERM_SCREEN_SIZE_X * DISPLAY_TERM_CHAR_HEIGHT,
-         0, blankBytes);
-}
-
-// Scrolls the screen up by one row
+// Scrolls the screen up by one row, except for the last row of the display.
+// The characters and the display rows are rings, so nothing is moved here
 static void termScrollUp(void) {
-  memmove(screen, screen + TERM_SCREEN_SIZE_X,
-          TERM_SCREEN_SIZE - TERM_SCREEN_SIZE_X);
-  memset(screen + TERM_SCREEN_SIZE - TERM_SCREEN_SIZE_X, 0, TERM_SCREEN_SIZE_X);
-  termScrollupBuffer(TERM_DISPLAY_ROW_BYTES);
+  memset(&SCREEN_CELL(0, 0), 0, TERM_SCREEN_SIZE_X);
+  screenTop = (screenTop + 1) % TERM_SCREEN_SIZE_Y;
+  display_scrollRing(TERM_SCREEN_SIZE_Y);
 }
 
 // Prints a character to the screen, handles scrolling
 static void termPutChar(char chr) {
-  screen[cursorY * TERM_SCREEN_SIZE_X + cursorX] = chr;
-  display_termChar(cursorX, cursorY, chr);
+  SCREEN_CELL(cursorX, cursorY) = chr;
+  if (reverseVideo) {
+    display_termCharReverse(cursorX, cursorY, chr);
+  } else {
+    display_termChar(cursorX, cursorY, chr);
+  }
   cursorX++;
   if (cursorX >= TERM_SCREEN_SIZE_X) {
+    if (!wrapEnabled) {
+      // The last column is written over
+      cursorX = TERM_SCREEN_SIZE_X - 1;
+      return;
+    }
     cursorX = 0;
     cursorY++;
     if (cursorY >= TERM_SCREEN_SIZE_Y) {
@@ -283,11 +704,55 @@ static void termPutChar(char chr) {
   }
 }
 
+// Removes the block of the cursor by restoring the character
+static void termHideCursor(void) {
+  if (cursorShown) {
+    display_termChar(prevCursorX, prevCursorY, ' ');
+    cursorShown = false;
+  }
+}
+
+// Draws a block at the cursor position
+static void termShowCursor(void) {
+  if (!cursorEnabled) {
+    return;
+  }
+  display_termCursor(cursorX, cursorY);
+  prevCursorX = cursorX;
+  prevCursorY = cursorY;
+  cursorShown = true;
+}
+
+// Refreshes the display now, or when the batch ends
+static void termRefresh(void) {
+  if (batchDepth > 0) {
+    batchRefreshPending = true;
+    return;
+  }
+  display_termRefresh();
+}
+
+void term_beginBatch(void) { batchDepth++; }
+
+void term_endBatch(void) {
+  if ((batchDepth == 0) || (--batchDepth > 0)) {
+    return;
+  }
+  if (batchCursorPending) {
+    batchCursorPending = false;
+    termShowCursor();
+  }
+  if (batchRefreshPending) {
+    batchRefreshPending = false;
+    display_termRefresh();
+  }
+}
+
 // Renders a single character, with special handling for newline and carriage
 // return
 static void termRenderChar(char chr) {
-  // First, remove the old block by restoring the character
-  display_termChar(prevCursorX, prevCursorY, ' ');
+  // First, remove the old block
+  termHideCursor();
   if (chr == '\n' || chr == '\r') {
     // Move to new line
     cursorX = 0;
@@ -300,19 +765,67 @@ static void termRenderChar(char chr) {
     termPutChar(chr);
   }
 
-  // Draw a block at the new cursor position
-  display_termCursor(cursorX, cursorY);
-  // Update previous cursor coords
-  prevCursorX = cursorX;
-  prevCursorY = cursorY;
+  // Draw a block at the new cursor position, once per batch
+  if (batchDepth > 0) {
+    batchCursorPending = true;
+  } else {
+    termShowCursor();
+  }
+}
+
+// Clears cells of a row, in screen[] and the display
+static void termClearCells(uint8_t row, uint8_t col, uint8_t count) {
+  memset(&SCREEN_CELL(col, row), 0, count);
+  display_termClearCells(row, col, count);
+}
+
+// Copies a whole row over another one, in screen[] and the display
+static void termCopyRow(uint8_t dstRow, uint8_t srcRow) {
+  memcpy(&SCREEN_CELL(0, dstRow), &SCREEN_CELL(0, srcRow), TERM_SCREEN_SIZE_X);
+  display_termCopyRow(dstRow, srcRow);
+}
+
+// ESC L: the rows from the cursor down move one row down, the last one is
+// lost and the row of the cursor is cleared
+static void termInsertLine(void) {
+  for (int row = TERM_SCREEN_SIZE_Y - 1; row > cursorY; row--) {
+    termCopyRow((uint8_t)row, (uint8_t)(row - 1));
+  }
+  termClearCells(cursorY, 0, TERM_SCREEN_SIZE_X);
+  cursorX = 0;
+}
+
+// ESC M: the rows below the cursor move one row up and the last one is
+// cleared
+static void termDeleteLine(void) {
+  for (int row = cursorY; row < TERM_SCREEN_SIZE_Y - 1; row++) {
+    termCopyRow((uint8_t)row, (uint8_t)(row + 1));
+  }
+  termClearCells(TERM_SCREEN_SIZE_Y - 1, 0, TERM_SCREEN_SIZE_X);
+  cursorX = 0;
+}
+
+// Length of the escape sequence that starts with ESC and the command char
+static size_t vt52SequenceLength(char command) {
+  switch (command) {
+    case 'Y':  // ESC Y <row> <col>
+      return 4;
+    case 'b':  // ESC b <color>
+    case 'c':  // ESC c <color>
+      return 3;
+    default:
+      return 2;
+  }
 }
 
 /**
  * @brief Processes a complete VT52 escape sequence.
  *
  * This function interprets the VT52 sequence stored in `seq` (with given
- * length) and performs the corresponding cursor movements. Modify the TODO
- * sections to implement additional features as needed.
+ * length): the cursor movements, the clears, insert and delete line, reverse
+ * video, wrap and save and restore of the cursor of the Atari ST VT52. The
+ * line operations move whole rows of screen[] and the display buffer. The
+ * colors of ESC b and ESC c are ignored, the display is monochrome.
  *
  * @param seq Pointer to the escape sequence buffer.
  * @param length The length of the escape sequence.
@@ -322,62 +835,64 @@ static void vt52ProcessSequence(const char *seq, size_t length) {
   if (length < 2) return;
 
   char command = seq[1];
+  // The sequence draws or moves the cursor, so the block is removed first
+  termHideCursor();
   switch (command) {
     case 'A':  // Move cursor up
-      // TODO(diego): Improve behavior if needed.
       if (cursorY > 0) {
         cursorY--;
       }
-      termRenderChar('\0');
       break;
     case 'B':  // Move cursor down
       if (cursorY < TERM_SCREEN_SIZE_Y - 1) {
         cursorY++;
       }
-      termRenderChar('\0');
       break;
     case 'C':  // Move cursor right
       if (cursorX < TERM_SCREEN_SIZE_X - 1) {
         cursorX++;
       }
-      termRenderChar('\0');
       break;
     case 'D':  // Move cursor left
       if (cursorX > 0) {
         cursorX--;
       }
-      termRenderChar('\0');
       break;
     case 'E':  // Clear screen and place cursor at top left corner
       cursorX = 0;
       cursorY = 0;
-      termRenderChar('\0');
       for (int posY = 0; posY < TERM_SCREEN_SIZE_Y; posY++) {
-        for (int posX = 0; posX < TERM_SCREEN_SIZE_X; posX++) {
-          screen[posY * TERM_SCREEN_SIZE_X + posX] = 0;
-          display_termChar(posX, posY, ' ');
-        }
+        termClearCells((uint8_t)posY, 0, TERM_SCREEN_SIZE_X);
       }
       break;
     case 'H':  // Cursor home
       cursorX = 0;
       cursorY = 0;
-      termRenderChar('\0');
+      break;
+    case 'I':  // Cursor up, scrolling the screen down on the top row
+      if (cursorY > 0) {
+        cursorY--;
+      } else {
+        uint8_t col = cursorX;
+        termInsertLine();
+        cursorX = col;
+      }
       break;
     case 'J':  // Erases from the current cursor position to the end of the
                // screen
-      for (int posY = cursorY; posY < TERM_SCREEN_SIZE_Y; posY++) {
-        for (int posX = cursorX; posX < TERM_SCREEN_SIZE_X; posX++) {
-          screen[posY * TERM_SCREEN_SIZE_X + posX] = 0;
-          display_termChar(posX, posY, ' ');
-        }
+      termClearCells(cursorY, cursorX, TERM_SCREEN_SIZE_X - cursorX);
+      for (int posY = cursorY + 1; posY < TERM_SCREEN_SIZE_Y; posY++) {
+        termClearCells((uint8_t)posY, 0, TERM_SCREEN_SIZE_X);
       }
       break;
     case 'K':  // Clear to end of line
-      for (int posX = cursorX; posX < TERM_SCREEN_SIZE_X; posX++) {
-        screen[cursorY * TERM_SCREEN_SIZE_X + posX] = 0;
-        display_termChar(posX, cursorY, ' ');
-      }
+      termClearCells(cursorY, cursorX, TERM_SCREEN_SIZE_X - cursorX);
+      break;
+    case 'L':  // Insert a line
+      termInsertLine();
+      break;
+    case 'M':  // Delete a line
+      termDeleteLine();
       break;
     case 'Y':  // Direct cursor addressing: ESC Y <row> <col>
       if (length == 4) {
@@ -388,14 +903,53 @@ static void vt52ProcessSequence(const char *seq, size_t length) {
           cursorY = row;
           cursorX = col;
         }
-        termRenderChar('\0');
       }
       break;
+    case 'd':  // Erases from the start of the screen to the cursor
+      for (int posY = 0; posY < cursorY; posY++) {
+        termClearCells((uint8_t)posY, 0, TERM_SCREEN_SIZE_X);
+      }
+      termClearCells(cursorY, 0, cursorX + 1);
+      break;
+    case 'e':  // Show the cursor
+      cursorEnabled = true;
+      break;
+    case 'f':  // Hide the cursor
+      cursorEnabled = false;
+      break;
+    case 'j':  // Save the cursor position
+      savedCursorX = cursorX;
+      savedCursorY = cursorY;
+      break;
+    case 'k':  // Restore the cursor position
+      cursorX = savedCursorX;
+      cursorY = savedCursorY;
+      break;
+    case 'l':  // Clear the line and move to its start
+      termClearCells(cursorY, 0, TERM_SCREEN_SIZE_X);
+      cursorX = 0;
+      break;
+    case 'o':  // Erases from the start of the line to the cursor
+      termClearCells(cursorY, 0, cursorX + 1);
+      break;
+    case 'p':  // Reverse video on
+      reverseVideo = true;
+      break;
+    case 'q':  // Reverse video off
+      reverseVideo = false;
+      break;
+    case 'v':  // Wrap at the end of the line
+      wrapEnabled = true;
+      break;
+    case 'w':  // Stay on the last column at the end of the line
+      wrapEnabled = false;
+      break;
     default:
-      // Unrecognized sequence. Optionally, print or ignore.
-      // For now, we'll ignore it.
+      // Unrecognized sequence, or a color. Ignore it.
       break;
   }
+  // Draw the cursor at its new position
+  termRenderChar('\0');
 }
 
 void term_printString(const char *str) {
@@ -415,19 +969,10 @@ void term_printString(const char *str) {
       }
     } else {  // STATE_ESC: we're accumulating an escape sequence
       escBuffer[escLen++] = chr;
-      // Check for sequence completion:
-      // Most VT52 sequences are two characters (ESC + command)...
-      if (escLen == 2) {
-        if (escBuffer[1] == 'Y') {
-          // ESC Y requires two more characters (for row and col)
-          // Do nothing now—wait until esc_len == 4.
-        } else {
-          // Sequence complete (ESC + single command)
-          vt52ProcessSequence(escBuffer, escLen);
-          state = STATE_NORMAL;
-        }
-      } else if (escBuffer[1] == 'Y' && escLen == 4) {
-        // ESC Y <row> <col> sequence complete
+      // Check for sequence completion: most VT52 sequences are two
+      // characters (ESC + command), ESC Y has a row and a column and the
+      // colors one more character
+      if (escLen == vt52SequenceLength(escBuffer[1])) {
         vt52ProcessSequence(escBuffer, escLen);
         state = STATE_NORMAL;
       }
@@ -448,15 +993,116 @@ void term_printString(const char *str) {
       termRenderChar(escBuffer[i]);
     }
   }
-  display_termRefresh();
+  termRefresh();
+}
+
+// Add chars to the input line and show them
+static void termAppendInput(const char *chars, size_t count) {
+  for (size_t i = 0;
+       (i < count) && (inputLength < TERM_INPUT_BUFFER_SIZE - 1); i++) {
+    inputBuffer[inputLength++] = chars[i];
+    termRenderChar(chars[i]);
+  }
+  inputBuffer[inputLength] = '\0';
+}
+
+// Tab: complete the command name of the input line up to the longest prefix
+// shared by the commands that start with it. When it can not grow, list them
+static void termCompleteCommand(void) {
+  if ((inputLength == 0) || (memchr(inputBuffer, ' ', inputLength) != NULL)) {
+    return;
+  }
+  size_t first = termLowerBound(inputBuffer, inputLength);
+  size_t last = first;
+  while ((last < numSortedCommands) &&
+         (strncmp(commands[commandOrder[last]].command, inputBuffer,
+                  inputLength) == 0)) {
+    last++;
+  }
+  if (first == last) {
+    return;
+  }
+  const char *name = commands[commandOrder[first]].command;
+  const char *lastName = commands[commandOrder[last - 1]].command;
+  // The sorted names share the prefix of the first and the last one
+  size_t common = inputLength;
+  while ((name[common] != '\0') && (name[common] == lastName[common])) {
+    common++;
+  }
+  termHideCursor();
+  bool grown = (common > inputLength);
+  if (grown) {
+    termAppendInput(name + inputLength, common - inputLength);
+  }
+  if ((name[common] == '\0') && (strcmp(name, lastName) == 0)) {
+    termAppendInput(" ", 1);
+  } else if (!grown) {
+    termRenderChar('\n');
+    for (size_t pos = first; pos < last; pos++) {
+      const char *option = commands[commandOrder[pos]].command;
+      // Aliases of a name are listed once
+      if ((pos == first) ||
+          (strcmp(option, commands[commandOrder[pos - 1]].command) != 0)) {
+        term_printString(option);
+        term_printString(" ");
+      }
+    }
+    term_printString("\n> ");
+    for (size_t i = 0; i < inputLength; i++) {
+      termRenderChar(inputBuffer[i]);
+    }
+  }
+  termShowCursor();
+  termRefresh();
+}
+
+// Print the settings from printPagerNext, one line at a time, up to a
+// screen. Drawn with one refresh
+static void termPrintPage(void) {
+  char line[SETTINGS_PRINT_LINE_SIZE];
+  int rows = 0;
+  int len = 0;
+  term_beginBatch();
+  while ((len = settings_format_entry(aconfig_getContext(),
+                                      (size_t)printPagerNext, line,
+                                      sizeof(line))) >= 0) {
+    // Screen rows of the line, wrapped
+    int lineRows = 1 + ((len > 1) ? (len - 2) / TERM_SCREEN_SIZE_X : 0);
+    if ((rows > 0) && (rows + lineRows > TERM_PRINT_PAGE_ROWS)) {
+      break;
+    }
+    term_printString(line);
+    rows += lineRows;
+    printPagerNext++;
+  }
+  if (len >= 0) {
+    term_printString("-- more --");
+  } else {
+    printPagerNext = -1;
+  }
+  term_endBatch();
 }
 
 // Called whenever a character is entered by the user
 // This is the single point of entry for user input
 static void termInputChar(char chr) {
+  // A key shows the next page of "print", or stops it with 'q'
+  if (printPagerNext >= 0) {
+    term_printString("\n");
+    if ((chr == 'q') || (chr == 'Q')) {
+      printPagerNext = -1;
+    } else {
+      termPrintPage();
+    }
+    if (printPagerNext < 0) {
+      term_printString("> ");
+    }
+    return;
+  }
+
   // Check for backspace
   if (chr == '\b') {
-    display_termChar(prevCursorX, prevCursorY, ' ');
+    termHideCursor();
 
     // If we have chars in input_buffer, remove last char
     if (inputLength > 0) {
@@ -475,14 +1121,17 @@ static void termInputChar(char chr) {
       } else {
         cursorX--;
       }
-      screen[cursorY * TERM_SCREEN_SIZE_X + cursorX] = 0;
+      SCREEN_CELL(cursorX, cursorY) = 0;
       display_termChar(cursorX, cursorY, ' ');
     }
 
-    display_termCursor(cursorX, cursorY);
-    prevCursorX = cursorX;
-    prevCursorY = cursorY;
-    display_termRefresh();
+    termShowCursor();
+    termRefresh();
+    return;
+  }
+
+  if (chr == '\t') {
+    termCompleteCommand();
     return;
   }
 
@@ -499,28 +1148,29 @@ static void termInputChar(char chr) {
            arg);  // Split at the first space
 
     bool commandFound = false;
-    for (size_t i = 0; i < numCommands; i++) {
-      if (strcmp(command, commands[i].command) == 0) {
-        commands[i].handler(arg);  // Pass the argument to the handler
-        commandFound = true;
-      }
+    size_t length = strlen(command);
+    for (size_t pos = termLowerBound(command, length + 1);
+         (pos < numSortedCommands) &&
+         (strcmp(commands[commandOrder[pos]].command, command) == 0);
+         pos++) {
+      termRunCommand(commandOrder[pos], arg);  // Pass the argument
+      commandFound = true;
     }
-    if ((!commandFound) && (strlen(command) > 0)) {
+    if ((!commandFound) && (length > 0) && (catchAllCommand >= 0)) {
       // The custom unknown command manager is called when the command is empty
       // in the command table. This is useful to manage custom entries.
-      for (size_t i = 0; i < numCommands; i++) {
-        if (strlen(commands[i].command) == 0) {
-          commands[i].handler(inputBuffer);  // Pass the argument to the handler
-        }
-      }
+      termRunCommand((size_t)catchAllCommand, inputBuffer);
     }
 
     // Reset input buffer
     memset(inputBuffer, 0, TERM_INPUT_BUFFER_SIZE);
     inputLength = 0;
 
-    term_printString("> ");
-    display_termRefresh();
+    // The pager prints the prompt after the last page
+    if (printPagerNext < 0) {
+      term_printString("> ");
+    }
+    termRefresh();
     return;
   }
 
@@ -533,7 +1183,7 @@ static void termInputChar(char chr) {
 
     // show block cursor
 
-    display_termRefresh();
+    termRefresh();
   } else {
     // Buffer full, ignore or beep?
   }
@@ -545,16 +1195,39 @@ void term_init(void) {
   memoryRandomTokenAddress = memorySharedAddress + TERM_RANDOM_TOKEN_OFFSET;
   memoryRandomTokenSeedAddress =
       memorySharedAddress + TERM_RANDON_TOKEN_SEED_OFFSET;
+  memoryAckSequenceAddress = memorySharedAddress + TERM_ACK_SEQUENCE_OFFSET;
   SET_SHARED_VAR(TERM_HARDWARE_TYPE, 0, memorySharedAddress,
                  TERM_SHARED_VARIABLES_OFFSET);  // Clean the hardware type
   SET_SHARED_VAR(TERM_HARDWARE_VERSION, 0, memorySharedAddress,
                  TERM_SHARED_VARIABLES_OFFSET);  // Clean the hardware version
+  memorySharedBlockAddress = memorySharedAddress + TERM_SHARED_BLOCK_OFFSET;
+  memset((void *)memorySharedBlockAddress, 0,
+         MEMFUNC_SHARED_BLOCK_VARS + (TERM_SHARED_BLOCK_VARS * 4));
 
   // Initialize the random seed (add this line)
   srand(time(NULL));
+  // Seed the generator used by the acknowledges. xorshift must not be zero
+  randomSeedState = (uint32_t)rand() | 1u;
   // Init the random token seed in the shared memory for the next command
-  uint32_t newRandomSeedToken = rand();  // Generate a new random 32-bit value
-  TPROTO_SET_RANDOM_TOKEN(memoryRandomTokenSeedAddress, newRandomSeedToken);
+  TPROTO_SET_RANDOM_TOKEN(memoryRandomTokenSeedAddress, termNextRandomSeed());
+
+  // Keep the bus running while the settings are written
+  settings_set_flash_executor(term_flashSafeExecute);
+
+  // Default terminal commands
+  term_setProtocolHandler(APP_TERMINAL_START, termProtocolStart,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK |
+                              TERM_PROTOCOL_FLAG_TRACE);
+  term_setProtocolHandler(APP_TERMINAL_KEYSTROKE, termProtocolKeystroke,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK |
+                              TERM_PROTOCOL_FLAG_TRACE);
+  term_setProtocolHandler(APP_TERMINAL_KEYSTROKES, termProtocolKeystrokes,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK |
+                              TERM_PROTOCOL_FLAG_TRACE);
+  term_setProtocolHandler(APP_TERMINAL_SET_SHARED_VARS,
+                          termProtocolSetSharedVars,
+                          TERM_PROTOCOL_FLAG_DEFERRED | TERM_PROTOCOL_FLAG_ACK |
+                              TERM_PROTOCOL_FLAG_TRACE);
 
   // Initialize the welcome messages
   term_clearScreen();
@@ -588,121 +1261,195 @@ void term_init(void) {
   display_refresh();
 }
 
-// Invoke this function to process the commands from the active loop in the
-// main function
-void __not_in_flash_func(term_loop)() {
-  TransmissionProtocol protocolSnapshot = {0};
-  bool protocolReady = false;
-  uint32_t overwriteCountSnapshot = 0;
-
-  // Minimal critical section: atomically snapshot the latest published slot.
-  // Easy to revert if we switch to a queue/ring-buffer approach later.
-  uint32_t irqState = save_and_disable_interrupts();
-  if (protocolBufferReady) {
-    uint8_t readIndex = protocolReadIndex;
-    protocolSnapshot = protocolBuffers[readIndex];
-    protocolBufferReady = false;
-    protocolReady = true;
-  }
-  overwriteCountSnapshot = protocolOverwriteCount;
-  restore_interrupts(irqState);
-
-  if (protocolReady) {
-    // Shared by all commands
-    // Read the random token from the command and increment the payload
-    // pointer to the first parameter available in the payload
-    uint32_t randomToken = TPROTO_GET_RANDOM_TOKEN(protocolSnapshot.payload);
-    uint16_t *payloadPtr = ((uint16_t *)(protocolSnapshot).payload);
-    uint16_t commandId = protocolSnapshot.command_id;
-    DPRINTF(
-        "Command ID: %d. Size: %d. Random token: 0x%08X, Checksum: 0x%04X, "
-        "Overwrites: %lu\n",
-        protocolSnapshot.command_id, protocolSnapshot.payload_size, randomToken,
-        protocolSnapshot.final_checksum,
-        (unsigned long)overwriteCountSnapshot);
-
+// Print the command and the first parameters of the payload
+static void termTraceCommand(const TransmissionProtocol *protocol) {
 #if defined(_DEBUG) && (_DEBUG != 0)
-    // Jump the random token
+  uint32_t randomToken = TPROTO_GET_RANDOM_TOKEN(protocol->payload);
+  uint16_t *payloadPtr = ((uint16_t *)protocol->payload);
+  DPRINTF(
+      "Command ID: %d. Size: %d. Random token: 0x%08X, Checksum: 0x%04X, "
+      "Drops: %lu. High water: %lu. Checksum errors: %lu\n",
+      protocol->command_id, protocol->payload_size, randomToken,
+      protocol->final_checksum, (unsigned long)protocolDropCount,
+      (unsigned long)protocolHighWater,
+      (unsigned long)protocolChecksumErrorCount);
+
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
+
+  // Read the payload parameters
+  uint16_t payloadSizeTmp = 4;
+  if ((protocol->payload_size > payloadSizeTmp) &&
+      (protocol->payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
+    DPRINTF("Payload D3: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
     TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
+  }
+  payloadSizeTmp += 4;
+  if ((protocol->payload_size > payloadSizeTmp) &&
+      (protocol->payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
+    DPRINTF("Payload D4: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
+    TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
+  }
+  payloadSizeTmp += 4;
+  if ((protocol->payload_size > payloadSizeTmp) &&
+      (protocol->payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
+    DPRINTF("Payload D5: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
+    TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
+  }
+  payloadSizeTmp += 4;
+  if ((protocol->payload_size > payloadSizeTmp) &&
+      (protocol->payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
+    DPRINTF("Payload D6: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
+    TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
+  }
+#else
+  (void)protocol;
+#endif
+}
 
-    // Read the payload parameters
-    uint16_t payloadSizeTmp = 4;
-    if ((protocolSnapshot.payload_size > payloadSizeTmp) &&
-        (protocolSnapshot.payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
-      DPRINTF("Payload D3: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
-      TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
-    }
-    payloadSizeTmp += 4;
-    if ((protocolSnapshot.payload_size > payloadSizeTmp) &&
-        (protocolSnapshot.payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
-      DPRINTF("Payload D4: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
-      TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
-    }
-    payloadSizeTmp += 4;
-    if ((protocolSnapshot.payload_size > payloadSizeTmp) &&
-        (protocolSnapshot.payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
-      DPRINTF("Payload D5: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
-      TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
-    }
-    payloadSizeTmp += 4;
-    if ((protocolSnapshot.payload_size > payloadSizeTmp) &&
-        (protocolSnapshot.payload_size <= TERM_PARAMETERS_MAX_SIZE)) {
-      DPRINTF("Payload D6: 0x%04X\n", TPROTO_GET_PAYLOAD_PARAM32(payloadPtr));
-      TPROTO_NEXT32_PAYLOAD_PTR(payloadPtr);
+static void termProtocolStart(const TransmissionProtocol *protocol) {
+  (void)protocol;
+  display_termStart(DISPLAY_TILES_WIDTH, DISPLAY_TILES_HEIGHT);
+  term_clearScreen();
+  term_printString("Type 'help' for available commands.\n");
+  termInputChar('\n');
+  SEND_COMMAND_TO_DISPLAY(DISPLAY_COMMAND_TERM);
+  DPRINTF("Send command to display: DISPLAY_COMMAND_TERM\n");
+}
+
+// Decode a key as returned by Cnecin with the shift status in conterm
+static void termKeystroke(uint32_t payload32) {
+  // Extract the ascii code from the payload lower 8 bits
+  char keystroke = (char)(payload32 & TERM_KEYBOARD_KEY_MASK);
+  // Get the shift key status from the higher byte of the payload
+  uint8_t shiftKey =
+      (payload32 & TERM_KEYBOARD_SHIFT_MASK) >> TERM_KEYBOARD_SHIFT_SHIFT;
+  // Get the keyboard scan code from the bits 16 to 23 of the payload
+  uint8_t scanCode =
+      (payload32 & TERM_KEYBOARD_SCAN_MASK) >> TERM_KEYBOARD_SCAN_SHIFT;
+  if (keystroke >= TERM_KEYBOARD_KEY_START &&
+      keystroke <= TERM_KEYBOARD_KEY_END) {
+    // Print the keystroke and the shift key status
+    DPRINTF("Keystroke: %c. Shift key: %d, Scan code: %d\n", keystroke,
+            shiftKey, scanCode);
+  } else {
+    // Print the keystroke and the shift key status
+    DPRINTF("Keystroke: %d. Shift key: %d, Scan code: %d\n", keystroke,
+            shiftKey, scanCode);
+  }
+  termInputChar(keystroke);
+}
+
+static void termProtocolKeystroke(const TransmissionProtocol *protocol) {
+  uint16_t *payload = ((uint16_t *)protocol->payload);
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  // Extract the 32 bit payload
+  termKeystroke(TPROTO_GET_PAYLOAD_PARAM32(payload));
+}
+
+static void termProtocolKeystrokes(const TransmissionProtocol *protocol) {
+  uint16_t *payload = ((uint16_t *)protocol->payload);
+  uint32_t keys =
+      (protocol->payload_size > 4) ? (protocol->payload_size - 4) / 4 : 0;
+  if (keys > TERM_KEYSTROKES_BATCH) {
+    keys = TERM_KEYSTROKES_BATCH;
+  }
+  // Jump the random token. The empty slots come first and are 0
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  for (uint32_t i = 0; i < keys; i++) {
+    uint32_t key = TPROTO_GET_PAYLOAD_PARAM32(payload);
+    TPROTO_NEXT32_PAYLOAD_PTR(payload);
+    if (key != 0) {
+      termKeystroke(key);
     }
-#endif
+  }
+}
 
-    // Handle the command
-    switch (protocolSnapshot.command_id) {
-      case APP_TERMINAL_START: {
-        display_termStart(DISPLAY_TILES_WIDTH, DISPLAY_TILES_HEIGHT);
-        term_clearScreen();
-        term_printString("Type 'help' for available commands.\n");
-        termInputChar('\n');
-        SEND_COMMAND_TO_DISPLAY(DISPLAY_COMMAND_TERM);
-        DPRINTF("Send command to display: DISPLAY_COMMAND_TERM\n");
-      } break;
-      case APP_TERMINAL_KEYSTROKE: {
-        uint16_t *payload = ((uint16_t *)(protocolSnapshot).payload);
-        // Jump the random token
-        TPROTO_NEXT32_PAYLOAD_PTR(payload);
-        // Extract the 32 bit payload
-        uint32_t payload32 = TPROTO_GET_PAYLOAD_PARAM32(payload);
-        // Extract the ascii code from the payload lower 8 bits
-        char keystroke = (char)(payload32 & TERM_KEYBOARD_KEY_MASK);
-        // Get the shift key status from the higher byte of the payload
-        uint8_t shiftKey =
-            (payload32 & TERM_KEYBOARD_SHIFT_MASK) >> TERM_KEYBOARD_SHIFT_SHIFT;
-        // Get the keyboard scan code from the bits 16 to 23 of the payload
-        uint8_t scanCode =
-            (payload32 & TERM_KEYBOARD_SCAN_MASK) >> TERM_KEYBOARD_SCAN_SHIFT;
-        if (keystroke >= TERM_KEYBOARD_KEY_START &&
-            keystroke <= TERM_KEYBOARD_KEY_END) {
-          // Print the keystroke and the shift key status
-          DPRINTF("Keystroke: %c. Shift key: %d, Scan code: %d\n", keystroke,
-                  shiftKey, scanCode);
-        } else {
-          // Print the keystroke and the shift key status
-          DPRINTF("Keystroke: %d. Shift key: %d, Scan code: %d\n", keystroke,
-                  shiftKey, scanCode);
-        }
-        termInputChar(keystroke);
-        break;
-      }
-      default:
-        // Unknown command
-        DPRINTF("Unknown command\n");
-        break;
+static void termProtocolSetSharedVars(const TransmissionProtocol *protocol) {
+  uint16_t *payload = ((uint16_t *)protocol->payload);
+  uint32_t count =
+      (protocol->payload_size > 8) ? (protocol->payload_size - 8) / 4 : 0;
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  uint32_t first = TPROTO_GET_PAYLOAD_PARAM32(payload);
+  if (first >= TERM_SHARED_BLOCK_VARS) {
+    DPRINTF("Shared block index out of range: %lu\n", (unsigned long)first);
+    return;
+  }
+  if (count > TERM_SHARED_BLOCK_VARS - first) {
+    count = TERM_SHARED_BLOCK_VARS - first;
+  }
+  memfunc_sharedBlockBegin(memorySharedBlockAddress);
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t value = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+    memfunc_sharedBlockSet(memorySharedBlockAddress, first + i, value);
+    if (first + i == TERM_SCREEN_REZ) {
+      // Only double the pixels of the display in high resolution
+      display_setHighres(value == TERM_SCREEN_REZ_HIGH);
     }
-    if (memoryRandomTokenAddress != 0) {
-      // Set the random token in the shared memory
-      TPROTO_SET_RANDOM_TOKEN(memoryRandomTokenAddress, randomToken);
-
-      // Init the random token seed in the shared memory for the next command
-      uint32_t newRandomSeedToken =
-          rand();  // Generate a new random 32-bit value
-      TPROTO_SET_RANDOM_TOKEN(memoryRandomTokenSeedAddress, newRandomSeedToken);
+  }
+  memfunc_sharedBlockEnd(memorySharedBlockAddress);
+  DPRINTF("Shared block: %lu variables from %lu\n", (unsigned long)count,
+          (unsigned long)first);
+}
+
+// Process a single command taken from the protocol ring. Returns the flags of
+// its handler, to know if and how the command must be acknowledged
+static uint8_t __not_in_flash_func(termProcessCommand)(
+    const TransmissionProtocol *protocol) {
+  const TermProtocolEntry *entry = termGetProtocolEntry(protocol->command_id);
+  if (entry == NULL) {
+    // Unknown command. Acknowledge it anyway so the remote does not stall
+    termTraceCommand(protocol);
+    DPRINTF("Unknown command\n");
+    return TERM_PROTOCOL_FLAG_ACK;
+  }
+
+  if (entry->flags & TERM_PROTOCOL_FLAG_TRACE) {
+    termTraceCommand(protocol);
+  }
+  entry->handler(protocol);
+  return entry->flags;
+}
+
+// Invoke this function to process the commands from the active loop in the
+// main function. Drains every command published since the last call.
+void __not_in_flash_func(term_loop)() {
+  uint32_t tail = protocolRingTail;
+  bool ackPending = false;
+  uint32_t ackToken = 0;
+  bool sequencePending = false;
+  uint32_t ackSequence = 0;
+  // Draw the output of all the commands with a single refresh
+  term_beginBatch();
+  while (tail != protocolRingHead) {
+    // Read the slot content only after observing the published head
+    __dmb();
+    const TransmissionProtocol *protocol =
+        &protocolRing[tail & TERM_PROTOCOL_RING_MASK];
+    uint8_t flags = termProcessCommand(protocol);
+    if ((flags & TERM_PROTOCOL_FLAG_ACK) &&
+        (flags & TERM_PROTOCOL_FLAG_PIPELINED)) {
+      ackSequence = TPROTO_GET_RANDOM_TOKEN(protocol->payload);
+      sequencePending = true;
+    } else if (flags & TERM_PROTOCOL_FLAG_ACK) {
+      ackToken = TPROTO_GET_RANDOM_TOKEN(protocol->payload);
+      ackPending = true;
     }
+    // Release the slot to the producer
+    __dmb();
+    tail++;
+    protocolRingTail = tail;
+  }
+  term_endBatch();
+
+  // A single shared memory update acknowledges the whole batch
+  if (ackPending) {
+    termAckToken(ackToken);
+  }
+  if (sequencePending) {
+    termAckSequence(ackSequence);
   }
 }
 
@@ -755,12 +1502,15 @@ void term_printNetworkInfo(void) {
 
   uint32_t sdTotalMb = 0;
   uint32_t sdFreeMb = 0;
-  if (sdcard_getMountedInfo(&sdTotalMb, &sdFreeMb)) {
+  // The free space is shown once the main loop has counted it
+  if (sdcard_getCachedInfo(&sdTotalMb, &sdFreeMb)) {
     snprintf(sdStatus, sizeof(sdStatus), "Mounted");
     snprintf(sdSpace, sizeof(sdSpace), "%lu/%lu MB free",
              (unsigned long)sdFreeMb, (unsigned long)sdTotalMb);
-  } else if (sdcard_isMounted()) {
+  } else if (sdcard_hasFreeSpaceError()) {
     snprintf(sdStatus, sizeof(sdStatus), "Error");
+  } else if (sdcard_isMounted()) {
+    snprintf(sdStatus, sizeof(sdStatus), "Mounted");
   }
 
   term_printString("Network status: ");
@@ -775,7 +1525,7 @@ void term_printNetworkInfo(void) {
     snprintf(wifiLink, sizeof(wifiLink), "%s", wifiLinkValue);
   }
 
-  SettingsConfigEntry *dhcpEntry =
+  const SettingsConfigEntry *dhcpEntry =
       settings_find_entry(gconfig_getContext(), PARAM_WIFI_DHCP);
   if ((dhcpEntry != NULL) && (dhcpEntry->value != NULL) &&
       (dhcpEntry->value[0] != '\0')) {
@@ -921,71 +1671,128 @@ static void term_appendText(char *buffer, size_t bufferSize, size_t *offset,
   *offset += writeSize;
 }
 
-static bool term_buildLiveMenuLines(char *ssidLine, size_t ssidLineSize,
-                                    char *selectLine, size_t selectLineSize,
-                                    char *sdLine, size_t sdLineSize) {
-  if ((ssidLine == NULL) || (selectLine == NULL) || (sdLine == NULL) ||
-      (ssidLineSize == 0) || (selectLineSize == 0) || (sdLineSize == 0)) {
-    return false;
-  }
-
-  char ssid[TERM_NETWORK_INFO_VALUE_SIZE] = {0};
-  char signalDb[TERM_NETWORK_INFO_VALUE_SIZE] = {0};
-  char selectState[TERM_NETWORK_INFO_VALUE_SIZE] = {0};
-  char sdStatus[TERM_NETWORK_INFO_VALUE_SIZE] = {0};
-  char sdSpace[TERM_NETWORK_INFO_VALUE_SIZE] = {0};
-
-  snprintf(ssid, sizeof(ssid), "N/A");
-  snprintf(signalDb, sizeof(signalDb), "N/A");
-  snprintf(selectState, sizeof(selectState), "%s",
-           select_detectPush() ? "Pressed" : "Released");
-  snprintf(sdStatus, sizeof(sdStatus), "Not mounted");
-  snprintf(sdSpace, sizeof(sdSpace), "N/A");
-
-  uint32_t sdTotalMb = 0;
-  uint32_t sdFreeMb = 0;
-  if (sdcard_getMountedInfo(&sdTotalMb, &sdFreeMb)) {
-    snprintf(sdStatus, sizeof(sdStatus), "Mounted");
-    snprintf(sdSpace, sizeof(sdSpace), "%lu/%lu MB free", (unsigned long)sdFreeMb,
-             (unsigned long)sdTotalMb);
-  } else if (sdcard_isMounted()) {
-    snprintf(sdStatus, sizeof(sdStatus), "Error");
-  }
-
+// Values behind the live lines of the menu. A line is formatted and drawn
+// again only when its values change
+typedef struct {
+  bool hasIp;
+  int16_t rssi;
+  char ssid[TERM_NETWORK_INFO_VALUE_SIZE];
+} TermLiveSsidValues;
+
+typedef enum {
+  TERM_LIVE_SD_NOT_MOUNTED = 0,
+  TERM_LIVE_SD_MOUNTED,
+  TERM_LIVE_SD_COUNTING,
+  TERM_LIVE_SD_ERROR
+} TermLiveSdStatus;
+
+typedef struct {
+  TermLiveSdStatus status;
+  uint32_t totalMb;
+  uint32_t freeMb;
+} TermLiveSdValues;
+
+static void term_readLiveSsidValues(TermLiveSsidValues *values) {
+  memset(values, 0, sizeof(*values));
 #if defined(CYW43_WL_GPIO_LED_PIN)
   ip_addr_t currentIp = network_getCurrentIp();
-  bool hasIp = !ip_addr_isany(&currentIp);
-  if (hasIp) {
+  values->hasIp = !ip_addr_isany(&currentIp);
+  if (values->hasIp) {
     wifi_network_info_t currentNetwork = network_getCurrentNetworkInfo();
-    if (currentNetwork.ssid[0] != '\0') {
-      snprintf(ssid, sizeof(ssid), "%s", currentNetwork.ssid);
-    }
-    if ((currentNetwork.rssi <= 0) && (currentNetwork.rssi >= -120)) {
-      snprintf(signalDb, sizeof(signalDb), "%d dBm", currentNetwork.rssi);
-    }
+    snprintf(values->ssid, sizeof(values->ssid), "%s", currentNetwork.ssid);
+    values->rssi = currentNetwork.rssi;
   }
 #endif
+}
 
-  snprintf(ssidLine, ssidLineSize, "SSID      : %s (%s)", ssid, signalDb);
-  snprintf(selectLine, selectLineSize, "SELECT  : %s", selectState);
-  snprintf(sdLine, sdLineSize, "SD card   : %s (%s)", sdStatus, sdSpace);
+// Never scans the FAT: until the main loop counts the free clusters in an
+// idle slice the space is not known
+static void term_readLiveSdValues(TermLiveSdValues *values) {
+  memset(values, 0, sizeof(*values));
+  if (sdcard_getCachedInfo(&values->totalMb, &values->freeMb)) {
+    values->status = TERM_LIVE_SD_MOUNTED;
+  } else if (sdcard_hasFreeSpaceError()) {
+    values->status = TERM_LIVE_SD_ERROR;
+  } else if (sdcard_isMounted()) {
+    values->status = TERM_LIVE_SD_COUNTING;
+  }
+}
 
-  return true;
+static void term_formatSsidLine(const TermLiveSsidValues *values, char *line,
+                                size_t lineSize) {
+  char signalDb[TERM_NETWORK_INFO_VALUE_SIZE] = {0};
+  snprintf(signalDb, sizeof(signalDb), "N/A");
+  if (values->hasIp && (values->rssi <= 0) && (values->rssi >= -120)) {
+    snprintf(signalDb, sizeof(signalDb), "%d dBm", values->rssi);
+  }
+  const char *ssid =
+      (values->hasIp && (values->ssid[0] != '\0')) ? values->ssid : "N/A";
+  snprintf(line, lineSize, "SSID      : %s (%s)", ssid, signalDb);
+}
+
+static void term_formatSdLine(const TermLiveSdValues *values, char *line,
+                              size_t lineSize) {
+  if (values->status == TERM_LIVE_SD_MOUNTED) {
+    snprintf(line, lineSize, "SD card   : Mounted (%lu/%lu MB free)",
+             (unsigned long)values->freeMb, (unsigned long)values->totalMb);
+  } else if (values->status == TERM_LIVE_SD_ERROR) {
+    snprintf(line, lineSize, "SD card   : Error (N/A)");
+  } else {
+    snprintf(line, lineSize, "SD card   : %s (N/A)",
+             (values->status == TERM_LIVE_SD_COUNTING) ? "Mounted"
+                                                       : "Not mounted");
+  }
 }
 
 void term_refreshMenuLiveInfo(void) {
   static char prevSsidLine[TERM_MENU_LIVE_LINE_MAX] = {0};
   static char prevSelectLine[TERM_MENU_LIVE_LINE_MAX] = {0};
   static char prevSdLine[TERM_MENU_LIVE_LINE_MAX] = {0};
+  static TermLiveSsidValues prevSsidValues = {0};
+  static TermLiveSdValues prevSdValues = {0};
+  static bool prevPushed = false;
+  static bool prevValuesValid = false;
 
+  if (!menuRowsValid) {
+    return;
+  }
+
+  TermLiveSsidValues ssidValues;
+  TermLiveSdValues sdValues;
+  term_readLiveSsidValues(&ssidValues);
+  term_readLiveSdValues(&sdValues);
+  bool pushed = select_detectPush();
+
+  bool ssidChanged =
+      !prevValuesValid ||
+      (memcmp(&ssidValues, &prevSsidValues, sizeof(ssidValues)) != 0);
+  bool sdChanged = !prevValuesValid ||
+                   (memcmp(&sdValues, &prevSdValues, sizeof(sdValues)) != 0);
+  bool selectChanged = !prevValuesValid || (pushed != prevPushed);
+  if (!ssidChanged && !sdChanged && !selectChanged) {
+    return;
+  }
+  prevSsidValues = ssidValues;
+  prevSdValues = sdValues;
+  prevPushed = pushed;
+  prevValuesValid = true;
+
+  // Format only the lines whose values changed
   char ssidLine[TERM_MENU_LIVE_LINE_MAX] = {0};
   char selectLine[TERM_MENU_LIVE_LINE_MAX] = {0};
   char sdLine[TERM_MENU_LIVE_LINE_MAX] = {0};
-
-  if (!menuRowsValid ||
-      !term_buildLiveMenuLines(ssidLine, sizeof(ssidLine), selectLine,
-                               sizeof(selectLine), sdLine, sizeof(sdLine))) {
-    return;
+  memcpy(ssidLine, prevSsidLine, sizeof(ssidLine));
+  memcpy(selectLine, prevSelectLine, sizeof(selectLine));
+  memcpy(sdLine, prevSdLine, sizeof(sdLine));
+  if (ssidChanged) {
+    term_formatSsidLine(&ssidValues, ssidLine, sizeof(ssidLine));
+  }
+  if (selectChanged) {
+    snprintf(selectLine, sizeof(selectLine), "SELECT  : %s",
+             pushed ? "Pressed" : "Released");
+  }
+  if (sdChanged) {
+    term_formatSdLine(&sdValues, sdLine, sizeof(sdLine));
   }
 
   bool updateSsid = (strcmp(ssidLine, prevSsidLine) != 0);
@@ -1125,14 +1932,8 @@ void term_cmdSettings(const char *arg) {
 }
 
 void term_cmdPrint(const char *arg) {
-  char *buffer = (char *)malloc(TERM_PRINT_SETTINGS_BUFFER_SIZE);
-  if (buffer == NULL) {
-    term_printString("Error: Out of memory.\n");
-    return;
-  }
-  settings_print(aconfig_getContext(), buffer);
-  term_printString(buffer);
-  free(buffer);
+  printPagerNext = 0;
+  termPrintPage();
 }
 
 void term_cmdClear(const char *arg) { term_clearScreen(); }
@@ -1159,7 +1960,7 @@ void term_cmdErase(const char *arg) {
 
 void term_cmdGet(const char *arg) {
   if (arg && strlen(arg) > 0) {
-    SettingsConfigEntry *entry =
+    const SettingsConfigEntry *entry =
         settings_find_entry(aconfig_getContext(), &arg[0]);
     if (entry != NULL) {
       TPRINTF("Key: %s\n", entry->key);
@@ -1239,6 +2040,217 @@ void term_cmdPutBool(const char *arg) {
   }
 }
 
+// Print the non empty bins of a log2 histogram
+static void termPrintHistogram(const char *title, const uint32_t *bins) {
+  TPRINTF("%s\n", title);
+  for (int i = 0; i < ROMEMUL_BUS_STATS_BINS; i++) {
+    if (bins[i] != 0) {
+      if (i == (ROMEMUL_BUS_STATS_BINS - 1)) {
+        TPRINTF("  >=%lu: %lu\n", 1ul << (i - 1), (unsigned long)bins[i]);
+      } else {
+        TPRINTF("  <%lu: %lu\n", 1ul << i, (unsigned long)bins[i]);
+      }
+    }
+  }
+}
+
+void term_cmdStats(const char *arg) {
+  if ((arg != NULL) && (strcmp(arg, "reset") == 0)) {
+    romemul_resetBusStats();
+    protocolCommandCount = 0;
+    protocolDropCount = 0;
+    protocolHighWater = 0;
+    protocolChecksumErrorCount = 0;
+    TPRINTF("Statistics reset.\n");
+    return;
+  }
+
+  TPRINTF("Commands: %lu, drops %lu, errors %lu\n",
+          (unsigned long)protocolCommandCount, (unsigned long)protocolDropCount,
+          (unsigned long)protocolChecksumErrorCount);
+  TPRINTF("Command ring high water: %lu/%d\n",
+          (unsigned long)protocolHighWater, TERM_PROTOCOL_RING_SLOTS);
+
+  RomemulBusStats stats;
+  if (romemul_getBusStats(&stats) != 0) {
+    TPRINTF("Bus stats not in this build.\n");
+    return;
+  }
+  TPRINTF("Bus IRQ samples: %lu\n", (unsigned long)stats.samples);
+  if (stats.samples > 0) {
+    uint32_t mhz = clock_get_hz(clk_sys) / 1000000;
+    TPRINTF("Latency us: %lu/%lu/%lu\n", (unsigned long)stats.latencyMinUs,
+            (unsigned long)(stats.latencySumUs / stats.samples),
+            (unsigned long)stats.latencyMaxUs);
+    TPRINTF("Handler cycles: %lu/%lu/%lu\n",
+            (unsigned long)stats.durationMinCycles,
+            (unsigned long)(stats.durationSumCycles / stats.samples),
+            (unsigned long)stats.durationMaxCycles);
+    TPRINTF("Handler max: %lu ns at %lu MHz\n",
+            (unsigned long)((stats.durationMaxCycles * 1000ull) / mhz),
+            (unsigned long)mhz);
+    termPrintHistogram("Latency histogram (us):", stats.latencyHistogram);
+    termPrintHistogram("Handler histogram (cycles):",
+                       stats.durationHistogram);
+  }
+  TPRINTF("FIFO stalls TX/RX: %lu/%lu\n", (unsigned long)stats.txStalls,
+          (unsigned long)stats.rxStalls);
+}
+
+void term_cmdBoot(const char *arg) {
+  (void)arg;
+  size_t count = boottrace_getCount();
+  if (count == 0) {
+    TPRINTF("No boot checkpoints.\n");
+    return;
+  }
+  uint64_t prevUs = 0;
+  for (size_t i = 0; i < count; i++) {
+    const BoottraceMark *mark = boottrace_get(i);
+    TPRINTF("%-10s %6lu ms +%lu\n", mark->stage,
+            (unsigned long)(mark->timeUs / 1000),
+            (unsigned long)((mark->timeUs - prevUs) / 1000));
+    prevUs = mark->timeUs;
+  }
+  int slowest = boottrace_getSlowest();
+  TPRINTF("Slowest stage: %s\n", boottrace_get((size_t)slowest)->stage);
+}
+
+static void printDownloadStats(const download_stats_t *stats) {
+  uint32_t done = stats->resumeOffset + stats->receivedBytes;
+  if (stats->totalBytes > 0) {
+    uint32_t total = stats->resumeOffset + stats->totalBytes;
+    TPRINTF("Progress: %lu/%lu bytes (%lu%%)\n", (unsigned long)done,
+            (unsigned long)total,
+            (unsigned long)(((uint64_t)done * 100) / total));
+  } else {
+    TPRINTF("Progress: %lu bytes\n", (unsigned long)done);
+  }
+  if (stats->resumeOffset > 0) {
+    TPRINTF("Resumed at: %lu bytes\n", (unsigned long)stats->resumeOffset);
+  }
+  TPRINTF("Speed: %lu KB/s now, %lu KB/s average\n",
+          (unsigned long)stats->instantKbps, (unsigned long)stats->averageKbps);
+  TPRINTF("Time: %lu ms%s\n", (unsigned long)(stats->elapsedUs / 1000),
+          stats->running ? " (running)" : "");
+  TPRINTF("Writes: %lu in %lu ms\n", (unsigned long)stats->writeCount,
+          (unsigned long)(stats->writeUs / 1000));
+  TPRINTF("Network wait: %lu ms\n", (unsigned long)(stats->networkUs / 1000));
+  TPRINTF("Response: %lu ms\n", (unsigned long)(stats->responseUs / 1000));
+  if (stats->tlsHeapPeak > 0) {
+    TPRINTF("TLS heap peak: %lu bytes\n", (unsigned long)stats->tlsHeapPeak);
+  }
+}
+
+// The benchmark ends after the prompt of its command
+static void benchmarkDone(download_err_t err, const download_stats_t *stats) {
+  term_printString("\n");
+  if (err != DOWNLOAD_OK) {
+    TPRINTF("Download error: %d\n", err);
+  }
+  printDownloadStats(stats);
+  term_printString("> ");
+  termRefresh();
+}
+
+void term_cmdDownload(const char *arg) {
+  download_stats_t stats = {0};
+  if ((arg != NULL) && (strncmp(arg, "bench ", 6) == 0)) {
+    const char *url = arg + 6;
+    TPRINTF("Downloading %s...\n", url);
+    download_err_t err = download_benchmark(url, benchmarkDone);
+    if (err != DOWNLOAD_OK) {
+      TPRINTF("Download error: %d\n", err);
+    }
+    return;
+  }
+  if ((arg == NULL) || (strcmp(arg, "stats") != 0)) {
+    TPRINTF("Usage: download stats | download bench <url>\n");
+    return;
+  }
+  download_getStats(&stats);
+  if (stats.startUs == 0) {
+    TPRINTF("No download yet.\n");
+    return;
+  }
+  printDownloadStats(&stats);
+}
+
+void term_cmdNet(const char *arg) {
+  (void)arg;
+  network_telemetry_t t;
+  network_getTelemetry(&t);
+  if (t.rssiSamples > 0) {
+    TPRINTF("RSSI: %d dBm, %d/%d/%d min/avg/max, trend %+d dB\n", t.rssi,
+            t.rssiMin, t.rssiAvg, t.rssiMax, t.rssiTrend);
+  } else {
+    TPRINTF("RSSI: no samples\n");
+  }
+  TPRINTF("Link down: %lu, connect attempts: %lu\n",
+          (unsigned long)t.linkDownCount, (unsigned long)t.connectAttempts);
+  if (!t.lwipStats) {
+    TPRINTF("lwIP stats not in this build.\n");
+    return;
+  }
+  TPRINTF("TCP segments: %lu sent, %lu again, %lu bad\n",
+          (unsigned long)t.tcpOutSegs, (unsigned long)t.tcpRetransSegs,
+          (unsigned long)t.tcpInErrors);
+  TPRINTF("Pbuf pool: %u used, %u max, %lu empty\n", t.pbufPoolUsed,
+          t.pbufPoolMax, (unsigned long)t.pbufPoolErrors);
+  TPRINTF("Alloc failures: %lu pools, %lu heap\n",
+          (unsigned long)t.mempErrors, (unsigned long)t.memErrors);
+}
+
+void term_cmdScan(const char *arg) {
+  (void)arg;
+  wifi_scan_data_t *scan = network_getFoundNetworks();
+  uint32_t ageMs = network_scanAgeMs();
+  if (scan->count == 0) {
+    if (network_scanIsActive()) {
+      TPRINTF("Scanning...\n");
+    } else {
+      TPRINTF("No networks found.\n");
+    }
+    return;
+  }
+  for (int i = 0; i < scan->count; i++) {
+    const wifi_network_info_t *network = &scan->networks[i];
+    TPRINTF("%4d %s %s\n", network->rssi, network->bssid, network->ssid);
+  }
+  if (ageMs == UINT32_MAX) {
+    TPRINTF("%d networks, scan in progress.\n", scan->count);
+  } else {
+    TPRINTF("%d networks, %lu s ago.\n", scan->count,
+            (unsigned long)(ageMs / 1000));
+  }
+}
+
+void term_publishBoot(void) {
+#if BOOTTRACE_SHARED_SUMMARY == 1
+  size_t count = boottrace_getCount();
+  if (count == 0) {
+    return;
+  }
+  const BoottraceMark *last = boottrace_get(count - 1);
+  uint32_t bootMs = (uint32_t)(last->timeUs / 1000);
+  int slowest = boottrace_getSlowest();
+  const BoottraceMark *mark = boottrace_get((size_t)slowest);
+  uint64_t startUs =
+      (slowest > 0) ? boottrace_get((size_t)slowest - 1)->timeUs : 0;
+  uint32_t slowestMs = (uint32_t)((mark->timeUs - startUs) / 1000);
+  if (slowestMs > 0xFFFF) {
+    slowestMs = 0xFFFF;
+  }
+  SET_SHARED_VAR(TERM_BOOT_TIME_MS, bootMs, memorySharedAddress,
+                 TERM_SHARED_VARIABLES_OFFSET);
+  SET_SHARED_VAR(TERM_BOOT_SLOWEST, ((uint32_t)slowest << 16) | slowestMs,
+                 memorySharedAddress, TERM_SHARED_VARIABLES_OFFSET);
+  const uint32_t boot[] = {bootMs, ((uint32_t)slowest << 16) | slowestMs};
+  memfunc_sharedBlockWrite(memorySharedBlockAddress, TERM_BOOT_TIME_INDEX, boot,
+                           2);
+#endif
+}
+
 void term_cmdPutString(const char *arg) {
   char key[SETTINGS_MAX_KEY_LENGTH] = {0};
   const char *value = NULL;
@@ -1,6 +1,308 @@
 #include "tprotocol.h"
 
+#include "memfunc.h"
+
 uint32_t tprotocol_last_header_found = 0;
 uint32_t tprotocol_new_header_found = 0;
 TPParseStep tprotocol_nextTPstep = HEADER_DETECTION;
-TransmissionProtocol tprotocol_transmission = {0};
+bool tprotocol_wordTimeSet = false;
+uint32_t tprotocol_wordTime = 0;
+
+// Used when the consumer does not provide its own buffers
+static TransmissionProtocol tprotocol_defaultTransmission = {0};
+TransmissionProtocol *tprotocol_transmission = &tprotocol_defaultTransmission;
+
+void __not_in_flash_func(tprotocol_setTarget)(TransmissionProtocol *target) {
+  tprotocol_transmission =
+      (target != NULL) ? target : &tprotocol_defaultTransmission;
+}
+
+// Steps of tprotocol_parseFast
+static void __not_in_flash_func(tprotocol_stepCommand)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback);
+static void __not_in_flash_func(tprotocol_stepPayloadSize)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback);
+static void __not_in_flash_func(tprotocol_stepPayload)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback);
+static void __not_in_flash_func(tprotocol_stepChecksum)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback);
+
+TPStepHandler tprotocol_step = tprotocol_stepHeader;
+
+// A header inside a command older than PROTOCOL_READ_RESTART_MICROSECONDS
+// starts a new command: the previous one was cut. Only headers read the time
+static inline bool __not_in_flash_func(tprotocol_restartStale)(uint16_t data) {
+  if (__builtin_expect(data != PROTOCOL_HEADER, 1)) {
+    return false;
+  }
+  tprotocol_new_header_found = tprotocol_getWordTime();
+  if (tprotocol_new_header_found - tprotocol_last_header_found <=
+      PROTOCOL_READ_RESTART_MICROSECONDS) {
+    return false;
+  }
+  tprotocol_last_header_found = tprotocol_new_header_found;
+  detect_header(data);
+  tprotocol_step = tprotocol_stepCommand;
+  return true;
+}
+
+void __not_in_flash_func(tprotocol_stepHeader)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback) {
+  (void)callback;
+  (void)protocolChecksumErrorCallback;
+  if (data == PROTOCOL_HEADER) {
+    tprotocol_last_header_found = tprotocol_getWordTime();
+    detect_header(data);
+    tprotocol_step = tprotocol_stepCommand;
+  }
+}
+
+static void __not_in_flash_func(tprotocol_stepCommand)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback) {
+  (void)callback;
+  (void)protocolChecksumErrorCallback;
+  if (tprotocol_restartStale(data)) {
+    return;
+  }
+  read_command(data);
+  tprotocol_step = tprotocol_stepPayloadSize;
+}
+
+static void __not_in_flash_func(tprotocol_stepPayloadSize)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback) {
+  (void)callback;
+  (void)protocolChecksumErrorCallback;
+  if (tprotocol_restartStale(data)) {
+    return;
+  }
+  read_payload_size(data);
+  switch (tprotocol_nextTPstep) {
+    case PAYLOAD_READ_START:
+      tprotocol_step = tprotocol_stepPayload;
+      break;
+    case PAYLOAD_READ_END:
+      tprotocol_step = tprotocol_stepChecksum;
+      break;
+    default:
+      // Too large, wait for the next header
+      tprotocol_step = tprotocol_stepHeader;
+      break;
+  }
+}
+
+// The hot step: most of the words of a command are payload
+static void __not_in_flash_func(tprotocol_stepPayload)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback) {
+  (void)callback;
+  (void)protocolChecksumErrorCallback;
+  if (tprotocol_restartStale(data)) {
+    return;
+  }
+  TransmissionProtocol *transmission = tprotocol_transmission;
+  store_payload_16_asm(data,
+                       &transmission->payload[transmission->bytes_read]);
+  transmission->final_checksum += data;
+  transmission->bytes_read += 2;
+  if (transmission->bytes_read >= transmission->payload_size) {
+    tprotocol_nextTPstep = PAYLOAD_READ_END;
+    tprotocol_step = tprotocol_stepChecksum;
+  }
+}
+
+static void __not_in_flash_func(tprotocol_stepChecksum)(
+    uint16_t data, ProtocolCallback callback,
+    ProtocolChecksumErrorCallback protocolChecksumErrorCallback) {
+  if (tprotocol_restartStale(data)) {
+    return;
+  }
+  // "data" is the checksum. Both paths go back to tprotocol_stepHeader
+  if (data == tprotocol_transmission->final_checksum) {
+    process_command(callback);
+  } else {
+    protocolChecksumErrorCallback(tprotocol_transmission);
+    tprotocol_resetParserState();
+  }
+}
+
+// CRC16-CCITT (poly 0x1021) lookup table
+static const uint16_t tprotocol_crc16Table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+uint16_t tprotocol_crc16(uint16_t crc, const uint8_t *data, size_t length) {
+  while (length--) {
+    crc = (uint16_t)((crc << 8) ^
+                     tprotocol_crc16Table[((crc >> 8) ^ *data++) & 0xFF]);
+  }
+  return crc;
+}
+
+void tprotocol_bulkBegin(TransmissionBulk *bulk, uint8_t *window,
+                         uint32_t windowSize, uint16_t transferId,
+                         uint32_t totalSize) {
+  bulk->window = window;
+  bulk->windowSize = windowSize;
+  bulk->windowFill = 0;
+  bulk->totalSize = totalSize;
+  bulk->received = 0;
+  bulk->crc = TPROTO_CRC16_INIT;
+  bulk->transferId = transferId;
+  bulk->nextFrame = 0;
+}
+
+tprotocol_bulk_status_t tprotocol_bulkFrame(
+    TransmissionBulk *bulk, const TransmissionProtocol *protocol) {
+  uint16_t *payload = (uint16_t *)protocol->payload;
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  uint32_t ids = TPROTO_GET_PAYLOAD_PARAM32(payload);
+  uint32_t offset = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+  uint32_t lengthCrc = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+
+  uint16_t transferId = (uint16_t)(ids & 0xFFFF);
+  uint16_t frameIndex = (uint16_t)(ids >> 16);
+  uint32_t length = lengthCrc & 0xFFFF;
+  uint16_t frameCrc = (uint16_t)(lengthCrc >> 16);
+
+  if (transferId != bulk->transferId) {
+    return TPROTO_BULK_ERR_SEQUENCE;
+  }
+  // The remote computer retries a frame if it missed the acknowledge
+  if ((bulk->nextFrame > 0) &&
+      (frameIndex == (uint16_t)(bulk->nextFrame - 1)) &&
+      (frameCrc == bulk->crc)) {
+    return TPROTO_BULK_DUPLICATE;
+  }
+  if ((frameIndex != bulk->nextFrame) || (offset != bulk->received)) {
+    return TPROTO_BULK_ERR_SEQUENCE;
+  }
+  if ((length > TPROTO_BULK_MAX_FRAME_DATA) ||
+      (length + TPROTO_BULK_HEADER_SIZE > protocol->payload_size) ||
+      (length > bulk->totalSize - bulk->received)) {
+    return TPROTO_BULK_ERR_OVERFLOW;
+  }
+
+  // A full window was handed to the caller in the previous call
+  if (bulk->windowFill >= bulk->windowSize) {
+    bulk->windowFill = 0;
+  }
+  if (bulk->windowFill + length > bulk->windowSize) {
+    return TPROTO_BULK_ERR_OVERFLOW;
+  }
+
+  // Words arrive with the remote high byte in the upper half. Restore the
+  // remote byte order while copying and feed the CRC in that order
+  uint8_t *dest = &bulk->window[bulk->windowFill];
+  uint16_t crc = bulk->crc;
+  for (uint32_t i = 0; i < length; i += 2) {
+    uint16_t word = *payload++;
+    dest[i] = (uint8_t)(word >> 8);
+    crc = (uint16_t)((crc << 8) ^
+                     tprotocol_crc16Table[((crc >> 8) ^ dest[i]) & 0xFF]);
+    if (i + 1 < length) {
+      dest[i + 1] = (uint8_t)(word & 0xFF);
+      crc = (uint16_t)((crc << 8) ^
+                       tprotocol_crc16Table[((crc >> 8) ^ dest[i + 1]) & 0xFF]);
+    }
+  }
+  if (crc != frameCrc) {
+    return TPROTO_BULK_ERR_CRC;
+  }
+
+  bulk->crc = crc;
+  bulk->windowFill += length;
+  bulk->received += length;
+  bulk->nextFrame++;
+
+  if (bulk->received >= bulk->totalSize) {
+    return TPROTO_BULK_COMPLETE;
+  }
+  if (bulk->windowFill >= bulk->windowSize) {
+    return TPROTO_BULK_WINDOW_FULL;
+  }
+  return TPROTO_BULK_IN_PROGRESS;
+}
+
+void tprotocol_readRequest(const TransmissionProtocol *protocol,
+                           TransmissionRead *read) {
+  uint16_t *payload = (uint16_t *)protocol->payload;
+  // Jump the random token
+  TPROTO_NEXT32_PAYLOAD_PTR(payload);
+  read->position = TPROTO_GET_PAYLOAD_PARAM32(payload);
+  read->length = TPROTO_GET_NEXT32_PAYLOAD_PARAM32(payload);
+  if (read->length > TPROTO_READ_MAX_SIZE) {
+    read->length = TPROTO_READ_MAX_SIZE;
+  }
+}
+
+// The read window in the ROM4 image. The linker symbol is a single word, so
+// the address is computed as an integer, like the terminal shared memory
+static inline uint8_t *tprotocol_readWindow(void) {
+  return (uint8_t *)((uintptr_t)&__rom_in_ram_start__ +
+                     TPROTO_READ_WINDOW_OFFSET);
+}
+
+uint8_t *tprotocol_readData(void) {
+  return tprotocol_readWindow() + TPROTO_READ_HEADER_SIZE;
+}
+
+uint32_t tprotocol_readPublish(uint32_t length) {
+  if (length > TPROTO_READ_MAX_SIZE) {
+    length = TPROTO_READ_MAX_SIZE;
+  }
+  uint8_t *window = tprotocol_readWindow();
+  CHANGE_ENDIANESS_BLOCK16(tprotocol_readData(), (length + 1) & ~1u);
+  // The remote computer reads the size only after the random token
+  WRITE_AND_SWAP_LONGWORD(window, 0, length);
+  return length;
+}
+
+uint32_t tprotocol_readFill(const void *data, uint32_t length) {
+  if (length > TPROTO_READ_MAX_SIZE) {
+    length = TPROTO_READ_MAX_SIZE;
+  }
+  uint8_t *window = tprotocol_readWindow();
+  COPY_AND_SWAP_16BIT_DMA(tprotocol_readData(), data, length);
+  WRITE_AND_SWAP_LONGWORD(window, 0, length);
+  return length;
+}
@@ -0,0 +1,481 @@
+/**
+ * File: upload.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: HTTP server of the uploads to the SD card
+ */
+
+#include "upload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "aconfig.h"
+#include "ff.h"
+#include "lwip/tcp.h"
+#include "network.h"
+#include "pico/cyw43_arch.h"
+#include "pico/time.h"
+#include "sdcard.h"
+
+#if UPLOAD_STAGING_SIZE > (TCP_WND - TCP_MSS)
+#error "UPLOAD_STAGING_SIZE must leave room for a segment in TCP_WND"
+#endif
+
+#if (UPLOAD_STAGING_SIZE % FF_MIN_SS) != 0
+#error "UPLOAD_STAGING_SIZE must be a multiple of the sector size"
+#endif
+
+typedef enum {
+  UPLOAD_STATE_IDLE,
+  UPLOAD_STATE_HEADERS,
+  UPLOAD_STATE_BODY
+} upload_state_t;
+
+static struct tcp_pcb *listenPcb = NULL;
+static struct tcp_pcb *clientPcb = NULL;
+static upload_state_t state = UPLOAD_STATE_IDLE;
+static int idlePolls = 0;
+
+// Request line and headers, received until the empty line
+static char header[UPLOAD_HEADER_SIZE + 1];
+static size_t headerLength = 0;
+
+static FIL file;
+static bool fileOpen = false;
+static char tmpPath[UPLOAD_PATH_SIZE];
+static char targetPath[UPLOAD_PATH_SIZE];
+static uint32_t contentLength = 0;
+static uint32_t receivedLength = 0;
+static uint32_t startUs = 0;
+
+// Received data not written to the file yet
+static uint8_t stagingBuffer[UPLOAD_STAGING_SIZE] __attribute__((aligned(4)));
+static size_t stagingLength = 0;
+// Bytes received and not acknowledged to TCP yet
+static size_t unackedLength = 0;
+
+static const char *reasonPhrase(int status) {
+  switch (status) {
+    case 100:
+      return "Continue";
+    case 200:
+      return "OK";
+    case 201:
+      return "Created";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 408:
+      return "Request Timeout";
+    case 411:
+      return "Length Required";
+    case 431:
+      return "Request Header Fields Too Large";
+    case 503:
+      return "Service Unavailable";
+    case 507:
+      return "Insufficient Storage";
+    default:
+      return "Internal Server Error";
+  }
+}
+
+// Send an answer, with a JSON body or none. An interim answer has no
+// headers, the final one closes the connection
+static void sendResponse(struct tcp_pcb *pcb, int status, const char *body) {
+  char response[160];
+  size_t bodyLength = (body != NULL) ? strlen(body) : 0;
+  int len;
+  if (status == 100) {
+    len = snprintf(response, sizeof(response), "HTTP/1.1 100 %s\r\n\r\n",
+                   reasonPhrase(status));
+  } else {
+    len = snprintf(response, sizeof(response),
+                   "HTTP/1.1 %d %s\r\n%sContent-Length: %u\r\n"
+                   "Connection: close\r\n\r\n",
+                   status, reasonPhrase(status),
+                   (body != NULL) ? "Content-Type: application/json\r\n" : "",
+                   (unsigned)bodyLength);
+  }
+  tcp_write(pcb, response, (u16_t)len, TCP_WRITE_FLAG_COPY);
+  if (bodyLength > 0) {
+    tcp_write(pcb, body, (u16_t)bodyLength, TCP_WRITE_FLAG_COPY);
+  }
+  tcp_output(pcb);
+}
+
+// Close the file of an upload that did not complete and delete it
+static void discardFile(void) {
+  if (fileOpen) {
+    f_close(&file);
+    fileOpen = false;
+    f_unlink(tmpPath);
+  }
+}
+
+// Back to the idle power mode once the body of an upload is over
+static void endTransfer(void) {
+  if (state == UPLOAD_STATE_BODY) {
+    network_activityEnd();
+  }
+  clientPcb = NULL;
+  state = UPLOAD_STATE_IDLE;
+}
+
+static err_t closeClient(struct tcp_pcb *pcb) {
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_err(pcb, NULL);
+  tcp_poll(pcb, NULL, 0);
+  endTransfer();
+  if (tcp_close(pcb) != ERR_OK) {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+  return ERR_OK;
+}
+
+static err_t failUpload(struct tcp_pcb *pcb, int status) {
+  DPRINTF("Upload failed: %d %s\n", status, reasonPhrase(status));
+  discardFile();
+  sendResponse(pcb, status, NULL);
+  return closeClient(pcb);
+}
+
+// Value of a header, case insensitive. NULL if it is not in the request
+static const char *findHeader(const char *name) {
+  size_t nameLength = strlen(name);
+  const char *line = strstr(header, "\r\n");
+  while ((line != NULL) && (line[2] != '\r')) {
+    line += 2;
+    if ((strncasecmp(line, name, nameLength) == 0) &&
+        (line[nameLength] == ':')) {
+      const char *value = line + nameLength + 1;
+      while (*value == ' ') {
+        value++;
+      }
+      return value;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return NULL;
+}
+
+// Copy the file name of the request line. Only a name in the app folder is
+// accepted, without folders
+static bool parseName(const char *path, char *name) {
+  if (*path != '/') {
+    return false;
+  }
+  path++;
+  size_t len = strcspn(path, " ?");
+  if ((len == 0) || (len >= UPLOAD_NAME_SIZE) || (path[len] != ' ')) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if ((path[i] <= ' ') || (path[i] == '/') || (path[i] == '\\') ||
+        (path[i] == '%')) {
+      return false;
+    }
+  }
+  memcpy(name, path, len);
+  name[len] = '\0';
+  return (strcmp(name, ".") != 0) && (strcmp(name, "..") != 0) &&
+         (strcmp(name, UPLOAD_TMP_FILE) != 0);
+}
+
+// Answer "GET /telemetry" with the network health snapshot
+static err_t answerGet(struct tcp_pcb *pcb) {
+  char body[UPLOAD_TELEMETRY_SIZE];
+  if ((strncmp(header, "GET /telemetry ", 15) != 0) ||
+      (network_formatTelemetryJson(body, sizeof(body)) < 0)) {
+    return failUpload(pcb, 404);
+  }
+  sendResponse(pcb, 200, body);
+  return closeClient(pcb);
+}
+
+// Check the request and open the file. Returns 0, or the status of the error
+static int startUpload(struct tcp_pcb *pcb) {
+  const char *path = NULL;
+  if (strncmp(header, "PUT ", 4) == 0) {
+    path = header + 4;
+  } else if (strncmp(header, "POST ", 5) == 0) {
+    path = header + 5;
+  } else {
+    return 405;
+  }
+  char name[UPLOAD_NAME_SIZE];
+  if (!parseName(path, name)) {
+    return 400;
+  }
+  const char *length = findHeader("Content-Length");
+  if ((findHeader("Transfer-Encoding") != NULL) || (length == NULL)) {
+    return 411;
+  }
+  char *end = NULL;
+  unsigned long value = strtoul(length, &end, 10);
+  if ((end == length) || ((*end != '\r') && (*end != ' '))) {
+    return 400;
+  }
+  contentLength = (uint32_t)value;
+
+  // The free space is known without a FAT scan once it was counted
+  uint32_t totalSizeMb = 0;
+  uint32_t freeSpaceMb = 0;
+  if (sdcard_getCachedInfo(&totalSizeMb, &freeSpaceMb) &&
+      ((contentLength >> 20) >= freeSpaceMb)) {
+    return 507;
+  }
+
+  const SettingsConfigEntry *folder =
+      settings_find_entry(aconfig_getContext(), ACONFIG_PARAM_FOLDER);
+  if (folder == NULL) {
+    return 500;
+  }
+  snprintf(tmpPath, sizeof(tmpPath), "%s/%s", folder->value, UPLOAD_TMP_FILE);
+  snprintf(targetPath, sizeof(targetPath), "%s/%s", folder->value, name);
+  FRESULT res = f_open(&file, tmpPath, FA_WRITE | FA_CREATE_ALWAYS);
+  if (res != FR_OK) {
+    DPRINTF("Error opening file %s: %i\n", tmpPath, res);
+    return 500;
+  }
+  fileOpen = true;
+  // Allocate the clusters now, so the writes do not walk the FAT
+  if (contentLength > 0) {
+    f_lseek(&file, contentLength);
+    f_lseek(&file, 0);
+  }
+
+  // curl waits for this before it sends a large body
+  const char *expect = findHeader("Expect");
+  if ((expect != NULL) && (strncasecmp(expect, "100-continue", 12) == 0)) {
+    sendResponse(pcb, 100, NULL);
+  }
+  receivedLength = 0;
+  stagingLength = 0;
+  startUs = time_us_32();
+  DPRINTF("Uploading %lu bytes to %s\n", (unsigned long)contentLength,
+          targetPath);
+  return 0;
+}
+
+// Write the staged data to the file. Returns false on error
+static bool flushStaging(void) {
+  if (stagingLength == 0) {
+    return true;
+  }
+  UINT bytesWritten = 0;
+  FRESULT res = f_write(&file, stagingBuffer, stagingLength, &bytesWritten);
+  if ((res != FR_OK) || (bytesWritten != stagingLength)) {
+    DPRINTF("Error writing to file: %i\n", res);
+    return false;
+  }
+  stagingLength = 0;
+  return true;
+}
+
+// Stage the body. The bytes after Content-Length are ignored
+static bool stageBody(const uint8_t *payload, size_t length, bool *flushed) {
+  if (length > contentLength - receivedLength) {
+    length = contentLength - receivedLength;
+  }
+  receivedLength += length;
+  while (length > 0) {
+    size_t chunk = UPLOAD_STAGING_SIZE - stagingLength;
+    if (chunk > length) {
+      chunk = length;
+    }
+    memcpy(&stagingBuffer[stagingLength], payload, chunk);
+    stagingLength += chunk;
+    payload += chunk;
+    length -= chunk;
+    if (stagingLength == UPLOAD_STAGING_SIZE) {
+      if (!flushStaging()) {
+        return false;
+      }
+      *flushed = true;
+    }
+  }
+  return true;
+}
+
+// Write the rest of the file and give it its name
+static err_t finishUpload(struct tcp_pcb *pcb) {
+  if (!flushStaging()) {
+    return failUpload(pcb, 500);
+  }
+  fileOpen = false;
+  FRESULT res = f_close(&file);
+  if (res == FR_OK) {
+    f_unlink(targetPath);
+    res = f_rename(tmpPath, targetPath);
+  }
+  if (res != FR_OK) {
+    DPRINTF("Error saving %s: %i\n", targetPath, res);
+    f_unlink(tmpPath);
+    return failUpload(pcb, 500);
+  }
+  uint32_t elapsedUs = time_us_32() - startUs;
+  DPRINTF("Uploaded %lu bytes in %lu ms\n", (unsigned long)receivedLength,
+          (unsigned long)(elapsedUs / 1000));
+  sendResponse(pcb, 201, NULL);
+  return closeClient(pcb);
+}
+
+static err_t uploadRecv(void *arg, struct tcp_pcb *pcb, struct pbuf *p,
+                        err_t err) {
+  (void)arg;
+  if (p == NULL) {
+    // Closed by the client
+    if (state == UPLOAD_STATE_BODY) {
+      DPRINTF("Upload cut at %lu of %lu bytes\n", (unsigned long)receivedLength,
+              (unsigned long)contentLength);
+      discardFile();
+    }
+    return closeClient(pcb);
+  }
+  if (err != ERR_OK) {
+    pbuf_free(p);
+    return err;
+  }
+  idlePolls = 0;
+  unackedLength += p->tot_len;
+
+  // Gather the headers. The bytes after the empty line are the body
+  u16_t offset = 0;
+  if (state == UPLOAD_STATE_HEADERS) {
+    size_t copied = pbuf_copy_partial(
+        p, &header[headerLength], UPLOAD_HEADER_SIZE - headerLength, 0);
+    header[headerLength + copied] = '\0';
+    const char *end = strstr(header, "\r\n\r\n");
+    if (end == NULL) {
+      headerLength += copied;
+      pbuf_free(p);
+      if (headerLength == UPLOAD_HEADER_SIZE) {
+        return failUpload(pcb, 431);
+      }
+      tcp_recved(pcb, (u16_t)unackedLength);
+      unackedLength = 0;
+      return ERR_OK;
+    }
+    offset = (u16_t)((size_t)(end + 4 - header) - headerLength);
+    if (strncmp(header, "GET ", 4) == 0) {
+      pbuf_free(p);
+      tcp_recved(pcb, (u16_t)unackedLength);
+      return answerGet(pcb);
+    }
+    int status = startUpload(pcb);
+    if (status != 0) {
+      pbuf_free(p);
+      return failUpload(pcb, status);
+    }
+    state = UPLOAD_STATE_BODY;
+    network_activityBegin();
+    tcp_recved(pcb, (u16_t)(unackedLength - (p->tot_len - offset)));
+    unackedLength = p->tot_len - offset;
+  }
+
+  // Stage the payload of each pbuf of the chain, as the downloads do
+  bool flushed = false;
+  for (struct pbuf *q = p; q != NULL; q = q->next) {
+    if (offset >= q->len) {
+      offset -= q->len;
+      continue;
+    }
+    if (!stageBody((const uint8_t *)q->payload + offset, q->len - offset,
+                   &flushed)) {
+      pbuf_free(p);
+      return failUpload(pcb, 500);
+    }
+    offset = 0;
+  }
+  pbuf_free(p);
+
+  if (receivedLength == contentLength) {
+    return finishUpload(pcb);
+  }
+  // Acknowledge the data once it is written, which opens the window again
+  if (flushed) {
+    tcp_recved(pcb, (u16_t)(unackedLength - stagingLength));
+    unackedLength = stagingLength;
+  }
+  return ERR_OK;
+}
+
+static void uploadErr(void *arg, err_t err) {
+  (void)arg;
+  // lwIP has freed the connection already
+  DPRINTF("Upload connection error: %d\n", err);
+  discardFile();
+  endTransfer();
+}
+
+static err_t uploadPoll(void *arg, struct tcp_pcb *pcb) {
+  (void)arg;
+  if (++idlePolls > UPLOAD_IDLE_POLLS) {
+    return failUpload(pcb, 408);
+  }
+  return ERR_OK;
+}
+
+static err_t uploadAccept(void *arg, struct tcp_pcb *pcb, err_t err) {
+  (void)arg;
+  if ((err != ERR_OK) || (pcb == NULL)) {
+    return ERR_VAL;
+  }
+  if (clientPcb != NULL) {
+    sendResponse(pcb, 503, NULL);
+    if (tcp_close(pcb) != ERR_OK) {
+      tcp_abort(pcb);
+      return ERR_ABRT;
+    }
+    return ERR_OK;
+  }
+  clientPcb = pcb;
+  state = UPLOAD_STATE_HEADERS;
+  headerLength = 0;
+  unackedLength = 0;
+  idlePolls = 0;
+  tcp_recv(pcb, uploadRecv);
+  tcp_err(pcb, uploadErr);
+  tcp_poll(pcb, uploadPoll, 1);
+  return ERR_OK;
+}
+
+int upload_init(void) {
+  if (listenPcb != NULL) {
+    return 0;
+  }
+  cyw43_arch_lwip_begin();
+  struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+  if ((pcb == NULL) || (tcp_bind(pcb, IP_ANY_TYPE, UPLOAD_PORT) != ERR_OK)) {
+    if (pcb != NULL) {
+      tcp_close(pcb);
+    }
+    cyw43_arch_lwip_end();
+    DPRINTF("Error binding the upload server to port %d\n", UPLOAD_PORT);
+    return -1;
+  }
+  listenPcb = tcp_listen_with_backlog(pcb, 1);
+  if (listenPcb == NULL) {
+    tcp_close(pcb);
+  } else {
+    tcp_accept(listenPcb, uploadAccept);
+  }
+  cyw43_arch_lwip_end();
+  if (listenPcb == NULL) {
+    return -1;
+  }
+  DPRINTF("Upload server listening on port %d\n", UPLOAD_PORT);
+  return 0;
+}
+
+bool upload_isActive(void) { return state != UPLOAD_STATE_IDLE; }
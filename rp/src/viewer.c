@@ -0,0 +1,183 @@
+/**
+ * File: viewer.c
+ * Author: Diego Parrilla Santamaría
+ * Date: February 2026
+ * Copyright: 2026 - GOODDATA LABS SL
+ * Description: Network viewer of the framebuffer
+ */
+
+#include "viewer.h"
+
+#include <string.h>
+
+#include "lwip/tcp.h"
+#include "pico/cyw43_arch.h"
+
+#if VIEWER_ROW_MAX_BYTES > TCP_SND_BUF
+#error "A row of the viewer must fit in TCP_SND_BUF"
+#endif
+
+static struct tcp_pcb *listenPcb = NULL;
+static struct tcp_pcb *clientPcb = NULL;
+// Rows to send to the client, and rows sent since the last frame end
+static uint32_t pendingRows = 0;
+static bool frameOpen = false;
+
+static uint8_t rowMessage[VIEWER_ROW_MAX_BYTES];
+
+// PackBits: a count n up to 127 is followed by n + 1 literal bytes, and a
+// count n from 129 by a byte repeated 257 - n times
+static size_t packRow(const uint8_t *src, size_t length, uint8_t *dest) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < length) {
+    size_t run = 1;
+    while ((in + run < length) && (run < 128) && (src[in + run] == src[in])) {
+      run++;
+    }
+    if (run >= 3) {
+      dest[out++] = (uint8_t)(257 - run);
+      dest[out++] = src[in];
+      in += run;
+      continue;
+    }
+    // The literal bytes go up to the next run of three
+    size_t start = in;
+    while ((in < length) && (in - start < 128)) {
+      if ((in + 2 < length) && (src[in] == src[in + 1]) &&
+          (src[in] == src[in + 2])) {
+        break;
+      }
+      in++;
+    }
+    dest[out++] = (uint8_t)(in - start - 1);
+    memcpy(&dest[out], &src[start], in - start);
+    out += in - start;
+  }
+  return out;
+}
+
+static bool sendMessage(int row, size_t dataLength) {
+  rowMessage[0] = (uint8_t)row;
+  rowMessage[1] = (uint8_t)(dataLength & 0xFF);
+  rowMessage[2] = (uint8_t)(dataLength >> 8);
+  return tcp_write(clientPcb, rowMessage, (u16_t)(3 + dataLength),
+                   TCP_WRITE_FLAG_COPY) == ERR_OK;
+}
+
+// ERR_ABRT if the connection was aborted, to return from the callbacks
+static err_t closeClient(struct tcp_pcb *pcb) {
+  tcp_arg(pcb, NULL);
+  tcp_recv(pcb, NULL);
+  tcp_err(pcb, NULL);
+  clientPcb = NULL;
+  if (tcp_close(pcb) != ERR_OK) {
+    tcp_abort(pcb);
+    return ERR_ABRT;
+  }
+  return ERR_OK;
+}
+
+static err_t viewerRecv(void *arg, struct tcp_pcb *pcb, struct pbuf *p,
+                        err_t err) {
+  (void)arg;
+  if (p == NULL) {
+    DPRINTF("Viewer client gone\n");
+    return closeClient(pcb);
+  }
+  // The client has nothing to say
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return err;
+}
+
+static void viewerErr(void *arg, err_t err) {
+  (void)arg;
+  // lwIP has freed the connection already
+  DPRINTF("Viewer connection error: %d\n", err);
+  clientPcb = NULL;
+}
+
+static err_t viewerAccept(void *arg, struct tcp_pcb *pcb, err_t err) {
+  (void)arg;
+  if ((err != ERR_OK) || (pcb == NULL)) {
+    return ERR_VAL;
+  }
+  if (clientPcb != NULL) {
+    if (tcp_close(pcb) != ERR_OK) {
+      tcp_abort(pcb);
+      return ERR_ABRT;
+    }
+    return ERR_OK;
+  }
+  DPRINTF("Viewer client connected\n");
+  clientPcb = pcb;
+  pendingRows = DISPLAY_DIRTY_ALL;
+  frameOpen = false;
+  tcp_nagle_disable(pcb);
+  tcp_recv(pcb, viewerRecv);
+  tcp_err(pcb, viewerErr);
+  return ERR_OK;
+}
+
+int viewer_init(void) {
+  if (listenPcb != NULL) {
+    return 0;
+  }
+  cyw43_arch_lwip_begin();
+  struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+  if ((pcb == NULL) || (tcp_bind(pcb, IP_ANY_TYPE, VIEWER_PORT) != ERR_OK)) {
+    if (pcb != NULL) {
+      tcp_close(pcb);
+    }
+    cyw43_arch_lwip_end();
+    DPRINTF("Error binding the viewer to port %d\n", VIEWER_PORT);
+    return -1;
+  }
+  listenPcb = tcp_listen_with_backlog(pcb, 1);
+  if (listenPcb == NULL) {
+    tcp_close(pcb);
+  } else {
+    tcp_accept(listenPcb, viewerAccept);
+  }
+  cyw43_arch_lwip_end();
+  if (listenPcb == NULL) {
+    return -1;
+  }
+  DPRINTF("Viewer listening on port %d\n", VIEWER_PORT);
+  return 0;
+}
+
+void viewer_poll(void) {
+  // Taken even without a client, so the first frame is not a stale delta
+  uint32_t rows = display_takePublishedRows();
+  if (clientPcb == NULL) {
+    return;
+  }
+  cyw43_arch_lwip_begin();
+  pendingRows |= rows;
+  bool sent = false;
+  while ((clientPcb != NULL) && (pendingRows != 0) &&
+         (tcp_sndbuf(clientPcb) >= VIEWER_ROW_MAX_BYTES)) {
+    int row = __builtin_ctz(pendingRows);
+    size_t length = packRow(display_getRowPixels(row), DISPLAY_DIRTY_ROW_BYTES,
+                            &rowMessage[3]);
+    if (!sendMessage(row, length)) {
+      break;  // No room in the queue, try in the next frame
+    }
+    pendingRows &= ~(1u << row);
+    frameOpen = true;
+    sent = true;
+  }
+  if ((clientPcb != NULL) && frameOpen && (pendingRows == 0) &&
+      sendMessage(VIEWER_FRAME_END, 0)) {
+    frameOpen = false;
+    sent = true;
+  }
+  if (sent && (clientPcb != NULL)) {
+    tcp_output(clientPcb);
+  }
+  cyw43_arch_lwip_end();
+}
+
+bool viewer_isActive(void) { return clientPcb != NULL; }
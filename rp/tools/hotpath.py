@@ -0,0 +1,154 @@
+"""List the flash functions reachable from the functions placed in RAM.
+
+The bus IRQ handlers and everything marked __not_in_flash_func run from
+SRAM, but a direct call from them to a function in the flash can stall on an
+XIP cache miss while the remote computer waits. This script disassembles the
+ELF, follows the direct calls (bl and tail call branches) from every RAM
+function, or from the roots given, and prints each flash callee with the
+path that reaches it. Calls through a register (blx rN, function pointers)
+can not be followed and are counted per function.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+FLASH_START = 0x10000000
+FLASH_END = 0x14000000  # XIP aliases included
+RAM_START = 0x20000000
+
+FUNC_RE = re.compile(r"^([0-9a-f]{8}) <([^>]+)>:$")
+CALL_RE = re.compile(
+    r"^\s*[0-9a-f]+:\s+(?:[0-9a-f]{4}(?: [0-9a-f]{4})?\s+)?"
+    r"(bl|blx|b|b\.w|b\.n)\s+([0-9a-f]+)\s+<([^>+]+)(\+0x[0-9a-f]+)?>")
+# The linker reaches a flash function from RAM, 256MB away, through a
+# long branch veneer named after it
+VENEER_RE = re.compile(r"^__(.+)_veneer$")
+INDIRECT_RE = re.compile(
+    r"^\s*[0-9a-f]+:\s+(?:[0-9a-f]{4}(?: [0-9a-f]{4})?\s+)?blx\s+r\d+")
+
+
+def read_disassembly(args):
+    if args.disassembly:
+        with open(args.disassembly, "r") as file:
+            return file.read().splitlines()
+    output = subprocess.run(
+        [args.objdump, "-d", "--no-show-raw-insn", args.elf],
+        check=True, capture_output=True, text=True).stdout
+    return output.splitlines()
+
+
+def parse(lines):
+    """Return the address, direct callees and indirect calls per function."""
+    functions = {}
+    current = None
+    for line in lines:
+        match = FUNC_RE.match(line)
+        if match:
+            current = match.group(2)
+            functions[current] = {"addr": int(match.group(1), 16),
+                                  "calls": set(), "indirect": 0}
+            continue
+        if current is None:
+            continue
+        match = CALL_RE.match(line)
+        if match:
+            target = match.group(3)
+            veneer = VENEER_RE.match(target)
+            if veneer:
+                target = veneer.group(1)
+            # A branch inside the function is not a call
+            if target != current and not match.group(4):
+                functions[current]["calls"].add(target)
+            continue
+        if INDIRECT_RE.match(line):
+            functions[current]["indirect"] += 1
+    return functions
+
+
+def in_flash(function):
+    return FLASH_START <= function["addr"] < FLASH_END
+
+
+def walk(functions, roots):
+    """Breadth first from the roots. Return the flash callees and a path."""
+    parent = {}
+    queue = []
+    for root in roots:
+        parent[root] = None
+        queue.append(root)
+    found = []
+    while queue:
+        name = queue.pop(0)
+        function = functions.get(name)
+        if function is None:
+            continue
+        if in_flash(function) and parent[name] is not None:
+            found.append(name)
+            continue  # Everything below is reported through this one
+        for callee in sorted(function["calls"]):
+            if callee not in parent:
+                parent[callee] = name
+                queue.append(callee)
+    paths = {}
+    for name in found:
+        path = [name]
+        while parent[path[-1]] is not None:
+            path.append(parent[path[-1]])
+        paths[name] = list(reversed(path))
+    return paths
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", nargs="?", help="ELF file of the firmware")
+    parser.add_argument("--objdump", default="arm-none-eabi-objdump",
+                        help="objdump of the toolchain")
+    parser.add_argument("--disassembly",
+                        help="Read an objdump -d listing instead of the ELF")
+    parser.add_argument("--root", action="append", default=[],
+                        help="Start from this function. Default: all the "
+                             "functions in RAM")
+    parser.add_argument("--ignore", action="append", default=[],
+                        help="Regular expression of flash callees to skip")
+    parser.add_argument("--output", help="Write the report to this file")
+    parser.add_argument("--strict", action="store_true",
+                        help="Exit with 1 if any flash callee is found")
+    args = parser.parse_args()
+    if not args.elf and not args.disassembly:
+        parser.error("an ELF file or --disassembly is needed")
+
+    functions = parse(read_disassembly(args))
+    roots = args.root
+    if not roots:
+        roots = sorted(name for name, function in functions.items()
+                       if function["addr"] >= RAM_START and
+                       not VENEER_RE.match(name))
+    ignore = [re.compile(pattern) for pattern in args.ignore]
+    paths = {name: path for name, path in walk(functions, roots).items()
+             if not any(pattern.search(name) for pattern in ignore)}
+
+    lines = []
+    for name in sorted(paths):
+        lines.append("0x%08x %s: %s" % (functions[name]["addr"], name,
+                                        " -> ".join(paths[name])))
+    indirect = sorted((name, functions[name]["indirect"]) for name in roots
+                      if name in functions and functions[name]["indirect"])
+    for name, count in indirect:
+        lines.append("indirect %s: %d calls through a register" %
+                     (name, count))
+
+    report = "\n".join(lines) + ("\n" if lines else "")
+    if args.output:
+        with open(args.output, "w") as file:
+            file.write(report)
+    else:
+        sys.stdout.write(report)
+    print("Hot path audit: %d RAM roots, %d flash callees, %d roots with "
+          "indirect calls" % (len(roots), len(paths), len(indirect)))
+    return 1 if (args.strict and paths) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,114 @@
+"""Watch the screen of the remote computer through the network viewer.
+
+Connects to the viewer of the firmware (VIEWER_SERVER 1, see viewer.h),
+unpacks the rows it streams and writes the screen to a PBM image after each
+frame, or draws it in the terminal with --text.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+
+WIDTH = 320
+HEIGHT = 200
+ROW_LINES = 8
+ROW_BYTES = (WIDTH // 8) * ROW_LINES
+ROWS = HEIGHT // ROW_LINES
+FRAME_END = 0xFF
+PORT = 5800
+
+
+def unpack_row(data):
+    """Undo the PackBits of a row."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        count = data[i]
+        i += 1
+        if count < 128:
+            out += data[i:i + count + 1]
+            i += count + 1
+        elif count > 128:
+            out += bytes([data[i]]) * (257 - count)
+            i += 1
+    if len(out) != ROW_BYTES:
+        raise ValueError("row of %d bytes instead of %d" % (len(out),
+                                                            ROW_BYTES))
+    return out
+
+
+def read_exactly(sock, length):
+    data = bytearray()
+    while len(data) < length:
+        chunk = sock.recv(length - len(data))
+        if not chunk:
+            raise EOFError("connection closed")
+        data += chunk
+    return bytes(data)
+
+
+def read_frames(sock):
+    """Yield the screen after each frame."""
+    screen = bytearray(ROW_BYTES * ROWS)
+    while True:
+        row, length = struct.unpack("<BH", read_exactly(sock, 3))
+        data = read_exactly(sock, length)
+        if row == FRAME_END:
+            yield bytes(screen)
+        elif row < ROWS:
+            screen[row * ROW_BYTES:(row + 1) * ROW_BYTES] = unpack_row(data)
+
+
+def write_pbm(path, screen):
+    # The leftmost pixel is in bit 0 of each byte, in PBM it is in bit 7
+    flipped = bytes(int("{:08b}".format(byte)[::-1], 2) for byte in screen)
+    with open(path, "wb") as file:
+        file.write(b"P4\n%d %d\n" % (WIDTH, HEIGHT))
+        file.write(flipped)
+
+
+def draw_text(screen):
+    # A character for each 2x4 pixels
+    lines = []
+    for y in range(0, HEIGHT, 4):
+        line = []
+        for x in range(0, WIDTH, 2):
+            byte = screen[y * (WIDTH // 8) + x // 8]
+            line.append("#" if byte & (1 << (x % 8)) else " ")
+        lines.append("".join(line).rstrip())
+    sys.stdout.write("\x1b[H\x1b[2J" + "\n".join(lines) + "\n")
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host", help="Name or address of the device")
+    parser.add_argument("--port", type=int, default=PORT)
+    parser.add_argument("--output", default="screen.pbm",
+                        help="PBM image rewritten after each frame")
+    parser.add_argument("--text", action="store_true",
+                        help="Draw the screen in the terminal instead")
+    parser.add_argument("--frames", type=int, default=0,
+                        help="Exit after this many frames. 0: never")
+    args = parser.parse_args()
+
+    frames = 0
+    with socket.create_connection((args.host, args.port)) as sock:
+        try:
+            for screen in read_frames(sock):
+                if args.text:
+                    draw_text(screen)
+                else:
+                    write_pbm(args.output, screen)
+                frames += 1
+                if args.frames and frames >= args.frames:
+                    break
+        except (EOFError, KeyboardInterrupt):
+            pass
+    print("Viewer: %d frames" % frames)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
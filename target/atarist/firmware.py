@@ -3,6 +3,14 @@ import os
 import argparse
 
 MAX_WORDS_PER_LINE = 16  # This results in 32 bytes per line
+MAX_BYTES_PER_LINE = 16
+
+# LZ4 block format limits
+LZ4_MIN_MATCH = 4
+LZ4_LAST_LITERALS = 5  # The last bytes are always literals
+LZ4_MATCH_LIMIT = 12  # No match starts in the last bytes
+LZ4_MAX_OFFSET = 65535
+LZ4_HASH_BITS = 12
 
 
 def read_binary_from_file(file_path):
@@ -10,7 +18,121 @@ def read_binary_from_file(file_path):
         return file.read()
 
 
-def binary_to_c_array(input_source, output_file, array_name, endian_format="little"):
+def lz4_length(length):
+    """Bytes that follow a token nibble of 15 for the given length."""
+    out = bytearray()
+    length -= 15
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+    return out
+
+
+def lz4_compress(data):
+    """Compress into a single LZ4 block, greedy with a hash of 4 bytes."""
+    out = bytearray()
+    table = {}
+    anchor = 0
+    pos = 0
+    limit = len(data) - LZ4_MATCH_LIMIT
+    while pos < limit:
+        key = data[pos : pos + LZ4_MIN_MATCH]
+        candidate = table.get(key, -1)
+        table[key] = pos
+        if candidate < 0 or pos - candidate > LZ4_MAX_OFFSET:
+            pos += 1
+            continue
+        length = LZ4_MIN_MATCH
+        end = len(data) - LZ4_LAST_LITERALS
+        while pos + length < end and data[candidate + length] == data[pos + length]:
+            length += 1
+
+        literals = pos - anchor
+        match = length - LZ4_MIN_MATCH
+        out.append((min(literals, 15) << 4) | min(match, 15))
+        if literals >= 15:
+            out += lz4_length(literals)
+        out += data[anchor:pos]
+        offset = pos - candidate
+        out += bytes((offset & 0xFF, offset >> 8))
+        if match >= 15:
+            out += lz4_length(match)
+        pos += length
+        anchor = pos
+
+    literals = len(data) - anchor
+    out.append(min(literals, 15) << 4)
+    if literals >= 15:
+        out += lz4_length(literals)
+    out += data[anchor:]
+    return bytes(out)
+
+
+def lz4_decompress(block):
+    """Expand an LZ4 block, to check the output of lz4_compress."""
+    out = bytearray()
+    pos = 0
+    while pos < len(block):
+        token = block[pos]
+        pos += 1
+        literals = token >> 4
+        if literals == 15:
+            while True:
+                extra = block[pos]
+                pos += 1
+                literals += extra
+                if extra != 255:
+                    break
+        out += block[pos : pos + literals]
+        pos += literals
+        if pos >= len(block):
+            break
+        offset = block[pos] | (block[pos + 1] << 8)
+        pos += 2
+        length = token & 0x0F
+        if length == 15:
+            while True:
+                extra = block[pos]
+                pos += 1
+                length += extra
+                if extra != 255:
+                    break
+        for _ in range(length + LZ4_MIN_MATCH):
+            out.append(out[-offset])
+    return bytes(out)
+
+
+def memory_bytes(data, endian_format):
+    """Bytes in the order the words have in the RP memory."""
+    if endian_format == "big":
+        return bytes(data)
+    swapped = bytearray(len(data))
+    swapped[0::2] = data[1::2]
+    swapped[1::2] = data[0::2]
+    return bytes(swapped)
+
+
+def compressed_c_array(data, array_name, endian_format):
+    image = memory_bytes(data, endian_format)
+    block = lz4_compress(image)
+    if lz4_decompress(block) != image:
+        raise ValueError("The LZ4 block does not expand to the image.")
+
+    content = "#define TARGET_FIRMWARE_LZ4 1\n\n"
+    content += f"const uint8_t {array_name}_lz4[] = {{\n"
+    for i in range(0, len(block), MAX_BYTES_PER_LINE):
+        chunk = block[i : i + MAX_BYTES_PER_LINE]
+        content += "    " + ", ".join(f"0x{byte:02X}" for byte in chunk) + ",\n"
+    content = content.rstrip(",\n") + "\n};\n"
+    content += f"uint32_t {array_name}_lz4_length = sizeof({array_name}_lz4);\n"
+    content += f"uint32_t {array_name}_size = {len(image)};\n\n"
+    print(f"Compressed {len(image)} bytes into {len(block)} bytes.")
+    return content
+
+
+def binary_to_c_array(input_source, output_file, array_name, endian_format="little",
+                      compress=False):
     offset = 0
 
     data = read_binary_from_file(input_source)
@@ -32,6 +154,12 @@ def binary_to_c_array(input_source, output_file, array_name, endian_format="litt
     if len(trimmed_data) % 2 != 0:
         raise ValueError("The binary file size (after trimming zeros) should be an even number of bytes for word processing.")
 
+    if compress:
+        with open(output_file, "w") as f:
+            f.write(compressed_c_array(trimmed_data, array_name, endian_format))
+        print(f"{output_file} generated successfully!")
+        return
+
     # Prepare the output content
     content = f"const uint16_t {array_name}[] = {{\n"
 
@@ -86,10 +214,17 @@ if __name__ == "__main__":
         help="Endianness of the words in the output array ('little' or 'big').",
     )
 
+    parser.add_argument(
+        "--compress",
+        action="store_true",
+        help="Store the image as an LZ4 block, expanded by the RP at boot.",
+    )
+
     args = parser.parse_args()
     array_name = args.array_name
     output_file = args.output
     input_source = args.input
     endian_format = args.endian_format
 
-    binary_to_c_array(input_source, output_file, array_name, endian_format)
+    binary_to_c_array(input_source, output_file, array_name, endian_format,
+                      args.compress)
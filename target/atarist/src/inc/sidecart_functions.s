@@ -3,10 +3,18 @@
 ; constants
 _p_cookies                              equ $5a0    ; pointer to the system Cookie-Jar
 
+COOKIE_JAR_STE                          equ $00010000 ; STE computer
 COOKIE_JAR_MEGASTE                      equ $00010010 ; Mega STE computer
+COOKIE_JAR_TT                           equ $00020000 ; TT computer
+COOKIE_JAR_FALCON                       equ $00030000 ; Falcon computer
 SHARED_VARIABLE_SHARED_FUNCTIONS_SIZE   equ 16      ; Size of the shared variables for the shared functions
 SHARED_VARIABLE_HARDWARE_TYPE           equ 0       ; Hardware type of the Atari ST computer
 SHARED_VARIABLE_SVERSION                equ 1       ; TOS version from Sversion
+SHARED_VARIABLE_CMD_COUNT               equ 4       ; Sync commands sent, see publish_command_stats
+SHARED_VARIABLE_CMD_TICKS               equ 5       ; Sum of the round trips of the sync commands in 200 Hz ticks
+SHARED_VARIABLE_CMD_MAX_TICKS           equ 6       ; Slowest round trip of a sync command in 200 Hz ticks
+SHARED_VARIABLE_CMD_TIMEOUTS            equ 7       ; Sync commands that timed out
+SHARED_VARIABLE_SCREEN_REZ              equ 8       ; Screen resolution of XBIOS Getrez
 
 COMMAND_SYNC_CODE_SIZE                  equ (4 + _end_sync_code_in_stack - _start_sync_code_in_stack)
 COMMAND_SYNC_WRITE_CODE_SIZE            equ (4 + _end_sync_write_code_in_stack - _start_sync_write_code_in_stack)
@@ -16,6 +24,26 @@ COMMAND_SYNC_USE_DSKBUF                 equ 0       ; Use different disk buffers
                                                     ; 1: Use the disk buffer to store the code. Safe
                                                     ; 0: Use the ROM address to store the code. Safe
 
+COMMAND_STATS                           equ 1       ; Keep the latency counters of the sync commands and scale the
+                                                    ; polling loops with the hardware. The shared functions must run
+                                                    ; in RAM, like the relocated code of main.s. 0 if they run in ROM
+COMMAND_LOOPS_PER_TICK                  equ 1200    ; Polling loops of a sync command in a 200 Hz tick of an 8 MHz ST,
+                                                    ; twice the real ones. Only ends the wait if hz200 does not run
+
+CMD_STATS_LOOPS                         equ 0       ; Word. Polling loops per tick for the detected hardware
+CMD_STATS_COUNT                         equ 4       ; Long. Sync commands sent
+CMD_STATS_TICKS                         equ 8       ; Long. Sum of the round trips in 200 Hz ticks
+CMD_STATS_MAX_TICKS                     equ 12      ; Long. Slowest round trip in 200 Hz ticks
+CMD_STATS_TIMEOUTS                      equ 16      ; Long. Sync commands that timed out
+
+COMMAND_WRITE_UNROLL                    equ 16      ; Words sent per iteration of the write loop. A power of 2
+COMMAND_WRITE_UNROLL_SHIFT              equ 4       ; log2 of COMMAND_WRITE_UNROLL
+COMMAND_WRITE_UNIT_SHIFT                equ 3       ; log2 of the 8 bytes of code that send one word
+
+COMMAND_READ_WINDOW_ADDR                equ (ROM4_ADDR + $2000) ; Read window. Must match TPROTO_READ_WINDOW_OFFSET
+COMMAND_READ_BLOCK_SIZE                 equ 32      ; Bytes copied by each movem.l of the read loop
+COMMAND_READ_BLOCK_SHIFT                equ 5       ; log2 of COMMAND_READ_BLOCK_SIZE
+
 
 ; Detect the hardware of the computer we are running on
 ; This code checks for the cookie-jar and reads the _MCH cookie to determine the hardware
@@ -28,6 +56,28 @@ COMMAND_SYNC_USE_DSKBUF                 equ 0       ; Use different disk buffers
 ; Outputs:
 ;   d0.l contains the hardware type as stored in the shared variable SHARED_VARIABLE_HARDWARE_TYPE
 detect_hw:
+    bsr read_hw_type
+_save_hw:
+    move.l d4, -(sp)            ; Save the hardware type    
+    move.l #SHARED_VARIABLE_HARDWARE_TYPE, d3   ; D3 Variable index
+                                                ; D4 Variable value
+    send_sync CMD_SET_SHARED_VAR, 8
+    tst.w d0
+    bne.s _detect_hw_timeout
+    move.l (sp)+, d0            ; Restore the hardware type in d0.l as result
+    rts
+_detect_hw_timeout
+    move.l (sp)+, d4            ; Restore the hardware type in d4.l to retry
+    bra.s _save_hw
+
+; Read the hardware type from the _MCH cookie, without sending it
+;
+; Inputs:
+;   None
+;
+; Outputs:
+;   d4.l contains the hardware type. d0 and a0 are modified
+read_hw_type:
 	move.l _p_cookies.w,d0      ; Check the cookie-jar to know what type of machine we are running on
 	beq _old_hardware           ; No cookie-jar, so it's a TOS <= 1.04
 	movea.l d0,a0               ; Get the address of the cookie-jar
@@ -40,21 +90,27 @@ _loop_cookie:
 	bra.s _loop_cookie          ; And try the next cookie
 _found_cookie:
 	move.l	(a0)+,d4            ; Get the cookie value
-	bra.s	_save_hw
+	bra.s	_read_hw_type_loops
 _old_hardware:
     clr.l d4                    ; 0x0000	0x0000	Atari ST (260 ST,520 ST,1040 ST,Mega ST,...)
-_save_hw:
-    move.l d4, -(sp)            ; Save the hardware type    
-    move.l #SHARED_VARIABLE_HARDWARE_TYPE, d3   ; D3 Variable index
-                                                ; D4 Variable value
-    send_sync CMD_SET_SHARED_VAR, 8
-    tst.w d0
-    bne.s _detect_hw_timeout
-    move.l (sp)+, d0            ; Restore the hardware type in d0.l as result
+_read_hw_type_loops:
+    ifne COMMAND_STATS == 1
+    ; The polling loops of the sync commands run faster in the 16 and 32 MHz computers
+    lea command_stats(pc), a0
+    move.w #COMMAND_LOOPS_PER_TICK, CMD_STATS_LOOPS(a0)
+    cmp.l #COOKIE_JAR_MEGASTE, d4
+    beq.s _read_hw_type_16mhz
+    cmp.l #COOKIE_JAR_FALCON, d4
+    beq.s _read_hw_type_16mhz
+    cmp.l #COOKIE_JAR_TT, d4
+    bne.s _read_hw_type_done
+    move.w #(COMMAND_LOOPS_PER_TICK * 4), CMD_STATS_LOOPS(a0)
+    bra.s _read_hw_type_done
+_read_hw_type_16mhz:
+    move.w #(COMMAND_LOOPS_PER_TICK * 2), CMD_STATS_LOOPS(a0)
+_read_hw_type_done:
+    endif
     rts
-_detect_hw_timeout
-    move.l (sp)+, d4            ; Restore the hardware type in d4.l to retry
-    bra.s _save_hw
 
 ; Get the TOS version
 ; This code reads the TOS version from the ROM and writes it in the shared variable SHARED_VARIABLE_SVERSION
@@ -64,6 +120,23 @@ _detect_hw_timeout
 ; Outputs:
 ;   None
 get_tos_version:
+    bsr read_tos_version
+    move.l #SHARED_VARIABLE_SVERSION, d3    ; Variable index
+    move.l d0, d4                           ; Variable value
+    send_sync CMD_SET_SHARED_VAR, 8
+    tst.w d0                    ; d0 holds error code: 0 = success, nonzero = failure
+    ; Do not retry indefinitely here; rely on send_sync's internal retry logic.
+    ; If the command failed, return with the error code in d0 instead of hard-locking boot.
+    rts
+
+; Read the TOS version, without sending it
+;
+; Inputs:
+;   None
+; Outputs:
+;   d0.l the TOS version from the ROM in the upper word and the one of Sversion in the lower word
+;   d1-d2 and a0-a2 are modified
+read_tos_version:
     gemdos Sversion, 2
     and.l #$FFFF,d0
     cmp.w #$FC, $4.w            ; Check if the TOS version is a 192Kb or 256Kb
@@ -78,22 +151,58 @@ get_tos_version:
     and.l #$FFFF,d1             ; Mask the upper word
     swap d1
     or.l d1, d0                 ; Set the TOS version in the upper word of d0
-    move.l #SHARED_VARIABLE_SVERSION, d3    ; Variable index
-    move.l d0, d4                           ; Variable value
-    send_sync CMD_SET_SHARED_VAR, 8
-    tst.w d0                    ; d0 holds error code: 0 = success, nonzero = failure
-    ; Do not retry indefinitely here; rely on send_sync's internal retry logic.
-    ; If the command failed, return with the error code in d0 instead of hard-locking boot.
     rts
 
+; Send the hardware type and the TOS version to the shared block in one command
+; Both variables are published together with the sequence counter of the block
+;
+; Inputs:
+;   None
+; Outputs:
+;   d0: error code, 0 if no error
+;   d1-d7 and a0-a3 are modified
+publish_system_vars:
+    bsr read_tos_version
+    move.l d0, -(sp)            ; Keep the TOS version
+    bsr read_hw_type            ; d4.l: SHARED_VARIABLE_HARDWARE_TYPE
+    move.l (sp)+, d5            ; d5.l: SHARED_VARIABLE_SVERSION
+    moveq.l #SHARED_VARIABLE_HARDWARE_TYPE, d3  ; First variable of the command
+    send_sync CMD_SET_SHARED_VARS, 12
+    rts
+
+; Prepare the wait for the token of a sync command, once the command is sent
+; The wait ends at a deadline of the 200 Hz timer, or after a number of polling loops
+; scaled with the hardware if the timer does not run
+; d0.l: timeout in 200 Hz ticks in the upper word, 0 for COMMAND_TIMEOUT_TICKS
+; Output: d5.l start tick, d6.l deadline tick, d7.l polling loops. d0 is modified
+command_wait_setup  macro
+    swap d0
+    moveq.l #0, d6
+    move.w d0, d6                               ; Timeout in ticks
+    bne.s .\@command_wait_timeout_set
+    moveq.l #COMMAND_TIMEOUT_TICKS, d6
+.\@command_wait_timeout_set:
+    move.l d6, d7
+    ifne COMMAND_STATS == 1
+    mulu.w command_stats+CMD_STATS_LOOPS(pc), d7 ; Polling loops for the detected hardware
+    else
+    mulu.w #COMMAND_LOOPS_PER_TICK, d7
+    endif
+    move.l hz200.w, d5                          ; Start of the round trip
+    add.l d5, d6                                ; Deadline
+                    endm
+
 ; Send an sync command to the Sidecart
 ; Wait until the command sets a response in the memory with a random number used as a token
+; Needs the supervisor mode to read the 200 Hz timer
 ; Input registers:
 ; d0.w: command code
+; d0.l: timeout in 200 Hz ticks in the upper word, 0 for COMMAND_TIMEOUT_TICKS
 ; d1.w: payload size
 ; From d3 to d6 the payload based on the size of the payload field d1.w
 ; Output registers:
 ; d0: error code, 0 if no error
+; d1.l: round trip in 200 Hz ticks
 ; d1-d7 are modified. a0-a3 modified.
 send_sync_command_to_sidecart:
     ; The random token is used to synchronize with the sidecart
@@ -214,6 +323,7 @@ _copy_sync_code:
 _no_more_payload_stack:
     ; SEND CHECKSUM
     tst.b (a0, d7.w)
+    command_wait_setup
     ifne COMMAND_SYNC_USE_DSKBUF !=0 ; If we are copying the code, we have to jump there
         jmp (a3)                    ; Jump to the code in the stack
     endif
@@ -221,17 +331,21 @@ _no_more_payload_stack:
 _start_sync_code_in_stack:
     ; End of the command loop. Now we need to wait for the token
     swap d2                                  ; D2 is the only register that is not used as a scratch register
-    move.l #COMMAND_TIMEOUT, d7              ; Most significant word is the inner loop, least significant word is the outer loop
     moveq #0, d0                             ; No Timeout
 _start_sync_code_in_stack_loop:
     cmp.l (a1), d2                           ; Compare the random number with the token
     beq.s _sync_token_found                  ; Token found, we can finish succesfully
-    subq.l #1, d7                            ; Decrement the inner loop
-    bne.s _start_sync_code_in_stack_loop     ; If the inner loop is not finished, continue
+    cmp.l hz200.w, d6                        ; Deadline reached?
+    bcs.s _sync_token_timeout
+    subq.l #1, d7                            ; Polling loops left if the timer does not run
+    bne.s _start_sync_code_in_stack_loop     ; If the loops are not finished, continue
 
     ; Sync token not found, timeout
+_sync_token_timeout:
     subq.l #1, d0                            ; Timeout
 _sync_token_found:
+    move.l hz200.w, d1
+    sub.l d5, d1                             ; Round trip in ticks
 
 ;    move.l #RANDOM_TOKEN_POST_WAIT, d7
 ;_postwait_me:
@@ -240,10 +354,122 @@ _sync_token_found:
     rts                                 ; Return to the code
 _end_sync_code_in_stack:
 
+; Send a pipelined command to the Sidecart
+; Does not wait for the command to complete. The sequence number travels in
+; the token field, and the Sidecart writes the sequence number of the last
+; processed command in RANDOM_TOKEN_ACK_SEQ_ADDR. Several commands can be in
+; flight, use wait_async_ack_from_sidecart to wait for any of them.
+; The Sidecart handler of the command must be registered as pipelined.
+; Input registers:
+; d0.w: command code
+; d1.w: payload size (0, 4 or 8 bytes from d3 and d4)
+; d2.l: sequence number. Increase it for each command
+; d3-d4 the payload based on the size of the payload field d1.w
+; Output registers:
+; d1, d7 and a0 are modified.
+send_async_command_to_sidecart:
+    addq.w #4, d1                 ; Add 4 bytes to the payload size to include the sequence number
+
+    move.l #ROMCMD_START_ADDR, a0 ; Start address of the ROM3
+    add.l #$8000, a0              ; Add 32Kb to the address to point to the middle of the ROM
+
+    ; SEND HEADER WITH MAGIC NUMBER
+    move.w #CMD_MAGIC_NUMBER, d7  ; Command header
+    tst.b (a0, d7.w)              ; Command header
+
+    ; Clean the CHECKSUM register in d7
+    clr.l d7
+
+    ; SEND COMMAND CODE
+    add.w d0, d7                  ; Add the command code to the checksum
+    tst.b (a0, d0.w)
+
+    ; SEND PAYLOAD SIZE
+    add.w d1, d7                  ; Add the payload size to the checksum
+    tst.b (a0, d1.w)
+
+    ; SEND SEQUENCE NUMBER LOW AND HIGH D2
+    add.w d2, d7
+    tst.b (a0, d2.w)
+    swap d2
+    add.w d2, d7
+    tst.b (a0, d2.w)
+    swap d2                       ; Restore the sequence number
+    cmp.w #4, d1
+    beq.s _no_more_payload_async
+
+    ; SEND PAYLOAD LOW AND HIGH D3
+    add.w d3, d7
+    tst.b (a0, d3.w)
+    swap d3
+    add.w d3, d7
+    tst.b (a0, d3.w)
+    swap d3                       ; Restore the payload
+    cmp.w #8, d1
+    beq.s _no_more_payload_async
+
+    ; SEND PAYLOAD LOW AND HIGH D4
+    add.w d4, d7
+    tst.b (a0, d4.w)
+    swap d4
+    add.w d4, d7
+    tst.b (a0, d4.w)
+    swap d4                       ; Restore the payload
+
+_no_more_payload_async:
+    ; SEND CHECKSUM
+    tst.b (a0, d7.w)
+    rts
+
+; Wait until the Sidecart acknowledges a pipelined command
+; Input registers:
+; d2.l: sequence number of the command to wait for
+; Output registers:
+; d0: error code, 0 if no error
+; d1 and d7 are modified.
+wait_async_ack_from_sidecart:
+    move.l #COMMAND_TIMEOUT, d7
+    moveq #0, d0                                ; No Timeout
+_wait_async_ack_loop:
+    move.l RANDOM_TOKEN_ACK_SEQ_ADDR, d1
+    sub.l d2, d1                                ; Last acknowledged minus the one we wait for
+    bpl.s _async_ack_found                      ; Acknowledged if not negative (wraps safely)
+    subq.l #1, d7
+    bne.s _wait_async_ack_loop
+
+    ; Sequence number not acknowledged, timeout
+    subq.l #1, d0
+_async_ack_found:
+    rts
+
+; Send d5.w words from the even address in a4 to the sidecart and add them to the checksum in d7
+; The loop is unrolled COMMAND_WRITE_UNROLL times. The words of the partial block go first,
+; jumping into the unrolled body, so only one dbf is paid every COMMAND_WRITE_UNROLL words
+; a0: middle of the ROM3 address space
+; d0, d1, d5 and a2 are modified. a4 points to the next word
+write_words_unrolled    macro
+    move.w d5, d1
+    and.w #(COMMAND_WRITE_UNROLL - 1), d1       ; Words of the partial block
+    lsr.w #COMMAND_WRITE_UNROLL_SHIFT, d5       ; Full blocks after the partial one
+    lsl.w #COMMAND_WRITE_UNIT_SHIFT, d1         ; Bytes of code of the partial block
+    neg.w d1
+    lea .\@write_unrolled_end(pc), a2
+    jmp (a2, d1.w)                              ; Send the partial block first
+.\@write_unrolled_loop:
+    rept COMMAND_WRITE_UNROLL
+    move.w (a4)+, d0          ; Load the word                     (2 bytes)
+    add.w d0, d7              ; Add the word to the checksum      (2 bytes)
+    tst.b (a0, d0.w)          ; Write the memory to the sidecart  (4 bytes)
+    endr
+.\@write_unrolled_end:
+    dbf d5, .\@write_unrolled_loop
+                        endm
+
 ; Send an sync write command to the Sidecart
 ; Wait until the command sets a response in the memory with a random number used as a token
 ; Input registers:
 ; d0.w: command code
+; d0.l: timeout in 200 Hz ticks in the upper word, 0 for COMMAND_TIMEOUT_TICKS
 ; d3.l: long word to send to the sidecart
 ; d4.l: long word to send to the sidecart
 ; d5.l: long word to send to the sidecart
@@ -251,9 +477,10 @@ _end_sync_code_in_stack:
 ; a4: address of the buffer to write in the sidecart
 ; Output registers:
 ; d0: error code, 0 if no error
-; d7: 16 bit checksum of the data written from address from a4 to a4 + d6
+; d1.l: round trip in 200 Hz ticks
 ; a4: next address in the computer memory to retrieve
-; d1-d6 are modified. a0-a3 modified.
+; d1-d7 are modified. a0-a3 modified. The checksum of the data does not survive
+; the wait, which keeps the polling loops in d7
 send_sync_write_command_to_sidecart:
     ; The random token is used to synchronize with the sidecart
     move.l RANDOM_TOKEN_SEED_ADDR, d2
@@ -354,35 +581,31 @@ _copy_sync_code_write:
     clr.l d7
 
     btst #0, d5             ; Test if number of bytes to copy is even or odd
-    bne.s _write_to_sidecart_byteodd_loop
-    addq.l #1, d5            ; Add one byte to the payload before rounding to the next word
+    bne _write_to_sidecart_byteodd_loop
     lsr.w #1, d5             ; Copy two bytes each iteration
-    subq.w #1, d5            ; one less
 
     ; Test if the address in A4 is even or odd
-    move.l a4, d0
+    move.w a4, d0            ; The upper word of d0 keeps the timeout
     btst #0, d0
     beq.s _write_to_sidecart_even_loop
+    subq.w #1, d5            ; one less
 _write_to_sidecart_odd_loop:
-    move.b  (a4)+, d3       ; Load the high byte
-    lsl.w   #8, d3          ; Shift it to the high part of the word
+    move.b  (a4)+, -(sp)    ; Load the high byte in the high part of a word in the stack
+    move.w  (sp)+, d3       ; Faster than shifting it to the high part of the word
     move.b  (a4)+, d3       ; Load the low byte
     tst.b (a0, d3.w)        ; Write the memory to the sidecart
     add.w d3, d7            ; Add the word to the checksum
     dbf d5, _write_to_sidecart_odd_loop
-    bra.s _no_more_payload_write_stack
+    bra _no_more_payload_write_stack
 
  _write_to_sidecart_even_loop:
-    move.w (a4)+, d0          ; Load the word
-    add.w d0, d7              ; Add the word to the checksum
-    tst.b (a0, d0.w)          ; Write the memory to the sidecart
-    dbf d5, _write_to_sidecart_even_loop
-    bra.s _no_more_payload_write_stack
+    write_words_unrolled
+    bra _no_more_payload_write_stack
 
  _write_to_sidecart_byteodd_loop:
     addq.l #1, d5             ; Add one byte to the payload before rounding to the next word
     lsr.w #1, d5              ; Copy two bytes each iteration
-    move.l a4, d0             ; Test if the address in A4 is even or odd
+    move.w a4, d0             ; Test if the address in A4 is even or odd
     btst #0, d0
     beq.s _write_to_sidecart_byteodd_odd_loop
 
@@ -390,8 +613,8 @@ _write_to_sidecart_odd_loop:
     beq.s _write_to_sidecart_byteodd_loop_tail
     subq.w #1, d5            ; one less
 _write_to_sidecart_byteodd_even_loop_copy:
-    move.b  (a4)+, d3       ; Load the high byte
-    lsl.w   #8, d3          ; Shift it to the high part of the word
+    move.b  (a4)+, -(sp)    ; Load the high byte in the high part of a word in the stack
+    move.w  (sp)+, d3       ; Faster than shifting it to the high part of the word
     move.b  (a4)+, d3       ; Load the low byte
     tst.b (a0, d3.w)        ; Write the memory to the sidecart
     add.w d3, d7            ; Add the word to the checksum
@@ -402,17 +625,11 @@ _write_to_sidecart_byteodd_loop_tail:
     and.w #$FF00,d0           ; Mask the upper word
     add.w d0, d7              ; Add the word to the checksum
     tst.b (a0, d0.w)          ; Write the memory to the sidecart
-    bra.s _no_more_payload_write_stack
+    bra _no_more_payload_write_stack
 
 _write_to_sidecart_byteodd_odd_loop:
-    subq.w #1, d5
-    beq.s _write_to_sidecart_byteodd_odd_loop_tail
-    subq.w #1, d5            ; one less
-_write_to_sidecart_byteodd_odd_loop_copy:
-    move.w (a4)+, d0          ; Load the word
-    add.w d0, d7              ; Add the word to the checksum
-    tst.b (a0, d0.w)          ; Write the memory to the sidecart
-    dbf d5, _write_to_sidecart_byteodd_odd_loop_copy
+    subq.w #1, d5             ; The last word only has the high byte
+    write_words_unrolled
 _write_to_sidecart_byteodd_odd_loop_tail:
     move.w (a4)+, d0          ; Load the word
     and.w #$FF00,d0           ; Mask the upper word
@@ -423,28 +640,162 @@ _no_more_payload_write_stack:
     add.w d7, d6              ; Add the checksum parameters to the buffer 
     ; SEND CHECKSUM
     tst.b (a0, d6.w)
+    command_wait_setup
     ifne COMMAND_SYNC_USE_DSKBUF !=0 ; If we are copying the code, we have to jump there
         jmp (a3)                    ; Jump to the code in the stack
     endif
 ; This is the code that cannot run in ROM while waiting for the command to complete
 _start_sync_write_code_in_stack:
     swap d2                                        ; D2 is the only register that is not used as a scratch register
-    move.l #COMMAND_TIMEOUT, d6                    ; Most significant word is the inner loop, least significant word is the outer loop
-    moveq #0, d0                                   ; Timeout
+    moveq #0, d0                                   ; No Timeout
 _start_sync_write_code_in_stack_loop:
     cmp.l (a1), d2                                 ; Compare the random number with the token
     beq.s _sync_write_token_found                  ; Token found, we can finish succesfully
-    subq.l #1, d6                                  ; Decrement the inner loop
-    bne.s _start_sync_write_code_in_stack_loop     ; If the inner loop is not finished, continue
+    cmp.l hz200.w, d6                              ; Deadline reached?
+    bcs.s _sync_write_token_timeout
+    subq.l #1, d7                                  ; Polling loops left if the timer does not run
+    bne.s _start_sync_write_code_in_stack_loop     ; If the loops are not finished, continue
 
     ; Sync token not found, timeout
+_sync_write_token_timeout:
     subq.l #1, d0                                  ; Timeout
 
 _sync_write_token_found:
+    move.l hz200.w, d1
+    sub.l d5, d1                                   ; Round trip in ticks
 ;    move.l #RANDOM_TOKEN_POST_WAIT, d6
 ;_postwait_write_me:
 ;    dbf d6, _postwait_write_me
 ;_no_wait_write_me:
     rts                                 ; Return to the code
 
-_end_sync_write_code_in_stack:
\ No newline at end of file
+_end_sync_write_code_in_stack:
+
+; Send a sync read command to the Sidecart and copy the data it publishes in the read window
+; The payload of the command is d3.l and d4.l. The window starts with the number of bytes published
+; Input registers:
+; d0.w: command code
+; d0.l: timeout in 200 Hz ticks in the upper word, 0 for COMMAND_TIMEOUT_TICKS
+; d3.l: position of the data in the source, defined by the command
+; d4.l: number of bytes to read, at most the size of the read window minus 4 bytes
+; a4: address of the buffer in the computer memory. Must be even
+; Output registers:
+; d0: error code, 0 if no error
+; d1.l: number of bytes copied. Can be less than requested
+; a4: next address in the computer memory
+; d2-d7 are modified. a0-a3 modified.
+send_sync_read_command_to_sidecart:
+    move.l d4, -(sp)                    ; Keep the number of bytes requested
+    moveq.l #8, d1                      ; Send d3.l and d4.l
+    bsr send_sync_command_to_sidecart
+    bsr update_command_stats
+    move.l (sp)+, d4
+    moveq.l #0, d1                      ; Nothing copied yet
+    tst.w d0
+    bne.s _read_from_sidecart_end       ; Timeout
+
+    lea COMMAND_READ_WINDOW_ADDR, a0
+    move.l (a0)+, d1                    ; Number of bytes published
+    cmp.l d4, d1
+    bls.s _read_from_sidecart_size_ok
+    move.l d4, d1                       ; Never copy more than requested
+_read_from_sidecart_size_ok:
+    move.w d1, d0
+    lsr.w #COMMAND_READ_BLOCK_SHIFT, d0 ; Number of blocks
+    beq.s _read_from_sidecart_longs
+    subq.w #1, d0
+_read_from_sidecart_block_loop:
+    movem.l (a0)+, d2-d7/a1-a2          ; Read 32 bytes from the window
+    movem.l d2-d7/a1-a2, (a4)           ; Write them in the buffer
+    lea COMMAND_READ_BLOCK_SIZE(a4), a4
+    dbf d0, _read_from_sidecart_block_loop
+
+_read_from_sidecart_longs:
+    move.w d1, d0
+    and.w #(COMMAND_READ_BLOCK_SIZE - 1), d0
+    lsr.w #2, d0                        ; Longwords left
+    beq.s _read_from_sidecart_word
+    subq.w #1, d0
+_read_from_sidecart_long_loop:
+    move.l (a0)+, (a4)+
+    dbf d0, _read_from_sidecart_long_loop
+
+_read_from_sidecart_word:
+    btst #1, d1
+    beq.s _read_from_sidecart_byte
+    move.w (a0)+, (a4)+
+_read_from_sidecart_byte:
+    btst #0, d1
+    beq.s _read_from_sidecart_done
+    move.b (a0)+, (a4)+
+_read_from_sidecart_done:
+    moveq.l #0, d0                      ; No error
+_read_from_sidecart_end:
+    rts
+
+; Add the round trip of a sync command to the latency counters
+; Called by the send macros, out of the wait code that can be copied elsewhere
+; Input registers:
+; d0.w: error code of the command, 0 if no error
+; d1.l: round trip in 200 Hz ticks
+; Output registers:
+; a0 is modified
+update_command_stats:
+    ifne COMMAND_STATS == 1
+    lea command_stats(pc), a0
+    addq.l #1, CMD_STATS_COUNT(a0)
+    add.l d1, CMD_STATS_TICKS(a0)
+    cmp.l CMD_STATS_MAX_TICKS(a0), d1
+    bls.s _update_command_stats_timeout
+    move.l d1, CMD_STATS_MAX_TICKS(a0)  ; Slowest round trip so far
+_update_command_stats_timeout:
+    tst.w d0
+    beq.s _update_command_stats_done
+    addq.l #1, CMD_STATS_TIMEOUTS(a0)
+_update_command_stats_done:
+    endif
+    rts
+
+; Send the latency counters to the shared variables SHARED_VARIABLE_CMD_*
+; A sync command carries three values at most, so the counters go in two
+; CMD_SET_SHARED_VARS commands. The commands sent here are counted too
+; Output registers:
+; d0: error code, 0 if no error
+; d1-d7 are modified. a0-a3 modified.
+publish_command_stats:
+    ifne COMMAND_STATS == 1
+    moveq.l #SHARED_VARIABLE_CMD_COUNT, d3      ; First variable of the command
+    move.l command_stats+CMD_STATS_COUNT(pc), d4
+    move.l command_stats+CMD_STATS_TICKS(pc), d5
+    move.l command_stats+CMD_STATS_MAX_TICKS(pc), d6
+    send_sync CMD_SET_SHARED_VARS, 16
+    moveq.l #SHARED_VARIABLE_CMD_TIMEOUTS, d3
+    move.l command_stats+CMD_STATS_TIMEOUTS(pc), d4
+    send_sync CMD_SET_SHARED_VARS, 8
+    else
+    moveq.l #0, d0
+    endif
+    rts
+
+; Read the timeouts and the slowest round trip of the sync commands
+; Output registers:
+; d5.l: sync commands that timed out, 0 if COMMAND_STATS is 0
+; d6.l: slowest round trip in 200 Hz ticks, 0 if COMMAND_STATS is 0
+read_command_stats:
+    ifne COMMAND_STATS == 1
+    move.l command_stats+CMD_STATS_TIMEOUTS(pc), d5
+    move.l command_stats+CMD_STATS_MAX_TICKS(pc), d6
+    else
+    moveq.l #0, d5
+    moveq.l #0, d6
+    endif
+    rts
+
+    ifne COMMAND_STATS == 1
+; Latency counters of the sync commands. Written in the RAM copy of the code
+    even
+command_stats:
+    dc.w COMMAND_LOOPS_PER_TICK         ; CMD_STATS_LOOPS, until detect_hw runs
+    dc.w 0
+    dc.l 0, 0, 0, 0                     ; CMD_STATS_COUNT, TICKS, MAX_TICKS and TIMEOUTS
+    endif
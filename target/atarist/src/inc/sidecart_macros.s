@@ -2,6 +2,17 @@
 
 ; Macros
 
+; Set the timeout of a sync command in the upper word of d0, doubling it on each retry
+; /1 : The register with the retries left, from CMD_RETRIES_COUNT down to 0
+; d1 is modified
+command_timeout     macro
+                    moveq.l #COMMAND_TIMEOUT_TICKS, d0   ; Timeout of the first try
+                    move.w #CMD_RETRIES_COUNT, d1
+                    sub.w \1, d1                         ; Retries done
+                    lsl.l d1, d0                         ; Exponential backoff
+                    swap d0                              ; Timeout in the upper word
+                    endm
+
 ; Send a synchronous command to the Multi-device passing arguments in the Dx registers
 ; /1 : The command code
 ; /2 : The payload size (even number always)
@@ -9,9 +20,11 @@ send_sync           macro
                     move.w #CMD_RETRIES_COUNT, d7        ; Set the number of retries
 .\@send_sync_retry:
                     movem.l d1-d7, -(sp)                 ; Save the registers
+                    command_timeout d7                   ; Timeout of this try
                     moveq.l #\2, d1                      ; Set the payload size of the command
                     move.w #\1,d0                        ; Command code
                     bsr send_sync_command_to_sidecart    ; Send the command to the Multi-device
+                    bsr update_command_stats             ; Count the round trip
                     movem.l (sp)+, d1-d7                 ; Restore the registers
                     tst.w d0                             ; Check the result of the command
                     beq.s .\@send_sync_ok                  ; If the command was ok, exit
@@ -19,6 +32,18 @@ send_sync           macro
 .\@send_sync_ok:
                     endm    
 
+; Send a pipelined command to the Multi-device without waiting for it
+; D2 holds the sequence number, D3-D4 the arguments
+; /1 : The command code
+; /2 : The payload size (0, 4 or 8)
+send_async          macro
+                    movem.l d1/d7/a0, -(sp)              ; Save the registers
+                    moveq.l #\2, d1                      ; Set the payload size of the command
+                    move.w #\1,d0                        ; Command code
+                    bsr send_async_command_to_sidecart   ; Send the command to the Multi-device
+                    movem.l (sp)+, d1/d7/a0              ; Restore the registers
+                    endm
+
 ; Send a synchronous write command to the Multi-device passing arguments in the D3-D5 registers
 ; A4 address of the buffer to send
 ; /1 : The command code
@@ -26,17 +51,37 @@ send_sync           macro
 send_write_sync     macro
                     move.w #CMD_RETRIES_COUNT, d6        ; Set the number of retries
 .\@send_write_sync_retry:
-                    movem.l d1-d6/a4, -(sp)                 ; Save the registers
+                    movem.l d1-d7/a4, -(sp)                 ; Save the registers
+                    command_timeout d6                      ; Timeout of this try
                     move.w #\1,d0                           ; Command code
                     move.l #\2,d6                           ; Number of bytes to send
                     bsr send_sync_write_command_to_sidecart ; Send the command to the Multi-device
-                    movem.l (sp)+, d1-d6/a4                 ; Restore the registers
+                    bsr update_command_stats                ; Count the round trip
+                    movem.l (sp)+, d1-d7/a4                 ; Restore the registers
                     tst.w d0                                ; Check the result of the command
                     beq.s .\@send_write_sync_ok             ; If the command was ok, exit
                     dbf d6, .\@send_write_sync_retry        ; If the command failed, retry
 .\@send_write_sync_ok:
                     endm    
 
+; Send a synchronous read command to the Multi-device passing arguments in the D3-D4 registers
+; D3 position of the data in the source, D4 number of bytes to read
+; A4 address of the buffer to fill. D1 returns the number of bytes copied
+; /1 : The command code
+send_read_sync      macro
+                    move.w #CMD_RETRIES_COUNT, d7        ; Set the number of retries
+.\@send_read_sync_retry:
+                    movem.l d2-d7/a4, -(sp)                 ; Save the registers
+                    command_timeout d7                      ; Timeout of this try
+                    move.w #\1,d0                           ; Command code
+                    bsr send_sync_read_command_to_sidecart  ; Send the command to the Multi-device
+                    movem.l (sp)+, d2-d7/a4                 ; Restore the registers
+                    tst.w d0                                ; Check the result of the command
+                    beq.s .\@send_read_sync_ok              ; If the command was ok, exit
+                    dbf d7, .\@send_read_sync_retry         ; If the command failed, retry
+.\@send_read_sync_ok:
+                    endm
+
 ; Wait for second (aprox 50 VBlanks)
 wait_sec                macro
                         move.l d7, -(sp)                    ; Save the number counter reg
@@ -32,16 +32,61 @@ ROWS_HIGH			equ 200		; 200 rows in the ST
 BYTES_ROW_HIGH		equ 80		; 80 bytes per row in the ST
 PRE_RESET_WAIT		equ $FFFFF
 TRANSTABLE			equ $FA1000	; Translation table for high resolution
+HIGHRES_ADDR		equ $FA2000	; Framebuffer with the pixels doubled for high resolution
+HIGHRES_ROW_BYTES	equ 640		; Bytes of a row of 8 lines in HIGHRES_ADDR
+DIRTY_MAP_ADDR		equ (FRAMEBUFFER_ADDR + FRAMEBUFFER_SIZE + 4)	; Change counter of each row, after the command
+DIRTY_ROWS			equ 25		; Rows of 8 lines in the framebuffer
+DIRTY_ROW_BYTES		equ 320		; Bytes of a row in the framebuffer
+DIRTY_ROW_LINES		equ 8		; Lines of a row in the framebuffer
+FRONT_BANK_ADDR		equ (DIRTY_MAP_ADDR + DIRTY_ROWS * 2)	; 0 or 1, the bank to copy
+FRAMEBUFFER_BANK1_ADDR	equ $FA6000	; Second framebuffer bank, with its own change map
+DIRTY_MAP_BANK1_ADDR	equ (FRAMEBUFFER_BANK1_ADDR + FRAMEBUFFER_SIZE + 4)
+HIGHRES_BANK1_ADDR	equ $FAA000	; Second bank of the doubled framebuffer, after the first bank
 
 ; If 1, the display will not use the framebuffer and will write directly to the
 ; display memory. This is useful to reduce the memory usage in the rp2040
 ; When not using the framebuffer, the endianness swap must be done in the atari ST
 DISPLAY_BYPASS_FRAMEBUFFER 	equ 1
 
+; If 1, the RP also renders the framebuffer with the pixels doubled, 640x200, at
+; HIGHRES_ADDR. In high resolution each line is then copied twice with block
+; moves instead of translating every byte with the TRANSTABLE
+DISPLAY_HIGHRES_EXPANDED	equ 1
+
+; If 1, the RP publishes the framebuffer in two banks and flips FRONT_BANK_ADDR
+; when a bank is complete. Each copy reads the front bank and its change map.
+; Needs DISPLAY_BYPASS_FRAMEBUFFER 0
+DISPLAY_DOUBLE_BUFFER		equ 0
+
+; If 1, the STE and the Mega STE copy the framebuffer to the screen with the
+; BLiTTER, sharing the bus with the CPU, and the other computers with the CPU.
+; The BLiTTER can not swap the bytes, so in low resolution it needs
+; DISPLAY_BYPASS_FRAMEBUFFER 0, and in high resolution DISPLAY_HIGHRES_EXPANDED 1
+DISPLAY_BLITTER				equ 1
+
+BLITTER_ADDR		equ $FFFF8A00	; BLiTTER registers
+BLIT_SRC_XINC		equ $20			; Word. Source increment inside a line
+BLIT_SRC_YINC		equ $22			; Word. Source increment after a line
+BLIT_SRC_ADDR		equ $24			; Long
+BLIT_ENDMASK1		equ $28			; Words. Masks of the first, middle and last
+BLIT_ENDMASK2		equ $2A			; words of a line
+BLIT_ENDMASK3		equ $2C
+BLIT_DST_XINC		equ $2E			; Word. Destination increment inside a line
+BLIT_DST_YINC		equ $30			; Word. Destination increment after a line
+BLIT_DST_ADDR		equ $32			; Long
+BLIT_XCOUNT			equ $36			; Word. Words of a line
+BLIT_YCOUNT			equ $38			; Word. Lines, 0 when the job is done
+BLIT_HOP			equ $3A			; Byte. Halftone operation, 2: source only
+BLIT_OP				equ $3B			; Byte. Logic operation, 3: source
+BLIT_CTRL			equ $3C			; Byte. Busy, hog mode and halftone line
+BLIT_SKEW			equ $3D			; Byte. Skew and the extra source reads
+BLIT_BUSY			equ 7			; Bit of BLIT_CTRL set while a job runs
+
 CMD_NOP				equ 0		; No operation command
 CMD_RESET			equ 1		; Reset command
 CMD_BOOT_GEM		equ 2		; Boot GEM command
 CMD_TERMINAL		equ 3		; Terminal command
+CMD_STRESS			equ 5		; Bus stress test command
 
 _conterm			equ $484	; Conterm device number
 
@@ -49,8 +94,10 @@ _conterm			equ $484	; Conterm device number
 ; Constants needed for the commands
 RANDOM_TOKEN_ADDR:        equ (ROM4_ADDR + $F000) 	      ; Random token address at $FAF000
 RANDOM_TOKEN_SEED_ADDR:   equ (RANDOM_TOKEN_ADDR + 4) 	  ; RANDOM_TOKEN_ADDR + 4 bytes
+RANDOM_TOKEN_ACK_SEQ_ADDR: equ (RANDOM_TOKEN_ADDR + 8) 	  ; Last acknowledged pipelined sequence number
 RANDOM_TOKEN_POST_WAIT:   equ $1        		      	  ; Wait this cycles after the random number generator is ready
-COMMAND_TIMEOUT           equ $0000FFFF                   ; Timeout for the command
+COMMAND_TIMEOUT           equ $0000FFFF                   ; Timeout for the pipelined command acknowledge
+COMMAND_TIMEOUT_TICKS     equ 20                          ; First timeout of a sync command in 200 Hz ticks. Doubles on each retry
 
 SHARED_VARIABLES:     	  equ (RANDOM_TOKEN_ADDR + $200)  ; random token + 512 bytes to the shared variables area: $FAF200
 
@@ -59,12 +106,21 @@ CMD_MAGIC_NUMBER    	  equ ($ABCD) 					  ; Magic number header to identify a co
 CMD_RETRIES_COUNT	  	  equ 3							  ; Number of retries for the command
 CMD_SET_SHARED_VAR		  equ 1							  ; This is a fake command to set the shared variables
 														  ; Used to store the system settings
+CMD_SET_SHARED_VARS		  equ 3							  ; Set consecutive variables of the shared block: index in d3, values from d4
 ; App commands for the terminal
 APP_TERMINAL 				equ $0 ; The terminal app
 
 ; App terminal commands
 APP_TERMINAL_START   		equ $0 ; Start terminal command
 APP_TERMINAL_KEYSTROKE 		equ $1 ; Keystroke command
+APP_TERMINAL_KEYSTROKES		equ $2 ; Batch of keys in d3-d6, 0 if empty
+KEYSTROKES_BATCH			equ 4  ; Keys of a batch command
+
+APP_STRESS_SYNC				equ $10 ; Sequence in d3, complement in d4, timeouts in d5, slowest round trip in d6
+APP_STRESS_WRITE			equ $11 ; Sequence in d3, complement in d4 and the words sequence + index
+APP_STRESS_STOP				equ $12 ; A key stops the stress test
+STRESS_SYNC_BURST			equ 64  ; Sync commands of each stress frame
+STRESS_WRITE_SIZE			equ 256 ; Bytes of the write command of each stress frame. Must match stress.h
 
 _dskbufp                equ $4c6                            ; Address of the disk buffer pointer    
 
@@ -98,6 +154,84 @@ get_screen_base		macro
 					addq.l #2,sp
 					endm
 
+; Copy 20 bytes of a line of HIGHRES_ADDR at a0 to the two screen lines at
+; a1 + \1. Destroys d1-d4 and d6
+copy_high			macro
+					movem.l (a0)+, d1-d4/d6				; Read 10 words from the cartridge ROM
+					movem.l d1-d4/d6, \1(a1)			; Copy them to the line
+					movem.l d1-d4/d6, (\1 + BYTES_ROW_HIGH)(a1)	; And to the next line
+					endm
+
+;
+; Screen copy helpers for the framebuffer in ST byte order (DISPLAY_BYPASS_FRAMEBUFFER == 0)
+;
+; Write the two words of the longword in \1 to the 4 bitplanes of 16 pixels
+; each in the low resolution screen at a0. Destroys d2-d3 and \1
+expand_low			macro
+					move.l \1, d2				; d2 = w0:w1
+					swap d2						; d2 = w1:w0
+					move.w \1, d2				; d2 = w1:w1
+					swap \1						; \1 = w1:w0
+					move.w \1, d3				; d3 = ?:w0
+					swap d3						; d3 = w0:?
+					move.w \1, d3				; d3 = w0:w0
+					move.l d3, (a0)+			; First word to the 4 bitplanes
+					move.l d3, (a0)+
+					move.l d2, (a0)+			; Second word to the 4 bitplanes
+					move.l d2, (a0)+
+					endm
+
+; Double the 16 pixels of the framebuffer word at a0 with the translation
+; table at a3, and write them to the two screen lines at a1 and a2. Destroys d2-d4
+double_high			macro
+					move.w (a0)+, d2			; Copy a word from the cartridge ROM
+					move.w d2, d3				; Copy the word to d3
+					clr.b d3					; Keep the high byte
+					lsr.w #7, d3				; Index of the high byte in the table
+					move.w (a3, d3.w), d4		; Translate the high byte
+					swap d4						; Swap the words
+					and.w #$00FF, d2			; Mask the low byte
+					add.w d2, d2				; Index of the low byte in the table
+					move.w (a3, d2.w), d4		; Translate the low byte
+					move.l d4, (a1)+			; Copy the word to the screen memory
+					move.l d4, (a2)+			; Copy the word to the next line
+					endm
+
+; Set up the BLiTTER at a3 to copy words for the jobs of a frame, without
+; halftone, skew or masks. \1 and \2 are the source increments inside and after
+; a line, \3 the words of a line, \4 and \5 the destination increments
+blit_setup			macro
+					move.w #\1, BLIT_SRC_XINC(a3)
+					move.w #\2, BLIT_SRC_YINC(a3)
+					move.l #-1, BLIT_ENDMASK1(a3)	; All the bits of every word
+					move.w #-1, BLIT_ENDMASK3(a3)
+					move.w #\3, BLIT_XCOUNT(a3)
+					move.w #\4, BLIT_DST_XINC(a3)
+					move.w #\5, BLIT_DST_YINC(a3)
+					move.b #2, BLIT_HOP(a3)		; Source only
+					move.b #3, BLIT_OP(a3)		; Copy
+					clr.b BLIT_SKEW(a3)
+					endm
+
+; Wait for the job of the BLiTTER at a3. Setting the busy bit again resumes a
+; job that gave the bus to the CPU, and does nothing once it is done
+blit_wait			macro
+.\@wait:
+					bset.b #BLIT_BUSY, BLIT_CTRL(a3)
+					nop
+					bne.s .\@wait
+					endm
+
+; Copy \3 lines from \1 to \2 with the BLiTTER at a3, after its last job.
+; The CPU goes on while it runs
+blit_start			macro
+					blit_wait
+					move.l \1, BLIT_SRC_ADDR(a3)
+					move.l \2, BLIT_DST_ADDR(a3)
+					move.w #\3, BLIT_YCOUNT(a3)
+					move.b #(1 << BLIT_BUSY), BLIT_CTRL(a3)	; Not in hog mode
+					endm
+
 ; Check the left or right shift key. If pressed, exit.
 check_shift_keys	macro
 					move.w #-1, -(sp)			; Read all key status
@@ -114,22 +248,42 @@ check_shift_keys	macro
 					endm
 
 ; Check the keys pressed
+; The keyboard interrupt of TOS buffers the keys, so drain them once per frame
+; and send up to KEYSTROKES_BATCH keys in each command. The keys shift from d6
+; to d3, so the empty slots are the first ones and the order is kept
 check_keys			macro
 
+					moveq #0, d3				; No keys yet
+					moveq #0, d4
+					moveq #0, d5
+					moveq #0, d6
+					moveq #(KEYSTROKES_BATCH - 1), d7
+.\@next_key:
 					gemdos	Cconis,2		; Check if a key is pressed
 					tst.l d0
-					beq .\@no_key
+					beq.s .\@send_keys
 
 					gemdos	Cnecin,2		; Read the key pressed
 
 					cmp.b #27, d0		; Check if the key is ESC
-					beq .\@esc_key	; If it is, send terminal command
-
-					move.l d0, d3
-					send_sync APP_TERMINAL_KEYSTROKE, 4
+					beq.s .\@esc_key	; If it is, send terminal command
+
+					move.l d4, d3				; Make room for the key
+					move.l d5, d4
+					move.l d6, d5
+					move.l d0, d6
+					dbf d7, .\@next_key
+.\@send_keys:
+					tst.l d6					; Any key?
+					beq .\@no_key
+					send_sync APP_TERMINAL_KEYSTROKES, 16
 
 					bra .\@no_key
 .\@esc_key:
+					tst.l d6					; Send the keys typed before the ESC
+					beq.s .\@esc_start
+					send_sync APP_TERMINAL_KEYSTROKES, 16
+.\@esc_start:
 					send_sync APP_TERMINAL_START, 0
 
 .\@no_key:
@@ -139,11 +293,16 @@ check_keys			macro
 check_commands		macro
 					move.l (FRAMEBUFFER_ADDR + FRAMEBUFFER_SIZE), d6	; Store in the D6 register the remote command value
 					cmp.l #CMD_TERMINAL, d6		; Check if the command is a terminal command
-					bne.s .\@check_reset
+					bne .\@check_stress
 
 					; Check the keys for the terminal emulation
 					check_keys
 					bra .\@bypass
+.\@check_stress:
+					cmp.l #CMD_STRESS, d6		; Check if the command is the stress test
+					bne.s .\@check_reset
+					bsr stress_commands			; Load the bus until a key is pressed
+					bra .\@bypass
 .\@check_reset:
 					cmp.l #CMD_RESET, d6		; Check if the command is a reset
 					beq .reset					; If it is, reset the computer
@@ -185,7 +344,8 @@ pre_auto:
 	lea SCREEN_SIZE(a2), a2		; Move to the work area just after the screen memory
 	move.l a2, a3				; Save the relocation destination address in A3
 	; Copy the code out of the ROM to avoid unstable behavior
-    move.l #end_rom_code - start_rom_code, d6
+	; Longs rounded up, the guards after end_rom_code check that the copy fits
+    move.l #end_rom_code - start_rom_code + 3, d6
     lea start_rom_code, a1    ; a1 points to the start of the code in ROM
     lsr.w #2, d6
     subq #1, d6
@@ -198,21 +358,100 @@ start_rom_code:
 ; We assume the screen memory address is in D0 after the get_screen_base call
 	move.l d0, a6				; Save the screen memory address in A6
 
+	ifne DISPLAY_BLITTER == 1
+; Only the STE and the Mega STE always have a BLiTTER
+	bsr read_hw_type			; Get the hardware type in d4
+	cmp.l #COOKIE_JAR_STE, d4
+	beq.s .blitter_found
+	cmp.l #COOKIE_JAR_MEGASTE, d4
+	bne.s .blitter_done
+.blitter_found:
+	move.l #BLITTER_ADDR, a3
+	clr.w BLIT_YCOUNT(a3)		; No job, so blit_wait never starts one
+	lea blitter_addr(pc), a0
+	move.l a3, (a0)				; Copy the screen with it
+.blitter_done:
+	endif
+
+; Send the hardware type and the TOS version to the RP in one command
+	bsr publish_system_vars
+
 ; Enable bconin to return shift key status
 	or.b #%1000, _conterm.w
 
-; Get the resolution of the screen
+; Start with counters different from the ones in the cartridge to copy all the rows
+	lea DIRTY_MAP_ADDR, a4		; Set the change map in a4
+	lea row_counters(pc), a5	; Set the counters of the last copy in a5
+	moveq #(DIRTY_ROWS - 1), d5	; Set the number of rows - 1
+.init_row_counters:
+	move.w (a4)+, d6			; Get the change counter of the row
+	not.w d6					; Make it different
+	move.w d6, (a5)+			; Store it as the last copied
+	dbf d5, .init_row_counters
+
+; Get the resolution of the screen, and send it to the RP so it only doubles
+; the pixels in high resolution
 	get_rez
-	cmp.w #2, d0				; Check if the resolution is 640x400 (high resolution)
+	moveq #0, d4
+	move.w d0, d4				; d4.l: SHARED_VARIABLE_SCREEN_REZ
+	moveq.l #SHARED_VARIABLE_SCREEN_REZ, d3	; First variable of the command
+	send_sync CMD_SET_SHARED_VARS, 8
+	cmp.w #2, d4				; Check if the resolution is 640x400 (high resolution)
 	beq .print_loop_high		; If it is, print the message in high resolution
 
 .print_loop_low:
 	vsync_wait
 
 ; We must move from the cartridge ROM to the screen memory to display the messages
+; Only the rows whose change counter is not the one of the last copy
 	move.l a6, a0				; Set the screen memory address in a0
 	move.l #FRAMEBUFFER_ADDR, a1			; Set the cartridge ROM address in a1
-	move.l #((FRAMEBUFFER_SIZE / 2) -1), d0			; Set the number of words to copy
+	lea DIRTY_MAP_ADDR, a4		; Set the change map in a4
+	ifne DISPLAY_DOUBLE_BUFFER == 1
+	tst.w FRONT_BANK_ADDR		; Which bank is complete?
+	beq.s .front_bank_low		; The first one
+	move.l #FRAMEBUFFER_BANK1_ADDR, a1	; Copy the second bank
+	lea DIRTY_MAP_BANK1_ADDR, a4	; With its change map
+.front_bank_low:
+	endif
+	ifne DISPLAY_BLITTER == 1
+	ifne DISPLAY_BYPASS_FRAMEBUFFER == 0
+	move.l blitter_addr(pc), a3	; The BLiTTER, or 0 to copy with the CPU
+	cmpa.w #0, a3
+	beq.s .blitter_ready_low
+; Each word of the framebuffer read 4 times, once for each bitplane
+	blit_setup 0, 2, 4, 2, 2
+.blitter_ready_low:
+	endif
+	endif
+	lea row_counters(pc), a5	; Set the counters of the last copy in a5
+	moveq #(DIRTY_ROWS - 1), d5	; Set the number of rows - 1
+.copy_row_low:
+	move.w (a4)+, d6			; Get the change counter of the row
+	cmp.w (a5), d6				; Has the row changed?
+	beq .skip_row_low			; If not, skip it
+	move.w d6, (a5)				; Read the counter before the row, never after
+	ifne DISPLAY_BLITTER == 1
+	ifne DISPLAY_BYPASS_FRAMEBUFFER == 0
+	cmpa.w #0, a3				; Is there a BLiTTER?
+	beq.s .cpu_row_low
+	blit_start a1, a0, (DIRTY_ROW_BYTES / 2)
+	bra .skip_row_low			; Move to the next row like a skipped one
+.cpu_row_low:
+	endif
+	endif
+	ifne DISPLAY_BYPASS_FRAMEBUFFER == 0
+; The RP already swapped the bytes: read 4 longwords at once and unroll
+	moveq #((DIRTY_ROW_BYTES / 16) -1), d0	; Set the number of 16 byte blocks to copy
+.copy_screen_low:
+	movem.l (a1)+, d1/d4/d6/d7	; Copy 8 words from the cartridge ROM
+	expand_low d1
+	expand_low d4
+	expand_low d6
+	expand_low d7
+	dbf d0, .copy_screen_low    ; Loop until all the row is copied
+	else
+	move.l #((DIRTY_ROW_BYTES / 2) -1), d0			; Set the number of words to copy
 .copy_screen_low:
 	move.w (a1)+ , d1			; Copy a word from the cartridge ROM
 	ifne DISPLAY_BYPASS_FRAMEBUFFER == 1
@@ -223,7 +462,23 @@ start_rom_code:
 	move.w d1, d2				; Copy the word to d2
 	move.l d2, (a0)+			; Copy the word to the screen memory
 	move.l d2, (a0)+			; Copy the word to the screen memory
-	dbf d0, .copy_screen_low    ; Loop until all the message is copied
+	dbf d0, .copy_screen_low    ; Loop until all the row is copied
+	endif
+	bra.s .next_row_low
+.skip_row_low:
+	lea DIRTY_ROW_BYTES(a1), a1			; Skip the row in the cartridge ROM
+	lea (DIRTY_ROW_BYTES * 4)(a0), a0	; Skip the row in the screen memory
+.next_row_low:
+	addq.l #2, a5				; Next counter
+	dbf d5, .copy_row_low		; Loop until all the rows are checked
+	ifne DISPLAY_BLITTER == 1
+	ifne DISPLAY_BYPASS_FRAMEBUFFER == 0
+	cmpa.w #0, a3
+	beq.s .copy_done_low
+	blit_wait					; The last row is on the screen
+.copy_done_low:
+	endif
+	endif
 
 ; Check the different commands and the keyboard
 	check_commands
@@ -237,10 +492,68 @@ start_rom_code:
 	move.l a6, a1				; Set the screen memory address in a1
 	move.l a6, a2
 	lea BYTES_ROW_HIGH(a2), a2	; Move to the next line in the screen
+	ifne DISPLAY_HIGHRES_EXPANDED == 1
+	move.l #HIGHRES_ADDR, a0	; Set the doubled framebuffer address in a0
+	else
 	move.l #FRAMEBUFFER_ADDR, a0		; Set the cartridge ROM address in a0
+	endif
 	move.l #TRANSTABLE, a3		; Set the translation table in a3
-	move.l #(ROWS_HIGH -1), d0	; Set the number of rows to copy - 1
+	lea DIRTY_MAP_ADDR, a4		; Set the change map in a4
+	ifne DISPLAY_DOUBLE_BUFFER == 1
+	tst.w FRONT_BANK_ADDR		; Which bank is complete?
+	beq.s .front_bank_high		; The first one
+	ifne DISPLAY_HIGHRES_EXPANDED == 1
+	move.l #HIGHRES_BANK1_ADDR, a0	; Copy the second bank
+	else
+	move.l #FRAMEBUFFER_BANK1_ADDR, a0	; Copy the second bank
+	endif
+	lea DIRTY_MAP_BANK1_ADDR, a4	; With its change map
+.front_bank_high:
+	endif
+	ifne DISPLAY_BLITTER == 1
+	ifne DISPLAY_HIGHRES_EXPANDED == 1
+	move.l blitter_addr(pc), a3	; The BLiTTER instead of the unused table
+	cmpa.w #0, a3
+	beq.s .blitter_ready_high
+; Each line of the doubled framebuffer, to every other line of the screen
+	blit_setup 2, 2, (BYTES_ROW_HIGH / 2), 2, (BYTES_ROW_HIGH + 2)
+.blitter_ready_high:
+	endif
+	endif
+	lea row_counters(pc), a5	; Set the counters of the last copy in a5
+	moveq #(DIRTY_ROWS - 1), d5	; Set the number of rows - 1
+.copy_row_high:
+	move.w (a4)+, d6			; Get the change counter of the row
+	cmp.w (a5), d6				; Has the row changed?
+	beq .skip_row_high			; If not, skip it
+	move.w d6, (a5)				; Read the counter before the row, never after
+	ifne DISPLAY_BLITTER == 1
+	ifne DISPLAY_HIGHRES_EXPANDED == 1
+	cmpa.w #0, a3				; Is there a BLiTTER?
+	beq.s .cpu_row_high
+	blit_start a0, a1, DIRTY_ROW_LINES	; To the even lines
+	blit_start a0, a2, DIRTY_ROW_LINES	; And again to the odd ones
+	bra .skip_row_high			; Move to the next row like a skipped one
+.cpu_row_high:
+	endif
+	endif
+	move.l #(DIRTY_ROW_LINES -1), d0	; Set the number of lines to copy - 1
 .copy_screen_row_high:
+	ifne DISPLAY_HIGHRES_EXPANDED == 1
+; The RP already doubled the pixels: only block moves
+	copy_high 0
+	copy_high 20
+	copy_high 40
+	copy_high 60
+	lea BYTES_ROW_HIGH(a1), a1	; Move to the end of the line like the loops below
+	lea BYTES_ROW_HIGH(a2), a2
+	else
+	ifne DISPLAY_BYPASS_FRAMEBUFFER == 0
+; The RP already swapped the bytes: unroll the columns of the line
+	rept COLS_HIGH
+	double_high
+	endr
+	else
 	move.l #(COLS_HIGH -1), d1	; Set the number of columns to copy - 1 
 .copy_screen_col_high:
 	move.w (a0)+ , d2			; Copy a word from the cartridge ROM
@@ -263,11 +576,33 @@ start_rom_code:
 	move.l d4, (a2)+			; Copy the word to the screen memory
 
 	dbf d1, .copy_screen_col_high   ; Loop until all the message is copied
+	endif
+	endif
 
 	lea BYTES_ROW_HIGH(a1), a1	; Move to the next line in the screen
 	lea BYTES_ROW_HIGH(a2), a2	; Move to the next line in the screen
 
-	dbf d0, .copy_screen_row_high   ; Loop until all the message is copied
+	dbf d0, .copy_screen_row_high   ; Loop until all the row is copied
+	bra.s .next_row_high
+.skip_row_high:
+	ifne DISPLAY_HIGHRES_EXPANDED == 1
+	lea HIGHRES_ROW_BYTES(a0), a0		; Skip the row in the cartridge ROM
+	else
+	lea DIRTY_ROW_BYTES(a0), a0			; Skip the row in the cartridge ROM
+	endif
+	lea (DIRTY_ROW_BYTES * 4)(a1), a1	; Skip the two screen lines of each line
+	lea (DIRTY_ROW_BYTES * 4)(a2), a2
+.next_row_high:
+	addq.l #2, a5				; Next counter
+	dbf d5, .copy_row_high		; Loop until all the rows are checked
+	ifne DISPLAY_BLITTER == 1
+	ifne DISPLAY_HIGHRES_EXPANDED == 1
+	cmpa.w #0, a3
+	beq.s .copy_done_high
+	blit_wait					; The last row is on the screen
+.copy_done_high:
+	endif
+	endif
 
 ; Check the different commands and the keyboard
 	check_commands
@@ -291,6 +626,66 @@ boot_gem:
 	; If we get here, continue loading GEM
     rts
 
+; Load the bus with STRESS_SYNC_BURST sync commands and a write command of
+; STRESS_WRITE_SIZE bytes, as fast as the RP answers. Each command has the next
+; sequence number in d3 and its complement in d4, so the RP can count the
+; commands lost, retried or corrupted. See stress.h
+; A key sends APP_STRESS_STOP
+; d0-d7 and a0-a4 are modified
+stress_commands:
+	move.l stress_sequence(pc), d3	; Next sequence number
+	move.w #(STRESS_SYNC_BURST - 1), d2
+.stress_sync:
+	move.l d3, d4
+	not.l d4					; Complement of the sequence
+	bsr read_command_stats		; Timeouts so far in d5, slowest round trip in d6
+	send_sync APP_STRESS_SYNC, 16
+	addq.l #1, d3				; Next sequence, even if the command failed
+	dbf d2, .stress_sync
+
+; The pattern of the write command goes in the stack
+	lea -STRESS_WRITE_SIZE(sp), sp
+	move.l sp, a4
+	move.w d3, d0				; First word: the low word of the sequence
+	move.w #((STRESS_WRITE_SIZE / 2) - 1), d1
+.stress_fill:
+	move.w d0, (a4)+
+	addq.w #1, d0				; Sequence + index
+	dbf d1, .stress_fill
+	move.l sp, a4
+	move.l d3, d4
+	not.l d4					; Complement of the sequence
+	moveq #0, d5
+	send_write_sync APP_STRESS_WRITE, STRESS_WRITE_SIZE
+	lea STRESS_WRITE_SIZE(sp), sp
+	addq.l #1, d3
+	lea stress_sequence(pc), a0	; Written in the RAM copy of the code
+	move.l d3, (a0)
+	bsr publish_command_stats	; Round trips of the burst for the RP
+
+	gemdos	Cconis,2			; Check if a key is pressed
+	tst.l d0
+	beq.s .stress_done
+	gemdos	Cnecin,2			; The key only stops the test
+	send_sync APP_STRESS_STOP, 0
+.stress_done:
+	rts
+
+; Change counters of the rows in the last copy. Written in the RAM copy of the code
+	even
+row_counters:
+	ds.w DIRTY_ROWS
+	even
+
+; Sequence number of the next stress command. Written in the RAM copy of the code
+stress_sequence:
+	dc.l 0
+
+; Address of the BLiTTER to copy the screen, or 0 to copy it with the CPU.
+; Written in the RAM copy of the code
+blitter_addr:
+	dc.l 0
+
 ; Shared functions included at the end of the file
 ; Don't forget to include the macros for the shared functions at the top of file
     include "inc/sidecart_functions.s"
@@ -299,4 +694,13 @@ boot_gem:
 end_rom_code:
 end_pre_auto:
 	even
-	dc.l 0
\ No newline at end of file
+	dc.l 0
+
+; The relocated code must fit in the SCREEN_SIZE bytes before the screen memory
+	ifgt (end_rom_code - start_rom_code) - (-SCREEN_SIZE)
+	fail "relocated code exceeds SCREEN_SIZE"
+	endif
+; And the cartridge code must end before the translation table of the RP
+	ifgt end_pre_auto - TRANSTABLE
+	fail "cartridge code overlaps TRANSTABLE"
+	endif
\ No newline at end of file